@@ -121,21 +121,45 @@ setInterval(updateTime, 1000);
 // Update device status every second
 setInterval(updateDeviceStatus, 1000);
 
+// Local copy of the schedule list and the server revision it matches
+let scheduleRevision = -1;
+let scheduleList = [];
+
 // Load schedules immediately when page loads
 loadSchedules();
 
 // Load config immediately
 loadConfig();
 
-// Update schedules every 5 seconds
-// setInterval(loadSchedules, 5000);
+// Load upcoming bells immediately and refresh them every 30 seconds
+loadUpcoming();
+setInterval(loadUpcoming, 30000);
+
+// Load holiday calendar immediately
+loadCalendar();
+
+// Pick up other clients' changes every 5 seconds (only deltas travel)
+setInterval(loadSchedules, 5000);
 
 function loadSchedules() {
-  fetch("/schedules")
+  const url = scheduleRevision < 0 ? "/schedules" : `/schedules/changes?since=${scheduleRevision}`;
+  fetch(url)
   // fetch("https://mocki.io/v1/0a97100d-fb9f-4508-add7-a19b6d1f52d5")
     .then((response) => response.json())
     .then((data) => {
-      displaySchedules(data.schedules);
+      if (data.schedules) {
+        // First load, or too far behind for deltas
+        scheduleList = data.schedules;
+        displaySchedules(scheduleList);
+      } else if (data.changes.length > 0) {
+        data.changes.forEach(applyScheduleChange);
+        updateScheduleCount();
+      } else {
+        return; // up to date
+      }
+      scheduleRevision = data.revision || 0;
+      loadProfiles();
+      loadUpcoming();
     })
     .catch((error) => {
       console.error("Error loading schedules:", error);
@@ -144,6 +168,72 @@ function loadSchedules() {
     });
 }
 
+function loadUpcoming() {
+  fetch("/schedules/upcoming?n=5")
+    .then((response) => response.json())
+    .then((data) => {
+      const container = document.getElementById("upcoming-list");
+      if (!container) return;
+      if (!data.enabled) {
+        container.innerHTML = "<p>Schedules are disabled (LED off)</p>";
+        return;
+      }
+      if (data.upcoming.length === 0) {
+        container.innerHTML = "<p>Nothing scheduled in the next month</p>";
+        return;
+      }
+      container.innerHTML = data.upcoming
+        .map((e) => {
+          const hours = Math.floor(e.in / 60);
+          const wait = hours > 0 ? `${hours}h ${e.in % 60}m` : `${e.in}m`;
+          return `<div class="schedule-item"><div class="schedule-info"><div class="schedule-time">${e.at} <span class="type-badge">${e.type.toUpperCase()}</span> <span class="type-badge">${e.profile.toUpperCase()}</span></div></div><div class="schedule-index">in ${wait}</div></div>`;
+        })
+        .join("");
+    })
+    .catch((error) => {
+      console.error("Error loading upcoming bells:", error);
+    });
+}
+
+function loadProfiles() {
+  fetch("/profiles")
+    .then((response) => response.json())
+    .then((data) => {
+      const select = document.getElementById("active-profile");
+      if (!select) return;
+      select.innerHTML = data.profiles
+        .map((p) => `<option value="${p.name}">${p.name} (${p.alarms})</option>`)
+        .join("");
+      select.value = data.active;
+
+      const today = document.getElementById("today-profile");
+      if (today) {
+        today.textContent = data.today !== data.active ? `Today: ${data.today}` : "";
+      }
+    })
+    .catch((error) => {
+      console.error("Error loading profiles:", error);
+    });
+}
+
+function activateProfile() {
+  const select = document.getElementById("active-profile");
+  fetch("/profiles/activate", {
+    method: "POST",
+    headers: { "Content-Type": "application/json" },
+    body: JSON.stringify({ name: select.value }),
+  })
+    .then((response) => response.json())
+    .then((data) => {
+      if (!data.success) alert("Error switching profile: " + data.message);
+      loadProfiles();
+    })
+    .catch((error) => {
+      console.error("Error:", error);
+      alert("Error switching profile");
+    });
+}
+
 function loadConfig() {
   fetch('/config')
     .then(res => res.json())
@@ -151,6 +241,8 @@ function loadConfig() {
       const seconds = Math.round((cfg.bellDurationMs || 3000) / 1000);
       const input = document.getElementById('bell-duration');
       if (input) input.value = seconds;
+      const catchUp = document.getElementById('catch-up-minutes');
+      if (catchUp) catchUp.value = cfg.catchUpMaxLateMin !== undefined ? cfg.catchUpMaxLateMin : 5;
     })
     .catch(() => {
       const input = document.getElementById('bell-duration');
@@ -176,6 +268,66 @@ function saveBellDuration() {
     .catch(() => alert('Failed to save'));
 }
 
+function saveCatchUp() {
+  const input = document.getElementById('catch-up-minutes');
+  if (!input) return;
+  let minutes = parseInt(input.value, 10);
+  if (isNaN(minutes) || minutes < 0) minutes = 0;
+  fetch('/config/catch-up', {
+    method: 'POST',
+    headers: { 'Content-Type': 'application/json' },
+    body: JSON.stringify({ catchUpMaxLateMin: minutes })
+  })
+    .then(r => r.json())
+    .then(d => {
+      if (!d.success) alert('Failed to save');
+    })
+    .catch(() => alert('Failed to save'));
+}
+
+// Applies one entry of /schedules/changes to scheduleList and the DOM,
+// touching only the items it affects
+function applyScheduleChange(change) {
+  const container = document.getElementById("schedules-list");
+  if (change.op === "add") {
+    if (scheduleList.length === 0) {
+      container.innerHTML = "";
+    }
+    scheduleList.splice(change.index, 0, change.schedule);
+    container.insertAdjacentHTML("beforeend", scheduleItemHTML(change.schedule, change.index));
+  } else if (change.op === "edit") {
+    scheduleList[change.index] = change.schedule;
+    const item = document.getElementById(`schedule-${change.index}`);
+    if (item) {
+      item.outerHTML = scheduleItemHTML(change.schedule, change.index);
+    }
+  } else if (change.op === "delete") {
+    scheduleList.splice(change.index, 1);
+    const item = document.getElementById(`schedule-${change.index}`);
+    if (item) {
+      item.remove();
+    }
+    // Later items moved up one place, and their ids and buttons carry the index
+    for (let i = change.index; i < scheduleList.length; i++) {
+      const next = document.getElementById(`schedule-${i + 1}`);
+      if (next) {
+        next.outerHTML = scheduleItemHTML(scheduleList[i], i);
+      }
+    }
+    if (scheduleList.length === 0) {
+      container.innerHTML = "<p>No alarms scheduled</p>";
+    }
+  }
+}
+
+function updateScheduleCount() {
+  const alarmCounter = document.getElementById("current-alarm-count");
+  if (alarmCounter) {
+    alarmCounter.textContent = scheduleList.length;
+  }
+  updateAddButtonState();
+}
+
 function displaySchedules(schedules) {
   const container = document.getElementById("schedules-list");
   
@@ -190,38 +342,36 @@ function displaySchedules(schedules) {
     return;
   }
 
-  let html = "";
-  schedules.forEach((schedule, index) => {
-    const daysHtml = getDaysHTML(schedule.days);
-    const statusClass = schedule.enabled ? "enabled" : "disabled";
-    const statusText = schedule.enabled ? "ENABLED" : "DISABLED";
+  container.innerHTML = schedules.map(scheduleItemHTML).join("");
+  
+  // Update add button state after displaying schedules
+  updateAddButtonState();
+}
 
-    html += `
-      <div class="schedule-item" id="schedule-${index}">
-        <div class="schedule-index">#${index + 1}</div>
-        <div class="schedule-info">
-          <div class="schedule-time-row">
-            <div class="schedule-time" id="time-display-${index}">${schedule.time} <span class="type-badge">${(schedule.type || 'bell').toUpperCase()}</span></div>
-            <div class="schedule-status ${statusClass}" onclick="toggleAlarmStatus(${index})">
-              <div class="toggle-switch ${statusClass}"></div>
-            </div>
-          </div>
-          <div class="schedule-days">       
-            ${daysHtml}
+function scheduleItemHTML(schedule, index) {
+  const daysHtml = getDaysHTML(schedule.days);
+  const statusClass = schedule.enabled ? "enabled" : "disabled";
+
+  return `
+    <div class="schedule-item" id="schedule-${index}">
+      <div class="schedule-index">#${index + 1}</div>
+      <div class="schedule-info">
+        <div class="schedule-time-row">
+          <div class="schedule-time" id="time-display-${index}">${schedule.time} <span class="type-badge">${(schedule.type || 'bell').toUpperCase()}</span>${schedule.profile && schedule.profile !== 'normal' ? ` <span class="type-badge">${schedule.profile.toUpperCase()}</span>` : ''}</div>
+          <div class="schedule-status ${statusClass}" onclick="toggleAlarmStatus(${index})">
+            <div class="toggle-switch ${statusClass}"></div>
           </div>
         </div>
-        <div class="schedule-actions">
-          <button class="edit-btn" onclick="editAlarm(${index})">Edit</button>
-          <button class="delete-btn" onclick="deleteAlarm(${index})">Delete</button>
+        <div class="schedule-days">       
+          ${daysHtml}
         </div>
       </div>
-    `;
-  });
-
-  container.innerHTML = html;
-  
-  // Update add button state after displaying schedules
-  updateAddButtonState();
+      <div class="schedule-actions">
+        <button class="edit-btn" onclick="editAlarm(${index})">Edit</button>
+        <button class="delete-btn" onclick="deleteAlarm(${index})">Delete</button>
+      </div>
+    </div>
+  `;
 }
 
 function getDaysHTML(selectedDays) {
@@ -289,10 +439,13 @@ function addAlarm() {
   }
 
   const type = document.getElementById("alarm-type") ? document.getElementById("alarm-type").value : "bell";
+  const profileInput = document.getElementById("alarm-profile");
+  const profile = (profileInput && profileInput.value.trim()) || "normal";
 
   const newAlarm = {
     time: time,
     type: type,
+    profile: profile,
     days: selectedDays,
     enabled: true,
   };
@@ -312,6 +465,9 @@ function addAlarm() {
         if (document.getElementById("alarm-type")) {
           document.getElementById("alarm-type").value = "bell";
         }
+        if (profileInput) {
+          profileInput.value = "";
+        }
         document
           .querySelectorAll('.day-checkboxes input[type="checkbox"]')
           .forEach((checkbox) => {
@@ -389,7 +545,7 @@ function editAlarm(index) {
     <div class="edit-content">
       <div class="edit-section">
         <label>Time:</label>
-        <input type="time" id="edit-time-${index}" value="${currentTime}" required>
+        <input type="time" id="edit-time-${index}" value="${currentTime}" step="1" required>
       </div>
       
       <div class="edit-section">
@@ -535,3 +691,109 @@ function cancelAlarmEdit(index) {
     editForm.remove();
   }
 }
+
+function loadCalendar() {
+  fetch("/calendar")
+    .then((response) => response.json())
+    .then((data) => {
+      displayCalendar(data.exceptions);
+    })
+    .catch((error) => {
+      console.error("Error loading calendar:", error);
+      document.getElementById("calendar-list").innerHTML =
+        "<p>Error loading calendar</p>";
+    });
+}
+
+function displayCalendar(exceptions) {
+  const container = document.getElementById("calendar-list");
+
+  if (exceptions.length === 0) {
+    container.innerHTML = "<p>No holidays or exceptions</p>";
+    return;
+  }
+
+  let html = "";
+  exceptions.forEach((exception, index) => {
+    const range =
+      exception.from === exception.to
+        ? exception.from
+        : `${exception.from} &rarr; ${exception.to}`;
+    const label =
+      exception.profile === "off" ? "NO BELLS" : exception.profile.toUpperCase();
+
+    html += `
+      <div class="schedule-item" id="calendar-${index}">
+        <div class="schedule-index">#${index + 1}</div>
+        <div class="schedule-info">
+          <div class="schedule-time">${range} <span class="type-badge">${label}</span></div>
+        </div>
+        <div class="schedule-actions">
+          <button class="delete-btn" onclick="deleteCalendarException(${index})">Delete</button>
+        </div>
+      </div>
+    `;
+  });
+
+  container.innerHTML = html;
+}
+
+function addCalendarException() {
+  const from = document.getElementById("calendar-from").value;
+  const to = document.getElementById("calendar-to").value;
+  const profile = document.getElementById("calendar-profile").value.trim() || "off";
+
+  if (!from) {
+    alert("Please select a start date");
+    return;
+  }
+
+  fetch("/calendar/add", {
+    method: "POST",
+    headers: {
+      "Content-Type": "application/json",
+    },
+    body: JSON.stringify({ from: from, to: to || from, profile: profile }),
+  })
+    .then((response) => response.json())
+    .then((data) => {
+      if (data.success) {
+        document.getElementById("calendar-from").value = "";
+        document.getElementById("calendar-to").value = "";
+        document.getElementById("calendar-profile").value = "";
+        loadCalendar();
+      } else {
+        alert("Error adding exception: " + data.message);
+      }
+    })
+    .catch((error) => {
+      console.error("Error:", error);
+      alert("Error adding exception");
+    });
+}
+
+function deleteCalendarException(index) {
+  if (!confirm("Are you sure you want to delete this exception?")) {
+    return;
+  }
+
+  fetch("/calendar/delete", {
+    method: "POST",
+    headers: {
+      "Content-Type": "application/json",
+    },
+    body: JSON.stringify({ index: index }),
+  })
+    .then((response) => response.json())
+    .then((data) => {
+      if (data.success) {
+        loadCalendar();
+      } else {
+        alert("Error deleting exception");
+      }
+    })
+    .catch((error) => {
+      console.error("Error:", error);
+      alert("Error deleting exception");
+    });
+}
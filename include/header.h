@@ -6,8 +6,13 @@
 #include "RTClib.h"
 #include <ESP8266WiFi.h>
 #include <ESP8266WebServer.h>
+#include <Response.h>
 #include <LittleFS.h>
+#include <FlashFS.h>
 #include <ArduinoJson.h>
+#include <JsonArena.h>
+#include <TaskLoop.h>
+#include <SipHash.h>
 
 
 // Create a web server on port 80
@@ -18,17 +23,28 @@ ESP8266WebServer server(80);
 #define SDA D2
 RTC_DS3231 rtc;
 
+// DS3231 SQW output, if wired to a GPIO with interrupts (not D0); without it
+// the second edge is predicted from micros(), see clock.h
+// #define SQW_PIN D3
+
 
 Timer timer(20UL);
 LED led(D7, D6);
 Bell bell(D5);
 
+// Shared parse/serialize buffer for the schedule list
+JsonArena jsonArena;
+
+// Runs everything loop() used to call, in priority order
+TaskLoop taskLoop;
+
 #define DEBUG_SERIAL false
 
 #if DEBUG_SERIAL
     #define dbg(...) Serial.print(__VA_ARGS__)
     #define dbgln(...) Serial.println(__VA_ARGS__)
 #else
-    #define dbg(...)
-    #define dbgln(...)
+    // A statement still, so "if (x) dbgln(...);" has a body
+    #define dbg(...) do {} while (0)
+    #define dbgln(...) do {} while (0)
 #endif
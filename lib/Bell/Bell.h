@@ -4,15 +4,68 @@
 #include <Arduino.h>
 #include <Toggelable.h>
 
+// The off edge can be timed by hardware timer 1 instead of the loop: on()
+// arms it for the duration, and its interrupt switches the pin off even while
+// the loop is stuck in a flash write or a slow client. The interrupt runs
+// from IRAM and only touches the pin and a few fields in RAM. Timer 1 counts
+// at most 0x7FFFFF ticks of 3.2 us (about 26.8 s), so longer bells take more
+// than one shot. loop() then only notes when and how late the bell went off,
+// see takeAutoOff(). Timer 1 belongs to one Bell.
+
+#define BELL_TIMER_TICKS_PER_MS 312.5 // 80 MHz / 256
+#define BELL_TIMER_MAX_TICKS 0x7FFFFFUL
+
 class Bell : public Togglable
 {
 private:
     byte pin;
     byte buttonPin; // it is optional to use
     boolean hasbutton;
+    boolean pressed = false; // rung by the button since takeButtonPress()
     boolean offState = HIGH;
     boolean onState = LOW;
 
+    bool timedOff = false;           // off edge from timer 1
+    uint32_t onUs = 0;               // micros() at the last on()
+    volatile uint32_t offUs = 0;     // micros() at the automatic off edge
+    volatile bool autoOff = false;   // went off by itself since takeAutoOff()
+    volatile uint32_t ticksLeft = 0; // timer 1 ticks still to wait past this shot
+
+    inline static Bell *timerBell = nullptr;
+
+    // Timer 1 interrupt: the next shot, or the off edge
+    static void IRAM_ATTR onTimer()
+    {
+        Bell *b = timerBell;
+        if (b == nullptr)
+            return;
+        if (b->ticksLeft > 0)
+        {
+            uint32_t shot = b->ticksLeft < BELL_TIMER_MAX_TICKS ? b->ticksLeft : BELL_TIMER_MAX_TICKS;
+            b->ticksLeft -= shot;
+            timer1_write(shot);
+            return;
+        }
+        digitalWrite(b->pin, b->offState);
+        b->offUs = micros();
+        b->autoOff = true;
+        timer1_disable();
+    }
+
+    void armTimer(unsigned long ms)
+    {
+        uint32_t ticks = ms * BELL_TIMER_TICKS_PER_MS;
+        if (ticks == 0)
+            ticks = 1;
+        uint32_t shot = ticks < BELL_TIMER_MAX_TICKS ? ticks : BELL_TIMER_MAX_TICKS;
+        timer1_disable();
+        ticksLeft = ticks - shot;
+        timerBell = this;
+        timer1_attachInterrupt(onTimer);
+        timer1_enable(TIM_DIV256, TIM_EDGE, TIM_SINGLE);
+        timer1_write(shot);
+    }
+
 public:
     Bell(byte pin)
     {
@@ -48,12 +101,52 @@ public:
         {
             digitalWrite(pin, onState);
             setStartTime(millis());
+            onUs = micros();
+            autoOff = false;
+            if (timedOff)
+                armTimer(getDuration()); // again on a ring while ringing: the duration starts over
         }
     }
     virtual void off() override
     {
+        if (timedOff)
+            timer1_disable();
         digitalWrite(pin, offState);
     }
+
+    // Time the off edge with timer 1 (true) or from loop()
+    virtual void setTimedOff(bool timed)
+    {
+        if (timedOff && !timed)
+            timer1_disable(); // loop() takes over a bell that is ringing
+        if (!timedOff && timed && isOn())
+        {
+            // timer 1 takes over what is left of it
+            unsigned long elapsed = millis() - getStartTime();
+            armTimer(elapsed < getDuration() ? getDuration() - elapsed : 0);
+        }
+        timedOff = timed;
+    }
+
+    virtual bool getTimedOff()
+    {
+        return timedOff;
+    }
+
+    // True once per automatic off; overrunUs is how long the bell rang past
+    // its duration
+    virtual bool takeAutoOff(uint32_t &overrunUs)
+    {
+        if (!autoOff)
+            return false;
+        noInterrupts();
+        uint32_t ringUs = offUs - onUs;
+        autoOff = false;
+        interrupts();
+        uint32_t durationUs = getDuration() * 1000UL;
+        overrunUs = ringUs > durationUs ? ringUs - durationUs : 0;
+        return true;
+    }
     virtual void toggle() override // you can just digialWrite(pin,!digitalRead(pin)); but this is better
     {
     }
@@ -95,16 +188,29 @@ public:
         {
             previous = millis(); // for debounce
             on();
+            pressed = true;
             btnprevstate = btncurstate;
         }
         btnprevstate = btncurstate;
     }
 
+    // True once per button press that rang the bell
+    virtual bool takeButtonPress()
+    {
+        bool wasPressed = pressed;
+        pressed = false;
+        return wasPressed;
+    }
+
     virtual void turnOffAfterDuration()
     {
+        if (timedOff)
+            return; // timer 1 does it
         if (getDuration() > 0UL && isOn() && (millis() - getStartTime()) > getDuration())
         {
             off();
+            offUs = micros();
+            autoOff = true;
         }
     }
 
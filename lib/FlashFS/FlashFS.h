@@ -0,0 +1,371 @@
+#ifndef FlashFS_h
+#define FlashFS_h
+
+#include <Arduino.h>
+#include <LittleFS.h>
+
+// LittleFS with I/O accounting. Everything that touches flash goes through
+// here (Persist, the static file handlers, the boot-time listing), so every
+// open, read, write, rename and remove is counted twice: against the file
+// it touched and against the caller doing it, with the time it took.
+//
+// The file key folds Persist's "<path>.tmp" and "<path>.bak" into <path>,
+// and every file under a directory given to countAsOne() into that
+// directory, so a log's rotating segments take one slot between them.
+// The caller is whatever setCaller() was last given; the watchdog passes
+// every phase it enters, so callers show up as "checkSchedules" or
+// "handleClient:/schedules/add".
+//
+// Wear is an estimate: LittleFS never rewrites a block in place, so every
+// commit of a written file (flush or close) costs the blocks from the one
+// holding the first byte changed to the end of the file, a whole file when
+// it was truncated, the tail when appended to. Each commit, rename and remove
+// also costs FLASHFS_COMMIT_BYTES of a metadata block. Counted since boot
+// only, to keep the counter itself off flash.
+
+#define FLASHFS_MAX_PATHS 8
+#define FLASHFS_MAX_CALLERS 10
+#define FLASHFS_PATH_LEN 24
+#define FLASHFS_LATENCY_BUCKETS 5
+#define FLASHFS_COMMIT_BYTES 64
+#define FLASHFS_ENDURANCE 100000UL // erase cycles per block
+#define FLASHFS_NO_SLOT 0xFF
+#define FLASHFS_UNTIMED UINT32_MAX
+#define FLASHFS_UNCHANGED UINT32_MAX
+
+struct FlashIoStats
+{
+    uint32_t opens;
+    uint32_t reads; // buffered reads; single-byte reads only add bytes
+    uint32_t bytesRead;
+    uint32_t writes;
+    uint32_t bytesWritten;
+    uint32_t metaOps; // exists, rename, remove
+    uint32_t maxUs;
+    uint32_t latency[FLASHFS_LATENCY_BUCKETS]; // see FlashFS::LATENCY_BOUNDS_US
+};
+
+struct FlashPathStats
+{
+    char path[FLASHFS_PATH_LEN];
+    FlashIoStats io;
+};
+
+struct FlashCallerStats
+{
+    const char *name;
+    const char *detail; // nullptr if none
+    FlashIoStats io;
+};
+
+class FlashFS;
+
+// A File that reports what it does to FlashFS. Usable as a Stream, so
+// ArduinoJson and Response read it like the File it wraps.
+class FlashFile : public Stream
+{
+public:
+    FlashFile() : slot(FLASHFS_NO_SLOT), writing(false), appending(false), changedFrom(FLASHFS_UNCHANGED) {}
+    FlashFile(const File &f, uint8_t pathSlot, const char *mode)
+        : file(f), slot(pathSlot), writing(mode[0] != 'r' || mode[1] == '+'), appending(mode[0] == 'a'),
+          changedFrom(mode[0] == 'w' && f ? 0 : FLASHFS_UNCHANGED) {}
+
+    int available() override { return file.available(); }
+    int peek() override { return file.peek(); }
+    int read() override;
+    int read(uint8_t *buffer, size_t size);
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t *buffer, size_t size) override;
+    void flush() override;
+    bool seek(uint32_t pos, SeekMode mode = SeekSet) { return file.seek(pos, mode); }
+    size_t position() const { return file.position(); }
+    size_t size() const { return file.size(); }
+    const char *name() const { return file.name(); }
+    void close();
+    explicit operator bool() const { return (bool)file; }
+
+private:
+    File file;
+    uint8_t slot;
+    bool writing;
+    bool appending;
+    uint32_t changedFrom; // first byte changed since the last commit, for the wear estimate
+
+    void commit();
+};
+
+class FlashFS
+{
+    friend class FlashFile;
+
+public:
+    static inline FlashPathStats paths[FLASHFS_MAX_PATHS] = {};
+    static inline FlashCallerStats callers[FLASHFS_MAX_CALLERS] = {};
+    static inline uint8_t pathCount = 0;
+    static inline uint8_t callerCount = 0;
+    static inline uint32_t untrackedOps = 0; // both tables full
+
+    static inline FSInfo fsInfo = {};
+    static inline uint32_t wearBytes = 0; // data written, in whole blocks
+    static inline uint32_t metadataCommits = 0;
+
+    static constexpr uint32_t LATENCY_BOUNDS_US[FLASHFS_LATENCY_BUCKETS - 1] = {100, 1000, 10000, 100000};
+
+    static bool begin()
+    {
+        uint32_t start = micros();
+        bool ok = LittleFS.begin();
+        if (ok)
+            LittleFS.info(fsInfo);
+        account(FLASHFS_NO_SLOT, META, 0, micros() - start);
+        return ok;
+    }
+
+    // I/O on any file under dir is counted against dir; dir must outlive
+    // FlashFS (a string literal)
+    static void countAsOne(const char *dir)
+    {
+        groupDir = dir;
+    }
+
+    // Who the following I/O is for; name and detail must outlive the call
+    // (string literals, route paths)
+    static void setCaller(const char *name, const char *detail = nullptr)
+    {
+        callerName = name;
+        callerDetail = detail;
+        callerSlot = FLASHFS_NO_SLOT; // looked up on first I/O
+    }
+
+    static FlashFile open(const char *path, const char *mode)
+    {
+        uint8_t slot = pathSlot(path);
+        uint32_t start = micros();
+        File f = LittleFS.open(path, mode);
+        account(slot, OPEN, 0, micros() - start);
+        return FlashFile(f, slot, mode);
+    }
+
+    static bool exists(const char *path)
+    {
+        uint32_t start = micros();
+        bool found = LittleFS.exists(path);
+        account(pathSlot(path), META, 0, micros() - start);
+        return found;
+    }
+
+    static bool remove(const char *path)
+    {
+        uint32_t start = micros();
+        bool ok = LittleFS.remove(path);
+        account(pathSlot(path), META, 0, micros() - start);
+        if (ok)
+            metadataCommits++;
+        return ok;
+    }
+
+    static bool rename(const char *from, const char *to)
+    {
+        uint32_t start = micros();
+        bool ok = LittleFS.rename(from, to);
+        account(pathSlot(from), META, 0, micros() - start);
+        if (ok)
+            metadataCommits++;
+        return ok;
+    }
+
+    static Dir openDir(const char *path)
+    {
+        uint32_t start = micros();
+        Dir dir = LittleFS.openDir(path);
+        account(FLASHFS_NO_SLOT, META, 0, micros() - start);
+        return dir;
+    }
+
+    // Erase cycles spent since boot, all blocks together
+    static uint32_t estimatedErases()
+    {
+        if (fsInfo.blockSize == 0)
+            return 0;
+        return (wearBytes + metadataCommits * FLASHFS_COMMIT_BYTES) / fsInfo.blockSize;
+    }
+
+    static uint32_t blockCount()
+    {
+        return fsInfo.blockSize ? fsInfo.totalBytes / fsInfo.blockSize : 0;
+    }
+
+private:
+    enum Op : uint8_t
+    {
+        OPEN,
+        READ,
+        WRITE,
+        META
+    };
+
+    static inline const char *callerName = nullptr;
+    static inline const char *callerDetail = nullptr;
+    static inline uint8_t callerSlot = FLASHFS_NO_SLOT;
+    static inline const char *groupDir = nullptr;
+
+    // Length of path without Persist's ".tmp"/".bak", or of groupDir
+    static size_t basePathLength(const char *path)
+    {
+        if (groupDir)
+        {
+            size_t dirLength = strlen(groupDir);
+            if (strncmp(path, groupDir, dirLength) == 0 && path[dirLength] == '/')
+                return dirLength;
+        }
+        size_t length = strlen(path);
+        if (length > 4 && (strcmp(path + length - 4, ".tmp") == 0 || strcmp(path + length - 4, ".bak") == 0))
+            length -= 4;
+        return length;
+    }
+
+    static uint8_t pathSlot(const char *path)
+    {
+        size_t length = basePathLength(path);
+        if (length > FLASHFS_PATH_LEN - 1)
+            length = FLASHFS_PATH_LEN - 1;
+        for (uint8_t i = 0; i < pathCount; i++)
+        {
+            if (strncmp(paths[i].path, path, length) == 0 && paths[i].path[length] == '\0')
+                return i;
+        }
+        if (pathCount >= FLASHFS_MAX_PATHS)
+            return FLASHFS_NO_SLOT;
+        FlashPathStats &entry = paths[pathCount];
+        memcpy(entry.path, path, length);
+        entry.path[length] = '\0';
+        return pathCount++;
+    }
+
+    static uint8_t currentCallerSlot()
+    {
+        if (callerSlot != FLASHFS_NO_SLOT)
+            return callerSlot;
+        for (uint8_t i = 0; i < callerCount; i++)
+        {
+            if (callers[i].name == callerName && callers[i].detail == callerDetail)
+                return callerSlot = i;
+        }
+        if (callerCount >= FLASHFS_MAX_CALLERS)
+            return FLASHFS_NO_SLOT;
+        callers[callerCount].name = callerName;
+        callers[callerCount].detail = callerDetail;
+        return callerSlot = callerCount++;
+    }
+
+    static void record(FlashIoStats &io, Op op, uint32_t bytes, uint32_t us)
+    {
+        switch (op)
+        {
+        case OPEN:
+            io.opens++;
+            break;
+        case READ:
+            io.bytesRead += bytes;
+            if (us != FLASHFS_UNTIMED)
+                io.reads++;
+            break;
+        case WRITE:
+            io.writes++;
+            io.bytesWritten += bytes;
+            break;
+        case META:
+            io.metaOps++;
+            break;
+        }
+        if (us == FLASHFS_UNTIMED)
+            return;
+        if (us > io.maxUs)
+            io.maxUs = us;
+        uint8_t bucket = 0;
+        while (bucket < FLASHFS_LATENCY_BUCKETS - 1 && us >= LATENCY_BOUNDS_US[bucket])
+            bucket++;
+        io.latency[bucket]++;
+    }
+
+    static void account(uint8_t slot, Op op, uint32_t bytes, uint32_t us)
+    {
+        uint8_t caller = currentCallerSlot();
+        if (slot != FLASHFS_NO_SLOT)
+            record(paths[slot].io, op, bytes, us);
+        if (caller != FLASHFS_NO_SLOT)
+            record(callers[caller].io, op, bytes, us);
+        if (slot == FLASHFS_NO_SLOT && caller == FLASHFS_NO_SLOT)
+            untrackedOps++;
+    }
+
+    static void committed(uint32_t changedFrom, uint32_t size)
+    {
+        uint32_t block = fsInfo.blockSize ? fsInfo.blockSize : 4096;
+        uint32_t last = (size + block - 1) / block;
+        uint32_t first = changedFrom / block;
+        if (last > first)
+            wearBytes += (last - first) * block;
+        metadataCommits++;
+    }
+};
+
+inline int FlashFile::read()
+{
+    int c = file.read();
+    if (c >= 0)
+        FlashFS::account(slot, FlashFS::READ, 1, FLASHFS_UNTIMED); // too many to time
+    return c;
+}
+
+inline int FlashFile::read(uint8_t *buffer, size_t size)
+{
+    uint32_t start = micros();
+    int n = file.read(buffer, size);
+    FlashFS::account(slot, FlashFS::READ, n > 0 ? n : 0, micros() - start);
+    return n;
+}
+
+inline size_t FlashFile::write(const uint8_t *buffer, size_t size)
+{
+    uint32_t at = appending ? file.size() : file.position();
+    uint32_t start = micros();
+    size_t n = file.write(buffer, size);
+    FlashFS::account(slot, FlashFS::WRITE, n, micros() - start);
+    if (n > 0 && at < changedFrom)
+        changedFrom = at;
+    return n;
+}
+
+inline void FlashFile::commit()
+{
+    if (changedFrom == FLASHFS_UNCHANGED)
+        return;
+    FlashFS::committed(changedFrom, file.size());
+    changedFrom = FLASHFS_UNCHANGED;
+}
+
+inline void FlashFile::flush()
+{
+    uint32_t start = micros();
+    file.flush();
+    if (writing)
+        FlashFS::account(slot, FlashFS::WRITE, 0, micros() - start);
+    commit();
+}
+
+inline void FlashFile::close()
+{
+    if (!file)
+        return;
+    uint32_t start = micros();
+    commit(); // closing a changed file commits it, that's where LittleFS programs
+    file.close();
+    if (writing)
+    {
+        FlashFS::account(slot, FlashFS::WRITE, 0, micros() - start);
+        writing = false;
+    }
+}
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef JsonArena_h
+#define JsonArena_h
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// One statically reserved JsonDocument shared by everything that parses or
+// builds the schedule list, instead of a 16 KB malloc/free per request. The
+// memory is never returned to the heap, so repeated edits can't fragment it.
+// Users take it through a JsonArenaLease, which clears the document on the
+// way in and out; a second lease while one is held fails instead of sharing.
+
+#define JSON_ARENA_SIZE 16384
+
+class JsonArena
+{
+private:
+    StaticJsonDocument<JSON_ARENA_SIZE> doc;
+    bool busy;
+
+public:
+    uint32_t leases;
+    uint32_t rejected;
+    size_t highWater; // most bytes of the arena ever used
+
+    JsonArena() : busy(false), leases(0), rejected(0), highWater(0) {}
+
+    JsonDocument *acquire()
+    {
+        if (busy)
+        {
+            rejected++;
+            return nullptr;
+        }
+        busy = true;
+        leases++;
+        doc.clear();
+        return &doc;
+    }
+
+    void release()
+    {
+        if (doc.memoryUsage() > highWater)
+            highWater = doc.memoryUsage();
+        doc.clear();
+        busy = false;
+    }
+
+    size_t capacity() const
+    {
+        return JSON_ARENA_SIZE;
+    }
+};
+
+class JsonArenaLease
+{
+private:
+    JsonArena &arena;
+    JsonDocument *doc;
+
+public:
+    JsonArenaLease(JsonArena &a) : arena(a), doc(a.acquire()) {}
+
+    ~JsonArenaLease()
+    {
+        if (doc != nullptr)
+            arena.release();
+    }
+
+    JsonArenaLease(const JsonArenaLease &) = delete;
+    JsonArenaLease &operator=(const JsonArenaLease &) = delete;
+
+    explicit operator bool() const
+    {
+        return doc != nullptr;
+    }
+
+    JsonDocument &operator*()
+    {
+        return *doc;
+    }
+};
+
+#endif
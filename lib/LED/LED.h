@@ -3,8 +3,8 @@
 
 #include <Arduino.h>
 #include <Toggelable.h>
-#include <LittleFS.h>
 #include <ArduinoJson.h>
+#include <Persist.h>
 
 class LED : public Togglable
 {
@@ -13,6 +13,7 @@ private:
     byte buttonPin; // it is optional to use
     boolean state;
     boolean hasbutton;
+    boolean savePending; // state changed since the last persist()
 
 public:
     LED(byte pin)
@@ -20,6 +21,7 @@ public:
         hasbutton = false;
         this->pin = pin;
         state = LOW;
+        savePending = false;
         // previous = 0UL;
         // duration = 0UL;
         // startTime = 0UL;
@@ -58,45 +60,27 @@ public:
     {
         digitalWrite(pin, HIGH);
         state = HIGH;
-        // Persist LED state
-        StaticJsonDocument<256> cfg;
-        File f = LittleFS.open("/config.json", "r");
-        if (f)
-        {
-            String c = f.readString();
-            f.close();
-            DeserializationError e = deserializeJson(cfg, c);
-            if (e) cfg.clear();
-        }
-        cfg["ledOn"] = true;
-        File wf = LittleFS.open("/config.json", "w");
-        if (wf)
-        {
-            serializeJson(cfg, wf);
-            wf.close();
-        }
+        savePending = true;
     }
     virtual void off() override
     {
         digitalWrite(pin, LOW);
         state = LOW;
-        // Persist LED state
-        StaticJsonDocument<256> cfg;
-        File f = LittleFS.open("/config.json", "r");
-        if (f)
+        savePending = true;
+    }
+
+    // Applies the state read back from flash, so there is nothing to save
+    virtual void restore(bool wasOn)
+    {
+        if (wasOn)
         {
-            String c = f.readString();
-            f.close();
-            DeserializationError e = deserializeJson(cfg, c);
-            if (e) cfg.clear();
+            on();
         }
-        cfg["ledOn"] = false;
-        File wf = LittleFS.open("/config.json", "w");
-        if (wf)
+        else
         {
-            serializeJson(cfg, wf);
-            wf.close();
+            off();
         }
+        savePending = false;
     }
 
     virtual bool isOn()
@@ -157,6 +141,19 @@ public:
     {
         moniterBtn();
     }
+
+    // Writes the last state to flash if it changed; kept out of on()/off() so
+    // a schedule or button never waits for a flash write
+    virtual void persist()
+    {
+        if (!savePending)
+            return;
+        savePending = false;
+        StaticJsonDocument<512> cfg;
+        Persist::load("/config.json", cfg);
+        cfg["ledOn"] = isOn();
+        Persist::save("/config.json", cfg);
+    }
 };
 
 #endif
\ No newline at end of file
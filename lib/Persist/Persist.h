@@ -0,0 +1,356 @@
+#ifndef Persist_h
+#define Persist_h
+
+#include <Arduino.h>
+#include <FlashFS.h>
+#include <ArduinoJson.h>
+
+// Crash-safe JSON files on LittleFS (through FlashFS, which counts the I/O).
+//
+// save() never touches the live file: the document is written to "<path>.tmp"
+// behind a small header (magic, generation, length, CRC32), flushed, read back
+// and verified, and only then renamed over "<path>". The copy it replaces is
+// kept as "<path>.bak". A brown-out at any point leaves at least one complete
+// copy, and load()/recover() always pick the newest one whose CRC checks out.
+// Plain JSON files without a header (e.g. uploaded from data/) are accepted as
+// generation 0.
+
+struct PersistStats
+{
+    uint32_t writes;
+    uint32_t writeFailures;
+    uint32_t lastWriteUs;
+    uint32_t maxWriteUs;
+    uint32_t recoveries;
+    uint32_t lastRecoveryUs;
+    uint32_t corruptCopies; // each bad copy once, however often it is read
+};
+
+class Persist
+{
+private:
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t generation;
+        uint32_t length;
+        uint32_t crc;
+    };
+
+    static const uint32_t MAGIC = 0x31424253; // "SBB1"
+    static const uint8_t PRIMARY = 0;
+    static const uint8_t TEMP = 1;
+    static const uint8_t BACKUP = 2;
+
+    // Print adapter that checksums and counts everything serializeJson writes
+    class CrcWriter : public Print
+    {
+    public:
+        FlashFile &file;
+        uint32_t crc;
+        uint32_t length;
+        bool failed;
+
+        CrcWriter(FlashFile &f) : file(f), crc(0), length(0), failed(false) {}
+
+        size_t write(uint8_t c) override
+        {
+            return write(&c, 1);
+        }
+
+        size_t write(const uint8_t *buffer, size_t size) override
+        {
+            size_t written = file.write(buffer, size);
+            if (written != size)
+                failed = true;
+            crc = crc32Update(crc, buffer, written);
+            length += written;
+            return written;
+        }
+    };
+
+    // Corrupt copies already counted, by name, size and header; save() and
+    // load() inspect the same copies over and over until a save replaces them
+    static const uint8_t SEEN_CORRUPT = 4;
+    static inline uint32_t seenCorrupt[SEEN_CORRUPT] = {};
+    static inline uint8_t seenCorruptNext = 0;
+
+    static void countCorrupt(const char *name, size_t size, const Header &h)
+    {
+        uint32_t key = crc32Update(0, (const uint8_t *)name, strlen(name));
+        key = crc32Update(key, (const uint8_t *)&size, sizeof(size));
+        key = crc32Update(key, (const uint8_t *)&h, sizeof(Header));
+        for (uint8_t i = 0; i < SEEN_CORRUPT; i++)
+        {
+            if (seenCorrupt[i] == key)
+                return;
+        }
+        seenCorrupt[seenCorruptNext] = key;
+        seenCorruptNext = (seenCorruptNext + 1) % SEEN_CORRUPT;
+        stats.corruptCopies++;
+    }
+
+    static void copyName(char *out, size_t size, const char *path, uint8_t which)
+    {
+        const char *suffix = which == TEMP ? ".tmp" : (which == BACKUP ? ".bak" : "");
+        snprintf(out, size, "%s%s", path, suffix);
+    }
+
+    // Checks one copy; legacy files report generation 0 and magic 0
+    static bool inspect(const char *name, Header &h)
+    {
+        FlashFile f = FlashFS::open(name, "r");
+        if (!f)
+            return false;
+
+        size_t size = f.size();
+        if (size >= sizeof(Header) && f.read((uint8_t *)&h, sizeof(Header)) == sizeof(Header) && h.magic == MAGIC)
+        {
+            bool ok = (size == sizeof(Header) + h.length);
+            uint32_t crc = 0;
+            uint8_t buffer[128];
+            while (ok && f.available())
+            {
+                int n = f.read(buffer, sizeof(buffer));
+                if (n <= 0)
+                    break;
+                crc = crc32Update(crc, buffer, n);
+            }
+            f.close();
+            if (!ok || crc != h.crc)
+            {
+                countCorrupt(name, size, h);
+                return false;
+            }
+            return true;
+        }
+
+        // Legacy plain JSON: can't be verified here, deserializing will tell
+        f.seek(0);
+        int first = f.peek();
+        f.close();
+        h.magic = 0;
+        h.generation = 0;
+        h.length = size;
+        h.crc = 0;
+        return first == '{' || first == '[';
+    }
+
+    static bool copyFile(const char *from, const char *to)
+    {
+        FlashFile in = FlashFS::open(from, "r");
+        if (!in)
+            return false;
+        FlashFile out = FlashFS::open(to, "w");
+        if (!out)
+        {
+            in.close();
+            return false;
+        }
+        uint8_t buffer[128];
+        bool ok = true;
+        while (ok && in.available())
+        {
+            int n = in.read(buffer, sizeof(buffer));
+            ok = n > 0 && out.write(buffer, n) == (size_t)n;
+        }
+        out.flush();
+        out.close();
+        in.close();
+        return ok;
+    }
+
+    // Index of the newest valid copy not excluded by the mask, or -1
+    static int8_t newest(const bool valid[3], const Header headers[3], uint8_t excluded)
+    {
+        int8_t best = -1;
+        for (uint8_t i = 0; i < 3; i++)
+        {
+            if (!valid[i] || (excluded & (1 << i)))
+                continue;
+            if (best < 0 || headers[i].generation > headers[best].generation)
+                best = i;
+        }
+        return best;
+    }
+
+public:
+    static inline PersistStats stats = {};
+
+    // Standard CRC-32, chainable: crc32Update(crc32Update(0, a, n), b, m)
+    static uint32_t crc32Update(uint32_t crc, const uint8_t *data, size_t len)
+    {
+        crc = ~crc;
+        while (len--)
+        {
+            crc ^= *data++;
+            for (uint8_t k = 0; k < 8; k++)
+                crc = (crc >> 1) ^ (0xEDB88320UL & (0UL - (crc & 1UL)));
+        }
+        return ~crc;
+    }
+
+    static bool exists(const char *path)
+    {
+        char name[40];
+        for (uint8_t i = 0; i < 3; i++)
+        {
+            copyName(name, sizeof(name), path, i);
+            if (FlashFS::exists(name))
+                return true;
+        }
+        return false;
+    }
+
+    // Deserializes the newest copy that is intact, falling back to older ones
+    static bool load(const char *path, JsonDocument &doc)
+    {
+        char name[40];
+        Header headers[3];
+        bool valid[3];
+        for (uint8_t i = 0; i < 3; i++)
+        {
+            copyName(name, sizeof(name), path, i);
+            valid[i] = inspect(name, headers[i]);
+        }
+
+        uint8_t tried = 0;
+        int8_t best;
+        while ((best = newest(valid, headers, tried)) >= 0)
+        {
+            tried |= 1 << best;
+            copyName(name, sizeof(name), path, best);
+            FlashFile f = FlashFS::open(name, "r");
+            if (!f)
+                continue;
+            if (headers[best].magic == MAGIC)
+                f.seek(sizeof(Header));
+            size_t size = f.size();
+            DeserializationError error = deserializeJson(doc, f);
+            f.close();
+            if (!error)
+                return true;
+            countCorrupt(name, size, headers[best]);
+        }
+
+        doc.clear();
+        return false;
+    }
+
+    static bool save(const char *path, const JsonDocument &doc)
+    {
+        unsigned long start = micros();
+        char name[40], tmp[40], bak[40];
+        copyName(name, sizeof(name), path, PRIMARY);
+        copyName(tmp, sizeof(tmp), path, TEMP);
+        copyName(bak, sizeof(bak), path, BACKUP);
+
+        Header current, previous;
+        bool currentValid = inspect(name, current);
+        uint32_t generation = currentValid ? current.generation : 0;
+        if (inspect(bak, previous) && previous.generation > generation)
+            generation = previous.generation;
+
+        Header h = {MAGIC, generation + 1, 0, 0};
+        FlashFile f = FlashFS::open(tmp, "w");
+        if (!f)
+        {
+            stats.writeFailures++;
+            return false;
+        }
+        bool ok = f.write((const uint8_t *)&h, sizeof(Header)) == sizeof(Header);
+        CrcWriter writer(f);
+        serializeJson(doc, writer);
+        h.length = writer.length;
+        h.crc = writer.crc;
+        ok = ok && !writer.failed && f.seek(0) && f.write((const uint8_t *)&h, sizeof(Header)) == sizeof(Header);
+        f.flush();
+        f.close();
+
+        // Read it back before it may replace anything
+        Header check;
+        if (!ok || !inspect(tmp, check) || check.generation != h.generation)
+        {
+            FlashFS::remove(tmp);
+            stats.writeFailures++;
+            return false;
+        }
+
+        if (currentValid)
+        {
+            FlashFS::remove(bak);
+            FlashFS::rename(name, bak);
+        }
+        else
+        {
+            FlashFS::remove(name);
+        }
+        if (!FlashFS::rename(tmp, name))
+        {
+            stats.writeFailures++;
+            return false; // tmp is still there for recover()
+        }
+
+        uint32_t elapsed = micros() - start;
+        stats.writes++;
+        stats.lastWriteUs = elapsed;
+        if (elapsed > stats.maxWriteUs)
+            stats.maxWriteUs = elapsed;
+        return true;
+    }
+
+    // Boot-time repair: makes the newest valid copy the live file again
+    static void recover(const char *path)
+    {
+        unsigned long start = micros();
+        char name[40], tmp[40], bak[40];
+        copyName(name, sizeof(name), path, PRIMARY);
+        copyName(tmp, sizeof(tmp), path, TEMP);
+        copyName(bak, sizeof(bak), path, BACKUP);
+
+        Header headers[3];
+        bool valid[3];
+        valid[PRIMARY] = inspect(name, headers[PRIMARY]);
+        valid[TEMP] = inspect(tmp, headers[TEMP]);
+        valid[BACKUP] = inspect(bak, headers[BACKUP]);
+
+        int8_t best = newest(valid, headers, 0);
+        if (best < 0)
+            return; // nothing usable, callers fall back to defaults
+
+        if (best == PRIMARY)
+        {
+            if (FlashFS::exists(tmp))
+                FlashFS::remove(tmp); // leftover of an interrupted save
+            return;
+        }
+
+        if (best == TEMP)
+        {
+            // Power was lost between writing the new copy and renaming it
+            if (valid[PRIMARY])
+            {
+                FlashFS::remove(bak);
+                FlashFS::rename(name, bak);
+            }
+            else
+            {
+                FlashFS::remove(name);
+            }
+            FlashFS::rename(tmp, name);
+        }
+        else
+        {
+            // Live file is missing or corrupt, restore the previous good copy
+            FlashFS::remove(name);
+            FlashFS::remove(tmp);
+            if (copyFile(bak, tmp))
+                FlashFS::rename(tmp, name);
+        }
+
+        stats.recoveries++;
+        stats.lastRecoveryUs = micros() - start;
+    }
+};
+
+#endif
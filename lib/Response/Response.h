@@ -0,0 +1,257 @@
+#ifndef Response_h
+#define Response_h
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <stdarg.h>
+
+// HTTP responses without String or heap use.
+//
+// The body is formatted into a fixed buffer (print(), printf(), or as the Print
+// target of serializeJson). If it fits, it goes out with a Content-Length
+// header when end() is called. If it doesn't, the writer switches to chunked
+// transfer encoding and flushes every full buffer as one chunk, so the size of
+// a response is never limited by the buffer. Status line and headers are
+// formatted on the stack and written straight to the client. A header block
+// that doesn't fit its buffer is never sent cut short: a bare 500 goes out
+// in its place, the connection is closed and the body is dropped.
+//
+// keepAliveS is set per request by whoever knows whether the connection may
+// be kept (connections.h); responses then say "keep-alive" with that idle
+// timeout instead of "close".
+
+#define RESPONSE_BUFFER_SIZE 1024
+
+class ResponseWriter : public Print
+{
+private:
+    char buffer[RESPONSE_BUFFER_SIZE];
+    size_t used;
+    WiFiClient *client;
+    int code;
+    const char *contentType;
+    bool chunked; // headers already sent, body goes out in chunks
+    bool failed;  // headers didn't fit, a 500 went out instead
+
+    static const char *statusText(int code)
+    {
+        switch (code)
+        {
+        case 200:
+            return "OK";
+        case 304:
+            return "Not Modified";
+        case 400:
+            return "Bad Request";
+        case 404:
+            return "Not Found";
+        case 406:
+            return "Not Acceptable";
+        case 500:
+            return "Internal Server Error";
+        case 503:
+            return "Service Unavailable";
+        default:
+            return "";
+        }
+    }
+
+    // In place of headers that didn't fit: the client can't be left reading
+    // a cut header block as if it were the response
+    void fail()
+    {
+        static const char text[] = "HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        client->write((const uint8_t *)text, sizeof(text) - 1);
+        client->stop();
+        failed = true;
+    }
+
+    // extra: more header lines, each ending in "\r\n", or nullptr; false if
+    // they didn't fit and the response failed instead
+    bool writeHeaders(size_t contentLength, bool chunkedEncoding, const char *extra = nullptr)
+    {
+        char connection[64];
+        if (keepAliveS)
+            snprintf(connection, sizeof(connection), "Connection: keep-alive\r\nKeep-Alive: timeout=%u\r\n", keepAliveS);
+        else
+            strcpy(connection, "Connection: close\r\n");
+
+        char header[288];
+        int len;
+        if (chunkedEncoding)
+            len = snprintf(header, sizeof(header),
+                           "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nTransfer-Encoding: chunked\r\n%s%s\r\n",
+                           code, statusText(code), contentType, extra ? extra : "", connection);
+        else
+            len = snprintf(header, sizeof(header),
+                           "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %u\r\n%s%s\r\n",
+                           code, statusText(code), contentType, (unsigned)contentLength, extra ? extra : "", connection);
+        if (len < 0 || len >= (int)sizeof(header))
+        {
+            fail();
+            return false;
+        }
+        client->write((const uint8_t *)header, len);
+        return true;
+    }
+
+    void flushChunk()
+    {
+        if (failed)
+        {
+            used = 0;
+            return;
+        }
+        if (!chunked)
+        {
+            chunked = true;
+            if (!writeHeaders(0, true))
+            {
+                used = 0;
+                return;
+            }
+        }
+        if (used == 0)
+            return;
+        char size[12];
+        int len = snprintf(size, sizeof(size), "%X\r\n", (unsigned)used);
+        client->write((const uint8_t *)size, len);
+        client->write((const uint8_t *)buffer, used);
+        client->write((const uint8_t *)"\r\n", 2);
+        used = 0;
+    }
+
+public:
+    static inline uint16_t keepAliveS = 0; // 0: Connection: close
+
+    ResponseWriter() : used(0), client(nullptr), code(200), contentType(""), chunked(false), failed(false) {}
+
+    void begin(WiFiClient &c, int status, const char *type)
+    {
+        client = &c;
+        code = status;
+        contentType = type;
+        used = 0;
+        chunked = false;
+        failed = false;
+    }
+
+    size_t write(uint8_t c) override
+    {
+        if (used >= sizeof(buffer))
+            flushChunk();
+        buffer[used++] = c;
+        return 1;
+    }
+
+    size_t write(const uint8_t *data, size_t size) override
+    {
+        size_t left = size;
+        while (left > 0)
+        {
+            if (used >= sizeof(buffer))
+                flushChunk();
+            size_t n = sizeof(buffer) - used;
+            if (n > left)
+                n = left;
+            memcpy(buffer + used, data, n);
+            used += n;
+            data += n;
+            left -= n;
+        }
+        return size;
+    }
+
+    // Print::printf falls back to malloc for long output, this never does
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)))
+    {
+        va_list args;
+        va_start(args, format);
+        va_list retry;
+        va_copy(retry, args);
+        int len = vsnprintf(buffer + used, sizeof(buffer) - used, format, args);
+        va_end(args);
+        if (len >= 0 && used + len >= sizeof(buffer))
+        {
+            // Didn't fit: send what we have and format again into the empty buffer
+            flushChunk();
+            len = vsnprintf(buffer, sizeof(buffer), format, retry);
+            if (len >= (int)sizeof(buffer))
+                len = sizeof(buffer) - 1; // truncated, single items never get this long
+        }
+        va_end(retry);
+        if (len < 0)
+            return 0;
+        used += len;
+        return len;
+    }
+
+    // s as a quoted JSON string, for anything a user named: quotes,
+    // backslashes and control characters are escaped
+    size_t printJsonString(const char *s)
+    {
+        size_t n = write('"');
+        for (; *s; s++)
+        {
+            uint8_t c = *s;
+            if (c == '"' || c == '\\')
+            {
+                n += write('\\');
+                n += write(c);
+            }
+            else if (c < 0x20)
+                n += printf("\\u%04x", c);
+            else
+                n += write(c);
+        }
+        return n + write('"');
+    }
+
+    void end()
+    {
+        if (!chunked)
+        {
+            if (!failed && writeHeaders(used, false))
+                client->write((const uint8_t *)buffer, used);
+        }
+        else
+        {
+            flushChunk();
+            if (!failed)
+                client->write((const uint8_t *)"0\r\n\r\n", 5);
+        }
+        used = 0;
+    }
+
+    // Sends only the headers of a length-byte body the caller writes itself;
+    // false if the response failed instead and there is nothing to write
+    bool beginStream(WiFiClient &c, int status, const char *type, size_t length, const char *extraHeaders = nullptr)
+    {
+        begin(c, status, type);
+        return writeHeaders(length, false, extraHeaders);
+    }
+
+    // Sends length bytes from a stream (e.g. a file) through a stack buffer.
+    // A stream that ends short closes the connection: the Content-Length
+    // already sent can't be kept, and a client on a kept connection would
+    // otherwise wait for the rest or read the next response as it.
+    void sendStream(WiFiClient &c, int status, const char *type, Stream &in, size_t length,
+                    const char *extraHeaders = nullptr)
+    {
+        if (!beginStream(c, status, type, length, extraHeaders))
+            return;
+        uint8_t chunk[256];
+        while (length > 0)
+        {
+            size_t n = in.readBytes(chunk, length < sizeof(chunk) ? length : sizeof(chunk));
+            if (n == 0)
+                break;
+            client->write(chunk, n);
+            length -= n;
+        }
+        if (length > 0)
+            client->stop();
+    }
+};
+
+#endif
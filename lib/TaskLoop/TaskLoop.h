@@ -0,0 +1,170 @@
+#ifndef TaskLoop_h
+#define TaskLoop_h
+
+#include <Arduino.h>
+
+// Cooperative, prioritised main loop.
+//
+// Tasks belong to one of four classes and every pass of run() walks them in
+// class order. Real-time tasks (bell and LED control) are also run again
+// after every lower-priority task, so nothing below them can delay a bell
+// by more than one task's budget. Background tasks are skipped while the
+// pass is over its own budget, unless they have been waiting a full second.
+//
+// A task returns true while it has more work it could do right away (e.g.
+// a file still being streamed). It is then called again in the same pass
+// until its per-pass budget is used up, and picks up next pass where it
+// left off. Nothing is preempted: a single call that runs past its budget is
+// only counted, which is what the stats are for.
+
+#define MAX_TASKS 16
+#define TASKLOOP_PASS_BUDGET_US 20000UL
+#define TASKLOOP_MAX_DEFER_US 1000000UL
+
+enum TaskPriority
+{
+    TASK_REALTIME,
+    TASK_SCHEDULING,
+    TASK_HTTP,
+    TASK_BACKGROUND,
+    TASK_PRIORITY_COUNT
+};
+
+typedef bool (*TaskFunction)();
+
+struct Task
+{
+    const char *name;
+    TaskFunction function;
+    uint8_t priority;
+    uint32_t periodUs;    // 0 = every pass
+    uint32_t budgetUs;    // per pass
+    uint32_t lastStartUs; // of the last pass the task ran in
+
+    uint32_t runs;
+    uint64_t totalUs;
+    uint32_t maxUs;       // longest single call
+    uint32_t maxLateUs;   // longest wait past the task's period
+    uint32_t overBudget;  // passes the task ran past its budget
+};
+
+class TaskLoop
+{
+private:
+    Task tasks[MAX_TASKS];
+    uint8_t count;
+
+    bool due(const Task &task, uint32_t now)
+    {
+        return task.runs == 0 || now - task.lastStartUs >= task.periodUs;
+    }
+
+    void runTask(Task &task)
+    {
+        uint32_t start = micros();
+        if (task.runs > 0)
+        {
+            uint32_t waited = start - task.lastStartUs;
+            if (waited > task.periodUs && waited - task.periodUs > task.maxLateUs)
+                task.maxLateUs = waited - task.periodUs;
+        }
+        task.lastStartUs = start;
+
+        bool more = true;
+        uint32_t used = 0;
+        while (more && used < task.budgetUs)
+        {
+            uint32_t callStart = micros();
+            more = task.function();
+            uint32_t elapsed = micros() - callStart;
+            task.runs++;
+            task.totalUs += elapsed;
+            if (elapsed > task.maxUs)
+                task.maxUs = elapsed;
+            used += elapsed;
+        }
+        if (used > task.budgetUs)
+            task.overBudget++;
+    }
+
+    void runRealtime()
+    {
+        uint32_t now = micros();
+        for (uint8_t i = 0; i < count; i++)
+        {
+            if (tasks[i].priority == TASK_REALTIME && due(tasks[i], now))
+                runTask(tasks[i]);
+        }
+    }
+
+public:
+    uint32_t passes;
+    uint32_t maxPassUs;
+    uint8_t dropped; // add() calls refused for a full table
+
+    TaskLoop() : count(0), passes(0), maxPassUs(0), dropped(0) {}
+
+    // Returns false when the task table is full; the task never runs
+    bool add(const char *name, TaskFunction function, TaskPriority priority, uint32_t periodMs, uint32_t budgetUs)
+    {
+        if (count >= MAX_TASKS)
+        {
+            dropped++;
+            return false;
+        }
+        tasks[count++] = {name, function, (uint8_t)priority, periodMs * 1000U, budgetUs, 0, 0, 0, 0, 0, 0};
+        return true;
+    }
+
+    void run()
+    {
+        uint32_t passStart = micros();
+        for (uint8_t priority = 0; priority < TASK_PRIORITY_COUNT; priority++)
+        {
+            for (uint8_t i = 0; i < count; i++)
+            {
+                Task &task = tasks[i];
+                uint32_t now = micros();
+                if (task.priority != priority || !due(task, now))
+                    continue;
+                if (priority == TASK_BACKGROUND && now - passStart > TASKLOOP_PASS_BUDGET_US &&
+                    now - task.lastStartUs < task.periodUs + TASKLOOP_MAX_DEFER_US)
+                    continue; // busy pass, try next time
+
+                runTask(task);
+                if (priority != TASK_REALTIME)
+                    runRealtime();
+            }
+        }
+
+        passes++;
+        uint32_t elapsed = micros() - passStart;
+        if (elapsed > maxPassUs)
+            maxPassUs = elapsed;
+    }
+
+    // Starts the maxima and over-budget counts again, so they cover only
+    // what follows (e.g. a load test); runs and run time keep counting
+    void resetMaxima()
+    {
+        maxPassUs = 0;
+        for (uint8_t i = 0; i < count; i++)
+        {
+            tasks[i].maxUs = 0;
+            tasks[i].maxLateUs = 0;
+            tasks[i].overBudget = 0;
+        }
+    }
+
+    uint8_t taskCount() const
+    {
+        return count;
+    }
+
+    const Task &task(uint8_t i) const
+    {
+        return tasks[i];
+    }
+};
+
+#endif
@@ -0,0 +1,142 @@
+// ===== Admission control =====
+// A phone stuck in a reload loop can keep handleClient() busy back to back.
+// Every routed request first takes a token from a global bucket and from
+// one for its client address; what the buckets can't pay for gets a cheap
+// 503 with Retry-After and never reaches its handler.
+//
+// Routes come in three classes. Control routes (bell, LED, clock) may empty
+// the buckets; API routes leave a quarter of them and static assets an
+// eighth, so a client flooding the page can still ring the bell, and under
+// pressure a page's API calls give way before the page itself: script.js
+// makes them again on its next poll, while a shed "/" is an empty error
+// page. The buckets are sized in page loads, "/" and its two assets and the
+// eight calls script.js makes as it starts: a client can load the page and
+// reload it a second later, and every station on the access point can load
+// it at once. While the listener's backlog is full (HTTP_BACKLOG, see
+// connections.h) only control routes are admitted. The server still takes
+// requests in arrival order, so priority means not being shed, not
+// jumping the queue.
+
+#define ADMIT_CONTROL 0
+#define ADMIT_API 1
+#define ADMIT_STATIC 2
+#define ADMIT_CLASSES 3
+
+#define ADMIT_PAGE_LOAD 11
+#define ADMIT_MAX_CLIENTS 8
+#define ADMIT_GLOBAL_RATE 24 // tokens per second; eight dashboards poll about 18
+#define ADMIT_GLOBAL_BURST 120 // every client's page load, 88, above the quarter API calls leave
+#define ADMIT_CLIENT_RATE 6
+#define ADMIT_CLIENT_BURST (2 * ADMIT_PAGE_LOAD + 2) // and the polls in between
+
+#define SHED_GLOBAL 0
+#define SHED_CLIENT 1
+#define SHED_QUEUE 2
+#define SHED_REASONS 3
+
+struct TokenBucket
+{
+    int32_t milliTokens;
+    uint32_t lastMs;
+};
+
+struct ClientBucket
+{
+    uint32_t ip;
+    TokenBucket bucket;
+};
+
+struct AdmissionStats
+{
+    uint32_t admitted[ADMIT_CLASSES];
+    uint32_t shed[SHED_REASONS][ADMIT_CLASSES];
+    uint32_t clientsEvicted; // bucket given to a new address
+};
+
+// Tokens a class must leave in a bucket, in eighths of the burst
+const uint8_t ADMIT_RESERVE_EIGHTHS[ADMIT_CLASSES] = {0, 2, 1};
+const char *const ADMIT_CLASS_NAMES[ADMIT_CLASSES] = {"control", "api", "static"};
+
+TokenBucket globalBucket = {ADMIT_GLOBAL_BURST * 1000, 0};
+ClientBucket clientBuckets[ADMIT_MAX_CLIENTS];
+AdmissionStats admissionStats = {};
+
+static void refill(TokenBucket &bucket, uint32_t rate, uint32_t burst, uint32_t nowMs)
+{
+    uint32_t elapsed = nowMs - bucket.lastMs;
+    bucket.lastMs = nowMs;
+    if (elapsed > burst * 1000 / rate)
+        elapsed = burst * 1000 / rate; // full anyway, and no overflow
+    bucket.milliTokens += elapsed * rate;
+    if (bucket.milliTokens > (int32_t)burst * 1000)
+        bucket.milliTokens = burst * 1000;
+}
+
+// Seconds until the bucket can pay for this class again, 0 if it can now
+static uint32_t bucketWaitS(const TokenBucket &bucket, uint32_t rate, uint32_t burst, uint8_t admitClass)
+{
+    int32_t needed = 1000 + burst * 1000 * ADMIT_RESERVE_EIGHTHS[admitClass] / 8;
+    if (bucket.milliTokens >= needed)
+        return 0;
+    return (needed - bucket.milliTokens + rate * 1000 - 1) / (rate * 1000);
+}
+
+static TokenBucket &clientBucket(uint32_t ip, uint32_t nowMs)
+{
+    ClientBucket *stalest = &clientBuckets[0];
+    for (ClientBucket &c : clientBuckets)
+    {
+        if (c.bucket.lastMs != 0 && c.ip == ip)
+            return c.bucket;
+        if (stalest->bucket.lastMs != 0 && (c.bucket.lastMs == 0 || nowMs - c.bucket.lastMs > nowMs - stalest->bucket.lastMs))
+            stalest = &c;
+    }
+    if (stalest->bucket.lastMs != 0)
+        admissionStats.clientsEvicted++;
+    stalest->ip = ip;
+    stalest->bucket = {ADMIT_CLIENT_BURST * 1000, nowMs};
+    return stalest->bucket;
+}
+
+// Admits the current request or tells how long to come back after
+uint32_t admitRequest(uint8_t admitClass)
+{
+    uint32_t nowMs = millis();
+    nowMs = nowMs ? nowMs : 1; // 0 marks an unused client bucket
+    refill(globalBucket, ADMIT_GLOBAL_RATE, ADMIT_GLOBAL_BURST, nowMs);
+    TokenBucket &client = clientBucket(server.client().remoteIP(), nowMs);
+    refill(client, ADMIT_CLIENT_RATE, ADMIT_CLIENT_BURST, nowMs);
+
+    if (admitClass != ADMIT_CONTROL && server.getServer().hasMaxPendingClients())
+    {
+        admissionStats.shed[SHED_QUEUE][admitClass]++;
+        return 1;
+    }
+    uint32_t waitS = bucketWaitS(client, ADMIT_CLIENT_RATE, ADMIT_CLIENT_BURST, admitClass);
+    if (waitS)
+    {
+        admissionStats.shed[SHED_CLIENT][admitClass]++;
+        return waitS;
+    }
+    waitS = bucketWaitS(globalBucket, ADMIT_GLOBAL_RATE, ADMIT_GLOBAL_BURST, admitClass);
+    if (waitS)
+    {
+        admissionStats.shed[SHED_GLOBAL][admitClass]++;
+        return waitS;
+    }
+
+    client.milliTokens -= 1000;
+    globalBucket.milliTokens -= 1000;
+    admissionStats.admitted[admitClass]++;
+    return 0;
+}
+
+// The whole response to a shed request: no body, and the connection closes
+void sendShed(uint32_t retryS)
+{
+    char header[112];
+    int len = snprintf(header, sizeof(header),
+                       "HTTP/1.1 503 Service Unavailable\r\nRetry-After: %u\r\nContent-Length: 0\r\nConnection: close\r\n\r\n",
+                       (unsigned)retryS);
+    server.client().write((const uint8_t *)header, len);
+}
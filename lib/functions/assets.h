@@ -0,0 +1,99 @@
+// ===== Embedded web assets =====
+// index.html, style.css and script.js are gzipped into the firmware at build
+// time (tools/embed_assets.py) and sent by the file stream task straight
+// from flash, so loading the page opens no file and stages nothing in RAM.
+// Browsers revalidate with the content's ETag and get a bodyless 304 while
+// the firmware hasn't changed.
+//
+// LittleFS is only an override: a file uploaded under /www (/www/script.js)
+// is served instead of the embedded copy, to try a change without
+// reflashing. Which overrides exist is looked up once when the web server
+// starts, not per request. The plain copies in the LittleFS root are what a
+// client that doesn't take gzip gets; without one it gets 406.
+
+#define ASSET_OVERRIDE_DIR "/www"
+#define ASSET_VARY "Vary: Accept-Encoding\r\n"
+#define ASSET_PATH_LEN 24
+
+// One embedded file, see tools/embed_assets.py
+struct WebAsset
+{
+    const char *path;
+    const uint8_t *data; // gzip, in PROGMEM
+    uint32_t length;
+    const char *etag; // quoted
+};
+
+#if __has_include(<web_assets.h>)
+#include <web_assets.h>
+#else
+#define WEB_ASSET_COUNT 0
+const WebAsset WEB_ASSETS[] = {{"", nullptr, 0, ""}};
+#endif
+
+struct AssetStats
+{
+    uint32_t served;      // whole body sent, from flash or LittleFS
+    uint32_t notModified; // 304 on a matching ETag
+    uint32_t fromFs;      // sent from LittleFS: override, or no gzip
+    uint32_t aborted;     // client went away mid-body
+    uint64_t sendUsTotal; // handler start to last byte, over served
+    uint32_t sendUsMax;
+};
+
+bool assetOverridden[WEB_ASSET_COUNT + 1] = {};
+AssetStats assetStats[WEB_ASSET_COUNT + 1] = {};
+
+// Index into WEB_ASSETS, -1 if not embedded
+int8_t findAsset(const char *path)
+{
+    for (uint8_t i = 0; i < WEB_ASSET_COUNT; i++)
+    {
+        if (strcmp(WEB_ASSETS[i].path, path) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static void overridePath(char *out, size_t size, const char *path)
+{
+    snprintf(out, size, ASSET_OVERRIDE_DIR "%s", path);
+}
+
+// Run once before the routes are served
+void scanAssetOverrides()
+{
+    for (uint8_t i = 0; i < WEB_ASSET_COUNT; i++)
+    {
+        char path[ASSET_PATH_LEN];
+        overridePath(path, sizeof(path), WEB_ASSETS[i].path);
+        assetOverridden[i] = FlashFS::exists(path);
+        if (assetOverridden[i])
+            dbgln("Serving " + String(path) + " instead of the embedded copy");
+    }
+}
+
+void recordAssetSent(int8_t asset, uint32_t startUs, bool complete)
+{
+    if (asset < 0)
+        return;
+    AssetStats &stats = assetStats[asset];
+    if (!complete)
+    {
+        stats.aborted++;
+        return;
+    }
+    uint32_t us = micros() - startUs;
+    stats.served++;
+    stats.sendUsTotal += us;
+    if (us > stats.sendUsMax)
+        stats.sendUsMax = us;
+}
+
+uint32_t embeddedAssetBytes()
+{
+    uint32_t total = 0;
+    for (uint8_t i = 0; i < WEB_ASSET_COUNT; i++)
+        total += WEB_ASSETS[i].length;
+    return total;
+}
@@ -0,0 +1,126 @@
+// ===== Per-second response cache =====
+// Every open dashboard asks for /time and /status once a second, and within
+// a second they all get the same bytes. The first request in a second
+// formats the body into a slot here, and the others in that second are sent
+// the slot as it is. /time goes stale when the second clock (clock.h) ticks.
+// /status goes stale on the tick too, and also as soon as the LED or bell
+// switches. Each wire format (wire.h) has its own /status slot. Headers are
+// still written per request, since keep-alive differs by connection.
+//
+// /time is formatted from the second clock instead of an RTC read, so a miss
+// costs no I2C either. Until the clock is valid it reads the RTC, uncached.
+
+#define CACHE_TIME 0
+#define CACHE_STATUS_JSON 1
+#define CACHE_STATUS_MSGPACK 2
+#define CACHE_SLOTS 3
+#define CACHE_BODY_MAX 32 // {"led":false,"bell":false} is 26
+
+struct CachedResponse
+{
+    bool valid;
+    uint32_t second; // secondClockNow() it was made in
+    uint8_t state;   // deviceState() it shows
+    uint8_t length;
+    char body[CACHE_BODY_MAX];
+};
+
+struct CacheStats
+{
+    uint32_t hits;
+    uint32_t misses;    // empty, or from an earlier second
+    uint32_t stateMiss; // same second, but the LED or bell switched since
+    uint32_t bypassed;  // no valid clock yet
+};
+
+const char *const CACHE_SLOT_NAMES[CACHE_SLOTS] = {"/time", "/status json", "/status msgpack"};
+
+CachedResponse responseCache[CACHE_SLOTS] = {};
+CacheStats cacheStats[CACHE_SLOTS] = {};
+
+ResponseWriter &beginResponse(int code, const char *contentType); // webPage.h
+
+static uint8_t deviceState()
+{
+    return (led.isOn() ? 1 : 0) | (bell.isOn() ? 2 : 0);
+}
+
+// The slot if it still holds what would be sent now; counts the lookup
+static const CachedResponse *cachedResponse(uint8_t slot, uint32_t second, uint8_t state)
+{
+    CachedResponse &entry = responseCache[slot];
+    if (entry.valid && entry.second == second && entry.state == state)
+    {
+        cacheStats[slot].hits++;
+        return &entry;
+    }
+    if (entry.valid && entry.second == second)
+        cacheStats[slot].stateMiss++;
+    else
+        cacheStats[slot].misses++;
+    return nullptr;
+}
+
+// Marks a slot whose body was just written as current
+static const CachedResponse *storeResponse(uint8_t slot, uint32_t second, uint8_t state, size_t length)
+{
+    CachedResponse &entry = responseCache[slot];
+    entry.valid = true;
+    entry.second = second;
+    entry.state = state;
+    entry.length = length;
+    return &entry;
+}
+
+static void sendCached(const CachedResponse *entry, const char *contentType)
+{
+    ResponseWriter &out = beginResponse(200, contentType);
+    out.write((const uint8_t *)entry->body, entry->length);
+    out.end();
+}
+
+// GET /time body, "YYYY/MM/DD HH:MM:SS"
+void sendCachedTime()
+{
+    if (!secondClockValid())
+    {
+        cacheStats[CACHE_TIME].bypassed++;
+        DateTime now = rtc.now();
+        ResponseWriter &out = beginResponse(200, "text/plain");
+        out.printf("%04d/%02d/%02d %02d:%02d:%02d", now.year(), now.month(), now.day(),
+                   now.hour(), now.minute(), now.second());
+        out.end();
+        return;
+    }
+
+    uint32_t second = secondClockNow();
+    const CachedResponse *entry = cachedResponse(CACHE_TIME, second, 0);
+    if (entry == nullptr)
+    {
+        DateTime now(second);
+        char *body = responseCache[CACHE_TIME].body;
+        int length = snprintf(body, CACHE_BODY_MAX, "%04d/%02d/%02d %02d:%02d:%02d", now.year(), now.month(),
+                              now.day(), now.hour(), now.minute(), now.second());
+        entry = storeResponse(CACHE_TIME, second, 0, length);
+    }
+    sendCached(entry, "text/plain");
+}
+
+// GET /status body, {"led":..,"bell":..} in the format the client accepts
+void sendCachedStatus()
+{
+    uint8_t format = responseFormat();
+    uint8_t slot = format == WIRE_MSGPACK ? CACHE_STATUS_MSGPACK : CACHE_STATUS_JSON;
+    uint32_t second = secondClockValid() ? secondClockNow() : millis() / 1000;
+    uint8_t state = deviceState();
+    const CachedResponse *entry = cachedResponse(slot, second, state);
+    if (entry == nullptr)
+    {
+        StaticJsonDocument<64> doc;
+        doc["led"] = (state & 1) != 0;
+        doc["bell"] = (state & 2) != 0;
+        size_t length = renderDocument(doc, format, responseCache[slot].body, CACHE_BODY_MAX);
+        entry = storeResponse(slot, second, state, length);
+    }
+    sendCached(entry, WIRE_CONTENT_TYPES[format]);
+}
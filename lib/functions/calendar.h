@@ -0,0 +1,295 @@
+// ===== Holiday / exception calendar =====
+// Exceptions live in /calendar.json as
+//   {"exceptions":[{"from":"2025-12-25","to":"2026-01-02","profile":"off"}, ...]}
+// where profile is "off" for a holiday or the name of a schedule profile to use
+// on those dates. In RAM every exception is 5 bytes and the list is compiled
+// into one byte per day of the current year, so deciding what kind of day
+// today is costs a single array index.
+
+#define CALENDAR_PATH "/calendar.json"
+#define MAX_CALENDAR_EXCEPTIONS 40
+#define MAX_CALENDAR_PROFILES 8
+#define CALENDAR_PROFILE_NAME_LEN 16
+
+#define CAL_SCHOOL_DAY 0x00 // normal weekday rules apply
+#define CAL_NO_SLOT 0xFE    // not a kind: every profile name slot is taken
+#define CAL_HOLIDAY 0xFF    // nothing rings
+// 1..MAX_CALENDAR_PROFILES : use calendarProfileNames[value - 1] for the day
+
+// What addCalendarException() made of a request
+#define CAL_ADD_OK 0
+#define CAL_ADD_BAD_DATES 1
+#define CAL_ADD_FULL 2     // MAX_CALENDAR_EXCEPTIONS reached
+#define CAL_ADD_NO_SLOT 3  // a new profile name, but MAX_CALENDAR_PROFILES are in use
+
+struct CalendarException
+{
+    uint16_t from; // days since 2000-01-01
+    uint16_t to;   // inclusive
+    uint8_t kind;  // CAL_HOLIDAY or a 1-based slot in calendarProfileNames
+};
+
+CalendarException calendarExceptions[MAX_CALENDAR_EXCEPTIONS];
+uint8_t calendarExceptionCount = 0;
+char calendarProfileNames[MAX_CALENDAR_PROFILES][CALENDAR_PROFILE_NAME_LEN];
+uint8_t calendarProfileCount = 0;
+
+// Compiled lookup for calendarYear, indexed by day of year (0 = 1 Jan)
+uint8_t calendarTable[366];
+int calendarYear = 0;
+bool calendarDirty = true;
+
+static const uint16_t CUMULATIVE_DAYS[12] = {0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334};
+static const uint8_t MONTH_DAYS[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+
+static bool isLeapYear(int year)
+{
+    return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+static uint8_t daysInMonth(int year, int month)
+{
+    return MONTH_DAYS[month - 1] + (month == 2 && isLeapYear(year) ? 1 : 0);
+}
+
+// 0-based day of the year
+static uint16_t dayOfYear(int year, int month, int day)
+{
+    uint16_t doy = CUMULATIVE_DAYS[month - 1] + day - 1;
+    if (month > 2 && isLeapYear(year))
+        doy++;
+    return doy;
+}
+
+// Days since 2000-01-01 (valid for 2000..2099, which covers the RTC range)
+static uint16_t calendarDayNumber(int year, int month, int day)
+{
+    int y = year - 2000;
+    return y * 365 + (y + 3) / 4 + dayOfYear(year, month, day);
+}
+
+static uint16_t calendarYearStart(int year)
+{
+    return calendarDayNumber(year, 1, 1);
+}
+
+static void formatCalendarDate(uint16_t dayNumber, char *out)
+{
+    int year = 2000;
+    while (dayNumber >= (isLeapYear(year) ? 366 : 365))
+    {
+        dayNumber -= isLeapYear(year) ? 366 : 365;
+        year++;
+    }
+    int month = 12;
+    while (month > 1 && dayNumber < CUMULATIVE_DAYS[month - 1] + (month > 2 && isLeapYear(year) ? 1 : 0))
+        month--;
+    int day = dayNumber - CUMULATIVE_DAYS[month - 1] - (month > 2 && isLeapYear(year) ? 1 : 0) + 1;
+    sprintf(out, "%04d-%02d-%02d", year, month, day);
+}
+
+// Parses "YYYY-MM-DD"; returns false on anything else
+static bool parseCalendarDate(const char *text, uint16_t &dayNumber)
+{
+    if (text == nullptr || strlen(text) < 10 || text[4] != '-' || text[7] != '-')
+        return false;
+    int year = atoi(text);
+    int month = atoi(text + 5);
+    int day = atoi(text + 8);
+    if (year < 2000 || year > 2099 || month < 1 || month > 12 || day < 1 || day > daysInMonth(year, month))
+        return false;
+    dayNumber = calendarDayNumber(year, month, day);
+    return true;
+}
+
+// Returns the day kind for a profile name, registering the name if needed;
+// CAL_NO_SLOT if it is new and there is no room for it
+static uint8_t calendarKindForProfile(const char *profile)
+{
+    if (profile == nullptr || profile[0] == '\0' || strcmp(profile, "off") == 0)
+        return CAL_HOLIDAY;
+
+    for (uint8_t i = 0; i < calendarProfileCount; i++)
+    {
+        if (strcmp(calendarProfileNames[i], profile) == 0)
+            return i + 1;
+    }
+    if (calendarProfileCount >= MAX_CALENDAR_PROFILES)
+        return CAL_NO_SLOT;
+
+    strncpy(calendarProfileNames[calendarProfileCount], profile, CALENDAR_PROFILE_NAME_LEN - 1);
+    calendarProfileNames[calendarProfileCount][CALENDAR_PROFILE_NAME_LEN - 1] = '\0';
+    calendarProfileCount++;
+    return calendarProfileCount;
+}
+
+static const char *calendarKindName(uint8_t kind)
+{
+    if (kind == CAL_HOLIDAY)
+        return "off";
+    if (kind == CAL_SCHOOL_DAY || kind > calendarProfileCount)
+        return "";
+    return calendarProfileNames[kind - 1];
+}
+
+void buildCalendarTable(int year)
+{
+    memset(calendarTable, CAL_SCHOOL_DAY, sizeof(calendarTable));
+
+    uint16_t yearStart = calendarYearStart(year);
+    uint16_t yearEnd = yearStart + (isLeapYear(year) ? 365 : 364);
+
+    // Later exceptions win over earlier ones
+    for (uint8_t i = 0; i < calendarExceptionCount; i++)
+    {
+        const CalendarException &e = calendarExceptions[i];
+        if (e.to < yearStart || e.from > yearEnd)
+            continue;
+        uint16_t from = e.from < yearStart ? yearStart : e.from;
+        uint16_t to = e.to > yearEnd ? yearEnd : e.to;
+        memset(calendarTable + (from - yearStart), e.kind, to - from + 1);
+    }
+
+    calendarYear = year;
+    calendarDirty = false;
+    dbgln("Calendar compiled for " + String(year));
+}
+
+// The kind of one day straight from the exception list, later ones winning
+static uint8_t calendarKindOn(uint16_t dayNumber)
+{
+    for (int i = calendarExceptionCount - 1; i >= 0; i--)
+    {
+        if (calendarExceptions[i].from <= dayNumber && dayNumber <= calendarExceptions[i].to)
+            return calendarExceptions[i].kind;
+    }
+    return CAL_SCHOOL_DAY;
+}
+
+// What kind of day is the given date? The table only moves forward, at an
+// edit or a year roll-over. A date in an earlier year (catch-up over New
+// Year, or today while /schedules/upcoming already looked into January)
+// is looked up in the exception list instead, so walking days across the
+// year boundary never rebuilds the table back and forth.
+uint8_t calendarDayKind(int year, int month, int day)
+{
+    if (year < 2000 || year > 2099 || month < 1 || month > 12 || day < 1 || day > daysInMonth(year, month))
+        return CAL_SCHOOL_DAY;
+    if (calendarDirty || year > calendarYear)
+        buildCalendarTable(year > calendarYear ? year : calendarYear);
+    if (year == calendarYear)
+        return calendarTable[dayOfYear(year, month, day)];
+    return calendarKindOn(calendarDayNumber(year, month, day));
+}
+
+// One of CAL_ADD_*
+uint8_t addCalendarException(const char *from, const char *to, const char *profile)
+{
+    if (calendarExceptionCount >= MAX_CALENDAR_EXCEPTIONS)
+        return CAL_ADD_FULL;
+
+    CalendarException e;
+    if (!parseCalendarDate(from, e.from))
+        return CAL_ADD_BAD_DATES;
+    if (to == nullptr || to[0] == '\0')
+        e.to = e.from;
+    else if (!parseCalendarDate(to, e.to))
+        return CAL_ADD_BAD_DATES;
+    if (e.to < e.from)
+        return CAL_ADD_BAD_DATES;
+
+    e.kind = calendarKindForProfile(profile);
+    if (e.kind == CAL_NO_SLOT)
+        return CAL_ADD_NO_SLOT;
+    calendarExceptions[calendarExceptionCount++] = e;
+    calendarDirty = true;
+    return CAL_ADD_OK;
+}
+
+// Frees the name slots no exception uses any more, renumbering the rest
+static void collectCalendarProfiles()
+{
+    uint8_t slot = 0;
+    while (slot < calendarProfileCount)
+    {
+        bool used = false;
+        for (uint8_t i = 0; i < calendarExceptionCount && !used; i++)
+            used = calendarExceptions[i].kind == slot + 1;
+        if (used)
+        {
+            slot++;
+            continue;
+        }
+        for (uint8_t j = slot; j + 1 < calendarProfileCount; j++)
+            memcpy(calendarProfileNames[j], calendarProfileNames[j + 1], CALENDAR_PROFILE_NAME_LEN);
+        calendarProfileCount--;
+        for (uint8_t i = 0; i < calendarExceptionCount; i++)
+        {
+            uint8_t kind = calendarExceptions[i].kind;
+            if (kind != CAL_HOLIDAY && kind > slot + 1)
+                calendarExceptions[i].kind = kind - 1;
+        }
+    }
+}
+
+bool removeCalendarException(int index)
+{
+    if (index < 0 || index >= calendarExceptionCount)
+        return false;
+    for (int i = index; i < calendarExceptionCount - 1; i++)
+        calendarExceptions[i] = calendarExceptions[i + 1];
+    calendarExceptionCount--;
+    collectCalendarProfiles();
+    calendarDirty = true;
+    return true;
+}
+
+void writeCalendarJson(JsonDocument &doc)
+{
+    doc.clear();
+    JsonArray exceptions = doc.createNestedArray("exceptions");
+    char date[11];
+    for (uint8_t i = 0; i < calendarExceptionCount; i++)
+    {
+        JsonObject e = exceptions.createNestedObject();
+        formatCalendarDate(calendarExceptions[i].from, date);
+        e["from"] = date; // copied, date is a stack buffer
+        formatCalendarDate(calendarExceptions[i].to, date);
+        e["to"] = date;
+        e["profile"] = calendarKindName(calendarExceptions[i].kind);
+    }
+}
+
+bool saveCalendar()
+{
+    JsonArenaLease lease(jsonArena);
+    if (!lease)
+        return false;
+    writeCalendarJson(*lease);
+    return Persist::save(CALENDAR_PATH, *lease);
+}
+
+void loadCalendar()
+{
+    calendarExceptionCount = 0;
+    calendarProfileCount = 0;
+    calendarDirty = true;
+
+    JsonArenaLease lease(jsonArena);
+    if (!lease)
+        return;
+    JsonDocument &doc = *lease;
+    if (!Persist::load(CALENDAR_PATH, doc))
+    {
+        dbgln("No calendar file found");
+        return;
+    }
+
+    for (JsonObject e : doc["exceptions"].as<JsonArray>())
+    {
+        if (addCalendarException(e["from"], e["to"], e["profile"]) != CAL_ADD_OK)
+        {
+            dbgln("Skipping invalid calendar exception");
+        }
+    }
+}
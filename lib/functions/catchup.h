@@ -0,0 +1,124 @@
+// ===== Missed-event catch-up =====
+// The last minute checkSchedules() processed is kept in the DS3231's alarm 1
+// registers (battery backed, untouched while A1IE is off), so it survives both
+// resets and power cuts. Alarm 1 (0x07-0x0A) belongs to this file alone:
+// nothing may set alarm 1 or turn A1IE on. The doze wake (power.h) uses
+// alarm 2 (0x0B-0x0D). When the next processed minute is not the one right
+// after it - the device was off or the loop stalled - the triggers in the gap
+// are looked up in the compiled tables. Ones younger than catchUpMaxLateMin
+// still fire, older ones are skipped. The scan is capped at
+// CATCHUP_SCAN_LIMIT_DAYS whatever the length of the outage.
+
+#define DS3231_ADDRESS 0x68
+#define DS3231_ALARM1_REG 0x07
+#define CATCHUP_EPOCH_MIN 28928160UL // 2025-01-01 00:00 in minutes since 1970
+#define CATCHUP_SCAN_LIMIT_DAYS 7
+
+struct CatchUpStats
+{
+    uint32_t runs;
+    uint32_t fired;
+    uint32_t skipped;
+    uint32_t lastGapMin;
+    uint32_t lastRunUs;
+};
+
+CatchUpStats catchUpStats = {};
+unsigned long catchUpMaxLateMin = 5; // 0 = never ring late
+
+void fireTrigger(const Trigger &trigger);
+
+static uint8_t processedChecksum(uint32_t value)
+{
+    uint8_t sum = 0xA;
+    for (uint8_t i = 0; i < 7; i++)
+        sum += (value >> (i * 4)) & 0xF;
+    return sum & 0xF;
+}
+
+// Stored as 28 bits of minutes since 2025 plus a 4-bit checksum
+void saveProcessedMinute(uint32_t minuteStamp)
+{
+    uint32_t value = (minuteStamp - CATCHUP_EPOCH_MIN) & 0x0FFFFFFFUL;
+    value |= (uint32_t)processedChecksum(value) << 28;
+
+    Wire.beginTransmission(DS3231_ADDRESS);
+    Wire.write(DS3231_ALARM1_REG);
+    for (uint8_t i = 0; i < 4; i++)
+        Wire.write((uint8_t)(value >> (i * 8)));
+    Wire.endTransmission();
+}
+
+// 0 if nothing valid was stored
+uint32_t loadProcessedMinute()
+{
+    Wire.beginTransmission(DS3231_ADDRESS);
+    Wire.write(DS3231_ALARM1_REG);
+    if (Wire.endTransmission() != 0 || Wire.requestFrom(DS3231_ADDRESS, 4) != 4)
+        return 0;
+
+    uint32_t value = 0;
+    for (uint8_t i = 0; i < 4; i++)
+        value |= (uint32_t)Wire.read() << (i * 8);
+
+    if ((value >> 28) != processedChecksum(value & 0x0FFFFFFFUL))
+        return 0;
+    return (value & 0x0FFFFFFFUL) + CATCHUP_EPOCH_MIN;
+}
+
+// Handles the minutes in [fromMinute, toMinute], which were never processed
+void catchUpMissed(uint32_t fromMinute, uint32_t toMinute)
+{
+    unsigned long start = micros();
+    catchUpStats.runs++;
+    catchUpStats.lastGapMin = toMinute - fromMinute + 1;
+
+    // Anything older than the scan limit is skipped without looking
+    uint32_t limit = toMinute - (uint32_t)CATCHUP_SCAN_LIMIT_DAYS * 1440UL;
+    if (toMinute > (uint32_t)CATCHUP_SCAN_LIMIT_DAYS * 1440UL && fromMinute < limit)
+        fromMinute = limit;
+
+    bool rang = false;
+    uint32_t minute = fromMinute;
+    while (minute <= toMinute)
+    {
+        // One day (or the part of it inside the gap) per step
+        uint32_t dayStart = minute - minute % 1440;
+        uint32_t dayEnd = dayStart + 1439 < toMinute ? dayStart + 1439 : toMinute;
+
+        DateTime day(dayStart * 60);
+        uint8_t dayKind = calendarDayKind(day.year(), day.month(), day.day());
+        if (dayKind != CAL_HOLIDAY)
+        {
+            const ProfileTable *table = profileForDay(dayKind);
+            uint8_t dayBit = 1 << scheduleDayOfWeek(day);
+            for (int i = firstTriggerAt(table, minute - dayStart); i < table->count; i++)
+            {
+                const Trigger &trigger = table->triggers[i];
+                if (dayStart + trigger.minute > dayEnd)
+                    break;
+                if (!(trigger.days & dayBit))
+                    continue;
+
+                uint32_t age = toMinute + 1 - (dayStart + trigger.minute);
+                // Ring the bell at most once however many were missed
+                if (age <= catchUpMaxLateMin && led.isOn() && !(trigger.type == TRIGGER_BELL && rang))
+                {
+                    dbgln("Catching up schedule #" + String(trigger.index) + ", " + String(age) + " min late");
+                    fireTrigger(trigger);
+                    logEvent(trigger.type == TRIGGER_BELL ? EVENT_ZONE_BELL : EVENT_ZONE_LED, EVENT_CATCHUP, trigger.index,
+                             UINT32_MAX);
+                    rang = rang || trigger.type == TRIGGER_BELL;
+                    catchUpStats.fired++;
+                }
+                else
+                {
+                    catchUpStats.skipped++;
+                }
+            }
+        }
+        minute = dayEnd + 1;
+    }
+
+    catchUpStats.lastRunUs = micros() - start;
+}
@@ -0,0 +1,118 @@
+// ===== Schedule change feed =====
+// Every saved add/edit/delete bumps scheduleRevision, which is also stored in
+// schedules.json so it keeps counting up across reboots. The last
+// SCHEDULE_CHANGES edits are kept in a ring, with the schedule as it was
+// saved, so /schedules/changes?since=rev can answer with deltas. A client
+// further behind than the ring (or from before a reboot) gets a full
+// snapshot instead. Indices are applied in order, exactly as the server did.
+
+#define SCHEDULE_CHANGES 16
+
+#define CHANGE_ADD 0
+#define CHANGE_EDIT 1
+#define CHANGE_DELETE 2
+
+#define CHANGE_ENABLED 0x01
+#define CHANGE_LED 0x02
+
+struct ScheduleChange
+{
+    uint32_t revision;
+    uint8_t op;
+    uint8_t index;
+    uint8_t days;  // bit n = day n
+    uint8_t flags; // CHANGE_ENABLED, CHANGE_LED
+    char time[9];  // as saved, "HH:MM" or "HH:MM:SS"
+    char profile[PROFILE_NAME_LEN];
+};
+
+uint32_t scheduleRevision = 0;
+ScheduleChange scheduleChanges[SCHEDULE_CHANGES];
+uint8_t scheduleChangeHead = 0; // next slot to write
+uint8_t scheduleChangeCount = 0;
+
+const char *const CHANGE_OPS[] = {"add", "edit", "delete"};
+
+// Copies text that can go into a JSON string without escaping
+static void copyPlainText(char *dest, const char *src, size_t size)
+{
+    size_t n = 0;
+    while (src != nullptr && *src != '\0' && n < size - 1)
+    {
+        char c = *src++;
+        if (c >= ' ' && c != '"' && c != '\\')
+            dest[n++] = c;
+    }
+    dest[n] = '\0';
+}
+
+// Stamps the document about to be saved with the next revision
+uint32_t nextScheduleRevision(JsonDocument &schedulesDoc)
+{
+    uint32_t saved = schedulesDoc["revision"] | 0UL;
+    uint32_t revision = (saved > scheduleRevision ? saved : scheduleRevision) + 1;
+    schedulesDoc["revision"] = revision;
+    return revision;
+}
+
+// Picks up the revision stored with schedules.json
+void loadScheduleRevision(JsonDocument &schedulesDoc)
+{
+    uint32_t saved = schedulesDoc["revision"] | 0UL;
+    if (saved > scheduleRevision)
+    {
+        scheduleRevision = saved;
+        scheduleChangeCount = 0; // older deltas don't lead up to this revision
+    }
+}
+
+// Call after the document stamped with revision was saved
+void recordScheduleChange(uint32_t revision, uint8_t op, uint8_t index, JsonObject schedule)
+{
+    if (revision != scheduleRevision + 1)
+        scheduleChangeCount = 0; // gap, keep the ring contiguous
+    scheduleRevision = revision;
+
+    ScheduleChange &change = scheduleChanges[scheduleChangeHead];
+    change.revision = revision;
+    change.op = op;
+    change.index = index;
+    change.days = 0;
+    change.flags = 0;
+    change.time[0] = '\0';
+    change.profile[0] = '\0';
+    if (!schedule.isNull())
+    {
+        for (int day : schedule["days"].as<JsonArray>())
+        {
+            if (day >= 0 && day <= 6)
+                change.days |= 1 << day;
+        }
+        if (schedule["enabled"].as<bool>())
+            change.flags |= CHANGE_ENABLED;
+        if (strcmp(schedule["type"] | "bell", "led") == 0)
+            change.flags |= CHANGE_LED;
+        copyPlainText(change.time, schedule["time"], sizeof(change.time));
+        copyPlainText(change.profile, scheduleProfileName(schedule), sizeof(change.profile));
+    }
+
+    scheduleChangeHead = (scheduleChangeHead + 1) % SCHEDULE_CHANGES;
+    if (scheduleChangeCount < SCHEDULE_CHANGES)
+        scheduleChangeCount++;
+}
+
+// i-th change, oldest first
+const ScheduleChange &scheduleChangeAt(uint8_t i)
+{
+    return scheduleChanges[(scheduleChangeHead + SCHEDULE_CHANGES - scheduleChangeCount + i) % SCHEDULE_CHANGES];
+}
+
+// True if the ring holds every change after since
+bool scheduleChangesCover(uint32_t since)
+{
+    if (since == scheduleRevision)
+        return true;
+    if (since > scheduleRevision || scheduleChangeCount == 0)
+        return false;
+    return scheduleChangeAt(0).revision <= since + 1;
+}
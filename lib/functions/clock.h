@@ -0,0 +1,336 @@
+// ===== Second edge clock =====
+// Keeps the time as "unix second N started at micros() E", so triggers can
+// fire on the DS3231's own second edge instead of whenever a loop pass
+// happens to read a new minute. Units whose RTCs tick together (see sync.h)
+// then ring together to within one loop pass.
+//
+// With SQW_PIN defined (header.h) the RTC's 1 Hz square wave marks every
+// edge in an interrupt. Otherwise, or while the square wave is missing, the
+// edge is predicted from micros(): found once by polling the seconds
+// register, then re-measured every CLOCK_DISCIPLINE_S seconds in a short
+// busy-wait around the predicted edge. Each measurement also corrects how
+// many micros() the ESP counts per RTC second, so the prediction doesn't
+// walk off with the ESP's crystal in between.
+
+#define DS3231_SECONDS_REG 0x00
+#define CLOCK_DISCIPLINE_S 60
+#define CLOCK_WINDOW_US 3000       // half the busy-wait once locked
+#define CLOCK_ACQUIRE_MAX_US 20000 // longest busy-wait while acquiring
+#define CLOCK_POLL_US 1000         // seconds register polling while searching
+#define CLOCK_MAX_MISSES 3         // edges not where predicted before searching again
+#define CLOCK_SQW_TIMEOUT_US 1500000UL
+
+#define CLOCK_NONE 0   // no estimate, searching for an edge
+#define CLOCK_COARSE 1 // edge known to within a loop pass
+#define CLOCK_LOCKED 2 // edge measured to a fraction of a millisecond
+
+struct ClockStats
+{
+    uint32_t locks;
+    uint32_t measurements;
+    uint32_t late;   // arrived after the edge, measured next second
+    uint32_t misses; // edge was not inside the window
+    uint32_t steps;  // clock set by hand or by a peer
+    int32_t lastCorrectionUs;
+    uint32_t maxCorrectionUs;
+    uint32_t sqwEdges;
+};
+
+ClockStats clockStats = {};
+uint8_t clockState = CLOCK_NONE;
+uint32_t clockUnix = 0;   // second that started at clockEdgeUs
+uint32_t clockEdgeUs = 0;
+uint32_t clockUsPerSecond = 1000000UL; // micros() per RTC second
+uint32_t clockMeasuredUnix = 0;        // last second whose edge was measured
+uint32_t clockUncertaintyUs = 0;       // while CLOCK_COARSE
+uint8_t clockMisses = 0;
+
+// Seconds register polling while searching
+int clockLastSecond = -1;
+uint32_t clockLastPollUs = 0;
+
+// Step requested for a given moment (sync.h), 0 = none
+uint32_t clockStepUnix = 0;
+uint32_t clockStepAtUs = 0;
+
+#ifdef SQW_PIN
+volatile uint32_t sqwEdgeCount = 0;
+volatile uint32_t sqwEdgeUs = 0;
+uint32_t sqwSeenCount = 0;
+uint32_t sqwVerifiedUnix = 0; // last edge checked against the registers
+bool sqwActive = false;
+
+// The seconds register turns over on the falling edge
+IRAM_ATTR static void onSqwEdge()
+{
+    sqwEdgeUs = micros();
+    sqwEdgeCount++;
+}
+#endif
+
+static int readRtcSecond()
+{
+    Wire.beginTransmission(DS3231_ADDRESS);
+    Wire.write(DS3231_SECONDS_REG);
+    if (Wire.endTransmission() != 0 || Wire.requestFrom(DS3231_ADDRESS, 1) != 1)
+        return -1;
+    uint8_t bcd = Wire.read();
+    return (bcd >> 4) * 10 + (bcd & 0x0F);
+}
+
+// Call once the RTC answers
+void initSecondClock()
+{
+    clockState = CLOCK_NONE;
+    clockLastSecond = -1;
+#ifdef SQW_PIN
+    rtc.writeSqwPinMode(DS3231_SquareWave1Hz);
+    pinMode(SQW_PIN, INPUT_PULLUP); // SQW is open drain
+    attachInterrupt(digitalPinToInterrupt(SQW_PIN), onSqwEdge, FALLING);
+#endif
+}
+
+bool secondClockValid()
+{
+    return clockState != CLOCK_NONE;
+}
+
+bool secondClockLocked()
+{
+    return clockState == CLOCK_LOCKED;
+}
+
+// Current unix second, valid once secondClockValid()
+uint32_t secondClockNow()
+{
+    return clockUnix;
+}
+
+// For handlers: the second clock once it runs, an RTC read until then,
+// false while the RTC is missing (rtc.now() would return garbage)
+bool currentUnixTime(uint32_t &now)
+{
+    if (secondClockValid())
+        now = secondClockNow();
+    else if (rtcAvailable)
+        now = rtc.now().unixtime();
+    else
+        return false;
+    return true;
+}
+
+// How far into the current second we are
+uint32_t secondClockSinceEdgeUs()
+{
+    return micros() - clockEdgeUs;
+}
+
+// Sets the RTC and restarts its second right now: the DS3231 resets its
+// countdown chain whenever the seconds register is written
+void setClock(const DateTime &time)
+{
+    rtc.adjust(time);
+    clockEdgeUs = micros();
+    clockUnix = time.unixtime();
+    clockMeasuredUnix = clockUnix;
+    clockState = CLOCK_LOCKED;
+    clockMisses = 0;
+    clockStepUnix = 0;
+    clockStats.steps++;
+}
+
+// setClock(unixTime) at micros() == atUs, done by updateSecondClock()
+void setClockAt(uint32_t unixTime, uint32_t atUs)
+{
+    clockStepUnix = unixTime;
+    clockStepAtUs = atUs;
+}
+
+static void lockEdge(uint32_t unixTime, uint32_t edgeUs)
+{
+    if (clockState == CLOCK_LOCKED && unixTime > clockMeasuredUnix && unixTime - clockUnix < CLOCK_DISCIPLINE_S)
+    {
+        // Predicted vs measured, spread over the seconds since the last
+        // measurement, is how far off the rate was. Anything bigger than a
+        // busy-wait is a step, not drift.
+        int32_t errorUs = (int32_t)(edgeUs - (clockEdgeUs + (unixTime - clockUnix) * clockUsPerSecond));
+        uint32_t magnitude = errorUs < 0 ? -errorUs : errorUs;
+        if (magnitude < CLOCK_ACQUIRE_MAX_US)
+        {
+            clockUsPerSecond += errorUs / (int32_t)(unixTime - clockMeasuredUnix);
+            clockStats.lastCorrectionUs = errorUs;
+            if (magnitude > clockStats.maxCorrectionUs)
+                clockStats.maxCorrectionUs = magnitude;
+        }
+    }
+    else if (clockState != CLOCK_LOCKED)
+    {
+        clockStats.locks++;
+    }
+    clockUnix = unixTime;
+    clockEdgeUs = edgeUs;
+    clockMeasuredUnix = unixTime;
+    clockState = CLOCK_LOCKED;
+    clockMisses = 0;
+    clockStats.measurements++;
+}
+
+#define EDGE_FOUND 0
+#define EDGE_LATE 1 // already past when we started looking
+#define EDGE_MISSED 2
+
+// Busy-waits until the seconds register turns over to that second, at most
+// until deadlineUs. The edge is put halfway between the last two reads.
+static uint8_t catchEdge(uint32_t unixTime, uint32_t deadlineUs, uint32_t &edgeUs)
+{
+    int before = (unixTime + 59) % 60;
+    uint32_t previousReadUs = micros();
+    int second = readRtcSecond();
+    if (second == (int)(unixTime % 60))
+        return EDGE_LATE;
+    if (second != before)
+        return EDGE_MISSED;
+
+    while ((int32_t)(micros() - deadlineUs) < 0)
+    {
+        uint32_t readUs = micros();
+        second = readRtcSecond();
+        if (second != before)
+        {
+            edgeUs = previousReadUs + (readUs - previousReadUs) / 2;
+            return second == (int)(unixTime % 60) ? EDGE_FOUND : EDGE_MISSED;
+        }
+        previousReadUs = readUs;
+    }
+    return EDGE_MISSED;
+}
+
+// Moves clockUnix along with micros() between measured edges
+static void advanceSecondClock(uint32_t nowUs)
+{
+    while (nowUs - clockEdgeUs >= clockUsPerSecond)
+    {
+        clockEdgeUs += clockUsPerSecond;
+        clockUnix++;
+    }
+}
+
+// Polls the seconds register every pass until it turns over
+static void searchEdge(uint32_t nowUs)
+{
+    if (clockLastSecond >= 0 && nowUs - clockLastPollUs < CLOCK_POLL_US)
+        return;
+    int second = readRtcSecond();
+    if (second < 0)
+        return;
+    if (clockLastSecond >= 0 && second != clockLastSecond)
+    {
+        // The edge lies between the two polls; good enough to ring by
+        // until the next one is measured properly
+        clockUncertaintyUs = nowUs - clockLastPollUs;
+        clockEdgeUs = clockLastPollUs + clockUncertaintyUs / 2;
+        clockUnix = rtc.now().unixtime();
+        clockState = CLOCK_COARSE;
+    }
+    clockLastSecond = second;
+    clockLastPollUs = nowUs;
+}
+
+static void disciplineEdge(uint32_t nowUs)
+{
+    bool due = clockState == CLOCK_COARSE || clockUnix + 1 - clockMeasuredUnix >= CLOCK_DISCIPLINE_S;
+    if (!due)
+        return;
+
+    uint32_t window = CLOCK_WINDOW_US;
+    if (clockState == CLOCK_COARSE)
+        window = clockUncertaintyUs + CLOCK_WINDOW_US < CLOCK_ACQUIRE_MAX_US / 2 ? clockUncertaintyUs + CLOCK_WINDOW_US
+                                                                              : CLOCK_ACQUIRE_MAX_US / 2;
+    uint32_t predictedUs = clockEdgeUs + clockUsPerSecond;
+    if ((int32_t)(nowUs - (predictedUs - window)) < 0)
+        return; // not yet
+
+    uint32_t edgeUs;
+    uint8_t result = catchEdge(clockUnix + 1, predictedUs + window, edgeUs);
+    if (result == EDGE_FOUND)
+    {
+        lockEdge(clockUnix + 1, edgeUs);
+        return;
+    }
+
+    // Let the prediction carry on into the next second, try again there
+    advanceSecondClock(predictedUs);
+    if (result == EDGE_LATE)
+    {
+        clockStats.late++;
+        return;
+    }
+    clockStats.misses++;
+    if (++clockMisses >= CLOCK_MAX_MISSES)
+    {
+        clockState = CLOCK_NONE; // lost it, search from scratch
+        clockLastSecond = -1;
+    }
+}
+
+#ifdef SQW_PIN
+// True while the square wave is ticking
+static bool followSqw(uint32_t nowUs)
+{
+    noInterrupts();
+    uint32_t count = sqwEdgeCount;
+    uint32_t edgeUs = sqwEdgeUs;
+    interrupts();
+
+    if (count == sqwSeenCount)
+    {
+        if (sqwActive && nowUs - clockEdgeUs > CLOCK_SQW_TIMEOUT_US)
+            sqwActive = false; // fall back to predicting from micros()
+        return sqwActive;
+    }
+
+    uint32_t edges = count - sqwSeenCount;
+    sqwSeenCount = count;
+    clockStats.sqwEdges += edges;
+    uint32_t unixTime = clockUnix + edges;
+    if (!sqwActive || clockState == CLOCK_NONE || unixTime - sqwVerifiedUnix >= CLOCK_DISCIPLINE_S)
+    {
+        // First edge, or time to check the count against the registers
+        uint32_t registers = rtc.now().unixtime();
+        if (sqwActive && clockState != CLOCK_NONE && registers != unixTime)
+            clockStats.misses++;
+        unixTime = registers;
+        sqwVerifiedUnix = unixTime;
+    }
+    lockEdge(unixTime, edgeUs);
+    sqwActive = true;
+    return true;
+}
+#endif
+
+// Runs every loop pass from the realtime trigger task
+void updateSecondClock()
+{
+    if (!rtcAvailable)
+        return;
+    uint32_t nowUs = micros();
+
+    if (clockStepUnix != 0 && (int32_t)(nowUs - clockStepAtUs) >= 0)
+    {
+        setClock(DateTime(clockStepUnix));
+        return;
+    }
+
+#ifdef SQW_PIN
+    if (followSqw(nowUs))
+        return;
+#endif
+
+    if (clockState == CLOCK_NONE)
+    {
+        searchEdge(nowUs);
+        return;
+    }
+    advanceSecondClock(nowUs);
+    disciplineEdge(nowUs);
+}
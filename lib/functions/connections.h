@@ -0,0 +1,138 @@
+// ===== HTTP connection reuse =====
+// The dashboard polls /time and /status every second. With keep-alive the
+// browser sends those down the connection it already has, instead of a TCP
+// handshake and teardown per poll that leaves a control block in TIME_WAIT
+// on the soft AP each time.
+//
+// ESP8266WebServer serves one client at a time: after a response it keeps
+// that connection for HTTP_MAX_CLOSE_WAIT in case another request comes on
+// it, and lets it go as soon as a different client connects. So the idle
+// timeout is the server's, and reuse works best with one dashboard open; the
+// counters below show how often it actually happened. Connections are told
+// apart by remote address and port.
+//
+// Caps: AP_MAX_STATIONS devices may join the soft AP, and at most
+// HTTP_BACKLOG connections wait to be accepted; lwIP refuses the rest
+// instead of holding memory for them.
+
+#ifndef HTTP_MAX_CLOSE_WAIT
+#define HTTP_MAX_CLOSE_WAIT 2000 // ESP8266WebServer.h
+#endif
+#define HTTP_KEEPALIVE_S (HTTP_MAX_CLOSE_WAIT / 1000)
+#define HTTP_BACKLOG 3
+#define AP_MAX_STATIONS 4
+#define MAX_TRACKED_CONNECTIONS 8
+
+struct TrackedConnection
+{
+    uint32_t ip;
+    uint16_t port;
+    uint32_t lastMs; // last request on it
+};
+
+struct ConnectionStats
+{
+    uint32_t requests;
+    uint32_t accepted;       // first request on a connection
+    uint32_t reused;         // every later one
+    uint32_t closeRequested; // client sent "Connection: close"
+    uint8_t live;            // requests within HTTP_MAX_CLOSE_WAIT, at the last one
+    uint8_t maxLive;
+    uint16_t requestsPerSec; // over the last full second
+    uint16_t maxRequestsPerSec;
+    uint32_t heapIdle;      // free heap last seen with no connection live
+    uint32_t heapSamples;   // requests measured against heapIdle
+    uint64_t heapHeldTotal; // heap per live connection, summed over those
+    uint32_t maxHeapHeld;
+};
+
+bool httpKeepAlive = true;
+TrackedConnection trackedConnections[MAX_TRACKED_CONNECTIONS];
+ConnectionStats connectionStats = {};
+uint32_t requestsAtLastSample = 0;
+
+static uint8_t liveConnections(uint32_t nowMs)
+{
+    uint8_t live = 0;
+    for (const TrackedConnection &c : trackedConnections)
+    {
+        if (c.lastMs != 0 && nowMs - c.lastMs < HTTP_MAX_CLOSE_WAIT)
+            live++;
+    }
+    return live;
+}
+
+// Heap a connection holds: what is missing against the idle heap, shared
+// out over the connections live right now. Includes the server's parsed
+// request, which lives exactly as long.
+static void measureConnectionHeap(uint8_t live)
+{
+    uint32_t freeHeap = ESP.getFreeHeap();
+    if (connectionStats.heapIdle == 0 || freeHeap >= connectionStats.heapIdle || live == 0)
+        return;
+    uint32_t held = (connectionStats.heapIdle - freeHeap) / live;
+    connectionStats.heapHeldTotal += held;
+    connectionStats.heapSamples++;
+    if (held > connectionStats.maxHeapHeld)
+        connectionStats.maxHeapHeld = held;
+}
+
+// Before every route handler: counts the request against its connection and
+// decides what the response says about keeping it
+void noteRequest()
+{
+    WiFiClient &client = server.client();
+    uint32_t ip = client.remoteIP();
+    uint16_t port = client.remotePort();
+    uint32_t nowMs = millis();
+    connectionStats.requests++;
+
+    TrackedConnection *slot = nullptr;
+    TrackedConnection *oldest = &trackedConnections[0];
+    for (TrackedConnection &c : trackedConnections)
+    {
+        if (c.lastMs != 0 && c.ip == ip && c.port == port && nowMs - c.lastMs < HTTP_MAX_CLOSE_WAIT)
+        {
+            slot = &c;
+            break;
+        }
+        if (oldest->lastMs != 0 && (c.lastMs == 0 || nowMs - c.lastMs > nowMs - oldest->lastMs))
+            oldest = &c; // an empty slot, else the longest idle
+    }
+
+    if (slot)
+    {
+        connectionStats.reused++;
+    }
+    else
+    {
+        slot = oldest;
+        *slot = {ip, port, 0};
+        connectionStats.accepted++;
+    }
+    slot->lastMs = nowMs ? nowMs : 1;
+
+    uint8_t live = liveConnections(nowMs);
+    connectionStats.live = live;
+    if (live > connectionStats.maxLive)
+        connectionStats.maxLive = live;
+    measureConnectionHeap(live);
+
+    bool closing = server.header("Connection").equalsIgnoreCase("close");
+    if (closing)
+        connectionStats.closeRequested++;
+    ResponseWriter::keepAliveS = httpKeepAlive && !closing ? HTTP_KEEPALIVE_S : 0;
+}
+
+// Once a second from the heap task
+void sampleConnections()
+{
+    uint32_t requests = connectionStats.requests;
+    connectionStats.requestsPerSec = requests - requestsAtLastSample;
+    requestsAtLastSample = requests;
+    if (connectionStats.requestsPerSec > connectionStats.maxRequestsPerSec)
+        connectionStats.maxRequestsPerSec = connectionStats.requestsPerSec;
+
+    if (liveConnections(millis()) == 0)
+        connectionStats.heapIdle = ESP.getFreeHeap();
+}
@@ -0,0 +1,288 @@
+// ===== Bell event log =====
+// Every bell that rang (and every LED switch a schedule or the web made) is
+// kept as an 8-byte record: unix time, schedule, zone, source and how late
+// it rang. Records collect in RAM and the event log task appends them to
+// LittleFS in one write once EVENT_FLUSH_AT have gathered or the oldest is
+// EVENT_FLUSH_MS old, so ringing never waits on flash. A power cut loses at
+// most what was still buffered.
+//
+// On flash the log is a run of segment files, /events/<seq>, each up to
+// EVENT_SEGMENT_RECORDS records (one 4 KB erase block) in time order. A
+// clock set backwards starts a new segment, so every segment stays sorted
+// and /history can binary-search it. Past EVENT_SEGMENTS the oldest segment
+// is removed, once the new one has been written to. Events without a valid clock are counted but not logged, a
+// history entry without a time is no use.
+
+#define EVENT_DIR "/events"
+#define EVENT_SEGMENT_RECORDS 512
+#define EVENT_SEGMENTS 4
+#define EVENT_BUFFER 32
+#define EVENT_FLUSH_AT 16
+#define EVENT_FLUSH_MS 60000UL
+#define EVENT_PATH_LEN 20
+#define EVENT_NO_SCHEDULE 0xFF
+#define EVENT_LATE_MAX 0xFF // lateCs saturates: 2.55 s or later
+
+// Sources
+#define EVENT_SCHEDULE 0
+#define EVENT_CATCHUP 1
+#define EVENT_BUTTON 2
+#define EVENT_WEB 3
+
+// Zones, what was switched
+#define EVENT_ZONE_BELL 0
+#define EVENT_ZONE_LED 1
+
+struct EventRecord
+{
+    uint32_t time;    // unix seconds, local time like the RTC
+    uint8_t schedule; // index in schedules.json, EVENT_NO_SCHEDULE if none
+    uint8_t zone;
+    uint8_t source;
+    uint8_t lateCs; // against the trigger's second, in 10 ms
+};
+static_assert(sizeof(EventRecord) == 8, "event records are 8 bytes on flash");
+
+struct EventSegment
+{
+    uint32_t seq;
+    uint32_t first; // time of the first and last record
+    uint32_t last;
+    uint16_t count;
+    bool sealed; // a write to it came up short, never appended to again
+};
+
+struct EventLogStats
+{
+    uint32_t logged;
+    uint32_t untimed; // no valid clock, not logged
+    uint32_t dropped; // buffer full while flash was failing
+    uint32_t flushes;
+    uint32_t flushFailures;
+    uint32_t rotations;
+    uint32_t lastFlushUs;
+    uint32_t maxFlushUs;
+};
+
+const char *const EVENT_SOURCE_NAMES[] = {"schedule", "catchup", "button", "web"};
+const char *const EVENT_ZONE_NAMES[] = {"bell", "led"};
+
+EventRecord eventBuffer[EVENT_BUFFER];
+uint8_t eventBuffered = 0;
+uint32_t eventOldestMs = 0; // when the oldest buffered record came in
+EventSegment eventSegments[EVENT_SEGMENTS];
+uint8_t eventSegmentCount = 0;
+bool eventLogReady = false;
+EventLogStats eventStats = {};
+
+bool secondClockValid();   // clock.h
+uint32_t secondClockNow(); // clock.h
+
+static void eventSegmentPath(char *out, size_t size, uint32_t seq)
+{
+    snprintf(out, size, EVENT_DIR "/%u", (unsigned)seq);
+}
+
+// Records one event; no flash I/O
+void logEvent(uint8_t zone, uint8_t source, uint8_t schedule = EVENT_NO_SCHEDULE, uint32_t lateUs = 0)
+{
+    if (!secondClockValid())
+    {
+        eventStats.untimed++;
+        return;
+    }
+    if (eventBuffered >= EVENT_BUFFER)
+    {
+        eventStats.dropped++;
+        return;
+    }
+    if (eventBuffered == 0)
+        eventOldestMs = millis();
+    uint32_t lateCs = lateUs / 10000;
+    eventBuffer[eventBuffered++] = {secondClockNow(), schedule, zone, source,
+                                    (uint8_t)(lateCs < EVENT_LATE_MAX ? lateCs : EVENT_LATE_MAX)};
+    eventStats.logged++;
+}
+
+static bool readEventRecord(FlashFile &file, uint16_t index, EventRecord &record)
+{
+    return file.seek(index * sizeof(EventRecord)) &&
+           file.read((uint8_t *)&record, sizeof(record)) == (int)sizeof(record);
+}
+
+// Finds the segments left by the last boot
+static void initEventLog()
+{
+    eventLogReady = true;
+    FlashFS::countAsOne(EVENT_DIR);
+    Dir dir = FlashFS::openDir(EVENT_DIR);
+    while (dir.next())
+    {
+        uint32_t seq = strtoul(dir.fileName().c_str(), nullptr, 10);
+        size_t size = dir.fileSize();
+        if (seq == 0)
+            continue;
+
+        char path[EVENT_PATH_LEN];
+        eventSegmentPath(path, sizeof(path), seq);
+        if (size < sizeof(EventRecord))
+        {
+            // Created by a flush whose write then failed; its seq is reused
+            FlashFS::remove(path);
+            continue;
+        }
+        EventSegment segment = {seq, 0, 0, (uint16_t)(size / sizeof(EventRecord)), size % sizeof(EventRecord) != 0};
+        FlashFile file = FlashFS::open(path, "r");
+        EventRecord record;
+        if (!file || !readEventRecord(file, 0, record))
+            continue;
+        segment.first = record.time;
+        if (!readEventRecord(file, segment.count - 1, record))
+            continue;
+        segment.last = record.time;
+        file.close();
+
+        // Keep the newest EVENT_SEGMENTS in seq order; the rest go
+        uint8_t at = eventSegmentCount;
+        while (at > 0 && eventSegments[at - 1].seq > seq)
+            at--;
+        if (eventSegmentCount == EVENT_SEGMENTS)
+        {
+            if (at == 0)
+            {
+                FlashFS::remove(path);
+                continue;
+            }
+            eventSegmentPath(path, sizeof(path), eventSegments[0].seq);
+            FlashFS::remove(path);
+            memmove(&eventSegments[0], &eventSegments[1], sizeof(EventSegment) * (at - 1));
+            at--;
+        }
+        else
+        {
+            memmove(&eventSegments[at + 1], &eventSegments[at], sizeof(EventSegment) * (eventSegmentCount - at));
+            eventSegmentCount++;
+        }
+        eventSegments[at] = segment;
+    }
+}
+
+// Adds a segment at the end, the oldest removed if there are too many
+static void addEventSegment(const EventSegment &segment)
+{
+    if (eventSegmentCount == EVENT_SEGMENTS)
+    {
+        char path[EVENT_PATH_LEN];
+        eventSegmentPath(path, sizeof(path), eventSegments[0].seq);
+        FlashFS::remove(path);
+        memmove(&eventSegments[0], &eventSegments[1], sizeof(EventSegment) * (EVENT_SEGMENTS - 1));
+        eventSegmentCount--;
+        eventStats.rotations++;
+    }
+    eventSegments[eventSegmentCount++] = segment;
+}
+
+// Appends the buffer, one write per segment it lands in. A new segment is
+// only added, and the oldest only removed for it, once a write to it has
+// stored something: while flash fails (not mounted, full) the records stay
+// buffered for the next pass, on the same segment, and the history on
+// flash is left as it was.
+static void flushEvents()
+{
+    uint32_t start = micros();
+    uint8_t done = 0;
+    while (done < eventBuffered)
+    {
+        const EventRecord &next = eventBuffer[done];
+        EventSegment *current = eventSegmentCount ? &eventSegments[eventSegmentCount - 1] : nullptr;
+        EventSegment segment;
+        if (!current || current->sealed || current->count >= EVENT_SEGMENT_RECORDS || next.time < current->last)
+        {
+            segment = {current ? current->seq + 1 : 1, next.time, next.time, 0, false};
+            current = nullptr;
+        }
+        else
+            segment = *current;
+
+        // The run that fits: in time order and below the segment size
+        uint8_t end = done + 1;
+        while (end < eventBuffered && segment.count + (end - done) < EVENT_SEGMENT_RECORDS &&
+               eventBuffer[end].time >= eventBuffer[end - 1].time)
+            end++;
+
+        char path[EVENT_PATH_LEN];
+        eventSegmentPath(path, sizeof(path), segment.seq);
+        FlashFile file = FlashFS::open(path, "a");
+        size_t bytes = sizeof(EventRecord) * (end - done);
+        size_t written = file ? file.write((const uint8_t *)&eventBuffer[done], bytes) : 0;
+        file.close();
+        if (written > 0)
+        {
+            // Whole records are on flash; a short write leaves a torn or
+            // missing tail, so the segment is sealed and the rest retried
+            // in the next one
+            uint8_t stored = written / sizeof(EventRecord);
+            segment.count += stored;
+            if (stored > 0)
+                segment.last = eventBuffer[done + stored - 1].time;
+            segment.sealed = written < bytes;
+            if (current)
+                *current = segment;
+            else
+                addEventSegment(segment);
+            done += stored;
+        }
+        if (written < bytes)
+        {
+            eventStats.flushFailures++;
+            break;
+        }
+    }
+
+    memmove(&eventBuffer[0], &eventBuffer[done], sizeof(EventRecord) * (eventBuffered - done));
+    eventBuffered -= done;
+    eventOldestMs = millis();
+    eventStats.flushes++;
+    eventStats.lastFlushUs = micros() - start;
+    if (eventStats.lastFlushUs > eventStats.maxFlushUs)
+        eventStats.maxFlushUs = eventStats.lastFlushUs;
+}
+
+// From the event log task
+void flushEventsIfDue()
+{
+    if (!eventLogReady)
+        initEventLog();
+    if (eventBuffered == 0)
+        return;
+    if (eventBuffered >= EVENT_FLUSH_AT || millis() - eventOldestMs >= EVENT_FLUSH_MS)
+        flushEvents();
+}
+
+// Index of the first record at or after from in a segment (binary search,
+// one 8-byte read per step); count if there is none
+uint16_t findEventIndex(FlashFile &file, const EventSegment &segment, uint32_t from)
+{
+    uint16_t low = 0;
+    uint16_t high = segment.count;
+    while (low < high)
+    {
+        uint16_t middle = low + (high - low) / 2;
+        EventRecord record;
+        if (!readEventRecord(file, middle, record))
+            return segment.count;
+        if (record.time < from)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+uint32_t loggedEventCount()
+{
+    uint32_t total = 0;
+    for (uint8_t i = 0; i < eventSegmentCount; i++)
+        total += eventSegments[i].count;
+    return total;
+}
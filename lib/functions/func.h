@@ -1,26 +1,108 @@
-// Global variable to track last triggered time to prevent multiple triggers
-String lastTriggeredTime = "";
+#include <calendar.h>
+#include <events.h>
+#include <profiles.h>
+#include <changes.h>
+#include <catchup.h>
+#include <upcoming.h>
+#include <watchdog.h>
+#include <connections.h>
+#include <admission.h>
+#include <monitor.h>
+#include <wire.h>
 
-// Global variables for schedule caching
-DynamicJsonDocument *cachedSchedulesDoc = nullptr;
+// Last minute (since 1970) checkSchedules() has processed, 0 = unknown
+uint32_t lastProcessedMinute = 0;
+
+// Set once schedules.json has been compiled into trigger tables; until then
+// the build-time defaults ring
 bool schedulesCacheValid = false;
 
+// Gap seen while the defaults stood in, caught up once schedules.json is in
+uint32_t pendingCatchUpFrom = 0;
+uint32_t pendingCatchUpTo = 0;
+
+// millis() at boot milestones, for /metrics
+struct BootTimes
+{
+    uint32_t defaultsReadyMs;  // build-time table active, bells can ring
+    uint32_t setupDoneMs;
+    uint32_t schedulesReadyMs; // schedules.json compiled
+    uint32_t webReadyMs;       // routes registered, server listening
+};
+
+BootTimes bootTimes = {0, 0, 0, 0};
+
+// Each step of setup(), in the order it ran
+#define MAX_BOOT_PHASES 10
+
+struct BootPhase
+{
+    const char *name;
+    uint32_t startUs;
+    uint32_t durationUs;
+};
+
+BootPhase bootPhases[MAX_BOOT_PHASES];
+uint8_t bootPhaseCount = 0;
+
+void timeBootPhase(const char *name, void (*step)())
+{
+    FlashFS::setCaller("setup", name);
+    uint32_t start = micros();
+    step();
+    uint32_t duration = micros() - start;
+    FlashFS::setCaller(nullptr);
+    if (bootPhaseCount < MAX_BOOT_PHASES)
+        bootPhases[bootPhaseCount++] = {name, start, duration};
+}
+
+// False while the DS3231 doesn't answer: no scheduled bells, the web UI and
+// manual bell still work
+bool rtcAvailable = false;
+Timer rtcRetryTimer(10UL); // seconds
+
+#include <clock.h>
+#include <triggers.h>
+#include <ringing.h>
+
+#include <sync.h>
+#include <power.h>
+#include <cache.h>
+
 void initLittleFS()
 {
-    if (!LittleFS.begin())
+    if (!FlashFS::begin())
     {
         dbgln("LittleFS initialization failed!");
         return;
     }
     dbgln("LittleFS initialized successfully!");
+
+    // Finish or roll back any save a power cut interrupted
+    Persist::recover("/config.json");
+    Persist::recover("/schedules.json");
+    Persist::recover(CALENDAR_PATH);
+
+#if DEBUG_SERIAL
+    // Walks every file, so only when someone is watching
     dbgln("Files on LittleFS:");
-    Dir dir = LittleFS.openDir("/"); // Root directory
+    Dir dir = FlashFS::openDir("/"); // Root directory
     while (dir.next())
     {
         dbg(dir.fileName());
         dbg("  \t");
         dbgln(dir.fileSize());
     }
+#endif
+}
+
+// The RTC answered, pick up where the last boot left off
+static void rtcFound()
+{
+    rtcAvailable = true;
+    // Where checkSchedules() left off before this boot
+    lastProcessedMinute = loadProcessedMinute();
+    initSecondClock();
 }
 
 void RtcSetup()
@@ -41,193 +123,200 @@ void RtcSetup()
 
     if (!rtc.begin())
     {
-        dbgln("Couldn't find RTC");
-        while (1)
-            ;
+        dbgln("Couldn't find RTC, retrying in the background");
+        return;
     }
+
+    rtcFound();
     // rtc.adjust(DateTime(F(__DATE__), F(__TIME__)));
 }
 
-// Function to load schedules into cache
+// Function to compile schedules.json into the trigger tables
 void loadSchedulesToCache()
 {
-    // Free existing cache if it exists
-    if (cachedSchedulesDoc != nullptr)
+    if (!Persist::exists("/schedules.json"))
     {
-        delete cachedSchedulesDoc;
-        cachedSchedulesDoc = nullptr;
+        dbgln("No schedules file found");
+        installSchedules(JsonArray()); // nothing to ring, but don't retry every loop
+        schedulesCacheValid = true;
+        return;
     }
 
-    // Read schedules from flash memory
-    File file = LittleFS.open("/schedules.json", "r");
-    if (!file)
+    // Read schedules from flash memory; the arena is only needed while
+    // compiling, the tables keep what the loop uses
+    JsonArenaLease lease(jsonArena);
+    if (!lease)
     {
-        schedulesCacheValid = false;
-        dbgln("No schedules file found");
-        return; // No schedules file
+        return; // a handler holds the arena, try again next loop
     }
-
-    String jsonData = file.readString();
-    file.close();
-
-    // Allocate new document on heap
-    cachedSchedulesDoc = new DynamicJsonDocument(16384);
-    DeserializationError error = deserializeJson(*cachedSchedulesDoc, jsonData);
-
-    if (error)
+    JsonDocument &schedulesDoc = *lease;
+    if (!Persist::load("/schedules.json", schedulesDoc))
     {
-        dbgln("Failed to parse schedules.json");
-        delete cachedSchedulesDoc;
-        cachedSchedulesDoc = nullptr;
+        dbgln("No intact copy of schedules.json");
         schedulesCacheValid = false;
         return;
     }
 
+    installSchedules(schedulesDoc["schedules"]);
+    loadScheduleRevision(schedulesDoc);
     schedulesCacheValid = true;
     dbgln("Schedules loaded to cache successfully");
 }
 
-// Function to initialize schedules cache (call in setup)
+// Schedules for the first loop (call in setup); schedules.json follows from
+// a task, see loadScheduleOverrides()
 void initSchedulesCache()
 {
-    loadSchedulesToCache();
+    installDefaultSchedules();
+    bootTimes.defaultsReadyMs = millis();
+}
+
+void fireTrigger(const Trigger &trigger)
+{
+    if (trigger.type == TRIGGER_BELL)
+    {
+        dbgln("Ringing bell for schedule #" + String(trigger.index));
+        bell.on();
+    }
+    else
+    {
+        dbgln("Turning LED off for schedule #" + String(trigger.index));
+        led.off();
+    }
 }
 
 void checkSchedules()
 {
-    if (!led.isOn())
+    // Degraded mode: keep probing for the RTC instead of hanging
+    if (!rtcAvailable)
     {
+        if (rtcRetryTimer.clause() && rtc.begin())
+        {
+            dbgln("RTC found");
+            rtcFound();
+        }
         return;
     }
 
-    // Check if cache is valid
-    if (!schedulesCacheValid || cachedSchedulesDoc == nullptr)
+    // Time from the second clock, no I2C read per pass; until it has found
+    // the RTC's second edge there is nothing to arm against
+    if (!secondClockValid())
     {
-        dbgln("Schedules cache invalid, reloading...");
-        loadSchedulesToCache();
-        return; // No valid schedules to check
+        return;
     }
-
-    // Get current time
-    DateTime now = rtc.now();
+    DateTime now(secondClockNow());
     int currentYear = now.year();
-    dbgln("Current year: " + String(currentYear));
     if (currentYear < 2025 || currentYear > 2060)
     {
         dbgln("Invalid year detected: " + String(currentYear) + ". Skipping schedule check.");
         return;
     }
-    int currentDayOfWeek = now.dayOfTheWeek(); // 0 = Sunday, 1 = Monday, etc.
-    currentDayOfWeek++;
-    if (currentDayOfWeek == 7)
-        currentDayOfWeek = 0;
-    String currentTime = "";
-    if (now.hour() < 10)
-        currentTime += "0";
-    currentTime += String(now.hour());
-    currentTime += ":";
-    if (now.minute() < 10)
-        currentTime += "0";
-    currentTime += String(now.minute());
-
-    dbgln("Current time: " + currentTime + " Day of week: " + String(currentDayOfWeek));
-    // Prevent multiple triggers in the same minute
-    if (currentTime == lastTriggeredTime)
+
+    // Each minute's triggers are armed during the minute before, so the ones
+    // on its first second fire right on the edge (see triggers.h)
+    uint32_t minuteStamp = now.unixtime() / 60;
+    if (armedThroughMinute > minuteStamp)
     {
         return;
     }
+    uint32_t previousMinute = lastProcessedMinute;
+    lastProcessedMinute = minuteStamp;
+    saveProcessedMinute(minuteStamp);
 
-    // Check each schedule using cached document
-    JsonArray schedules = (*cachedSchedulesDoc)["schedules"];
-    for (JsonObject schedule : schedules)
+    if (armedThroughMinute < minuteStamp)
     {
-        // Check if schedule is enabled
-        if (!schedule["enabled"].as<bool>())
-        {
-            continue;
-        }
-
-        // Check if current day is in the schedule
-        JsonArray days = schedule["days"];
-        bool dayMatches = false;
-        for (int day : days)
+        // Booted, stalled across minute boundaries or the clock changed. Minutes
+        // armed before the stall still fire late from the armed list; the ones
+        // never armed are caught up. A switched-off period never counts as missed.
+        uint32_t handled = armedThroughMinute > previousMinute ? armedThroughMinute : previousMinute;
+        if (previousMinute != 0 && minuteStamp > handled + 1 && led.isOn())
         {
-            if (day == currentDayOfWeek)
+            if (schedulesCacheValid)
             {
-                dayMatches = true;
-                break;
+                catchUpMissed(handled + 1, minuteStamp - 1);
             }
-        }
-
-        if (!dayMatches)
-        {
-            continue;
-        }
-
-        // Check if current time matches schedule time
-        const char *scheduleTime = schedule["time"];
-        if (strcmp(scheduleTime, currentTime.c_str()) == 0)
-        {
-            // Time matches! Ring the bell
-            const char *type = schedule["type"];
-            if (strcmp(type, "bell") == 0)
-            {
-                dbg("Ringing bell at scheduled time: ");
-                dbgln(scheduleTime);
-                bell.on();
-                lastTriggeredTime = currentTime; // Mark this time as triggered
-            }
-            else if (strcmp(type, "led") == 0)
+            else
             {
-                dbg("Toggling LED at scheduled time: ");
-                dbgln(scheduleTime);
-                led.off();
-                lastTriggeredTime = currentTime; // Mark this time as triggered
+                // Judge the gap against the real schedule, not the defaults
+                pendingCatchUpFrom = handled + 1;
+                pendingCatchUpTo = minuteStamp - 1;
             }
         }
+
+        // The last boot may have got part way through this minute already
+        armMinute(minuteStamp, previousMinute == minuteStamp ? now.second() : 0);
     }
+    armMinute(minuteStamp + 1, 0);
 }
 
-void controlDevices()
+// Replaces the defaults with schedules.json, retried until it succeeds
+void loadScheduleOverrides()
 {
-    led.loop();
-    bell.loop();
-    checkSchedules(); // Add schedule checking
+    if (schedulesCacheValid)
+    {
+        return;
+    }
+    loadSchedulesToCache();
+    if (!schedulesCacheValid)
+    {
+        return;
+    }
+    bootTimes.schedulesReadyMs = millis();
+
+    if (pendingCatchUpTo != 0 && led.isOn())
+    {
+        catchUpMissed(pendingCatchUpFrom, pendingCatchUpTo);
+    }
+    pendingCatchUpTo = 0;
 }
 
 void applySavedConfig()
 {
-    StaticJsonDocument<256> cfg;
-    File f = LittleFS.open("/config.json", "r");
-    if (f)
-    {
-        String c = f.readString();
-        f.close();
-        DeserializationError e = deserializeJson(cfg, c);
-        if (e)
-        {
-            cfg.clear();
-        }
-    }
+    StaticJsonDocument<512> cfg;
+    Persist::load("/config.json", cfg); // leaves cfg empty if there is no intact copy
 
     // Bell duration
     unsigned long bellDurationMs = cfg.containsKey("bellDurationMs") ? cfg["bellDurationMs"].as<unsigned long>() : 3000UL;
     bell.setDuration(bellDurationMs);
 
+    // Bell off edge from hardware timer 1 rather than the loop (ringing.h)
+    bell.setTimedOff(cfg["bellTimer"] | true);
+
+    // How late a bell missed during a reboot or stall may still ring
+    catchUpMaxLateMin = cfg.containsKey("catchUpMaxLateMin") ? cfg["catchUpMaxLateMin"].as<unsigned long>() : 5UL;
+
+    // Loop phases running longer than this are logged as stalls
+    stallThresholdMs = cfg.containsKey("stallThresholdMs") ? cfg["stallThresholdMs"].as<unsigned long>() : 500UL;
+
+    // Keep HTTP connections open between requests (connections.h)
+    httpKeepAlive = cfg["httpKeepAlive"] | true;
+
+    // Doze between triggers while nobody is connected (power.h)
+    uint8_t mode = cfg["powerSave"] | POWER_OFF;
+    powerMode = mode < POWER_MODES ? mode : POWER_OFF;
+
+    // Campus network shared with the other bell units, the key their
+    // packets are signed with, and when this clock was last set by hand
+    // (see sync.h)
+    strlcpy(syncSsid, cfg["syncSsid"] | "", sizeof(syncSsid));
+    strlcpy(syncPassword, cfg["syncPassword"] | "", sizeof(syncPassword));
+    setSyncKey(cfg["syncKey"] | "");
+    timeSetAt = cfg["timeSetAt"] | 0UL;
+
+    // Active schedule profile (selected once the schedules are compiled)
+    const char *profile = cfg["activeProfile"] | DEFAULT_PROFILE;
+    strncpy(activeProfileName, profile, PROFILE_NAME_LEN - 1);
+    activeProfileName[PROFILE_NAME_LEN - 1] = '\0';
+
     // LED last state
     bool ledOn = cfg.containsKey("ledOn") ? cfg["ledOn"].as<bool>() : false;
-    if (ledOn)
-    {
-        led.on();
-    }
-    else
-    {
-        led.off();
-    }
+    led.restore(ledOn); // no write back of what was just read
 }
 
 void showTime()
 {
+#if DEBUG_SERIAL
+    // The time is only read for someone watching the serial port
     DateTime now = rtc.now();
 
     //   if (rtc.lostPower()) {
@@ -247,5 +336,8 @@ void showTime()
     dbg(':');
     dbg(now.second(), DEC);
     dbgln();
+#endif
 }
+#include <assets.h>
 #include <webPage.h>
+#include <tasks.h>
@@ -0,0 +1,108 @@
+// ===== Heap and route monitor =====
+// Free heap, largest free block and fragmentation are sampled by a background
+// task once a second (one heap walk) and their low/high-water marks kept since boot. Every route
+// registered through route() also records its call count, slowest run, and
+// the heap it left behind, so a handler that leaks or fragments shows up by
+// name in /metrics, and how many of its requests admission.h turned away.
+
+#define MAX_ROUTES 32
+
+struct HeapStats
+{
+    uint32_t freeHeap;
+    uint32_t minFreeHeap;
+    uint32_t maxFreeBlock;
+    uint32_t minMaxFreeBlock;
+    uint8_t fragmentation;    // percent
+    uint8_t maxFragmentation; // percent
+};
+
+struct RouteStats
+{
+    const char *path;
+    uint32_t calls;
+    uint32_t maxUs;
+    uint32_t totalUs;      // wraps, for differences between reads
+    uint32_t minFreeHeap;  // lowest free heap seen right after the handler
+    uint32_t maxHeapDrop;  // most heap the handler ever kept across a call
+    uint32_t minFreeBlock; // smallest largest-free-block after the handler
+    uint8_t admitClass;    // see admission.h
+    uint32_t shed;         // answered 503 instead of running the handler
+};
+
+HeapStats heapStats = {0, UINT32_MAX, 0, UINT32_MAX, 0, 0};
+RouteStats routeStats[MAX_ROUTES];
+uint8_t routeCount = 0;
+
+void sampleHeap()
+{
+    uint32_t freeHeap;
+    uint32_t maxFreeBlock;
+    uint8_t fragmentation;
+    ESP.getHeapStats(&freeHeap, &maxFreeBlock, &fragmentation);
+
+    heapStats.freeHeap = freeHeap;
+    heapStats.maxFreeBlock = maxFreeBlock;
+    heapStats.fragmentation = fragmentation;
+    if (freeHeap < heapStats.minFreeHeap)
+        heapStats.minFreeHeap = freeHeap;
+    if (maxFreeBlock < heapStats.minMaxFreeBlock)
+        heapStats.minMaxFreeBlock = maxFreeBlock;
+    if (fragmentation > heapStats.maxFragmentation)
+        heapStats.maxFragmentation = fragmentation;
+}
+
+static void runRoute(uint8_t slot, void (*handler)())
+{
+    RouteStats &stats = routeStats[slot];
+    noteRequest();
+    uint32_t retryS = admitRequest(stats.admitClass);
+    if (retryS)
+    {
+        stats.shed++;
+        sendShed(retryS);
+        return;
+    }
+
+    uint32_t heapBefore = ESP.getFreeHeap();
+    unsigned long start = micros();
+
+    enterPhase("handleClient", stats.path);
+    handler();
+    exitPhase();
+
+    uint32_t elapsed = micros() - start;
+    uint32_t heapAfter = ESP.getFreeHeap();
+    uint32_t freeBlock = ESP.getMaxFreeBlockSize();
+
+    stats.calls++;
+    stats.totalUs += elapsed;
+    if (elapsed > stats.maxUs)
+        stats.maxUs = elapsed;
+    if (heapAfter < stats.minFreeHeap)
+        stats.minFreeHeap = heapAfter;
+    if (heapBefore > heapAfter && heapBefore - heapAfter > stats.maxHeapDrop)
+        stats.maxHeapDrop = heapBefore - heapAfter;
+    if (freeBlock < stats.minFreeBlock)
+        stats.minFreeBlock = freeBlock;
+}
+
+// server.on() with per-route accounting and admission control
+void route(const char *path, HTTPMethod method, void (*handler)(), uint8_t admitClass = ADMIT_API)
+{
+    if (routeCount >= MAX_ROUTES)
+    {
+        server.on(path, method, handler); // still served, just not tracked
+        return;
+    }
+
+    uint8_t slot = routeCount++;
+    routeStats[slot] = {path, 0, 0, 0, UINT32_MAX, 0, UINT32_MAX, admitClass, 0};
+    server.on(path, method, [slot, handler]()
+              { runRoute(slot, handler); });
+}
+
+void route(const char *path, void (*handler)(), uint8_t admitClass = ADMIT_API)
+{
+    route(path, HTTP_ANY, handler, admitClass);
+}
@@ -0,0 +1,287 @@
+// ===== Power saving =====
+// Overnight and at weekends nothing can ring for hours, yet the loop spins
+// and the soft AP beacons all day. With power saving on, once no phone has
+// been on the AP for POWER_IDLE_S and the next trigger (findUpcomingEvents)
+// is at least POWER_MIN_DOZE_S away, the unit dozes: the radio goes off
+// until POWER_GUARD_S before that trigger, or for at most POWER_MAX_DOZE_S.
+// Then the AP comes back for at least POWER_AP_WINDOW_S so a phone can join,
+// and the unit dozes again if nobody does.
+//
+// POWER_MODEM only turns the radio off; the loop keeps running, so buttons,
+// the second clock and the bells work exactly as when awake. POWER_LIGHT
+// also stops the CPU in forced light sleep, in slices of at most
+// POWER_SLICE_S with the RTC read in between, since the ESP's sleep timer
+// runs off an RC oscillator. A button (LED or bell, on a GPIO that can wake
+// the chip) ends the doze. With SQW_PIN wired the DS3231 alarm ends it on
+// the RTC's own minute, so the slices can be longer. After light sleep the
+// second clock starts over from the RTC registers.
+//
+// A doze never spans a trigger: it needs nothing armed (dozeBlocker) and
+// ends POWER_GUARD_S before the next one, more than a light sleep slice can
+// overrun by. lastProcessedMinute stays where it was while the CPU sleeps,
+// so the first checkSchedules() after the wake sees the dozed minutes as a
+// gap and catchUpMissed() scans them. They hold no trigger, so nothing rings
+// from the scan. The minute with the next trigger is armed from second 0 as
+// usual and fires once, on its edge. If a doze ever did overrun that edge,
+// the trigger's minute is either the current one, armed and fired late
+// once, or lies in the gap and is caught up per catchUpMaxLateMin. It is
+// never processed twice, since no minute past the doze start was.
+
+#define POWER_OFF 0
+#define POWER_MODEM 1 // radio off
+#define POWER_LIGHT 2 // radio off, CPU in light sleep
+#define POWER_MODES 3
+
+#define POWER_GUARD_S 30 // awake before a trigger: clock locked, minute armed
+#define POWER_MIN_DOZE_S 120
+#define POWER_MAX_DOZE_S 900 // AP back at least this often...
+#define POWER_AP_WINDOW_S 60 // ...for this long
+#define POWER_IDLE_S 120     // since the last HTTP request
+#define POWER_SLICE_S 60     // light sleep between RTC reads
+#define POWER_ALARM_SLICE_S 240 // with the DS3231 alarm as backstop; one sleep may last up to 268 s
+#define POWER_LOOKAHEAD 4
+
+#define WAKE_TIMER 0 // doze over: trigger near or AP interval up
+#define WAKE_BUTTON 1
+#define WAKE_ALARM 2
+#define WAKE_REASONS 3
+
+struct PowerStats
+{
+    uint32_t sinceUnix; // first valid clock, duty cycles count from here
+    uint32_t dozes;
+    uint32_t slices; // light sleeps
+    uint32_t wakes[WAKE_REASONS];
+    uint32_t radioOffS;   // RTC seconds with the AP down
+    uint32_t lightSleepS; // of those, with the CPU asleep
+    uint32_t lastDozeS;
+    uint32_t maxRadioUpUs; // bringing the AP back
+};
+
+const char *const POWER_MODE_NAMES[POWER_MODES] = {"off", "modem", "light"};
+const char *const WAKE_REASON_NAMES[WAKE_REASONS] = {"timer", "button", "alarm"};
+
+uint8_t powerMode = POWER_OFF;
+bool radioOff = false;
+uint32_t dozeStartUnix = 0;
+uint32_t dozeEndUnix = 0;        // AP back at this RTC second
+uint32_t apUpSinceMs = 0;        // last time the AP came (back) up
+uint32_t lastRequestMs = 0;      // last seen connectionStats.requests change
+uint32_t requestsSeen = 0;
+bool ledOnAtDoze = false;
+int32_t nextEventS = -1;         // from the last check, -1 = none in range
+const char *powerBlocker = "off"; // why the unit isn't dozing, nullptr while it is
+PowerStats powerStats = {};
+
+void WifiSetup(); // webPage.h
+
+// Seconds from nowUnix to the next trigger, -1 if none within the horizon
+static int32_t secondsToNextEvent(uint32_t nowUnix)
+{
+    UpcomingEvent events[POWER_LOOKAHEAD];
+    uint8_t count = findUpcomingEvents(nowUnix / 60, events, POWER_LOOKAHEAD);
+    for (uint8_t i = 0; i < count; i++)
+    {
+        // The current minute's earlier seconds have fired already
+        uint32_t at = events[i].minute * 60 + events[i].trigger->second;
+        if (at >= nowUnix)
+            return at - nowUnix;
+    }
+    return count < POWER_LOOKAHEAD ? -1 : 0; // a minute full of passed triggers: stay up
+}
+
+// What keeps the unit awake right now, nullptr if it may doze for windowS
+static const char *dozeBlocker(uint32_t nowMs, uint32_t &windowS)
+{
+    if (powerMode == POWER_OFF)
+        return "off";
+    if (!rtcAvailable || !secondClockValid() || !schedulesCacheValid || pendingCatchUpFrom != 0)
+        return "starting";
+    if (WiFi.softAPgetStationNum() > 0)
+        return "stations";
+    if (nowMs - lastRequestMs < POWER_IDLE_S * 1000UL)
+        return "requests";
+    if (nowMs - apUpSinceMs < POWER_AP_WINDOW_S * 1000UL)
+        return "ap window";
+    if (bell.isOn() || armedCount > 0 || clockStepUnix != 0)
+        return "busy";
+
+    nextEventS = secondsToNextEvent(secondClockNow());
+    windowS = POWER_MAX_DOZE_S;
+    if (nextEventS >= 0 && (uint32_t)nextEventS < POWER_MAX_DOZE_S + POWER_GUARD_S)
+        windowS = nextEventS > POWER_GUARD_S ? nextEventS - POWER_GUARD_S : 0;
+    if (windowS < POWER_MIN_DOZE_S)
+        return "event soon";
+    return nullptr;
+}
+
+static void radioDown(uint32_t windowS)
+{
+    // Nothing buffered may sit out the doze; a power cut then loses nothing
+    if (eventLogReady && eventBuffered > 0)
+        flushEvents();
+    led.persist();
+
+    WiFi.mode(WIFI_OFF);
+    if (powerMode == POWER_MODEM)
+        WiFi.forceSleepBegin();
+    radioOff = true;
+    dozeStartUnix = secondClockNow();
+    dozeEndUnix = dozeStartUnix + windowS;
+    ledOnAtDoze = led.isOn();
+    powerStats.dozes++;
+}
+
+static void radioUp(uint8_t reason, uint32_t nowUnix)
+{
+    uint32_t start = micros();
+    if (powerMode == POWER_MODEM)
+        WiFi.forceSleepWake();
+    WifiSetup();
+    uint32_t elapsed = micros() - start;
+    if (elapsed > powerStats.maxRadioUpUs)
+        powerStats.maxRadioUpUs = elapsed;
+
+    radioOff = false;
+    powerStats.wakes[reason]++;
+    powerStats.lastDozeS = nowUnix > dozeStartUnix ? nowUnix - dozeStartUnix : 0;
+    powerStats.radioOffS += powerStats.lastDozeS;
+    apUpSinceMs = millis();
+}
+
+static bool buttonHeld()
+{
+    return (led.hasButton() && digitalRead(led.btn()) == LOW) || (bell.hasButton() && digitalRead(bell.btn()) == LOW);
+}
+
+// From the power task: decides when to doze, and ends a modem doze
+void powerLoop()
+{
+    uint32_t nowMs = millis();
+    if (connectionStats.requests != requestsSeen)
+    {
+        requestsSeen = connectionStats.requests;
+        lastRequestMs = nowMs;
+    }
+    if (powerStats.sinceUnix == 0 && secondClockValid())
+        powerStats.sinceUnix = secondClockNow();
+
+    if (radioOff)
+    {
+        // Light sleep is handled from loop(); in a modem doze the loop runs
+        // on, and a button shows as the LED or bell it switched
+        if (powerMode == POWER_MODEM && (led.isOn() != ledOnAtDoze || bell.isOn()))
+            radioUp(WAKE_BUTTON, secondClockNow());
+        else if (powerMode == POWER_MODEM && secondClockNow() >= dozeEndUnix)
+            radioUp(WAKE_TIMER, secondClockNow());
+        return;
+    }
+
+    uint32_t windowS = 0;
+    powerBlocker = dozeBlocker(nowMs, windowS);
+    if (powerBlocker == nullptr)
+        radioDown(windowS);
+}
+
+#ifdef SQW_PIN
+// The INT/SQW pin goes low at the end of the doze instead of every second.
+// DS3231 registers: alarm 1 (0x07-0x0A) holds the catch-up marker
+// (catchup.h) and must keep A1IE off, so the wake uses alarm 2 (0x0B-0x0D)
+// only. Alarm 2 has no seconds: it fires at the start of the doze's last
+// minute, which only ends the doze early by less than a minute.
+static void armWakeAlarm()
+{
+    detachInterrupt(digitalPinToInterrupt(SQW_PIN));
+    rtc.clearAlarm(2);
+    rtc.writeSqwPinMode(DS3231_OFF);
+    rtc.setAlarm2(DateTime(dozeEndUnix - dozeEndUnix % 60), DS3231_A2_Date);
+}
+
+static void disarmWakeAlarm()
+{
+    rtc.clearAlarm(2);
+    rtc.disableAlarm(2); // initSecondClock() brings the square wave back
+}
+#endif
+
+// One forced light sleep, cut short by a wake GPIO going low
+static void lightSleep(uint32_t seconds)
+{
+    if (led.hasButton())
+        gpio_pin_wakeup_enable(GPIO_ID_PIN(led.btn()), GPIO_PIN_INTR_LOLEVEL);
+    if (bell.hasButton())
+        gpio_pin_wakeup_enable(GPIO_ID_PIN(bell.btn()), GPIO_PIN_INTR_LOLEVEL);
+#ifdef SQW_PIN
+    gpio_pin_wakeup_enable(GPIO_ID_PIN(SQW_PIN), GPIO_PIN_INTR_LOLEVEL);
+#endif
+    ESP.forcedLightSleepBegin(seconds * 1000000UL);
+    delay(seconds * 1000UL + 1); // where the CPU actually sleeps
+    ESP.forcedLightSleepEnd();
+    gpio_pin_wakeup_disable();
+}
+
+// The RTC's time, 0 if the DS3231 doesn't answer; rtc.now() alone would
+// return whatever the failed read left
+static uint32_t rtcUnixNow()
+{
+    Wire.beginTransmission(DS3231_ADDRESS);
+    if (Wire.endTransmission() != 0)
+    {
+        rtcAvailable = false; // checkSchedules() probes for it again
+        return 0;
+    }
+    return rtc.now().unixtime();
+}
+
+// From loop(), outside the task loop so the sleep doesn't count as a slow
+// pass: sleeps a light doze through to its end, or until the RTC is lost
+void lightSleepIfDozing()
+{
+    if (!radioOff || powerMode != POWER_LIGHT)
+        return;
+
+    uint32_t sliceS = POWER_SLICE_S;
+#ifdef SQW_PIN
+    armWakeAlarm();
+    sliceS = POWER_ALARM_SLICE_S;
+#endif
+    uint8_t reason = WAKE_TIMER;
+    uint32_t nowUnix = rtcUnixNow();
+    while (nowUnix != 0 && nowUnix < dozeEndUnix)
+    {
+        lightSleep(dozeEndUnix - nowUnix < sliceS ? dozeEndUnix - nowUnix : sliceS);
+        powerStats.slices++;
+        uint32_t after = rtcUnixNow();
+        if (after == 0)
+            break; // no clock to sleep by: wake, the loop runs degraded
+        powerStats.lightSleepS += after > nowUnix ? after - nowUnix : 0;
+        nowUnix = after;
+        if (buttonHeld())
+        {
+            reason = WAKE_BUTTON;
+            break;
+        }
+#ifdef SQW_PIN
+        if (rtc.alarmFired(2))
+        {
+            reason = WAKE_ALARM;
+            break;
+        }
+#endif
+    }
+#ifdef SQW_PIN
+    disarmWakeAlarm();
+#endif
+
+    initSecondClock(); // micros() stood still
+    radioUp(reason, nowUnix);
+}
+
+// Permille of the time since powerStats.sinceUnix spent outside offS
+uint32_t dutyPermille(uint32_t offS)
+{
+    uint32_t elapsed = secondClockValid() && powerStats.sinceUnix ? secondClockNow() - powerStats.sinceUnix : 0;
+    if (elapsed == 0 || offS >= elapsed)
+        return elapsed ? 0 : 1000;
+    return 1000 - (uint64_t)offS * 1000 / elapsed;
+}
@@ -0,0 +1,303 @@
+// ===== Schedule profiles =====
+// Every entry in /schedules.json may carry a "profile" name (default "normal").
+// Each profile is compiled into a small trigger table sorted by time, so the
+// loop never walks JSON. Tables are built into the spare half of a double
+// buffer and published by swapping a single pointer; switching profiles by hand
+// or from the calendar is just another pointer swap.
+
+#define MAX_SCHEDULES 50
+#define MAX_PROFILES 8
+#define PROFILE_NAME_LEN 16
+#define DEFAULT_PROFILE "normal"
+
+#define TRIGGER_BELL 0
+#define TRIGGER_LED 1
+
+struct Trigger
+{
+    uint16_t minute; // minute of the day
+    uint8_t second;  // within the minute, "HH:MM:SS" entries
+    uint8_t days;    // bit n set = day n (0 = Sat ... 6 = Fri)
+    uint8_t type;    // TRIGGER_BELL or TRIGGER_LED
+    uint8_t index;   // position in schedules.json
+};
+
+struct ProfileTable
+{
+    char name[PROFILE_NAME_LEN];
+    const Trigger *triggers; // enabled entries only, sorted by minute and second
+    uint8_t count;
+};
+
+struct ScheduleSet
+{
+    Trigger triggers[MAX_SCHEDULES];
+    uint8_t triggerCount;
+    ProfileTable profiles[MAX_PROFILES];
+    uint8_t profileCount;
+};
+
+ScheduleSet scheduleSets[2];
+ScheduleSet *currentSet = nullptr;
+
+// The only thing checkSchedules() reads; always points into a complete set
+const ProfileTable *volatile activeTable = nullptr;
+char activeProfileName[PROFILE_NAME_LEN] = DEFAULT_PROFILE;
+
+static const ProfileTable EMPTY_PROFILE = {DEFAULT_PROFILE, nullptr, 0};
+
+static const char *scheduleProfileName(JsonObject schedule)
+{
+    const char *name = schedule["profile"];
+    return (name == nullptr || name[0] == '\0') ? DEFAULT_PROFILE : name;
+}
+
+// "HH:MM" -> minute of day, -1 if malformed
+static int parseScheduleMinute(const char *time)
+{
+    if (time == nullptr || strlen(time) < 5 || time[2] != ':')
+        return -1;
+    int hour = atoi(time);
+    int minute = atoi(time + 3);
+    if (hour < 0 || hour > 23 || minute < 0 || minute > 59)
+        return -1;
+    return hour * 60 + minute;
+}
+
+// Seconds of "HH:MM:SS", 0 for "HH:MM", -1 if malformed
+static int parseScheduleSecond(const char *time)
+{
+    size_t length = strlen(time);
+    if (length == 5)
+        return 0;
+    if (length < 8 || time[5] != ':')
+        return -1;
+    int second = atoi(time + 6);
+    return (second < 0 || second > 59) ? -1 : second;
+}
+
+static const ProfileTable *findProfileIn(const ScheduleSet *set, const char *name)
+{
+    if (set == nullptr || name == nullptr)
+        return nullptr;
+    for (uint8_t i = 0; i < set->profileCount; i++)
+    {
+        if (strncmp(set->profiles[i].name, name, PROFILE_NAME_LEN - 1) == 0)
+            return &set->profiles[i];
+    }
+    return nullptr;
+}
+
+const ProfileTable *findProfile(const char *name)
+{
+    return findProfileIn(currentSet, name);
+}
+
+// Distinct profile names in schedules, the default included, stopping
+// once there are more than fit in a ScheduleSet
+uint8_t countScheduleProfiles(JsonArray schedules)
+{
+    const char *names[MAX_PROFILES + 1] = {DEFAULT_PROFILE};
+    uint8_t count = 1;
+    for (JsonObject schedule : schedules)
+    {
+        const char *name = scheduleProfileName(schedule);
+        uint8_t i = 0;
+        while (i < count && strncmp(names[i], name, PROFILE_NAME_LEN - 1) != 0)
+            i++;
+        if (i < count)
+            continue;
+        names[count++] = name;
+        if (count > MAX_PROFILES)
+            break;
+    }
+    return count;
+}
+
+// Profiles past MAX_PROFILES get no table; the add and edit handlers refuse
+// a list that would need one (countScheduleProfiles)
+static void compileScheduleSet(JsonArray schedules, ScheduleSet &set)
+{
+    set.triggerCount = 0;
+    set.profileCount = 0;
+
+    // Profile names in order of first appearance; the default always exists
+    strcpy(set.profiles[set.profileCount++].name, DEFAULT_PROFILE);
+    for (JsonObject schedule : schedules)
+    {
+        const char *name = scheduleProfileName(schedule);
+        if (findProfileIn(&set, name) == nullptr && set.profileCount < MAX_PROFILES)
+        {
+            ProfileTable &p = set.profiles[set.profileCount++];
+            strncpy(p.name, name, PROFILE_NAME_LEN - 1);
+            p.name[PROFILE_NAME_LEN - 1] = '\0';
+        }
+    }
+
+    // One contiguous, minute-sorted run of triggers per profile
+    for (uint8_t p = 0; p < set.profileCount; p++)
+    {
+        ProfileTable &profile = set.profiles[p];
+        uint8_t start = set.triggerCount;
+
+        int index = -1;
+        for (JsonObject schedule : schedules)
+        {
+            index++;
+            if (!schedule["enabled"].as<bool>())
+                continue;
+            if (strncmp(scheduleProfileName(schedule), profile.name, PROFILE_NAME_LEN - 1) != 0)
+                continue;
+            if (set.triggerCount >= MAX_SCHEDULES)
+                break;
+
+            const char *time = schedule["time"];
+            int minute = parseScheduleMinute(time);
+            int second = minute < 0 ? -1 : parseScheduleSecond(time);
+            if (second < 0)
+                continue;
+
+            const char *type = schedule["type"] | "bell";
+            Trigger t;
+            t.minute = minute;
+            t.second = second;
+            t.type = strcmp(type, "led") == 0 ? TRIGGER_LED : TRIGGER_BELL;
+            t.index = index;
+            t.days = 0;
+            for (int day : schedule["days"].as<JsonArray>())
+            {
+                if (day >= 0 && day <= 6)
+                    t.days |= 1 << day;
+            }
+
+            // Insertion sort, at most MAX_SCHEDULES entries
+            int pos = set.triggerCount;
+            while (pos > start && (set.triggers[pos - 1].minute > t.minute ||
+                                   (set.triggers[pos - 1].minute == t.minute && set.triggers[pos - 1].second > t.second)))
+            {
+                set.triggers[pos] = set.triggers[pos - 1];
+                pos--;
+            }
+            set.triggers[pos] = t;
+            set.triggerCount++;
+        }
+
+        profile.triggers = set.triggers + start;
+        profile.count = set.triggerCount - start;
+    }
+}
+
+void updateSyncDigest(JsonArray schedules); // sync.h
+void rearmTriggers();                        // triggers.h
+
+// Points activeTable at the named profile of the current set
+bool selectProfile(const char *name)
+{
+    const ProfileTable *table = findProfile(name);
+    if (table == nullptr)
+        return false;
+
+    strncpy(activeProfileName, table->name, PROFILE_NAME_LEN - 1);
+    activeProfileName[PROFILE_NAME_LEN - 1] = '\0';
+    activeTable = table; // single pointer swap
+    rearmTriggers();
+    return true;
+}
+
+static ScheduleSet *spareScheduleSet()
+{
+    return (currentSet == &scheduleSets[0]) ? &scheduleSets[1] : &scheduleSets[0];
+}
+
+static void publishScheduleSet(ScheduleSet *set)
+{
+    const ProfileTable *table = findProfileIn(set, activeProfileName);
+    if (table == nullptr)
+        table = &set->profiles[0]; // profile vanished, fall back to default
+
+    currentSet = set;
+    activeTable = table;
+    rearmTriggers();
+}
+
+// Compiles schedules into the spare buffer, then publishes it
+void installSchedules(JsonArray schedules)
+{
+    ScheduleSet *spare = spareScheduleSet();
+    compileScheduleSet(schedules, *spare);
+    publishScheduleSet(spare);
+    updateSyncDigest(schedules);
+    dbgln("Schedules compiled: " + String(spare->triggerCount) + " triggers, " + String(spare->profileCount) + " profiles");
+}
+
+// Profile of the build-time table, see tools/default_schedules.py
+struct DefaultProfile
+{
+    char name[PROFILE_NAME_LEN];
+    uint8_t start; // into DEFAULT_TRIGGERS
+    uint8_t count;
+};
+
+#if __has_include(<default_schedules.h>)
+#include <default_schedules.h>
+#else
+#define DEFAULT_TRIGGER_COUNT 0
+#define DEFAULT_PROFILE_COUNT 1
+constexpr Trigger DEFAULT_TRIGGERS[] PROGMEM = {{0, 0, 0, TRIGGER_BELL, 0}};
+constexpr DefaultProfile DEFAULT_PROFILES[] PROGMEM = {{DEFAULT_PROFILE, 0, 0}};
+#endif
+
+// Publishes the schedule compiled into flash from data/schedules.json; no
+// LittleFS or JSON involved, so bells are right from the first loop
+void installDefaultSchedules()
+{
+    ScheduleSet *spare = spareScheduleSet();
+    memcpy_P(spare->triggers, DEFAULT_TRIGGERS, sizeof(Trigger) * DEFAULT_TRIGGER_COUNT);
+    spare->triggerCount = DEFAULT_TRIGGER_COUNT;
+    spare->profileCount = DEFAULT_PROFILE_COUNT;
+    for (uint8_t p = 0; p < DEFAULT_PROFILE_COUNT; p++)
+    {
+        DefaultProfile profile;
+        memcpy_P(&profile, &DEFAULT_PROFILES[p], sizeof(profile));
+        memcpy(spare->profiles[p].name, profile.name, PROFILE_NAME_LEN);
+        spare->profiles[p].triggers = spare->triggers + profile.start;
+        spare->profiles[p].count = profile.count;
+    }
+    publishScheduleSet(spare);
+}
+
+// Index of the first trigger at or after minuteOfDay
+int firstTriggerAt(const ProfileTable *table, int minuteOfDay)
+{
+    int lo = 0;
+    int hi = table->count;
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (table->triggers[mid].minute < minuteOfDay)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// Day numbering used by schedules.json: 0 = Saturday ... 6 = Friday
+int scheduleDayOfWeek(const DateTime &date)
+{
+    int day = date.dayOfTheWeek() + 1; // RTClib: 0 = Sunday
+    return day == 7 ? 0 : day;
+}
+
+// Table to use for a calendar day kind (see calendar.h)
+const ProfileTable *profileForDay(uint8_t dayKind)
+{
+    const ProfileTable *table = activeTable;
+    if (dayKind != CAL_SCHOOL_DAY && dayKind != CAL_HOLIDAY)
+    {
+        const ProfileTable *override = findProfile(calendarKindName(dayKind));
+        if (override != nullptr)
+            table = override;
+    }
+    return table != nullptr ? table : &EMPTY_PROFILE;
+}
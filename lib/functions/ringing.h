@@ -0,0 +1,44 @@
+// ===== Bell off timing =====
+// How long past its duration each bell rang before it went off by itself,
+// with the off edge timed by hardware timer 1 (Bell::setTimedOff) or by the
+// loop. The loop only sees a bell go off when deviceTask() gets a turn, so a
+// slow flash write or HTTP client makes it late. Timer 1 is not held up. The
+// deviceTask() reads each automatic off into a histogram per mode for
+// /metrics; a bell switched off by hand doesn't count.
+
+#define OVERRUN_BUCKETS 9
+
+#define BELL_OFF_LOOP 0
+#define BELL_OFF_TIMER 1
+#define BELL_OFF_MODES 2
+
+struct BellOffStats
+{
+    uint32_t offs;
+    uint32_t maxOverrunUs;
+    uint32_t overrun[OVERRUN_BUCKETS]; // see OVERRUN_BOUNDS_MS
+};
+
+// Upper bounds of the overrun buckets, the last one takes the rest
+const uint16_t OVERRUN_BOUNDS_MS[OVERRUN_BUCKETS - 1] = {1, 2, 5, 10, 50, 100, 500, 2000};
+
+const char *const BELL_OFF_MODE_NAMES[BELL_OFF_MODES] = {"loop", "timer"};
+
+BellOffStats bellOffStats[BELL_OFF_MODES] = {};
+
+// From deviceTask(), after bell.loop()
+void recordBellOff()
+{
+    uint32_t overrunUs;
+    if (!bell.takeAutoOff(overrunUs))
+        return;
+
+    BellOffStats &stats = bellOffStats[bell.getTimedOff() ? BELL_OFF_TIMER : BELL_OFF_LOOP];
+    stats.offs++;
+    if (overrunUs > stats.maxOverrunUs)
+        stats.maxOverrunUs = overrunUs;
+    uint8_t bucket = 0;
+    while (bucket < OVERRUN_BUCKETS - 1 && overrunUs >= OVERRUN_BOUNDS_MS[bucket] * 1000UL)
+        bucket++;
+    stats.overrun[bucket]++;
+}
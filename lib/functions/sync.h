@@ -0,0 +1,511 @@
+// ===== Schedule replication =====
+// Units that join a shared network (config "syncSsid") keep one schedule list
+// and one clock. Each node multicasts a small beacon with its schedule
+// revision, a digest of the list and its clock. Beacons follow a Trickle timer
+// (RFC 6206): while everyone agrees the interval doubles up to SYNC_IMAX_MS,
+// and a node stays quiet once it has heard SYNC_REDUNDANCY matching beacons in
+// the current interval, so the traffic stays about constant however many
+// units there are. Any disagreement, or a new list on this unit, drops the
+// interval back to SYNC_IMIN_MS.
+//
+// Schedules: last writer wins by revision. Equal revisions with different
+// lists are settled by the higher digest, whose owner re-stamps revision + 1.
+// The newer node sends its whole list (one packet, MAX_SCHEDULES at most)
+// after a random delay, and holds back if another node sends the same list
+// first.
+//
+// Clock: nodes follow whoever had the time set by hand most recently
+// (timeSetAt), ties going to the lowest node id. Beacons carry how far into
+// its second the sender is (clock.h), so a follower more than
+// SYNC_PHASE_TOLERANCE_MS off writes the leader's next second into its RTC
+// right on the leader's edge, and their bells ring together. The follower
+// reads its own phase when it handles the beacon, so the sync task runs on
+// every pass next to HTTP (tasks.h): a beacon left waiting would set its
+// edge that much late.
+//
+// The campus network is shared, so nothing is taken on trust: every packet
+// ends in a SipHash-2-4 MAC over header and records under a key every unit
+// is given with the network (config "syncKey", 32 hex digits), and
+// replication stays off until there is one. Even a keyed packet is dropped
+// if its revision is more than SYNC_MAX_REVISION_STEP past ours, so one bad
+// list can't push revisions to where they wrap and no local edit wins
+// again, or if its clock was set by hand later than the time it reports,
+// which would make its sender leader for good.
+//
+// tools/sync_sim.py runs it on units of the native build.
+
+#define SYNC_PORT 4210
+#define SYNC_MAGIC 0x32534253 // "SBS2", with the MAC
+#define SYNC_BEACON 1
+#define SYNC_SNAPSHOT 2
+#define SYNC_IMIN_MS 2000UL
+#define SYNC_IMAX_MS 64000UL
+#define SYNC_REDUNDANCY 2
+#define SYNC_SNAPSHOT_DELAY_MS 500
+#define SYNC_MAX_PEERS 8
+#define SYNC_PEER_TIMEOUT_MS 300000UL
+#define SYNC_PHASE_UNKNOWN 0xFFFF
+#define SYNC_PHASE_TOLERANCE_MS 20
+#define SYNC_MAX_REVISION_STEP 10000UL // edits made while a unit was away
+#define SYNC_MAC_SIZE 8
+
+struct __attribute__((packed)) SyncHeader
+{
+    uint32_t magic;
+    uint8_t type;  // SYNC_BEACON or SYNC_SNAPSHOT
+    uint8_t count; // snapshot records that follow
+    uint16_t phaseMs; // into the sender's second, SYNC_PHASE_UNKNOWN until locked
+    uint32_t node;    // sender's chip id
+    uint32_t revision;
+    uint32_t digest;    // CRC-32 of the records
+    uint32_t unixTime;  // sender's RTC, 0 if it has none
+    uint32_t timeSetAt; // unix time someone last set a clock by hand
+};
+
+struct __attribute__((packed)) SyncRecord
+{
+    char time[9];
+    uint8_t days;  // bit n = day n
+    uint8_t flags; // CHANGE_ENABLED, CHANGE_LED
+    char profile[PROFILE_NAME_LEN];
+    uint8_t reserved;
+};
+
+#define SYNC_PACKET_SIZE (sizeof(SyncHeader) + MAX_SCHEDULES * sizeof(SyncRecord) + SYNC_MAC_SIZE)
+static_assert(SYNC_PACKET_SIZE <= 1472, "a snapshot must fit one UDP packet");
+
+struct SyncStats
+{
+    uint32_t beaconsSent;
+    uint32_t beaconsSuppressed;
+    uint32_t snapshotsSent;
+    uint32_t snapshotsSuppressed;
+    uint32_t received;
+    uint32_t rejected;        // bad magic, size or digest, or fields out of bounds
+    uint32_t unauthenticated; // MAC doesn't match our key
+    uint32_t adopted;
+    uint32_t conflicts;
+    uint32_t timeAdjusts;
+    uint32_t bytesSent;
+};
+
+struct SyncPeer
+{
+    uint32_t node;
+    uint32_t revision;
+    uint32_t lastSeenMs;
+};
+
+const IPAddress SYNC_GROUP(239, 255, 66, 66);
+
+char syncSsid[33] = "";
+char syncPassword[65] = "";
+uint8_t syncKey[SIPHASH_KEY_SIZE];
+bool syncKeySet = false;
+uint32_t timeSetAt = 0;
+uint32_t scheduleDigest = 0;
+
+SyncStats syncStats = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+SyncPeer syncPeers[SYNC_MAX_PEERS];
+uint8_t syncPeerCount = 0;
+uint8_t clockOffBeacons = 0; // leader beacons in a row outside the tolerance
+
+WiFiUDP syncUdp;
+bool syncStarted = false;
+uint8_t syncPacket[SYNC_PACKET_SIZE];
+
+// Trickle timer
+uint32_t trickleIntervalMs = SYNC_IMIN_MS;
+uint32_t trickleStartMs = 0;
+uint32_t trickleFireMs = 0; // into the interval
+uint8_t trickleHeard = 0;
+bool trickleFired = false;
+
+bool snapshotPending = false;
+uint32_t snapshotDueMs = 0;
+
+static void fillSyncRecord(SyncRecord &record, JsonObject schedule)
+{
+    memset(&record, 0, sizeof(record));
+    copyPlainText(record.time, schedule["time"], sizeof(record.time));
+    copyPlainText(record.profile, scheduleProfileName(schedule), sizeof(record.profile));
+    for (int day : schedule["days"].as<JsonArray>())
+    {
+        if (day >= 0 && day <= 6)
+            record.days |= 1 << day;
+    }
+    if (schedule["enabled"].as<bool>())
+        record.flags |= CHANGE_ENABLED;
+    if (strcmp(schedule["type"] | "bell", "led") == 0)
+        record.flags |= CHANGE_LED;
+}
+
+void trickleReset();
+
+// Called by installSchedules() for every list that goes live
+void updateSyncDigest(JsonArray schedules)
+{
+    uint32_t crc = 0;
+    uint8_t n = 0;
+    for (JsonObject schedule : schedules)
+    {
+        if (n++ >= MAX_SCHEDULES)
+            break;
+        SyncRecord record;
+        fillSyncRecord(record, schedule);
+        crc = Persist::crc32Update(crc, (const uint8_t *)&record, sizeof(record));
+    }
+    // A new list is news to the others (RFC 6206): beacon again soon, not at
+    // the end of what may be a 64 s interval
+    if (syncStarted && crc != scheduleDigest)
+        trickleReset();
+    scheduleDigest = crc;
+}
+
+static void trickleNewInterval(uint32_t now)
+{
+    trickleStartMs = now;
+    trickleFireMs = trickleIntervalMs / 2 + random(trickleIntervalMs / 2);
+    trickleHeard = 0;
+    trickleFired = false;
+}
+
+// Something disagrees: beacon again soon
+void trickleReset()
+{
+    if (trickleIntervalMs == SYNC_IMIN_MS)
+        return; // already at the fastest rate
+    trickleIntervalMs = SYNC_IMIN_MS;
+    trickleNewInterval(millis());
+}
+
+static void fillSyncHeader(SyncHeader &header, uint8_t type, uint8_t count)
+{
+    header.magic = SYNC_MAGIC;
+    header.type = type;
+    header.count = count;
+    uint32_t sinceEdgeMs = secondClockSinceEdgeUs() / 1000;
+    header.phaseMs = !secondClockLocked() ? SYNC_PHASE_UNKNOWN : sinceEdgeMs > 999 ? 999 : sinceEdgeMs;
+    header.node = ESP.getChipId();
+    header.revision = scheduleRevision;
+    header.digest = scheduleDigest;
+    header.unixTime = rtcAvailable && secondClockValid() ? secondClockNow() : 0;
+    header.timeSetAt = timeSetAt;
+}
+
+// Takes the key from config text; replication is off without a valid one
+void setSyncKey(const char *hex)
+{
+    syncKeySet = SipHash::parseKey(hex, syncKey);
+}
+
+// MAC over length bytes of syncPacket, written after them; the new length
+static size_t signSyncPacket(size_t length)
+{
+    uint64_t mac = SipHash::mac(syncKey, syncPacket, length);
+    memcpy(syncPacket + length, &mac, SYNC_MAC_SIZE);
+    return length + SYNC_MAC_SIZE;
+}
+
+static void sendSyncPacket(size_t length)
+{
+    length = signSyncPacket(length);
+    syncUdp.beginPacketMulticast(SYNC_GROUP, SYNC_PORT, WiFi.localIP());
+    syncUdp.write(syncPacket, length);
+    if (syncUdp.endPacket())
+        syncStats.bytesSent += length;
+}
+
+static void sendBeacon()
+{
+    fillSyncHeader(*(SyncHeader *)syncPacket, SYNC_BEACON, 0);
+    sendSyncPacket(sizeof(SyncHeader));
+    syncStats.beaconsSent++;
+}
+
+static void sendSnapshot()
+{
+    JsonArenaLease lease(jsonArena);
+    if (!lease)
+        return; // stays pending
+    JsonDocument &schedulesDoc = *lease;
+    if (!Persist::load("/schedules.json", schedulesDoc))
+    {
+        snapshotPending = false;
+        return;
+    }
+
+    SyncRecord *records = (SyncRecord *)(syncPacket + sizeof(SyncHeader));
+    uint8_t count = 0;
+    for (JsonObject schedule : schedulesDoc["schedules"].as<JsonArray>())
+    {
+        if (count >= MAX_SCHEDULES)
+            break;
+        fillSyncRecord(records[count++], schedule);
+    }
+    fillSyncHeader(*(SyncHeader *)syncPacket, SYNC_SNAPSHOT, count);
+    sendSyncPacket(sizeof(SyncHeader) + count * sizeof(SyncRecord));
+    syncStats.snapshotsSent++;
+    snapshotPending = false;
+}
+
+static void scheduleSnapshot()
+{
+    if (snapshotPending)
+        return;
+    snapshotPending = true;
+    snapshotDueMs = millis() + random(SYNC_SNAPSHOT_DELAY_MS);
+}
+
+// Writes a received list as schedules.json at the sender's revision
+static void adoptSnapshot(const SyncHeader &header, const SyncRecord *records)
+{
+    JsonArenaLease lease(jsonArena);
+    if (!lease)
+        return; // the next snapshot will do
+    JsonDocument &schedulesDoc = *lease;
+    JsonArray schedules = schedulesDoc.createNestedArray("schedules");
+    for (uint8_t i = 0; i < header.count; i++)
+    {
+        const SyncRecord &record = records[i];
+        JsonObject schedule = schedules.createNestedObject();
+        schedule["time"] = record.time;
+        JsonArray days = schedule.createNestedArray("days");
+        for (uint8_t day = 0; day < 7; day++)
+        {
+            if (record.days & (1 << day))
+                days.add(day);
+        }
+        schedule["enabled"] = (record.flags & CHANGE_ENABLED) != 0;
+        schedule["type"] = (record.flags & CHANGE_LED) ? "led" : "bell";
+        if (strcmp(record.profile, DEFAULT_PROFILE) != 0)
+            schedule["profile"] = record.profile;
+    }
+    schedulesDoc["revision"] = header.revision;
+
+    if (!Persist::save("/schedules.json", schedulesDoc))
+        return;
+    installSchedules(schedules);
+    loadScheduleRevision(schedulesDoc); // clients resync with a snapshot
+    syncStats.adopted++;
+    dbgln("Adopted schedules revision " + String(header.revision) + " from node " + String(header.node));
+}
+
+// Equal revisions, different lists, and ours wins: move past both
+static void restampSchedules()
+{
+    JsonArenaLease lease(jsonArena);
+    if (!lease)
+        return;
+    JsonDocument &schedulesDoc = *lease;
+    if (!Persist::load("/schedules.json", schedulesDoc))
+        return;
+    nextScheduleRevision(schedulesDoc);
+    if (Persist::save("/schedules.json", schedulesDoc))
+        loadScheduleRevision(schedulesDoc);
+}
+
+// Our clock now shows the leader's setting; taken only then, as our own
+// beacons would otherwise report a clock set later than they read
+static void adoptTimeSetAt(uint32_t setAt)
+{
+    if (setAt == timeSetAt)
+        return;
+    timeSetAt = setAt;
+    trickleReset();
+}
+
+static void followClock(const SyncHeader &header)
+{
+    if (header.unixTime == 0 || !rtcAvailable || !secondClockValid())
+        return;
+    bool newer = header.timeSetAt > timeSetAt ||
+                 (header.timeSetAt == timeSetAt && header.node < ESP.getChipId());
+    if (!newer)
+        return;
+
+    int32_t offset = (int32_t)(header.unixTime - secondClockNow());
+    if (offset < -60 || offset > 60)
+    {
+        setClock(DateTime(header.unixTime));
+        lastProcessedMinute = 0; // a clock change is not a missed-bell gap
+        disarmTriggers();
+        adoptTimeSetAt(header.timeSetAt);
+        syncStats.timeAdjusts++;
+        return;
+    }
+
+    // Whole seconds only, unless both sides know where their edge is
+    bool phased = header.phaseMs != SYNC_PHASE_UNKNOWN && secondClockLocked();
+    int32_t offsetMs = offset * 1000;
+    int32_t tolerance = 1000;
+    if (phased)
+    {
+        offsetMs += (int32_t)header.phaseMs - (int32_t)(secondClockSinceEdgeUs() / 1000);
+        tolerance = SYNC_PHASE_TOLERANCE_MS;
+    }
+    if (offsetMs >= -tolerance && offsetMs <= tolerance)
+    {
+        clockOffBeacons = 0;
+        adoptTimeSetAt(header.timeSetAt);
+        return;
+    }
+
+    // Multicast may wait in the access point for a beacon interval, which
+    // makes the leader look late; only act on the second packet in a row
+    if (phased && ++clockOffBeacons < 2)
+        return;
+    clockOffBeacons = 0;
+
+    if (phased)
+        setClockAt(header.unixTime + 1, micros() + (1000UL - header.phaseMs) * 1000UL);
+    else
+        setClock(DateTime(header.unixTime));
+    adoptTimeSetAt(header.timeSetAt);
+    syncStats.timeAdjusts++;
+}
+
+static void notePeer(const SyncHeader &header, uint32_t now)
+{
+    uint8_t slot = syncPeerCount;
+    for (uint8_t i = 0; i < syncPeerCount; i++)
+    {
+        if (syncPeers[i].node == header.node)
+        {
+            slot = i;
+            break;
+        }
+        if (now - syncPeers[i].lastSeenMs > SYNC_PEER_TIMEOUT_MS)
+            slot = i; // reuse unless the node is further down
+    }
+    if (slot == SYNC_MAX_PEERS)
+        return;
+    if (slot == syncPeerCount)
+        syncPeerCount++;
+    syncPeers[slot] = {header.node, header.revision, now};
+}
+
+static void handleSyncPacket(size_t length)
+{
+    const SyncHeader &header = *(const SyncHeader *)syncPacket;
+    const SyncRecord *records = (const SyncRecord *)(syncPacket + sizeof(SyncHeader));
+    if (length < sizeof(SyncHeader) + SYNC_MAC_SIZE || header.magic != SYNC_MAGIC || header.count > MAX_SCHEDULES ||
+        length != sizeof(SyncHeader) + header.count * sizeof(SyncRecord) + SYNC_MAC_SIZE)
+    {
+        syncStats.rejected++;
+        return;
+    }
+    length -= SYNC_MAC_SIZE;
+    uint64_t mac;
+    memcpy(&mac, syncPacket + length, SYNC_MAC_SIZE);
+    if (mac != SipHash::mac(syncKey, syncPacket, length))
+    {
+        syncStats.unauthenticated++;
+        return;
+    }
+    if ((header.unixTime != 0 && header.timeSetAt > header.unixTime) ||
+        (header.revision > scheduleRevision && header.revision - scheduleRevision > SYNC_MAX_REVISION_STEP))
+    {
+        syncStats.rejected++;
+        return;
+    }
+    if (header.node == ESP.getChipId())
+        return; // our own multicast
+    if (header.type == SYNC_SNAPSHOT)
+    {
+        SyncRecord *writable = (SyncRecord *)(syncPacket + sizeof(SyncHeader));
+        uint32_t crc = 0;
+        for (uint8_t i = 0; i < header.count; i++)
+        {
+            writable[i].time[sizeof(writable[i].time) - 1] = '\0';
+            writable[i].profile[sizeof(writable[i].profile) - 1] = '\0';
+            crc = Persist::crc32Update(crc, (const uint8_t *)&writable[i], sizeof(SyncRecord));
+        }
+        if (crc != header.digest)
+        {
+            syncStats.rejected++;
+            return;
+        }
+    }
+    syncStats.received++;
+    notePeer(header, millis());
+    followClock(header);
+
+    bool sameList = header.revision == scheduleRevision && header.digest == scheduleDigest;
+    bool theirsNewer = header.revision > scheduleRevision ||
+                       (header.revision == scheduleRevision && header.digest > scheduleDigest);
+    if (sameList)
+    {
+        if (header.timeSetAt == timeSetAt)
+            trickleHeard++;
+        if (header.type == SYNC_SNAPSHOT && snapshotPending)
+        {
+            snapshotPending = false; // someone else already sent it
+            syncStats.snapshotsSuppressed++;
+        }
+        return;
+    }
+
+    trickleReset();
+    if (theirsNewer)
+    {
+        if (header.type == SYNC_SNAPSHOT)
+            adoptSnapshot(header, records);
+        return; // wait for their snapshot
+    }
+
+    if (header.revision == scheduleRevision)
+    {
+        syncStats.conflicts++;
+        restampSchedules();
+    }
+    scheduleSnapshot();
+}
+
+// Joins the campus network next to the access point, see WifiSetup()
+void beginSyncNetwork()
+{
+    if (syncSsid[0] == '\0')
+        return;
+    WiFi.mode(WIFI_AP_STA);
+    WiFi.begin(syncSsid, syncPassword);
+}
+
+// Sync task: starts once the network is up and schedules.json is in
+void syncLoop()
+{
+    if (!syncStarted)
+    {
+        if (syncSsid[0] == '\0' || !syncKeySet || WiFi.status() != WL_CONNECTED || !schedulesCacheValid)
+            return;
+        syncUdp.beginMulticast(WiFi.localIP(), SYNC_GROUP, SYNC_PORT);
+        syncStarted = true;
+        trickleIntervalMs = SYNC_IMIN_MS;
+        trickleNewInterval(millis());
+    }
+
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        int length = syncUdp.parsePacket();
+        if (length <= 0)
+            break;
+        handleSyncPacket(syncUdp.read(syncPacket, sizeof(syncPacket)));
+    }
+
+    uint32_t now = millis();
+    if (!trickleFired && now - trickleStartMs >= trickleFireMs)
+    {
+        trickleFired = true;
+        if (trickleHeard < SYNC_REDUNDANCY)
+            sendBeacon();
+        else
+            syncStats.beaconsSuppressed++;
+    }
+    if (now - trickleStartMs >= trickleIntervalMs)
+    {
+        trickleIntervalMs = trickleIntervalMs * 2 > SYNC_IMAX_MS ? SYNC_IMAX_MS : trickleIntervalMs * 2;
+        trickleNewInterval(now);
+    }
+    if (snapshotPending && (int32_t)(now - snapshotDueMs) >= 0)
+        sendSnapshot();
+}
@@ -0,0 +1,122 @@
+// ===== Main loop tasks =====
+// What loop() runs, by priority class: due triggers, bell and LED first, then
+// the schedule check, then HTTP, then flash writes and diagnostics. See
+// TaskLoop.h. Each task names its watchdog phase; routes add their path inside
+// "handleClient".
+//
+// Only file streams give the loop back part way (fileStreamTask). A route
+// handler still runs to completion inside "http", and a Persist save inside
+// "persist", so either can hold up everything below the real-time tasks.
+// test/test_deadlines holds the real-time tasks' lateness to one HTTP turn
+// while eight clients load the page.
+
+bool triggerTask()
+{
+    PhaseScope phase("triggers");
+    updateSecondClock();
+    fireDueTriggers();
+    return false;
+}
+
+bool deviceTask()
+{
+    PhaseScope phase("devices");
+    led.loop();
+    bell.loop();
+    recordBellOff();
+    if (bell.takeButtonPress())
+        logEvent(EVENT_ZONE_BELL, EVENT_BUTTON);
+    return false;
+}
+
+bool scheduleTask()
+{
+    PhaseScope phase("checkSchedules");
+    checkSchedules();
+    return false;
+}
+
+bool scheduleFileTask()
+{
+    PhaseScope phase("loadSchedulesToCache");
+    loadScheduleOverrides();
+    return false;
+}
+
+bool httpTask()
+{
+    PhaseScope phase("handleClient");
+    static bool started = false; // not webReadyMs, millis() may still be 0
+    if (!started)
+    {
+        startWebServer(); // first pass after setup()
+        started = true;
+    }
+    server.handleClient(); // handle incoming client requests
+    return false;
+}
+
+bool fileStreamTask()
+{
+    PhaseScope phase("fileStreams");
+    return continueFileStreams();
+}
+
+bool persistTask()
+{
+    PhaseScope phase("LED::persist flash write");
+    led.persist();
+    return false;
+}
+
+bool eventLogTask()
+{
+    PhaseScope phase("flushEvents");
+    flushEventsIfDue();
+    return false;
+}
+
+bool syncTask()
+{
+    PhaseScope phase("syncLoop");
+    syncLoop();
+    return false;
+}
+
+bool powerTask()
+{
+    PhaseScope phase("powerLoop");
+    powerLoop();
+    return false;
+}
+
+bool heapTask()
+{
+    PhaseScope phase("sampleHeap");
+    sampleHeap();
+    sampleConnections();
+    return false;
+}
+
+static void addTask(const char *name, TaskFunction function, TaskPriority priority, uint32_t periodMs,
+                    uint32_t budgetUs)
+{
+    if (!taskLoop.add(name, function, priority, periodMs, budgetUs))
+        dbgln("Task table full (MAX_TASKS), " + String(name) + " will not run");
+}
+
+void initTasks()
+{
+    // name, function, class, period (ms), budget per pass (us)
+    addTask("triggers", triggerTask, TASK_REALTIME, 0, 7000); // edge busy-wait once a minute
+    addTask("devices", deviceTask, TASK_REALTIME, 0, 500);
+    addTask("schedules", scheduleTask, TASK_SCHEDULING, 100, 5000);
+    addTask("scheduleFile", scheduleFileTask, TASK_SCHEDULING, 1000, 50000);
+    addTask("http", httpTask, TASK_HTTP, 0, 20000);
+    addTask("fileStreams", fileStreamTask, TASK_HTTP, 0, 10000);
+    addTask("sync", syncTask, TASK_HTTP, 0, 20000); // a beacon's phase is read as it's handled
+    addTask("persist", persistTask, TASK_BACKGROUND, 1000, 50000);
+    addTask("eventLog", eventLogTask, TASK_BACKGROUND, 1000, 50000);
+    addTask("heap", heapTask, TASK_BACKGROUND, 1000, 2000);
+    addTask("power", powerTask, TASK_BACKGROUND, 1000, 5000);
+}
@@ -0,0 +1,179 @@
+// ===== Armed triggers =====
+// checkSchedules() looks each minute's triggers up one minute ahead and arms
+// them with the unix second they are due. The realtime trigger task fires
+// them as soon as the second clock (clock.h) passes that edge, so a bell at
+// 08:00:00 rings on the RTC's edge rather than on the next schedule poll.
+// How late each one fired against its edge goes into a histogram for
+// /metrics.
+
+#define MAX_ARMED_TRIGGERS 16
+#define LATENESS_BUCKETS 9
+
+struct ArmedTrigger
+{
+    uint32_t dueUnix; // second it is due
+    Trigger trigger;
+};
+
+struct TriggerStats
+{
+    uint32_t armed;
+    uint32_t fired;
+    uint32_t skipped;  // due while the bells were off, or too late
+    uint32_t overflow; // more due in two minutes than MAX_ARMED_TRIGGERS
+    uint32_t maxLateUs;
+    uint32_t lateness[LATENESS_BUCKETS]; // see LATENESS_BOUNDS_MS
+};
+
+// Upper bounds of the lateness buckets, the last one takes the rest
+const uint16_t LATENESS_BOUNDS_MS[LATENESS_BUCKETS - 1] = {1, 2, 5, 10, 20, 50, 100, 1000};
+
+ArmedTrigger armedTriggers[MAX_ARMED_TRIGGERS];
+uint8_t armedCount = 0;
+uint32_t armedThroughMinute = 0; // last minute whose triggers are armed, 0 = none
+uint32_t nextArmedUnix = UINT32_MAX;
+TriggerStats triggerStats = {};
+
+static void updateNextArmed()
+{
+    nextArmedUnix = UINT32_MAX;
+    for (uint8_t i = 0; i < armedCount; i++)
+    {
+        if (armedTriggers[i].dueUnix < nextArmedUnix)
+            nextArmedUnix = armedTriggers[i].dueUnix;
+    }
+}
+
+// Arms the triggers of one minute (minutes since 1970) from fromSecond on
+void armMinute(uint32_t minuteStamp, uint8_t fromSecond)
+{
+    armedThroughMinute = minuteStamp;
+
+    DateTime day(minuteStamp * 60);
+    uint8_t dayKind = calendarDayKind(day.year(), day.month(), day.day());
+    if (dayKind == CAL_HOLIDAY)
+        return;
+
+    const ProfileTable *table = profileForDay(dayKind);
+    uint8_t dayBit = 1 << scheduleDayOfWeek(day);
+    int minuteOfDay = minuteStamp % 1440;
+    for (int i = firstTriggerAt(table, minuteOfDay); i < table->count && table->triggers[i].minute == minuteOfDay; i++)
+    {
+        const Trigger &trigger = table->triggers[i];
+        if (!(trigger.days & dayBit) || trigger.second < fromSecond)
+            continue;
+        if (armedCount >= MAX_ARMED_TRIGGERS)
+        {
+            triggerStats.overflow++;
+            continue;
+        }
+        armedTriggers[armedCount++] = {minuteStamp * 60 + trigger.second, trigger};
+        triggerStats.armed++;
+    }
+    updateNextArmed();
+}
+
+// Forgets everything armed, for clock changes
+void disarmTriggers()
+{
+    armedCount = 0;
+    armedThroughMinute = 0;
+    nextArmedUnix = UINT32_MAX;
+}
+
+// The tables changed (edit, profile switch, calendar): arms again from the
+// new ones whatever is not due yet
+void rearmTriggers()
+{
+    if (!secondClockValid())
+        return;
+    uint32_t now = secondClockNow();
+    uint32_t through = armedThroughMinute;
+    if (through < now / 60)
+        return; // checkSchedules() hasn't armed this minute yet, it will
+
+    // Keep what is already due, the task fires it on its next pass
+    uint8_t kept = 0;
+    for (uint8_t i = 0; i < armedCount; i++)
+    {
+        if (armedTriggers[i].dueUnix <= now)
+            armedTriggers[kept++] = armedTriggers[i];
+    }
+    armedCount = kept;
+
+    armMinute(now / 60, now % 60 + 1);
+    for (uint32_t minute = now / 60 + 1; minute <= through; minute++)
+        armMinute(minute, 0);
+}
+
+static void recordLateness(uint32_t lateUs)
+{
+    if (lateUs > triggerStats.maxLateUs)
+        triggerStats.maxLateUs = lateUs;
+    uint8_t bucket = 0;
+    while (bucket < LATENESS_BUCKETS - 1 && lateUs >= LATENESS_BOUNDS_MS[bucket] * 1000UL)
+        bucket++;
+    triggerStats.lateness[bucket]++;
+}
+
+// Upper bound (ms) of the bucket holding the given percentile of fired
+// triggers, 0 if none fired; past the last bound it is the largest lateness
+uint32_t latenessPercentileMs(uint8_t percent)
+{
+    uint32_t total = 0;
+    for (uint8_t i = 0; i < LATENESS_BUCKETS; i++)
+        total += triggerStats.lateness[i];
+    if (total == 0)
+        return 0;
+
+    uint32_t rank = (total * percent + 99) / 100;
+    uint32_t seen = 0;
+    for (uint8_t i = 0; i < LATENESS_BUCKETS - 1; i++)
+    {
+        seen += triggerStats.lateness[i];
+        if (seen >= rank)
+            return LATENESS_BOUNDS_MS[i];
+    }
+    return (triggerStats.maxLateUs + 999) / 1000;
+}
+
+// Runs every loop pass; cheap unless something is due
+void fireDueTriggers()
+{
+    if (armedCount == 0 || !secondClockValid())
+        return;
+    uint32_t now = secondClockNow();
+    if (now < nextArmedUnix)
+        return;
+
+    uint32_t sinceEdgeUs = secondClockSinceEdgeUs();
+    bool enabled = led.isOn(); // an LED trigger in this batch doesn't silence the rest
+    for (uint8_t i = 0; i < armedCount;)
+    {
+        const ArmedTrigger &armed = armedTriggers[i];
+        if (armed.dueUnix > now)
+        {
+            i++;
+            continue;
+        }
+
+        // Same limit as catch-up, but never less than the minute itself
+        uint32_t lateS = now - armed.dueUnix;
+        bool tooLate = lateS >= 60 && lateS / 60 >= catchUpMaxLateMin;
+        if (enabled && !tooLate)
+        {
+            uint32_t lateUs = lateS >= 4000 ? UINT32_MAX : lateS * 1000000UL + sinceEdgeUs;
+            fireTrigger(armed.trigger);
+            recordLateness(lateUs);
+            logEvent(armed.trigger.type == TRIGGER_BELL ? EVENT_ZONE_BELL : EVENT_ZONE_LED, EVENT_SCHEDULE,
+                     armed.trigger.index, lateUs);
+            triggerStats.fired++;
+        }
+        else
+        {
+            triggerStats.skipped++;
+        }
+        armedTriggers[i] = armedTriggers[--armedCount];
+    }
+    updateNextArmed();
+}
@@ -0,0 +1,110 @@
+// ===== Upcoming events =====
+// Enumerates the next fire times straight from the compiled trigger tables.
+// Every trigger gets a cursor on its next fire minute and the cursors sit in a
+// min-heap, so N events cost O(K) to set up and O(N log K) to merge. Profile
+// switches and holidays come from a per-day view of the calendar, built once
+// per query for UPCOMING_HORIZON_DAYS days.
+
+#define UPCOMING_HORIZON_DAYS 31
+#define UPCOMING_MAX 50
+
+struct UpcomingEvent
+{
+    uint32_t minute; // minutes since 1970
+    const Trigger *trigger;
+    const ProfileTable *table;
+};
+
+struct UpcomingDay
+{
+    const ProfileTable *table; // nullptr on holidays
+    uint8_t dayBit;
+};
+
+// Moves the cursor to the first day >= firstDay the trigger rings on
+static bool advanceUpcoming(UpcomingEvent &cursor, const UpcomingDay *days, uint8_t firstDay, uint32_t dayStart)
+{
+    for (uint8_t d = firstDay; d < UPCOMING_HORIZON_DAYS; d++)
+    {
+        if (days[d].table == cursor.table && (cursor.trigger->days & days[d].dayBit))
+        {
+            cursor.minute = dayStart + d * 1440UL + cursor.trigger->minute;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void siftUpcomingDown(UpcomingEvent *heap, uint8_t size, uint8_t i)
+{
+    while (true)
+    {
+        uint8_t smallest = i;
+        uint8_t left = 2 * i + 1;
+        uint8_t right = left + 1;
+        if (left < size && heap[left].minute < heap[smallest].minute)
+            smallest = left;
+        if (right < size && heap[right].minute < heap[smallest].minute)
+            smallest = right;
+        if (smallest == i)
+            return;
+        UpcomingEvent tmp = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+// Fills out[] with up to n events at or after fromMinute, earliest first
+uint8_t findUpcomingEvents(uint32_t fromMinute, UpcomingEvent *out, uint8_t n)
+{
+    uint32_t dayStart = fromMinute - fromMinute % 1440;
+
+    UpcomingDay days[UPCOMING_HORIZON_DAYS];
+    const ProfileTable *tables[MAX_PROFILES];
+    uint8_t tableCount = 0;
+    for (uint8_t d = 0; d < UPCOMING_HORIZON_DAYS; d++)
+    {
+        DateTime date((dayStart + d * 1440UL) * 60);
+        uint8_t dayKind = calendarDayKind(date.year(), date.month(), date.day());
+        days[d].table = dayKind == CAL_HOLIDAY ? nullptr : profileForDay(dayKind);
+        days[d].dayBit = 1 << scheduleDayOfWeek(date);
+
+        bool seen = days[d].table == nullptr;
+        for (uint8_t t = 0; t < tableCount && !seen; t++)
+            seen = tables[t] == days[d].table;
+        if (!seen && tableCount < MAX_PROFILES)
+            tables[tableCount++] = days[d].table;
+    }
+
+    // One cursor per trigger of every profile in use within the horizon
+    UpcomingEvent heap[MAX_SCHEDULES];
+    uint8_t size = 0;
+    for (uint8_t t = 0; t < tableCount; t++)
+    {
+        for (uint8_t i = 0; i < tables[t]->count && size < MAX_SCHEDULES; i++)
+        {
+            UpcomingEvent &cursor = heap[size];
+            cursor.trigger = &tables[t]->triggers[i];
+            cursor.table = tables[t];
+            uint8_t firstDay = dayStart + cursor.trigger->minute >= fromMinute ? 0 : 1;
+            if (advanceUpcoming(cursor, days, firstDay, dayStart))
+                size++;
+        }
+    }
+    for (int i = size / 2 - 1; i >= 0; i--)
+        siftUpcomingDown(heap, size, i);
+
+    uint8_t count = 0;
+    while (count < n && size > 0)
+    {
+        out[count++] = heap[0];
+
+        // Re-arm the cursor for its next day, or drop it past the horizon
+        uint8_t nextDay = (heap[0].minute - dayStart) / 1440 + 1;
+        if (!advanceUpcoming(heap[0], days, nextDay, dayStart))
+            heap[0] = heap[--size];
+        siftUpcomingDown(heap, size, 0);
+    }
+    return count;
+}
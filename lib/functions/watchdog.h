@@ -0,0 +1,168 @@
+// ===== Stall watchdog =====
+// Tracks which phase of the loop is running (a task, a route, a flash write)
+// and records every phase that runs longer than stallThresholdMs. The current
+// phase and the last WATCHDOG_RECORDS stalls live in RTC user memory, which
+// survives every reset except a power cut. A phase that never finished because
+// the chip reset (hardware/software watchdog, exception) is recorded on the
+// next boot with that reset reason, so /metrics can name what hung.
+//
+// Only the innermost phase of a nested stall is recorded: a slow
+// "handleClient:/schedules/add" doesn't also log "http".
+
+#define WATCHDOG_RTC_BLOCK 32 // the first 128 bytes belong to OTA
+#define WATCHDOG_MAGIC 0x57444731 // "WDG1"
+#define WATCHDOG_RECORDS 6
+#define WATCHDOG_PHASE_LEN 36
+#define WATCHDOG_MAX_DEPTH 4
+
+struct StallRecord
+{
+    char phase[WATCHDOG_PHASE_LEN];
+    uint32_t durationMs; // 0 = never finished, see resetReason
+    uint32_t uptimeSec;  // when the phase started
+    uint16_t boot;
+    uint16_t resetReason; // REASON_* for phases cut short by a reset
+};
+
+struct WatchdogState
+{
+    uint32_t magic;
+    char phase[WATCHDOG_PHASE_LEN]; // running now, "" between phases
+    uint32_t phaseSinceMs;
+    uint16_t boot;
+    uint8_t head;
+    uint8_t count;
+    StallRecord records[WATCHDOG_RECORDS];
+};
+
+static_assert(sizeof(WatchdogState) <= 512 - WATCHDOG_RTC_BLOCK * 4, "RTC user memory is 512 bytes");
+
+struct PhaseFrame
+{
+    const char *name;
+    const char *detail; // appended as "name:detail", may be nullptr
+    uint32_t startMs;
+};
+
+WatchdogState watchdog;
+PhaseFrame phaseStack[WATCHDOG_MAX_DEPTH];
+uint8_t phaseDepth = 0;
+uint32_t lastStallStartMs = 0;
+uint32_t stallsThisBoot = 0;
+uint32_t stallThresholdMs = 500;
+uint32_t lastResetReason = 0;
+
+static void saveWatchdog()
+{
+    ESP.rtcUserMemoryWrite(WATCHDOG_RTC_BLOCK, (uint32_t *)&watchdog, sizeof(watchdog));
+}
+
+// Only the phase name and start time, this runs on every phase change
+static void saveCurrentPhase()
+{
+    ESP.rtcUserMemoryWrite(WATCHDOG_RTC_BLOCK + offsetof(WatchdogState, phase) / 4, (uint32_t *)watchdog.phase,
+                           sizeof(watchdog.phase) + sizeof(watchdog.phaseSinceMs));
+}
+
+static void setCurrentPhase(const PhaseFrame *frame)
+{
+    if (frame == nullptr)
+        watchdog.phase[0] = '\0';
+    else if (frame->detail == nullptr)
+        snprintf(watchdog.phase, sizeof(watchdog.phase), "%s", frame->name);
+    else
+        snprintf(watchdog.phase, sizeof(watchdog.phase), "%s:%s", frame->name, frame->detail);
+    watchdog.phaseSinceMs = frame ? frame->startMs : 0;
+    saveCurrentPhase();
+    FlashFS::setCaller(frame ? frame->name : nullptr, frame ? frame->detail : nullptr); // flash I/O is billed to the phase
+}
+
+static void recordStall(const char *phase, uint32_t startMs, uint32_t durationMs, uint16_t resetReason)
+{
+    StallRecord &record = watchdog.records[watchdog.head];
+    strncpy(record.phase, phase, sizeof(record.phase) - 1);
+    record.phase[sizeof(record.phase) - 1] = '\0';
+    record.durationMs = durationMs;
+    record.uptimeSec = startMs / 1000;
+    record.boot = watchdog.boot;
+    record.resetReason = resetReason;
+
+    watchdog.head = (watchdog.head + 1) % WATCHDOG_RECORDS;
+    if (watchdog.count < WATCHDOG_RECORDS)
+        watchdog.count++;
+    lastStallStartMs = startMs;
+    stallsThisBoot++;
+    saveWatchdog();
+}
+
+// Call first thing in setup()
+void initWatchdog()
+{
+    lastResetReason = ESP.getResetInfoPtr()->reason;
+
+    ESP.rtcUserMemoryRead(WATCHDOG_RTC_BLOCK, (uint32_t *)&watchdog, sizeof(watchdog));
+    if (watchdog.magic != WATCHDOG_MAGIC || watchdog.head >= WATCHDOG_RECORDS || watchdog.count > WATCHDOG_RECORDS)
+    {
+        // Power-on: RTC memory holds garbage
+        memset(&watchdog, 0, sizeof(watchdog));
+        watchdog.magic = WATCHDOG_MAGIC;
+    }
+    else if (watchdog.phase[0] != '\0' &&
+             (lastResetReason == REASON_WDT_RST || lastResetReason == REASON_SOFT_WDT_RST ||
+              lastResetReason == REASON_EXCEPTION_RST))
+    {
+        // The last boot died inside this phase
+        watchdog.phase[sizeof(watchdog.phase) - 1] = '\0';
+        recordStall(watchdog.phase, watchdog.phaseSinceMs, 0, lastResetReason);
+        stallsThisBoot = 0; // that one belongs to the last boot
+    }
+
+    watchdog.boot++;
+    watchdog.phase[0] = '\0';
+    watchdog.phaseSinceMs = 0;
+    lastStallStartMs = 0;
+    saveWatchdog();
+}
+
+void enterPhase(const char *name, const char *detail = nullptr)
+{
+    if (phaseDepth >= WATCHDOG_MAX_DEPTH)
+    {
+        phaseDepth++; // too deep to track, still balanced by exitPhase()
+        return;
+    }
+    PhaseFrame &frame = phaseStack[phaseDepth++];
+    frame = {name, detail, (uint32_t)millis()};
+    setCurrentPhase(&frame);
+}
+
+void exitPhase()
+{
+    if (phaseDepth == 0)
+        return;
+    if (--phaseDepth >= WATCHDOG_MAX_DEPTH)
+        return;
+
+    const PhaseFrame &frame = phaseStack[phaseDepth];
+    uint32_t duration = millis() - frame.startMs;
+    bool innerStall = stallsThisBoot > 0 && lastStallStartMs >= frame.startMs;
+    if (duration >= stallThresholdMs && !innerStall)
+        recordStall(watchdog.phase, frame.startMs, duration, 0);
+
+    setCurrentPhase(phaseDepth > 0 ? &phaseStack[phaseDepth - 1] : nullptr);
+}
+
+// Enters a phase for the rest of the enclosing block
+class PhaseScope
+{
+public:
+    PhaseScope(const char *name, const char *detail = nullptr)
+    {
+        enterPhase(name, detail);
+    }
+
+    ~PhaseScope()
+    {
+        exitPhase();
+    }
+};
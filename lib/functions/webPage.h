@@ -1,151 +1,287 @@
+// ===== Response helpers =====
+// One writer for every route, handlers run one at a time
+ResponseWriter response;
 
-void handleRoot()
+// Starts a formatted response, finish it with response.end()
+ResponseWriter &beginResponse(int code, const char *contentType)
 {
-    File file = LittleFS.open("/index.html", "r");
-    if (!file)
+    response.begin(server.client(), code, contentType);
+    return response;
+}
+
+void sendResponse(int code, const char *contentType, const char *body)
+{
+    beginResponse(code, contentType).print(body);
+    response.end();
+}
+
+// Static files are sent a slice at a time by the file stream task instead of
+// in one blocking loop, from a LittleFS file or from PROGMEM (assets.h). The
+// copied client keeps the connection open after the handler returns, even if
+// the server has moved on to another client.
+#define MAX_FILE_STREAMS 4
+#define FILE_STREAM_SLICE 512
+
+struct FileStream
+{
+    WiFiClient client;
+    FlashFile file;
+    const uint8_t *flash; // PROGMEM source, nullptr when sending file
+    size_t left;
+    int8_t asset; // for assetStats, -1 if none
+    uint32_t startUs;
+};
+
+FileStream fileStreams[MAX_FILE_STREAMS];
+
+static FileStream *freeFileStream()
+{
+    for (FileStream &stream : fileStreams)
+    {
+        if (stream.left == 0)
+            return &stream;
+    }
+    return nullptr;
+}
+
+// Takes over the file, callers must not close it; headers are extra header
+// lines
+void sendFile(FlashFile &file, const char *contentType, int8_t asset = -1, uint32_t startUs = 0,
+              const char *headers = nullptr)
+{
+    FileStream *stream = freeFileStream();
+    if (!stream)
+    {
+        // Every slot busy: send this one in one go
+        response.sendStream(server.client(), 200, contentType, file, file.size(), headers);
+        file.close();
+        recordAssetSent(asset, startUs, true);
+        return;
+    }
+    if (!response.beginStream(server.client(), 200, contentType, file.size(), headers))
     {
-        server.send(500, "text/plain", "Failed to open file");
+        file.close();
+        recordAssetSent(asset, startUs, false);
         return;
     }
-    server.streamFile(file, "text/html");
-    file.close();
+    *stream = {server.client(), file, nullptr, file.size(), asset, startUs};
 }
 
-void handleCSS()
+// Sends length bytes of PROGMEM; headers are the extra header lines
+void sendFlash(const uint8_t *data, size_t length, const char *contentType, const char *headers, int8_t asset,
+               uint32_t startUs)
 {
-    File file = LittleFS.open("/style.css", "r");
-    if (!file)
+    if (!response.beginStream(server.client(), 200, contentType, length, headers))
+    {
+        recordAssetSent(asset, startUs, false);
+        return;
+    }
+    FileStream *stream = freeFileStream();
+    if (!stream)
     {
-        server.send(404, "text/plain", "CSS file not found");
+        server.client().write_P((PGM_P)data, length);
+        recordAssetSent(asset, startUs, true);
         return;
     }
-    server.streamFile(file, "text/css");
-    file.close();
+    *stream = {server.client(), FlashFile(), data, length, asset, startUs};
 }
 
-void handleJS()
+static void finishFileStream(FileStream &stream)
 {
-    File file = LittleFS.open("/script.js", "r");
+    recordAssetSent(stream.asset, stream.startUs, stream.left == 0);
+    stream.file.close();
+    stream.client = WiFiClient(); // closes it, unless the server keeps it alive
+    stream.flash = nullptr;
+    stream.left = 0;
+}
+
+// One slice per open stream; true while a stream could take more right away
+bool continueFileStreams()
+{
+    bool more = false;
+    for (FileStream &stream : fileStreams)
+    {
+        if (stream.left == 0)
+            continue;
+        if (!stream.client.connected())
+        {
+            finishFileStream(stream);
+            continue;
+        }
+
+        size_t room = stream.client.availableForWrite();
+        if (room == 0)
+            continue; // wait for the client to ack
+        size_t n = stream.left;
+        if (n > FILE_STREAM_SLICE)
+            n = FILE_STREAM_SLICE;
+        if (n > room)
+            n = room;
+        if (stream.flash)
+        {
+            // Straight from flash into the TCP buffers, no stack copy
+            n = stream.client.write_P((PGM_P)stream.flash, n);
+            stream.flash += n;
+        }
+        else
+        {
+            uint8_t chunk[FILE_STREAM_SLICE];
+            n = stream.file.read(chunk, n);
+            if (n == 0)
+            {
+                // File shorter than announced: close rather than leave a
+                // kept connection waiting for bytes that won't come
+                stream.client.stop();
+                finishFileStream(stream);
+                continue;
+            }
+            stream.client.write(chunk, n);
+        }
+        stream.left -= n;
+        if (stream.left == 0)
+            finishFileStream(stream);
+        else
+            more = true;
+    }
+    return more;
+}
+
+// Sends a LittleFS file, false if it can't be opened
+static bool sendFsAsset(const char *path, const char *contentType, int8_t asset, uint32_t startUs)
+{
+    FlashFile file = FlashFS::open(path, "r");
     if (!file)
+        return false;
+    if (asset >= 0)
+        assetStats[asset].fromFs++;
+    sendFile(file, contentType, asset, startUs, asset >= 0 ? ASSET_VARY : nullptr);
+    return true;
+}
+
+// The /www override, else the embedded copy, else whatever LittleFS has.
+// Clients that don't take gzip get the plain copy from LittleFS if there is
+// one, and 406 otherwise. Every answer for an embedded asset says it varies
+// with Accept-Encoding, so a cache never hands the gzip to such a client.
+void serveAsset(const char *path, const char *contentType, const char *notFound)
+{
+    uint32_t startUs = micros();
+    int8_t asset = findAsset(path);
+    if (asset < 0)
+    {
+        if (!sendFsAsset(path, contentType, asset, startUs))
+            sendResponse(404, "text/plain", notFound);
+        return;
+    }
+
+    if (assetOverridden[asset])
     {
-        server.send(404, "text/plain", "JavaScript file not found");
+        char override[ASSET_PATH_LEN];
+        overridePath(override, sizeof(override), path);
+        if (sendFsAsset(override, contentType, asset, startUs))
+            return;
+    }
+    if (strstr(requestHeader("Accept-Encoding"), "gzip") == nullptr)
+    {
+        if (!sendFsAsset(path, contentType, asset, startUs))
+        {
+            response.beginStream(server.client(), 406, "text/plain", 0, ASSET_VARY);
+        }
+        return;
+    }
+
+    const WebAsset &embedded = WEB_ASSETS[asset];
+    char headers[128];
+    int len = snprintf(headers, sizeof(headers), "ETag: %s\r\nCache-Control: no-cache\r\n" ASSET_VARY, embedded.etag);
+    if (strcmp(requestHeader("If-None-Match"), embedded.etag) == 0)
+    {
+        response.beginStream(server.client(), 304, contentType, 0, headers);
+        assetStats[asset].notModified++;
         return;
     }
-    server.streamFile(file, "application/javascript");
-    file.close();
+    snprintf(headers + len, sizeof(headers) - len, "Content-Encoding: gzip\r\n");
+    sendFlash(embedded.data, embedded.length, contentType, headers, asset, startUs);
+}
+
+void handleRoot()
+{
+    serveAsset("/index.html", "text/html", "Page not found");
+}
+
+void handleCSS()
+{
+    serveAsset("/style.css", "text/css", "CSS file not found");
+}
+
+void handleJS()
+{
+    serveAsset("/script.js", "application/javascript", "JavaScript file not found");
 }
 
 void handleTime()
 {
-    DateTime now = rtc.now();
-    String timeString = "";
-
-    // Format: YYYY/MM/DD HH:MM:SS
-    timeString += now.year();
-    timeString += "/";
-    if (now.month() < 10)
-        timeString += "0";
-    timeString += now.month();
-    timeString += "/";
-    if (now.day() < 10)
-        timeString += "0";
-    timeString += now.day();
-    timeString += " ";
-    if (now.hour() < 10)
-        timeString += "0";
-    timeString += now.hour();
-    timeString += ":";
-    if (now.minute() < 10)
-        timeString += "0";
-    timeString += now.minute();
-    timeString += ":";
-    if (now.second() < 10)
-        timeString += "0";
-    timeString += now.second();
-
-    server.send(200, "text/plain", timeString);
+    if (!rtcAvailable)
+    {
+        sendResponse(503, "text/plain", "RTC not found");
+        return;
+    }
+    sendCachedTime();
 }
 
 void handleStatus()
 {
-    StaticJsonDocument<200> doc;
-    doc["led"] = led.isOn();
-    doc["bell"] = bell.isOn();
-
-    String json;
-    serializeJson(doc, json);
-    server.send(200, "application/json", json);
+    sendCachedStatus();
 }
 
 void handleLEDToggle()
 {
     led.toggle();
+    logEvent(EVENT_ZONE_LED, EVENT_WEB);
 
-    StaticJsonDocument<100> doc;
+    StaticJsonDocument<32> doc;
     doc["led"] = led.isOn();
-
-    String json;
-    serializeJson(doc, json);
-    server.send(200, "application/json", json);
+    sendDocument(200, doc);
 }
 
 // ===== Config helpers =====
 static const char *CONFIG_PATH = "/config.json";
 
-static void loadConfigOrDefaults(StaticJsonDocument<256> &cfg)
+static void loadConfigOrDefaults(StaticJsonDocument<512> &cfg)
 {
-    cfg.clear();
-    File f = LittleFS.open(CONFIG_PATH, "r");
-    if (!f)
+    if (!Persist::load(CONFIG_PATH, cfg))
     {
         // defaults
         cfg["bellDurationMs"] = 3000; // 3s default
         cfg["ledOn"] = false;
-        return;
-    }
-    String content = f.readString();
-    f.close();
-    DeserializationError err = deserializeJson(cfg, content);
-    if (err)
-    {
-        cfg.clear();
-        cfg["bellDurationMs"] = 3000;
-        cfg["ledOn"] = false;
     }
 }
 
-static bool saveConfig(const StaticJsonDocument<256> &cfg)
+static bool saveConfig(const StaticJsonDocument<512> &cfg)
 {
-    File f = LittleFS.open(CONFIG_PATH, "w");
-    if (!f)
-        return false;
-    serializeJson(cfg, f);
-    f.close();
-    return true;
+    return Persist::save(CONFIG_PATH, cfg);
 }
 
 void handleGetConfig()
 {
-    StaticJsonDocument<256> cfg;
+    StaticJsonDocument<512> cfg;
     loadConfigOrDefaults(cfg);
-    String json;
-    serializeJson(cfg, json);
-    server.send(200, "application/json", json);
+    cfg.remove("syncPassword");
+    cfg.remove("syncKey");
+    sendDocument(200, cfg);
 }
 
 void handleUpdateBellDuration()
 {
     if (!server.hasArg("plain"))
     {
-        server.send(400, "application/json", "{\"success\":false,\"message\":\"No data\"}");
+        sendResponse(400, "application/json", "{\"success\":false,\"message\":\"No data\"}");
         return;
     }
 
     StaticJsonDocument<128> body;
-    DeserializationError err = deserializeJson(body, server.arg("plain"));
+    DeserializationError err = parseBody(body);
     if (err)
     {
-        server.send(400, "application/json", "{\"success\":false,\"message\":\"Bad JSON\"}");
+        sendResponse(400, "application/json", "{\"success\":false,\"message\":\"Bad JSON\"}");
         return;
     }
 
@@ -161,7 +297,7 @@ void handleUpdateBellDuration()
     }
     else
     {
-        server.send(400, "application/json", "{\"success\":false,\"message\":\"Missing duration\"}");
+        sendResponse(400, "application/json", "{\"success\":false,\"message\":\"Missing duration\"}");
         return;
     }
 
@@ -170,7 +306,7 @@ void handleUpdateBellDuration()
         bellDurationMs = 60000UL;
 
     // Persist
-    StaticJsonDocument<256> cfg;
+    StaticJsonDocument<512> cfg;
     loadConfigOrDefaults(cfg);
     cfg["bellDurationMs"] = bellDurationMs;
     saveConfig(cfg);
@@ -178,13 +314,217 @@ void handleUpdateBellDuration()
     // Apply immediately
     bell.setDuration(bellDurationMs);
 
-    server.send(200, "application/json", "{\"success\":true}");
+    sendResponse(200, "application/json", "{\"success\":true}");
+}
+
+void handleUpdateCatchUp()
+{
+    if (!server.hasArg("plain"))
+    {
+        sendResponse(400, "application/json", "{\"success\":false,\"message\":\"No data\"}");
+        return;
+    }
+
+    StaticJsonDocument<64> body;
+    DeserializationError err = parseBody(body);
+    if (err || !body.containsKey("catchUpMaxLateMin"))
+    {
+        sendResponse(400, "application/json", "{\"success\":false,\"message\":\"Bad JSON\"}");
+        return;
+    }
+
+    // Clamp to the span catchUpMissed() scans anyway
+    unsigned long maxLateMin = body["catchUpMaxLateMin"].as<unsigned long>();
+    if (maxLateMin > CATCHUP_SCAN_LIMIT_DAYS * 1440UL)
+        maxLateMin = CATCHUP_SCAN_LIMIT_DAYS * 1440UL;
+
+    // Persist
+    StaticJsonDocument<512> cfg;
+    loadConfigOrDefaults(cfg);
+    cfg["catchUpMaxLateMin"] = maxLateMin;
+    saveConfig(cfg);
+
+    // Apply immediately
+    catchUpMaxLateMin = maxLateMin;
+
+    sendResponse(200, "application/json", "{\"success\":true}");
+}
+
+void handleUpdateStallThreshold()
+{
+    if (!server.hasArg("plain"))
+    {
+        sendResponse(400, "application/json", "{\"success\":false,\"message\":\"No data\"}");
+        return;
+    }
+
+    StaticJsonDocument<64> body;
+    DeserializationError err = parseBody(body);
+    if (err || !body.containsKey("stallThresholdMs"))
+    {
+        sendResponse(400, "application/json", "{\"success\":false,\"message\":\"Bad JSON\"}");
+        return;
+    }
+
+    // Below ~50 ms every flash write would count as a stall
+    unsigned long thresholdMs = body["stallThresholdMs"].as<unsigned long>();
+    if (thresholdMs < 50UL)
+        thresholdMs = 50UL;
+
+    // Persist
+    StaticJsonDocument<512> cfg;
+    loadConfigOrDefaults(cfg);
+    cfg["stallThresholdMs"] = thresholdMs;
+    saveConfig(cfg);
+
+    // Apply immediately
+    stallThresholdMs = thresholdMs;
+
+    sendResponse(200, "application/json", "{\"success\":true}");
+}
+
+void handleUpdateKeepAlive()
+{
+    if (!server.hasArg("plain"))
+    {
+        sendResponse(400, "application/json", "{\"success\":false,\"message\":\"No data\"}");
+        return;
+    }
+
+    StaticJsonDocument<64> body;
+    DeserializationError err = parseBody(body);
+    if (err || !body["keepAlive"].is<bool>())
+    {
+        sendResponse(400, "application/json", "{\"success\":false,\"message\":\"Bad JSON\"}");
+        return;
+    }
+    bool keepAlive = body["keepAlive"];
+
+    // Persist
+    StaticJsonDocument<512> cfg;
+    loadConfigOrDefaults(cfg);
+    cfg["httpKeepAlive"] = keepAlive;
+    saveConfig(cfg);
+
+    // Apply from the next request on; this response still says what noteRequest() decided
+    httpKeepAlive = keepAlive;
+    server.keepAlive(keepAlive);
+
+    sendResponse(200, "application/json", "{\"success\":true}");
+}
+
+void handleUpdateBellTimer()
+{
+    if (!server.hasArg("plain"))
+    {
+        sendResponse(400, "application/json", "{\"success\":false,\"message\":\"No data\"}");
+        return;
+    }
+
+    StaticJsonDocument<64> body;
+    DeserializationError err = parseBody(body);
+    if (err || !body["bellTimer"].is<bool>())
+    {
+        sendResponse(400, "application/json", "{\"success\":false,\"message\":\"Bad JSON\"}");
+        return;
+    }
+    bool timed = body["bellTimer"];
+
+    // Persist
+    StaticJsonDocument<512> cfg;
+    loadConfigOrDefaults(cfg);
+    cfg["bellTimer"] = timed;
+    saveConfig(cfg);
+
+    // Apply; a bell ringing now is finished by the new mode
+    bell.setTimedOff(timed);
+
+    sendResponse(200, "application/json", "{\"success\":true}");
+}
+
+void handleUpdatePowerSave()
+{
+    if (!server.hasArg("plain"))
+    {
+        sendResponse(400, "application/json", "{\"success\":false,\"message\":\"No data\"}");
+        return;
+    }
+
+    StaticJsonDocument<64> body;
+    DeserializationError err = parseBody(body);
+    const char *name = body["powerSave"] | "";
+    uint8_t mode = 0;
+    while (mode < POWER_MODES && strcmp(name, POWER_MODE_NAMES[mode]) != 0)
+        mode++;
+    if (err || mode == POWER_MODES)
+    {
+        sendResponse(400, "application/json", "{\"success\":false,\"message\":\"Expected off, modem or light\"}");
+        return;
+    }
+
+    // Persist
+    StaticJsonDocument<512> cfg;
+    loadConfigOrDefaults(cfg);
+    cfg["powerSave"] = mode;
+    saveConfig(cfg);
+
+    // Apply from the next power check; a doze only starts once this client has gone
+    powerMode = mode;
+
+    sendResponse(200, "application/json", "{\"success\":true}");
+}
+
+void handleUpdateSync()
+{
+    if (!server.hasArg("plain"))
+    {
+        sendResponse(400, "application/json", "{\"success\":false,\"message\":\"No data\"}");
+        return;
+    }
+
+    StaticJsonDocument<256> body;
+    DeserializationError err = parseBody(body);
+    if (err || !body.containsKey("ssid"))
+    {
+        sendResponse(400, "application/json", "{\"success\":false,\"message\":\"Bad JSON\"}");
+        return;
+    }
+
+    // Every packet is signed with the key, so no replication without one
+    const char *ssid = body["ssid"] | "";
+    const char *key = body["key"] | "";
+    uint8_t parsed[SIPHASH_KEY_SIZE];
+    if (ssid[0] != '\0' && !SipHash::parseKey(key, parsed))
+    {
+        sendResponse(400, "application/json", "{\"success\":false,\"message\":\"key must be 32 hex digits\"}");
+        return;
+    }
+
+    // Persist; an empty ssid turns replication off
+    StaticJsonDocument<512> cfg;
+    loadConfigOrDefaults(cfg);
+    cfg["syncSsid"] = ssid;
+    cfg["syncPassword"] = body["password"] | "";
+    cfg["syncKey"] = key;
+    if (!saveConfig(cfg))
+    {
+        sendResponse(500, "application/json", "{\"success\":false,\"message\":\"Failed to write config\"}");
+        return;
+    }
+
+    // Apply immediately
+    strlcpy(syncSsid, cfg["syncSsid"] | "", sizeof(syncSsid));
+    strlcpy(syncPassword, cfg["syncPassword"] | "", sizeof(syncPassword));
+    setSyncKey(key);
+    beginSyncNetwork();
+
+    sendResponse(200, "application/json", "{\"success\":true}");
 }
 
 void handleBellToggle()
 {
     // // Print file content
-    // File file = LittleFS.open("/schedules.json", "r");
+    // FlashFile file = FlashFS::open("/schedules.json", "r");
     // if (!file)
     // {
     //     dbg("Schedules file not found, assuming no schedules");
@@ -217,69 +557,250 @@ void handleBellToggle()
     // }
 
     bell.on();
+    if (bell.isOn())
+        logEvent(EVENT_ZONE_BELL, EVENT_WEB);
 
-    StaticJsonDocument<100> doc;
-    doc["bell"] = bell.isOn();
     // dbgln("--------------------------");
-    String json;
-    serializeJson(doc, json);
-    server.send(200, "application/json", json);
+    StaticJsonDocument<32> doc;
+    doc["bell"] = bell.isOn();
+    sendDocument(200, doc);
+}
+
+// ===== Event history =====
+#define HISTORY_DEFAULT_LIMIT 100
+#define HISTORY_MAX_LIMIT 500
+#define HISTORY_READ_RECORDS 32
+
+static void printEvent(const EventRecord &event, bool first)
+{
+    DateTime at(event.time);
+    response.printf("%s{\"time\":%u,\"at\":\"%04d-%02d-%02d %02d:%02d:%02d\",\"zone\":\"%s\",\"source\":\"%s\",\"lateMs\":%u,\"schedule\":",
+                    first ? "" : ",", event.time, at.year(), at.month(), at.day(), at.hour(), at.minute(), at.second(),
+                    event.zone <= EVENT_ZONE_LED ? EVENT_ZONE_NAMES[event.zone] : "unknown",
+                    event.source <= EVENT_WEB ? EVENT_SOURCE_NAMES[event.source] : "unknown", event.lateCs * 10);
+    if (event.schedule == EVENT_NO_SCHEDULE)
+        response.print("null}");
+    else
+        response.printf("%u}", event.schedule);
+}
+
+// GET /history?from=&to=[&limit=][&cursor=] - events between two unix
+// times, oldest first. Each segment is binary-searched for from and read a
+// few records at a time, so the log is never in memory. With more than
+// limit events, "next" is the cursor to ask for the rest with; events still
+// buffered in RAM come with the last page.
+void handleHistory()
+{
+    uint32_t from = server.hasArg("from") ? strtoul(server.arg("from").c_str(), nullptr, 10) : 0;
+    uint32_t to = server.hasArg("to") ? strtoul(server.arg("to").c_str(), nullptr, 10) : UINT32_MAX;
+    long limit = server.hasArg("limit") ? server.arg("limit").toInt() : HISTORY_DEFAULT_LIMIT;
+    if (limit < 1 || limit > HISTORY_MAX_LIMIT)
+        limit = HISTORY_MAX_LIMIT;
+
+    // "<seq>-<index>" from the previous page
+    uint32_t cursorSeq = 0;
+    uint32_t cursorIndex = 0;
+    if (server.hasArg("cursor"))
+    {
+        char *dash;
+        cursorSeq = strtoul(server.arg("cursor").c_str(), &dash, 10);
+        cursorIndex = *dash == '-' ? strtoul(dash + 1, nullptr, 10) : 0;
+    }
+
+    beginResponse(200, "application/json").printf("{\"from\":%u,\"to\":%u,\"events\":[", from, to);
+    long sent = 0;
+    uint32_t nextSeq = 0;
+    uint32_t nextIndex = 0;
+    for (uint8_t s = 0; s < eventSegmentCount && nextSeq == 0; s++)
+    {
+        const EventSegment &segment = eventSegments[s];
+        if (segment.seq < cursorSeq || segment.count == 0 || segment.last < from || segment.first > to)
+            continue;
+
+        char path[EVENT_PATH_LEN];
+        eventSegmentPath(path, sizeof(path), segment.seq);
+        FlashFile file = FlashFS::open(path, "r");
+        if (!file)
+            continue;
+        uint32_t index = segment.seq == cursorSeq ? cursorIndex : findEventIndex(file, segment, from);
+        bool past = false;
+        while (index < segment.count && !past && nextSeq == 0)
+        {
+            EventRecord records[HISTORY_READ_RECORDS];
+            uint32_t n = segment.count - index < HISTORY_READ_RECORDS ? segment.count - index : HISTORY_READ_RECORDS;
+            size_t bytes = n * sizeof(EventRecord);
+            if (!file.seek(index * sizeof(EventRecord)) || file.read((uint8_t *)records, bytes) != (int)bytes)
+                break;
+            for (uint32_t i = 0; i < n; i++, index++)
+            {
+                if (records[i].time > to)
+                {
+                    past = true; // sorted, the rest of this segment is later still
+                    break;
+                }
+                if (records[i].time < from)
+                    continue;
+                if (sent == limit)
+                {
+                    nextSeq = segment.seq;
+                    nextIndex = index;
+                    break;
+                }
+                printEvent(records[i], sent++ == 0);
+            }
+        }
+        file.close();
+    }
+
+    if (nextSeq == 0)
+    {
+        for (uint8_t i = 0; i < eventBuffered; i++)
+        {
+            if (eventBuffer[i].time >= from && eventBuffer[i].time <= to)
+                printEvent(eventBuffer[i], sent++ == 0);
+        }
+        response.print("],\"next\":null}");
+    }
+    else
+    {
+        response.printf("],\"next\":\"%u-%u\"}", nextSeq, nextIndex);
+    }
+    response.end();
 }
 
 void handleSchedules()
 {
-    File file = LittleFS.open("/schedules.json", "r");
-    if (!file)
+    JsonArenaLease lease(jsonArena);
+    if (!lease)
     {
-        server.send(200, "application/json", "{\"schedules\":[]}");
+        sendResponse(503, "application/json", "{\"success\":false,\"message\":\"Busy\"}");
         return;
     }
+    JsonDocument &schedulesDoc = *lease;
+    if (Persist::load("/schedules.json", schedulesDoc))
+        loadScheduleRevision(schedulesDoc);
+    else
+        schedulesDoc.createNestedArray("schedules");
 
-    String json = file.readString();
-    file.close();
-    server.send(200, "application/json", json);
+    // The revision this list is at, base for /schedules/changes
+    schedulesDoc["revision"] = scheduleRevision;
+    sendDocument(200, schedulesDoc);
+}
+
+// Changes after ?since=rev, or the whole list if they are no longer in the ring
+void handleScheduleChanges()
+{
+    uint32_t since = strtoul(server.arg("since").c_str(), nullptr, 10);
+    if (!scheduleChangesCover(since))
+    {
+        handleSchedules();
+        return;
+    }
+
+    beginResponse(200, "application/json").printf("{\"revision\":%u,\"changes\":[", scheduleRevision);
+    bool first = true;
+    for (uint8_t i = 0; i < scheduleChangeCount; i++)
+    {
+        const ScheduleChange &change = scheduleChangeAt(i);
+        if (change.revision <= since)
+            continue;
+        response.printf("%s{\"revision\":%u,\"op\":\"%s\",\"index\":%u", first ? "" : ",",
+                        change.revision, CHANGE_OPS[change.op], change.index);
+        first = false;
+        if (change.op == CHANGE_DELETE)
+        {
+            response.print("}");
+            continue;
+        }
+        response.print(",\"schedule\":{\"time\":");
+        response.printJsonString(change.time);
+        response.print(",\"days\":[");
+        bool firstDay = true;
+        for (uint8_t day = 0; day < 7; day++)
+        {
+            if (change.days & (1 << day))
+            {
+                response.printf("%s%u", firstDay ? "" : ",", day);
+                firstDay = false;
+            }
+        }
+        response.printf("],\"enabled\":%s,\"type\":\"%s\",\"profile\":",
+                        (change.flags & CHANGE_ENABLED) ? "true" : "false",
+                        (change.flags & CHANGE_LED) ? "led" : "bell");
+        response.printJsonString(change.profile);
+        response.print("}}");
+    }
+    response.print("]}");
+    response.end();
+}
+
+void handleUpcomingSchedules()
+{
+    int n = server.hasArg("n") ? server.arg("n").toInt() : 10;
+    if (n < 1)
+        n = 1;
+    if (n > UPCOMING_MAX)
+        n = UPCOMING_MAX;
+
+    uint32_t nowUnix;
+    if (!currentUnixTime(nowUnix))
+    {
+        sendResponse(503, "application/json", "{\"success\":false,\"message\":\"RTC not found\"}");
+        return;
+    }
+    uint32_t nowMinute = nowUnix / 60;
+    uint32_t fromMinute = lastProcessedMinute >= nowMinute ? nowMinute + 1 : nowMinute;
+
+    UpcomingEvent events[UPCOMING_MAX];
+    uint8_t count = findUpcomingEvents(fromMinute, events, n);
+
+    // Formatted item by item, the list is never built as one JSON document
+    beginResponse(200, "application/json").printf("{\"enabled\":%s,\"upcoming\":[", led.isOn() ? "true" : "false");
+    for (uint8_t i = 0; i < count; i++)
+    {
+        DateTime at(events[i].minute * 60 + events[i].trigger->second);
+        response.printf("%s{\"at\":\"%04d-%02d-%02d %02d:%02d", i ? "," : "", at.year(), at.month(), at.day(),
+                        at.hour(), at.minute());
+        if (at.second() != 0)
+            response.printf(":%02d", at.second());
+        response.printf("\",\"in\":%lu,\"index\":%u,\"type\":\"%s\",\"profile\":",
+                        (unsigned long)(events[i].minute - nowMinute), events[i].trigger->index,
+                        events[i].trigger->type == TRIGGER_LED ? "led" : "bell");
+        response.printJsonString(events[i].table->name);
+        response.print("}");
+    }
+    response.print("]}");
+    response.end();
 }
 
 void handleAddSchedule()
 {
     if (server.hasArg("plain"))
     {
-        String jsonData = server.arg("plain");
         dbgln("Adding new schedule...");
 
         // Parse the new schedule
-        DynamicJsonDocument newScheduleDoc(1024);
-        DeserializationError error = deserializeJson(newScheduleDoc, jsonData);
+        StaticJsonDocument<512> newScheduleDoc;
+        DeserializationError error = parseBody(newScheduleDoc);
 
         if (error)
         {
             dbgln("Error: Failed to parse schedule JSON");
-            server.send(400, "application/json", "{\"success\":false,\"message\":\"Invalid JSON format\"}");
+            sendResponse(400, "application/json", "{\"success\":false,\"message\":\"Invalid JSON format\"}");
             return;
         }
 
-        delete cachedSchedulesDoc; // Free existing cache
-        cachedSchedulesDoc = nullptr;
-        // Read current schedules
-        File file = LittleFS.open("/schedules.json", "r");
-        DynamicJsonDocument schedulesDoc(16384); // 16KB for large number of schedules
-
-        if (file)
+        // Read current schedules into the shared arena
+        JsonArenaLease lease(jsonArena);
+        if (!lease)
         {
-            String currentJson = file.readString();
-            file.close();
-
-            error = deserializeJson(schedulesDoc, currentJson);
-            if (error)
-            {
-                dbgln("Warning: Corrupted schedules file, creating fresh");
-                schedulesDoc.clear();
-                schedulesDoc.createNestedArray("schedules");
-            }
+            sendResponse(503, "application/json", "{\"success\":false,\"message\":\"Busy\"}");
+            return;
         }
-        else
+        JsonDocument &schedulesDoc = *lease;
+        if (!Persist::load("/schedules.json", schedulesDoc))
         {
-            // File doesn't exist, create new structure
+            // No intact copy exists, create new structure
             schedulesDoc.createNestedArray("schedules");
         }
 
@@ -288,7 +809,7 @@ void handleAddSchedule()
         if (schedules.size() >= 50)
         {
             dbgln("Error: Maximum number of alarms (50) reached");
-            server.send(400, "application/json", "{\"success\":false,\"message\":\"Maximum number of alarms (50) reached. Please delete some alarms before adding new ones.\"}");
+            sendResponse(400, "application/json", "{\"success\":false,\"message\":\"Maximum number of alarms (50) reached. Please delete some alarms before adding new ones.\"}");
             return;
         }
 
@@ -301,27 +822,33 @@ void handleAddSchedule()
             newSchedule[kv.key()] = kv.value();
         }
 
-        // Write back to file
-        File writeFile = LittleFS.open("/schedules.json", "w");
-        if (writeFile)
+        // A profile past MAX_PROFILES would never ring
+        if (countScheduleProfiles(schedules) > MAX_PROFILES)
         {
-            serializeJson(schedulesDoc, writeFile);
-            writeFile.close();
+            dbgln("Error: Too many profiles");
+            sendResponse(400, "application/json", "{\"success\":false,\"message\":\"Maximum number of profiles (8, including normal) reached\"}");
+            return;
+        }
 
+        // Write back to file
+        uint32_t revision = nextScheduleRevision(schedulesDoc);
+        if (Persist::save("/schedules.json", schedulesDoc))
+        {
             dbgln("Schedule added successfully");
-            // loadSchedulesToCache(); // not necessary, check schedules will do it since cachedSchedulesDoc == nullptr
-            server.send(200, "application/json", "{\"success\":true}");
+            recordScheduleChange(revision, CHANGE_ADD, schedules.size() - 1, newSchedule);
+            installSchedules(schedules); // recompile from the document we already have
+            sendResponse(200, "application/json", "{\"success\":true}");
         }
         else
         {
             dbgln("Error: Failed to write schedules file");
-            server.send(500, "application/json", "{\"success\":false,\"message\":\"Failed to write file\"}");
+            sendResponse(500, "application/json", "{\"success\":false,\"message\":\"Failed to write file\"}");
         }
     }
     else
     {
         dbgln("Error: No schedule data received");
-        server.send(400, "application/json", "{\"success\":false,\"message\":\"No data received\"}");
+        sendResponse(400, "application/json", "{\"success\":false,\"message\":\"No data received\"}");
     }
 }
 
@@ -333,23 +860,22 @@ void handleDeleteSchedule()
     if (!server.hasArg("plain"))
     {
         dbgln("Error: No POST data");
-        server.send(400, "application/json", "{\"success\":false}");
+        sendResponse(400, "application/json", "{\"success\":false}");
         return;
     }
 
     // Get and parse the request data
-    String jsonData = server.arg("plain");
     dbg("Delete request data: ");
-    dbgln(jsonData);
+    dbgln(server.arg("plain"));
 
     StaticJsonDocument<64> requestDoc;
-    DeserializationError error = deserializeJson(requestDoc, jsonData);
+    DeserializationError error = parseBody(requestDoc);
 
     if (error)
     {
         dbg("Parse error: ");
         dbgln(error.c_str());
-        server.send(400, "application/json", "{\"success\":false}");
+        sendResponse(400, "application/json", "{\"success\":false}");
         return;
     }
 
@@ -358,32 +884,18 @@ void handleDeleteSchedule()
     dbg("Index to delete: ");
     dbgln(index);
 
-    // Open and read schedules file
-    File file = LittleFS.open("/schedules.json", "r");
-    if (!file)
+    // Read and parse the newest intact schedules file into the shared arena
+    JsonArenaLease lease(jsonArena);
+    if (!lease)
     {
-        dbgln("Error: File not found");
-        server.send(404, "application/json", "{\"success\":false}");
+        sendResponse(503, "application/json", "{\"success\":false,\"message\":\"Busy\"}");
         return;
     }
-
-    String fileContent = file.readString();
-    file.close();
-    dbg("File size: ");
-    dbgln(fileContent.length());
-
-    delete cachedSchedulesDoc; // Free existing cache
-    cachedSchedulesDoc = nullptr;
-
-    // Parse schedules
-    DynamicJsonDocument schedulesDoc(16384); // 16KB for large number of schedules
-    error = deserializeJson(schedulesDoc, fileContent);
-
-    if (error)
+    JsonDocument &schedulesDoc = *lease;
+    if (!Persist::load("/schedules.json", schedulesDoc))
     {
-        dbg("Schedule parse error: ");
-        dbgln(error.c_str());
-        server.send(400, "application/json", "{\"success\":false}");
+        dbgln("Error: No intact schedules file");
+        sendResponse(404, "application/json", "{\"success\":false}");
         return;
     }
 
@@ -396,7 +908,7 @@ void handleDeleteSchedule()
     if (index < 0 || index >= count)
     {
         dbgln("Error: Invalid index");
-        server.send(400, "application/json", "{\"success\":false}");
+        sendResponse(400, "application/json", "{\"success\":false}");
         return;
     }
 
@@ -404,20 +916,18 @@ void handleDeleteSchedule()
     schedules.remove(index);
     dbgln("Schedule removed from array");
 
-    File writeFile = LittleFS.open("/schedules.json", "w");
-    if (!writeFile)
+    uint32_t revision = nextScheduleRevision(schedulesDoc);
+    if (!Persist::save("/schedules.json", schedulesDoc))
     {
-        dbgln("Error: Failed to open file for writing");
-        server.send(500, "application/json", "{\"success\":false}");
+        dbgln("Error: Failed to write schedules file");
+        sendResponse(500, "application/json", "{\"success\":false}");
         return;
     }
 
-    serializeJson(schedulesDoc, writeFile);
-    writeFile.close();
-
     dbgln("Schedule deleted successfully");
-    // loadSchedulesToCache(); // not necessary, check schedules will do it since cachedSchedulesDoc == nullptr
-    server.send(200, "application/json", "{\"success\":true}");
+    recordScheduleChange(revision, CHANGE_DELETE, index, JsonObject());
+    installSchedules(schedules); // recompile from the document we already have
+    sendResponse(200, "application/json", "{\"success\":true}");
 }
 
 void handleEditSchedule()
@@ -426,19 +936,18 @@ void handleEditSchedule()
     if (!server.hasArg("plain"))
     {
         dbgln("Error: No edit data received");
-        server.send(400, "application/json", "{\"success\":false}");
+        sendResponse(400, "application/json", "{\"success\":false}");
         return;
     }
 
     // Get and parse the request data
-    String jsonData = server.arg("plain");
-    StaticJsonDocument<256> requestDoc;
-    DeserializationError error = deserializeJson(requestDoc, jsonData);
+    StaticJsonDocument<384> requestDoc;
+    DeserializationError error = parseBody(requestDoc);
 
     if (error)
     {
         dbgln("Error: Failed to parse edit request");
-        server.send(400, "application/json", "{\"success\":false}");
+        sendResponse(400, "application/json", "{\"success\":false}");
         return;
     }
 
@@ -448,28 +957,18 @@ void handleEditSchedule()
     JsonArray newDays = requestDoc["days"];
     bool newEnabled = requestDoc["enabled"];
 
-    // Open and read schedules file
-    File file = LittleFS.open("/schedules.json", "r");
-    if (!file)
+    // Read and parse the newest intact schedules file into the shared arena
+    JsonArenaLease lease(jsonArena);
+    if (!lease)
     {
-        dbgln("Error: Schedules file not found");
-        server.send(404, "application/json", "{\"success\":false}");
+        sendResponse(503, "application/json", "{\"success\":false,\"message\":\"Busy\"}");
         return;
     }
-
-    String fileContent = file.readString();
-    file.close();
-
-    delete cachedSchedulesDoc; // Free existing cache
-    cachedSchedulesDoc = nullptr;
-    // Parse schedules
-    DynamicJsonDocument schedulesDoc(16384); // 16KB for large number of schedules
-    error = deserializeJson(schedulesDoc, fileContent);
-
-    if (error)
+    JsonDocument &schedulesDoc = *lease;
+    if (!Persist::load("/schedules.json", schedulesDoc))
     {
-        dbgln("Error: Failed to parse schedules file");
-        server.send(400, "application/json", "{\"success\":false}");
+        dbgln("Error: No intact schedules file");
+        sendResponse(404, "application/json", "{\"success\":false}");
         return;
     }
 
@@ -478,7 +977,7 @@ void handleEditSchedule()
     if (index < 0 || index >= (int)schedules.size())
     {
         dbgln("Error: Invalid schedule index");
-        server.send(400, "application/json", "{\"success\":false}");
+        sendResponse(400, "application/json", "{\"success\":false}");
         return;
     }
 
@@ -499,21 +998,32 @@ void handleEditSchedule()
     // Update enabled status
     schedule["enabled"] = newEnabled;
 
+    // Move to another profile if requested
+    if (requestDoc.containsKey("profile"))
+    {
+        schedule["profile"] = requestDoc["profile"].as<const char *>();
+    }
+
+    if (countScheduleProfiles(schedules) > MAX_PROFILES)
+    {
+        dbgln("Error: Too many profiles");
+        sendResponse(400, "application/json", "{\"success\":false,\"message\":\"Maximum number of profiles (8, including normal) reached\"}");
+        return;
+    }
+
     // Write back to file
-    File writeFile = LittleFS.open("/schedules.json", "w");
-    if (!writeFile)
+    uint32_t revision = nextScheduleRevision(schedulesDoc);
+    if (!Persist::save("/schedules.json", schedulesDoc))
     {
         dbgln("Error: Failed to write schedules file");
-        server.send(500, "application/json", "{\"success\":false}");
+        sendResponse(500, "application/json", "{\"success\":false}");
         return;
     }
 
-    serializeJson(schedulesDoc, writeFile);
-    writeFile.close();
-
     dbgln("Schedule edited successfully");
-    // loadSchedulesToCache(); // not necessary, check schedules will do it since cachedSchedulesDoc == nullptr
-    server.send(200, "application/json", "{\"success\":true}");
+    recordScheduleChange(revision, CHANGE_EDIT, index, schedule);
+    installSchedules(schedules); // recompile from the document we already have
+    sendResponse(200, "application/json", "{\"success\":true}");
 }
 
 void handleSendTime()
@@ -521,20 +1031,17 @@ void handleSendTime()
     // Check if we have POST data
     if (!server.hasArg("plain"))
     {
-        server.send(400, "application/json", "{\"success\":false,\"message\":\"No data received\"}");
+        sendResponse(400, "application/json", "{\"success\":false,\"message\":\"No data received\"}");
         return;
     }
 
-    // Get the raw JSON data
-    String jsonData = server.arg("plain");
-
     // Parse the JSON data
     StaticJsonDocument<512> doc;
-    DeserializationError error = deserializeJson(doc, jsonData);
+    DeserializationError error = parseBody(doc);
 
     if (error)
     {
-        server.send(400, "application/json", "{\"success\":false,\"message\":\"Invalid JSON format\"}");
+        sendResponse(400, "application/json", "{\"success\":false,\"message\":\"Invalid JSON format\"}");
         return;
     }
 
@@ -545,7 +1052,7 @@ void handleSendTime()
     // Format: "2025-09-01T13:30:55" (local timezone format)
     if (strlen(timeString) < 19)
     {
-        server.send(400, "application/json", "{\"success\":false,\"message\":\"Invalid time format\"}");
+        sendResponse(400, "application/json", "{\"success\":false,\"message\":\"Invalid time format\"}");
         return;
     }
 
@@ -560,18 +1067,388 @@ void handleSendTime()
     // Create DateTime object
     DateTime newTime(year, month, day, hour, minute, second);
 
-    // Set the RTC
-    rtc.adjust(newTime);
+    // Set the RTC; its second restarts now
+    setClock(newTime);
+    lastProcessedMinute = 0; // a clock change is not a missed-bell gap
+    disarmTriggers();
+
+    // Newest manual setting, the other units follow it
+    timeSetAt = newTime.unixtime();
+    StaticJsonDocument<512> cfg;
+    loadConfigOrDefaults(cfg);
+    cfg["timeSetAt"] = timeSetAt;
+    saveConfig(cfg);
+    trickleReset();
 
     // Send success response
-    StaticJsonDocument<100> response;
-    response["success"] = true;
-    response["message"] = "RTC time set successfully";
+    sendResponse(200, "application/json", "{\"success\":true,\"message\":\"RTC time set successfully\"}");
+}
+
+void handleProfiles()
+{
+    uint32_t nowUnix;
+    if (!currentUnixTime(nowUnix))
+    {
+        sendResponse(503, "application/json", "{\"success\":false,\"message\":\"RTC not found\"}");
+        return;
+    }
+    DateTime now(nowUnix);
+    const ProfileTable *today = profileForDay(calendarDayKind(now.year(), now.month(), now.day()));
+
+    beginResponse(200, "application/json").print("{\"active\":");
+    response.printJsonString(activeProfileName);
+    response.print(",\"today\":");
+    response.printJsonString(today->name);
+    response.print(",\"profiles\":[");
+    for (uint8_t i = 0; currentSet != nullptr && i < currentSet->profileCount; i++)
+    {
+        response.print(i ? ",{\"name\":" : "{\"name\":");
+        response.printJsonString(currentSet->profiles[i].name);
+        response.printf(",\"alarms\":%u}", currentSet->profiles[i].count);
+    }
+    response.print("]}");
+    response.end();
+}
+
+void handleActivateProfile()
+{
+    if (!server.hasArg("plain"))
+    {
+        sendResponse(400, "application/json", "{\"success\":false,\"message\":\"No data received\"}");
+        return;
+    }
+
+    StaticJsonDocument<96> requestDoc;
+    DeserializationError error = parseBody(requestDoc);
+    if (error)
+    {
+        sendResponse(400, "application/json", "{\"success\":false,\"message\":\"Invalid JSON format\"}");
+        return;
+    }
+
+    // Tables are already compiled, this only swaps a pointer
+    if (!selectProfile(requestDoc["name"] | ""))
+    {
+        sendResponse(404, "application/json", "{\"success\":false,\"message\":\"Unknown profile\"}");
+        return;
+    }
+
+    StaticJsonDocument<512> cfg;
+    loadConfigOrDefaults(cfg);
+    cfg["activeProfile"] = activeProfileName;
+    saveConfig(cfg);
+
+    sendResponse(200, "application/json", "{\"success\":true}");
+}
+
+void handleCalendar()
+{
+    beginResponse(200, "application/json").print("{\"exceptions\":[");
+    char from[11], to[11];
+    for (uint8_t i = 0; i < calendarExceptionCount; i++)
+    {
+        formatCalendarDate(calendarExceptions[i].from, from);
+        formatCalendarDate(calendarExceptions[i].to, to);
+        response.printf("%s{\"from\":\"%s\",\"to\":\"%s\",\"profile\":", i ? "," : "", from, to);
+        response.printJsonString(calendarKindName(calendarExceptions[i].kind));
+        response.print("}");
+    }
+    response.print("]}");
+    response.end();
+}
+
+void handleAddCalendarException()
+{
+    if (!server.hasArg("plain"))
+    {
+        sendResponse(400, "application/json", "{\"success\":false,\"message\":\"No data received\"}");
+        return;
+    }
+
+    StaticJsonDocument<192> requestDoc;
+    DeserializationError error = parseBody(requestDoc);
+    if (error)
+    {
+        sendResponse(400, "application/json", "{\"success\":false,\"message\":\"Invalid JSON format\"}");
+        return;
+    }
+
+    switch (addCalendarException(requestDoc["from"], requestDoc["to"], requestDoc["profile"]))
+    {
+    case CAL_ADD_OK:
+        break;
+    case CAL_ADD_FULL:
+        sendResponse(400, "application/json", "{\"success\":false,\"message\":\"Maximum number of calendar exceptions reached\"}");
+        return;
+    case CAL_ADD_NO_SLOT:
+        sendResponse(400, "application/json", "{\"success\":false,\"message\":\"Too many different profiles in the calendar\"}");
+        return;
+    default:
+        sendResponse(400, "application/json", "{\"success\":false,\"message\":\"Invalid dates (use YYYY-MM-DD)\"}");
+        return;
+    }
+
+    if (!saveCalendar())
+    {
+        dbgln("Error: Failed to write calendar file");
+        sendResponse(500, "application/json", "{\"success\":false,\"message\":\"Failed to write file\"}");
+        return;
+    }
+
+    rearmTriggers(); // the next minute may have become a holiday
+    sendResponse(200, "application/json", "{\"success\":true}");
+}
+
+void handleDeleteCalendarException()
+{
+    if (!server.hasArg("plain"))
+    {
+        sendResponse(400, "application/json", "{\"success\":false}");
+        return;
+    }
+
+    StaticJsonDocument<64> requestDoc;
+    DeserializationError error = parseBody(requestDoc);
+    if (error || !removeCalendarException(requestDoc["index"] | -1))
+    {
+        sendResponse(400, "application/json", "{\"success\":false}");
+        return;
+    }
 
-    String responseJson;
-    serializeJson(response, responseJson);
+    if (!saveCalendar())
+    {
+        sendResponse(500, "application/json", "{\"success\":false}");
+        return;
+    }
 
-    server.send(200, "application/json", responseJson);
+    rearmTriggers();
+    sendResponse(200, "application/json", "{\"success\":true}");
+}
+
+// Rest of one /metrics "fs" entry, after its name
+static void printFlashIo(const FlashIoStats &io)
+{
+    response.printf("\"opens\":%u,\"reads\":%u,\"bytesRead\":%u,\"writes\":%u,\"bytesWritten\":%u,\"metaOps\":%u,\"maxUs\":%u,\"latency\":[",
+                    io.opens, io.reads, io.bytesRead, io.writes, io.bytesWritten, io.metaOps, io.maxUs);
+    for (uint8_t i = 0; i < FLASHFS_LATENCY_BUCKETS; i++)
+        response.printf("%s%u", i ? "," : "", io.latency[i]);
+    response.print("]}");
+}
+
+void handleMetrics()
+{
+    // Streamed with printf: the route table alone outgrows any fixed document
+    beginResponse(200, "application/json").printf("{\"uptimeMs\":%lu,\"freeHeap\":%u,\"maxFreeBlock\":%u,",
+                                                   millis(), ESP.getFreeHeap(), ESP.getMaxFreeBlockSize());
+
+    response.printf("\"boot\":{\"defaultsReadyMs\":%u,\"setupDoneMs\":%u,\"schedulesReadyMs\":%u,\"webReadyMs\":%u,\"defaultTriggers\":%u,\"rtc\":%s,\"phases\":[",
+                    bootTimes.defaultsReadyMs, bootTimes.setupDoneMs, bootTimes.schedulesReadyMs, bootTimes.webReadyMs,
+                    DEFAULT_TRIGGER_COUNT, rtcAvailable ? "true" : "false");
+    for (uint8_t i = 0; i < bootPhaseCount; i++)
+    {
+        response.printf("%s{\"name\":\"%s\",\"startUs\":%u,\"durationUs\":%u}",
+                        i ? "," : "", bootPhases[i].name, bootPhases[i].startUs, bootPhases[i].durationUs);
+    }
+    response.print("]},");
+
+    response.printf("\"heap\":{\"free\":%u,\"minFree\":%u,\"maxFreeBlock\":%u,\"minMaxFreeBlock\":%u,\"fragmentation\":%u,\"maxFragmentation\":%u},",
+                    heapStats.freeHeap, heapStats.minFreeHeap, heapStats.maxFreeBlock, heapStats.minMaxFreeBlock,
+                    heapStats.fragmentation, heapStats.maxFragmentation);
+
+    response.printf("\"jsonArena\":{\"capacity\":%u,\"highWater\":%u,\"leases\":%u,\"rejected\":%u},",
+                    (unsigned)jsonArena.capacity(), (unsigned)jsonArena.highWater, jsonArena.leases, jsonArena.rejected);
+
+    response.printf("\"persist\":{\"writes\":%u,\"writeFailures\":%u,\"lastWriteUs\":%u,\"maxWriteUs\":%u,\"recoveries\":%u,\"lastRecoveryUs\":%u,\"corruptCopies\":%u},",
+                    Persist::stats.writes, Persist::stats.writeFailures, Persist::stats.lastWriteUs, Persist::stats.maxWriteUs,
+                    Persist::stats.recoveries, Persist::stats.lastRecoveryUs, Persist::stats.corruptCopies);
+
+    // Flash I/O per file and per caller, and the wear it adds up to
+    uint32_t erases = FlashFS::estimatedErases();
+    uint32_t blocks = FlashFS::blockCount();
+    uint64_t cycles = (uint64_t)blocks * FLASHFS_ENDURANCE;
+    uint32_t yearsLeft = erases ? (uint32_t)(cycles * (millis() / 1000) / erases / 31557600ULL) : 0;
+    response.printf("\"fs\":{\"blockSize\":%u,\"blocks\":%u,\"usedBytes\":%u,\"estimatedErases\":%u,\"metadataCommits\":%u,\"lifeUsedPpm\":%u,\"yearsLeftAtThisRate\":%u,\"untrackedOps\":%u,\"latencyBoundsUs\":[",
+                    (unsigned)FlashFS::fsInfo.blockSize, blocks, (unsigned)FlashFS::fsInfo.usedBytes, erases, FlashFS::metadataCommits,
+                    cycles ? (uint32_t)((uint64_t)erases * 1000000ULL / cycles) : 0, yearsLeft, FlashFS::untrackedOps);
+    for (uint8_t i = 0; i < FLASHFS_LATENCY_BUCKETS - 1; i++)
+        response.printf("%s%u", i ? "," : "", FlashFS::LATENCY_BOUNDS_US[i]);
+    response.print("],\"paths\":[");
+    for (uint8_t i = 0; i < FlashFS::pathCount; i++)
+    {
+        response.printf("%s{\"path\":\"%s\",", i ? "," : "", FlashFS::paths[i].path);
+        printFlashIo(FlashFS::paths[i].io);
+    }
+    response.print("],\"callers\":[");
+    for (uint8_t i = 0; i < FlashFS::callerCount; i++)
+    {
+        const FlashCallerStats &caller = FlashFS::callers[i];
+        response.printf("%s{\"caller\":\"%s%s%s\",", i ? "," : "", caller.name ? caller.name : "other",
+                        caller.detail ? ":" : "", caller.detail ? caller.detail : "");
+        printFlashIo(caller.io);
+    }
+    response.print("]},");
+
+    // Page assets: how often each went out whole, as a 304 or from LittleFS,
+    // and how long from the handler starting to the last byte written
+    response.printf("\"assets\":{\"embeddedBytes\":%u,\"items\":[", embeddedAssetBytes());
+    for (uint8_t i = 0; i < WEB_ASSET_COUNT; i++)
+    {
+        const AssetStats &a = assetStats[i];
+        response.printf("%s{\"path\":\"%s\",\"bytes\":%u,\"override\":%s,\"served\":%u,\"notModified\":%u,\"fromFs\":%u,\"aborted\":%u,\"avgSendUs\":%u,\"maxSendUs\":%u}",
+                        i ? "," : "", WEB_ASSETS[i].path, WEB_ASSETS[i].length, assetOverridden[i] ? "true" : "false",
+                        a.served, a.notModified, a.fromFs, a.aborted, a.served ? (uint32_t)(a.sendUsTotal / a.served) : 0,
+                        a.sendUsMax);
+    }
+    response.print("]},");
+
+    // Connection reuse; heapPerConnection is an estimate, see connections.h
+    response.printf("\"connections\":{\"keepAlive\":%s,\"idleTimeoutMs\":%u,\"backlog\":%u,\"maxStations\":%u,\"stations\":%u,\"requests\":%u,\"accepted\":%u,\"reused\":%u,\"closeRequested\":%u,\"live\":%u,\"maxLive\":%u,\"requestsPerSec\":%u,\"maxRequestsPerSec\":%u,\"heapIdle\":%u,\"heapPerConnection\":%u,\"maxHeapPerConnection\":%u},",
+                    httpKeepAlive ? "true" : "false", HTTP_MAX_CLOSE_WAIT, HTTP_BACKLOG, AP_MAX_STATIONS, WiFi.softAPgetStationNum(),
+                    connectionStats.requests, connectionStats.accepted, connectionStats.reused, connectionStats.closeRequested,
+                    connectionStats.live, connectionStats.maxLive, connectionStats.requestsPerSec, connectionStats.maxRequestsPerSec,
+                    connectionStats.heapIdle,
+                    connectionStats.heapSamples ? (uint32_t)(connectionStats.heapHeldTotal / connectionStats.heapSamples) : 0,
+                    connectionStats.maxHeapHeld);
+
+    // Requests admitted and shed per class, by the bucket or queue that shed them
+    response.printf("\"admission\":{\"globalRate\":%u,\"globalBurst\":%u,\"clientRate\":%u,\"clientBurst\":%u,\"globalTokens\":%d,\"clientsEvicted\":%u,\"classes\":[",
+                    ADMIT_GLOBAL_RATE, ADMIT_GLOBAL_BURST, ADMIT_CLIENT_RATE, ADMIT_CLIENT_BURST,
+                    (int)(globalBucket.milliTokens / 1000), admissionStats.clientsEvicted);
+    for (uint8_t c = 0; c < ADMIT_CLASSES; c++)
+    {
+        response.printf("%s{\"class\":\"%s\",\"admitted\":%u,\"shedGlobal\":%u,\"shedClient\":%u,\"shedQueue\":%u}",
+                        c ? "," : "", ADMIT_CLASS_NAMES[c], admissionStats.admitted[c], admissionStats.shed[SHED_GLOBAL][c],
+                        admissionStats.shed[SHED_CLIENT][c], admissionStats.shed[SHED_QUEUE][c]);
+    }
+    response.print("]},");
+
+    // Document responses and request bodies per wire format (wire.h); the
+    // *Us totals wrap, they are there to take differences between reads
+    response.print("\"wire\":{");
+    for (uint8_t f = 0; f < WIRE_FORMATS; f++)
+    {
+        const WireStats &w = wireStats[f];
+        response.printf("%s\"%s\":{\"responses\":%u,\"bytesOut\":%u,\"serializeUs\":%u,\"avgSerializeUs\":%u,\"maxSerializeUs\":%u,"
+                        "\"requests\":%u,\"bytesIn\":%u,\"parseUs\":%u,\"avgParseUs\":%u,\"maxParseUs\":%u,\"parseErrors\":%u}",
+                        f ? "," : "", WIRE_FORMAT_NAMES[f], w.responses, w.bytesOut, (uint32_t)w.serializeUsTotal,
+                        w.responses ? (uint32_t)(w.serializeUsTotal / w.responses) : 0, w.maxSerializeUs, w.requests, w.bytesIn,
+                        (uint32_t)w.parseUsTotal, w.requests ? (uint32_t)(w.parseUsTotal / w.requests) : 0, w.maxParseUs, w.parseErrors);
+    }
+    response.print("},");
+
+    // Shared /time and /status bodies (cache.h)
+    response.print("\"responseCache\":[");
+    for (uint8_t c = 0; c < CACHE_SLOTS; c++)
+    {
+        const CacheStats &cs = cacheStats[c];
+        uint32_t lookups = cs.hits + cs.misses + cs.stateMiss;
+        response.printf("%s{\"route\":\"%s\",\"hits\":%u,\"misses\":%u,\"stateMisses\":%u,\"bypassed\":%u,\"hitPermille\":%u}",
+                        c ? "," : "", CACHE_SLOT_NAMES[c], cs.hits, cs.misses, cs.stateMiss, cs.bypassed,
+                        lookups ? (uint32_t)((uint64_t)cs.hits * 1000 / lookups) : 0);
+    }
+    response.print("],");
+
+    response.printf("\"events\":{\"logged\":%u,\"onFlash\":%u,\"buffered\":%u,\"segments\":%u,\"oldest\":%u,\"newest\":%u,\"untimed\":%u,\"dropped\":%u,\"flushes\":%u,\"flushFailures\":%u,\"rotations\":%u,\"lastFlushUs\":%u,\"maxFlushUs\":%u},",
+                    eventStats.logged, loggedEventCount(), eventBuffered, eventSegmentCount,
+                    eventSegmentCount ? eventSegments[0].first : 0, eventSegmentCount ? eventSegments[eventSegmentCount - 1].last : 0,
+                    eventStats.untimed, eventStats.dropped, eventStats.flushes, eventStats.flushFailures, eventStats.rotations,
+                    eventStats.lastFlushUs, eventStats.maxFlushUs);
+
+    response.printf("\"catchUp\":{\"runs\":%u,\"fired\":%u,\"skipped\":%u,\"lastGapMin\":%u,\"lastRunUs\":%u},",
+                    catchUpStats.runs, catchUpStats.fired, catchUpStats.skipped, catchUpStats.lastGapMin, catchUpStats.lastRunUs);
+
+    response.printf("\"loop\":{\"passes\":%u,\"maxPassUs\":%u,\"dropped\":%u,\"tasks\":[", taskLoop.passes,
+                    taskLoop.maxPassUs, taskLoop.dropped);
+    for (uint8_t i = 0; i < taskLoop.taskCount(); i++)
+    {
+        const Task &t = taskLoop.task(i);
+        response.printf("%s{\"name\":\"%s\",\"priority\":%u,\"runs\":%u,\"avgUs\":%u,\"maxUs\":%u,\"maxLateUs\":%u,\"overBudget\":%u}",
+                        i ? "," : "", t.name, t.priority, t.runs, t.runs ? (uint32_t)(t.totalUs / t.runs) : 0,
+                        t.maxUs, t.maxLateUs, t.overBudget);
+    }
+    response.print("]},");
+
+    response.printf("\"watchdog\":{\"boot\":%u,\"resetReason\":%u,\"thresholdMs\":%u,\"stallsThisBoot\":%u,\"stalls\":[",
+                    watchdog.boot, lastResetReason, stallThresholdMs, stallsThisBoot);
+    for (uint8_t i = 0; i < watchdog.count; i++)
+    {
+        // Newest first
+        const StallRecord &s = watchdog.records[(watchdog.head + WATCHDOG_RECORDS - 1 - i) % WATCHDOG_RECORDS];
+        response.printf("%s{\"phase\":\"%s\",\"durationMs\":%u,\"uptimeSec\":%u,\"boot\":%u,\"resetReason\":%u}",
+                        i ? "," : "", s.phase, s.durationMs, s.uptimeSec, s.boot, s.resetReason);
+    }
+    response.print("]},");
+
+    response.printf("\"sync\":{\"node\":%u,\"connected\":%s,\"revision\":%u,\"digest\":%u,\"intervalMs\":%u,\"beaconsSent\":%u,\"beaconsSuppressed\":%u,\"snapshotsSent\":%u,\"snapshotsSuppressed\":%u,\"received\":%u,\"rejected\":%u,\"unauthenticated\":%u,\"adopted\":%u,\"conflicts\":%u,\"timeAdjusts\":%u,\"bytesSent\":%u,\"peers\":[",
+                    ESP.getChipId(), syncStarted ? "true" : "false", scheduleRevision, scheduleDigest, trickleIntervalMs,
+                    syncStats.beaconsSent, syncStats.beaconsSuppressed, syncStats.snapshotsSent, syncStats.snapshotsSuppressed,
+                    syncStats.received, syncStats.rejected, syncStats.unauthenticated, syncStats.adopted, syncStats.conflicts, syncStats.timeAdjusts,
+                    syncStats.bytesSent);
+    for (uint8_t i = 0; i < syncPeerCount; i++)
+    {
+        response.printf("%s{\"node\":%u,\"revision\":%u,\"ageMs\":%lu}", i ? "," : "",
+                        syncPeers[i].node, syncPeers[i].revision, millis() - syncPeers[i].lastSeenMs);
+    }
+    response.print("]},");
+
+    // Second clock and how late armed triggers fired against the edge
+    const char *clockSource = !secondClockValid() ? "none" : secondClockLocked() ? "locked" : "coarse";
+#ifdef SQW_PIN
+    if (sqwActive)
+        clockSource = "sqw";
+#endif
+    response.printf("\"triggers\":{\"clock\":\"%s\",\"ppm\":%d,\"locks\":%u,\"measurements\":%u,\"late\":%u,\"misses\":%u,\"steps\":%u,\"lastCorrectionUs\":%d,\"maxCorrectionUs\":%u,"
+                    "\"armed\":%u,\"armedTotal\":%u,\"fired\":%u,\"skipped\":%u,\"overflow\":%u,\"maxLateUs\":%u,\"p50LateMs\":%u,\"p90LateMs\":%u,\"p99LateMs\":%u,\"lateMs\":[",
+                    clockSource, (int)(clockUsPerSecond - 1000000UL), clockStats.locks, clockStats.measurements, clockStats.late,
+                    clockStats.misses, clockStats.steps, clockStats.lastCorrectionUs, clockStats.maxCorrectionUs,
+                    armedCount, triggerStats.armed, triggerStats.fired, triggerStats.skipped, triggerStats.overflow,
+                    triggerStats.maxLateUs, latenessPercentileMs(50), latenessPercentileMs(90), latenessPercentileMs(99));
+    for (uint8_t i = 0; i < LATENESS_BUCKETS; i++)
+    {
+        if (i < LATENESS_BUCKETS - 1)
+            response.printf("%s{\"le\":%u,\"count\":%u}", i ? "," : "", LATENESS_BOUNDS_MS[i], triggerStats.lateness[i]);
+        else
+            response.printf(",{\"le\":null,\"count\":%u}", triggerStats.lateness[i]);
+    }
+    response.print("]},");
+
+    // How long bells rang past their duration, per off mode (ringing.h)
+    response.printf("\"bellOff\":{\"mode\":\"%s\",\"modes\":[", BELL_OFF_MODE_NAMES[bell.getTimedOff() ? BELL_OFF_TIMER : BELL_OFF_LOOP]);
+    for (uint8_t m = 0; m < BELL_OFF_MODES; m++)
+    {
+        const BellOffStats &b = bellOffStats[m];
+        response.printf("%s{\"mode\":\"%s\",\"offs\":%u,\"maxOverrunUs\":%u,\"overrunMs\":[",
+                        m ? "," : "", BELL_OFF_MODE_NAMES[m], b.offs, b.maxOverrunUs);
+        for (uint8_t i = 0; i < OVERRUN_BUCKETS; i++)
+        {
+            if (i < OVERRUN_BUCKETS - 1)
+                response.printf("%s{\"le\":%u,\"count\":%u}", i ? "," : "", OVERRUN_BOUNDS_MS[i], b.overrun[i]);
+            else
+                response.printf(",{\"le\":null,\"count\":%u}", b.overrun[i]);
+        }
+        response.print("]}");
+    }
+    response.print("]},");
+
+    // Dozing between triggers; served only while awake, so the radio is on
+    response.printf("\"power\":{\"mode\":\"%s\",\"blocker\":\"%s\",\"nextEventS\":%d,\"dozes\":%u,\"slices\":%u,\"wakes\":{",
+                    POWER_MODE_NAMES[powerMode], powerBlocker ? powerBlocker : "", nextEventS, powerStats.dozes, powerStats.slices);
+    for (uint8_t i = 0; i < WAKE_REASONS; i++)
+        response.printf("%s\"%s\":%u", i ? "," : "", WAKE_REASON_NAMES[i], powerStats.wakes[i]);
+    response.printf("},\"radioOffS\":%u,\"lightSleepS\":%u,\"lastDozeS\":%u,\"maxRadioUpUs\":%u,\"radioDutyPermille\":%u,\"cpuDutyPermille\":%u},",
+                    powerStats.radioOffS, powerStats.lightSleepS, powerStats.lastDozeS, powerStats.maxRadioUpUs,
+                    dutyPermille(powerStats.radioOffS), dutyPermille(powerStats.lightSleepS));
+
+    response.print("\"routes\":[");
+    for (uint8_t i = 0; i < routeCount; i++)
+    {
+        const RouteStats &r = routeStats[i];
+        response.printf("%s{\"path\":\"%s\",\"class\":\"%s\",\"calls\":%u,\"shed\":%u,\"us\":%u,\"maxUs\":%u,\"minFreeHeap\":%u,\"maxHeapDrop\":%u,\"minFreeBlock\":%u}",
+                        i ? "," : "", r.path, ADMIT_CLASS_NAMES[r.admitClass], r.calls, r.shed, r.totalUs, r.maxUs,
+                        r.calls ? r.minFreeHeap : 0, r.maxHeapDrop, r.calls ? r.minFreeBlock : 0);
+    }
+    response.print("]}");
+    response.end();
 }
 
 void WifiSetup()
@@ -580,29 +1457,65 @@ void WifiSetup()
     const char *ssid = "NodeMCU_AP";
     const char *password = "12345678"; // at least 8 chars
 
-    WiFi.softAP(ssid, password);
+    WiFi.softAP(ssid, password, 1, false, AP_MAX_STATIONS);
+    server.keepAlive(httpKeepAlive); // see connections.h
+    beginSyncNetwork(); // also join the campus network if configured
 
     dbgln("Access Point Started");
     dbg("IP address: ");
     dbgln(WiFi.softAPIP());
+}
 
-    // Setup web server routes
-    server.on("/", handleRoot);
-    server.on("/style.css", handleCSS);
-    server.on("/script.js", handleJS);
-    server.on("/time", handleTime);
-    server.on("/status", handleStatus);
-    server.on("/led/toggle", HTTP_POST, handleLEDToggle);
-    server.on("/bell/toggle", HTTP_POST, handleBellToggle);
-    server.on("/schedules", handleSchedules);
-    server.on("/schedules/add", HTTP_POST, handleAddSchedule);
-    server.on("/schedules/delete", HTTP_POST, handleDeleteSchedule);
-    server.on("/schedules/edit", HTTP_POST, handleEditSchedule); // Added edit route
-    server.on("/send-time", HTTP_POST, handleSendTime);          // Added send-time route
+// Registers the routes and starts listening; run from the HTTP task so setup()
+// doesn't wait for it
+void startWebServer()
+{
+    // Setup web server routes; see admission.h for the classes
+    route("/", handleRoot, ADMIT_STATIC);
+    route("/style.css", handleCSS, ADMIT_STATIC);
+    route("/script.js", handleJS, ADMIT_STATIC);
+    route("/time", handleTime);
+    route("/status", handleStatus);
+    route("/led/toggle", HTTP_POST, handleLEDToggle, ADMIT_CONTROL);
+    route("/bell/toggle", HTTP_POST, handleBellToggle, ADMIT_CONTROL);
+    route("/schedules", handleSchedules);
+    route("/schedules/upcoming", handleUpcomingSchedules);
+    route("/schedules/changes", handleScheduleChanges);
+    route("/schedules/add", HTTP_POST, handleAddSchedule);
+    route("/schedules/delete", HTTP_POST, handleDeleteSchedule);
+    route("/schedules/edit", HTTP_POST, handleEditSchedule); // Added edit route
+    route("/send-time", HTTP_POST, handleSendTime, ADMIT_CONTROL); // Added send-time route
 
     // Config endpoints
-    server.on("/config", handleGetConfig);
-    server.on("/config/bell-duration", HTTP_POST, handleUpdateBellDuration);
+    route("/config", handleGetConfig);
+    route("/config/bell-duration", HTTP_POST, handleUpdateBellDuration);
+    route("/config/catch-up", HTTP_POST, handleUpdateCatchUp);
+    route("/config/stall-threshold", HTTP_POST, handleUpdateStallThreshold);
+    route("/config/sync", HTTP_POST, handleUpdateSync);
+    route("/config/keep-alive", HTTP_POST, handleUpdateKeepAlive);
+    route("/config/power-save", HTTP_POST, handleUpdatePowerSave);
+    route("/config/bell-timer", HTTP_POST, handleUpdateBellTimer);
+
+    // Diagnostics
+    route("/metrics", handleMetrics);
+    route("/history", handleHistory);
+
+    // Schedule profiles
+    route("/profiles", handleProfiles);
+    route("/profiles/activate", HTTP_POST, handleActivateProfile, ADMIT_CONTROL);
+
+    // Holiday / exception calendar
+    route("/calendar", handleCalendar);
+    route("/calendar/add", HTTP_POST, handleAddCalendarException);
+    route("/calendar/delete", HTTP_POST, handleDeleteCalendarException);
+
+    // Read by serveAsset(), noteRequest() and wire.h; the server drops every
+    // other request header
+    static const char *requestHeaders[] = {"Accept-Encoding", "If-None-Match", "Connection", "Accept", "Content-Type"};
+    server.collectHeaders(requestHeaders, 5);
+    scanAssetOverrides();
     server.begin();
+    server.getServer().begin(80, HTTP_BACKLOG); // listen again, with the backlog cap
+    bootTimes.webReadyMs = millis();
     dbgln("Web server started");
 }
\ No newline at end of file
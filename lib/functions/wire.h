@@ -0,0 +1,109 @@
+// ===== Wire format =====
+// Clients that send "Accept: application/msgpack" get the document-backed
+// and state responses (/schedules, /config, /status, the toggles) as
+// MessagePack instead of JSON: the same document, without the repeated
+// quoted keys and with small numbers in one byte. Request bodies sent with
+// "Content-Type: application/msgpack" are read as MessagePack by every POST
+// route. Routes that stream their JSON with printf (/metrics, /history,
+// /schedules/changes, ...) and error bodies stay JSON, so clients go by the
+// response's Content-Type. Both directions are timed per format for
+// /metrics.
+
+#define WIRE_JSON 0
+#define WIRE_MSGPACK 1
+#define WIRE_FORMATS 2
+
+#define MSGPACK_TYPE "application/msgpack"
+
+struct WireStats
+{
+    uint32_t responses;
+    uint32_t bytesOut;
+    uint64_t serializeUsTotal; // into the response buffer, and the socket for chunks
+    uint32_t maxSerializeUs;
+    uint32_t requests;
+    uint32_t bytesIn;
+    uint64_t parseUsTotal;
+    uint32_t maxParseUs;
+    uint32_t parseErrors;
+};
+
+const char *const WIRE_FORMAT_NAMES[WIRE_FORMATS] = {"json", "msgpack"};
+const char *const WIRE_CONTENT_TYPES[WIRE_FORMATS] = {"application/json", MSGPACK_TYPE};
+
+WireStats wireStats[WIRE_FORMATS] = {};
+
+ResponseWriter &beginResponse(int code, const char *contentType); // webPage.h
+
+// A collected request header, "" if the request had none. The core's
+// header() takes the name as a String, which is allocated for a name longer
+// than the 11 characters String keeps inline ("Content-Type" and up).
+const char *requestHeader(const char *name)
+{
+    for (int i = 0; i < server.headers(); i++)
+    {
+        if (strcasecmp(server.headerName(i).c_str(), name) == 0)
+            return server.header(i).c_str();
+    }
+    return "";
+}
+
+// The format the current request asked for in its Accept header
+uint8_t responseFormat()
+{
+    return strstr(requestHeader("Accept"), MSGPACK_TYPE) != nullptr ? WIRE_MSGPACK : WIRE_JSON;
+}
+
+static void countSerialized(uint8_t format, size_t bytes, uint32_t elapsed)
+{
+    WireStats &stats = wireStats[format];
+    stats.responses++;
+    stats.bytesOut += bytes;
+    stats.serializeUsTotal += elapsed;
+    if (elapsed > stats.maxSerializeUs)
+        stats.maxSerializeUs = elapsed;
+}
+
+// Sends doc in the format the client accepts
+void sendDocument(int code, const JsonDocument &doc)
+{
+    uint8_t format = responseFormat();
+    uint32_t start = micros();
+    ResponseWriter &out = beginResponse(code, WIRE_CONTENT_TYPES[format]);
+    size_t bytes = format == WIRE_MSGPACK ? serializeMsgPack(doc, out) : serializeJson(doc, out);
+    uint32_t elapsed = micros() - start;
+    out.end();
+    countSerialized(format, bytes, elapsed);
+}
+
+// Writes doc into buffer instead, for a response kept to be sent again
+// (cache.h); it counts as served once, here
+size_t renderDocument(const JsonDocument &doc, uint8_t format, char *buffer, size_t size)
+{
+    uint32_t start = micros();
+    size_t bytes = format == WIRE_MSGPACK ? serializeMsgPack(doc, buffer, size) : serializeJson(doc, buffer, size);
+    countSerialized(format, bytes, micros() - start);
+    return bytes;
+}
+
+// Reads the request body into doc, as MessagePack if the client said so.
+// The body is taken with its length, MessagePack has NUL bytes in it.
+DeserializationError parseBody(JsonDocument &doc)
+{
+    const String &body = server.arg("plain");
+    uint8_t format = strncmp(requestHeader("Content-Type"), MSGPACK_TYPE, strlen(MSGPACK_TYPE)) == 0 ? WIRE_MSGPACK : WIRE_JSON;
+    uint32_t start = micros();
+    DeserializationError error = format == WIRE_MSGPACK ? deserializeMsgPack(doc, body.c_str(), body.length())
+                                                        : deserializeJson(doc, body.c_str(), body.length());
+    uint32_t elapsed = micros() - start;
+
+    WireStats &stats = wireStats[format];
+    stats.requests++;
+    stats.bytesIn += body.length();
+    stats.parseUsTotal += elapsed;
+    if (elapsed > stats.maxParseUs)
+        stats.maxParseUs = elapsed;
+    if (error)
+        stats.parseErrors++;
+    return error;
+}
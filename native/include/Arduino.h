@@ -0,0 +1,137 @@
+#ifndef Arduino_h
+#define Arduino_h
+
+// The ESP8266 Arduino core API the firmware uses, on Linux. Only the [env:native]
+// build sees this; see native/library.json for what else is emulated.
+//
+// Time is CLOCK_MONOTONIC since start, and millis()/micros() wrap like on the
+// chip. Interrupts (timer 1, the DS3231 square wave) are POSIX timer signals
+// sent to the thread running setup() and loop(), so they preempt whatever the
+// loop is doing just as they do on the ESP8266; noInterrupts() blocks them.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+#include "WString.h"
+#include "Print.h"
+#include "Stream.h"
+#include "Esp.h"
+#include "HardwareSerial.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x00
+#define INPUT_PULLUP 0x02
+#define OUTPUT 0x01
+
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+// NodeMCU pin names, GPIO numbers
+#define D0 16
+#define D1 5
+#define D2 4
+#define D3 0
+#define D4 2
+#define D5 14
+#define D6 12
+#define D7 13
+#define D8 15
+#define NATIVE_PINS 17
+
+// Flash and IRAM placement mean nothing here
+#define PROGMEM
+#define PGM_P const char *
+#define PGM_VOID_P const void *
+#define PSTR(s) (s)
+#define FPSTR(p) (reinterpret_cast<const __FlashStringHelper *>(p))
+#define F(s) FPSTR(s)
+#define IRAM_ATTR
+#define ICACHE_RAM_ATTR
+#define ICACHE_FLASH_ATTR
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_word(p) (*(const uint16_t *)(p))
+#define pgm_read_dword(p) (*(const uint32_t *)(p))
+#define pgm_read_ptr(p) (*(void *const *)(p))
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define strcpy_P strcpy
+#define strncpy_P strncpy
+#define sprintf_P sprintf
+#define snprintf_P snprintf
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+#define digitalPinToInterrupt(p) (p)
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode);
+void detachInterrupt(uint8_t pin);
+void noInterrupts();
+void interrupts();
+
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+
+using std::max;
+using std::min;
+
+// Timer 1: 80 MHz divided by 1, 16 or 256, counting down from timer1_write()
+#define TIM_DIV1 0
+#define TIM_DIV16 1
+#define TIM_DIV256 3
+#define TIM_EDGE 0
+#define TIM_LEVEL 1
+#define TIM_SINGLE 0
+#define TIM_LOOP 1
+typedef void (*timercallback)(void);
+void timer1_isr_init();
+void timer1_attachInterrupt(timercallback isr);
+void timer1_detachInterrupt();
+void timer1_enable(uint8_t divider, uint8_t intType, uint8_t reload);
+void timer1_disable();
+void timer1_write(uint32_t ticks);
+bool timer1_enabled();
+
+// Light sleep wake sources (user_interface.h); sleeps here are plain delays
+#define GPIO_ID_PIN(n) (n)
+enum GPIO_INT_TYPE
+{
+    GPIO_PIN_INTR_DISABLE = 0,
+    GPIO_PIN_INTR_POSEDGE = 1,
+    GPIO_PIN_INTR_NEGEDGE = 2,
+    GPIO_PIN_INTR_ANYEDGE = 3,
+    GPIO_PIN_INTR_LOLEVEL = 4,
+    GPIO_PIN_INTR_HILEVEL = 5
+};
+void gpio_pin_wakeup_enable(uint32_t pin, GPIO_INT_TYPE type);
+void gpio_pin_wakeup_disable();
+
+// newlib has it, glibc only from 2.38
+#if defined(__GLIBC__) && !__GLIBC_PREREQ(2, 38)
+size_t strlcpy(char *dst, const char *src, size_t size);
+#endif
+
+void setup();
+void loop();
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef ESP8266WebServer_h
+#define ESP8266WebServer_h
+
+#include <functional>
+#include <ESP8266WiFi.h>
+
+// The core's web server as far as the firmware uses it, with its behaviour:
+// one client at a time; after a response the connection is kept for
+// HTTP_MAX_CLOSE_WAIT in case another request comes on it, and let go as
+// soon as a different client is waiting. A request's arguments and collected
+// headers are Strings in arrays allocated per request, freed at the next one
+// or when the client goes. A body that isn't a form is the argument "plain".
+// Routes match the path exactly.
+
+enum HTTPMethod
+{
+    HTTP_ANY,
+    HTTP_GET,
+    HTTP_HEAD,
+    HTTP_POST,
+    HTTP_PUT,
+    HTTP_PATCH,
+    HTTP_DELETE,
+    HTTP_OPTIONS
+};
+
+enum HTTPClientStatus
+{
+    HC_NONE,
+    HC_WAIT_READ,
+    HC_WAIT_CLOSE
+};
+
+#define HTTP_MAX_DATA_WAIT 5000  // ms to wait for the client to send the request
+#define HTTP_MAX_POST_WAIT 5000  // ms to wait for POST data to arrive
+#define HTTP_MAX_SEND_WAIT 5000  // ms to wait for data chunk to be ACKed
+#define HTTP_MAX_CLOSE_WAIT 2000 // ms to wait for the client to close the connection
+
+#define CONTENT_LENGTH_UNKNOWN ((size_t)-1)
+#define CONTENT_LENGTH_NOT_SET ((size_t)-2)
+
+class ESP8266WebServer
+{
+public:
+    typedef std::function<void(void)> THandlerFunction;
+
+    ESP8266WebServer(int port = 80) : server(port) {}
+    ~ESP8266WebServer();
+
+    void begin() { server.begin(); }
+    void begin(uint16_t port) { server.begin(port); }
+    void handleClient();
+    void close();
+    void stop() { close(); }
+
+    void on(const String &uri, THandlerFunction handler) { on(uri, HTTP_ANY, handler); }
+    void on(const String &uri, HTTPMethod method, THandlerFunction handler);
+    void onNotFound(THandlerFunction handler) { notFoundHandler = handler; }
+
+    const String &uri() const { return currentUri; }
+    HTTPMethod method() const { return currentMethod; }
+    WiFiClient &client() { return currentClient; }
+    WiFiServer &getServer() { return server; }
+
+    const String &arg(const String &name) const;
+    const String &arg(int i) const;
+    const String &argName(int i) const;
+    int args() const { return argCount; }
+    bool hasArg(const String &name) const;
+
+    void collectHeaders(const char *headerKeys[], const size_t headerKeysCount);
+    const String &header(const String &name) const;
+    const String &header(int i) const;
+    const String &headerName(int i) const;
+    int headers() const { return headerCount; }
+    bool hasHeader(const String &name) const;
+
+    void send(int code, const char *contentType = nullptr, const String &content = String());
+    void send(int code, const String &contentType, const String &content)
+    {
+        send(code, contentType.c_str(), content);
+    }
+    void send_P(int code, PGM_P contentType, PGM_P content) { send(code, contentType, String(content)); }
+    void sendContent(const String &content) { sendContent(content.c_str(), content.length()); }
+    void sendContent(const char *content, size_t size);
+
+    void keepAlive(bool keepAlive) { keepAliveOn = keepAlive; }
+
+    static String urlDecode(const String &text);
+
+protected:
+    struct RequestArgument
+    {
+        String key;
+        String value;
+    };
+
+    struct Route
+    {
+        String uri;
+        HTTPMethod method;
+        THandlerFunction handler;
+        Route *next;
+    };
+
+    WiFiServer server;
+    WiFiClient currentClient;
+    HTTPClientStatus currentStatus = HC_NONE;
+    uint32_t statusChange = 0;
+    bool keepAliveOn = false;
+
+    HTTPMethod currentMethod = HTTP_ANY;
+    String currentUri;
+    RequestArgument *currentArgs = nullptr;
+    int argCount = 0;
+    RequestArgument *currentHeaders = nullptr;
+    int headerCount = 0;
+
+    Route *firstRoute = nullptr;
+    Route *lastRoute = nullptr;
+    THandlerFunction notFoundHandler;
+
+    bool parseRequest();
+    void parseArguments(const String &data);
+    void collectHeader(const String &name, const String &value);
+    void handleRequest();
+    void dropClient();
+};
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef ESP8266WiFi_h
+#define ESP8266WiFi_h
+
+#include <Arduino.h>
+#include "IPAddress.h"
+#include "WiFiClient.h"
+#include "WiFiServer.h"
+#include "WiFiUdp.h"
+
+enum WiFiMode_t
+{
+    WIFI_OFF = 0,
+    WIFI_STA = 1,
+    WIFI_AP = 2,
+    WIFI_AP_STA = 3
+};
+
+enum wl_status_t
+{
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_SCAN_COMPLETED = 2,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_WRONG_PASSWORD = 6,
+    WL_DISCONNECTED = 7
+};
+
+// The soft AP and the station both are the host's loopback: softAP() always
+// works, and begin() is connected at once with NATIVE_IP as the address.
+// Stations on the AP are the distinct addresses that connected to a server
+// in the last minute.
+class ESP8266WiFiClass
+{
+public:
+    bool mode(WiFiMode_t mode);
+    WiFiMode_t getMode() { return currentMode; }
+
+    bool softAP(const char *ssid, const char *passphrase = nullptr, int channel = 1, int hidden = 0,
+                int maxConnection = 4);
+    bool softAPdisconnect(bool wifiOff = false);
+    IPAddress softAPIP();
+    uint8_t softAPgetStationNum();
+
+    wl_status_t begin(const char *ssid, const char *passphrase = nullptr);
+    bool disconnect(bool wifiOff = false);
+    wl_status_t status();
+    IPAddress localIP();
+
+    bool forceSleepBegin(uint32_t sleepUs = 0);
+    bool forceSleepWake();
+
+    // Native: whether clients can reach the unit
+    bool radioUp() { return currentMode != WIFI_OFF && !sleeping; }
+    void noteStation(IPAddress address);
+
+private:
+    WiFiMode_t currentMode = WIFI_OFF;
+    bool sleeping = false;
+    bool stationJoined = false;
+};
+
+extern ESP8266WiFiClass WiFi;
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef Esp_h
+#define Esp_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include "WString.h"
+
+enum rst_reason
+{
+    REASON_DEFAULT_RST = 0,
+    REASON_WDT_RST = 1,
+    REASON_EXCEPTION_RST = 2,
+    REASON_SOFT_WDT_RST = 3,
+    REASON_SOFT_RESTART = 4,
+    REASON_DEEP_SLEEP_AWAKE = 5,
+    REASON_EXT_SYS_RST = 6
+};
+
+struct rst_info
+{
+    uint32_t reason;
+    uint32_t exccause;
+    uint32_t epc1;
+    uint32_t epc2;
+    uint32_t epc3;
+    uint32_t excvaddr;
+    uint32_t depc;
+};
+
+// The heap figures describe the emulated heap (NativeHeap.h), not the
+// process's: every malloc() and new of the thread running the firmware comes
+// out of it.
+class EspClass
+{
+public:
+    uint32_t getFreeHeap();
+    uint32_t getMaxFreeBlockSize();
+    uint8_t getHeapFragmentation();
+    void getHeapStats(uint32_t *free = nullptr, uint32_t *max = nullptr, uint8_t *frag = nullptr);
+    void getHeapStats(uint32_t *free, uint16_t *max, uint8_t *frag);
+
+    // 512 bytes in 4-byte blocks, zero in a new process as after power-on
+    bool rtcUserMemoryRead(uint32_t offset, uint32_t *data, size_t size);
+    bool rtcUserMemoryWrite(uint32_t offset, uint32_t *data, size_t size);
+
+    rst_info *getResetInfoPtr();
+    String getResetReason();
+    uint32_t getChipId();
+    uint32_t getCpuFreqMHz() { return 80; }
+    uint32_t getCycleCount();
+    void wdtFeed() {}
+    void restart(); // ends the process; whoever started the unit restarts it
+    void reset() { restart(); }
+
+    // The sleep itself is the delay() that follows, as on the chip
+    bool forcedLightSleepBegin(uint32_t durationUs = 0, void (*wakeupCb)() = nullptr);
+    void forcedLightSleepEnd(bool cancel = false);
+};
+
+extern EspClass ESP;
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef FS_H
+#define FS_H
+
+#include <Arduino.h>
+
+// The core's filesystem API as far as the firmware uses it. The only
+// filesystem behind it is LittleFS in RAM (LittleFS.cpp). As with the core,
+// File and Dir are handles: copies share one open file, which closes with
+// the last copy or close(); the open file's state is on the heap.
+
+namespace fs
+{
+    enum SeekMode
+    {
+        SeekSet = 0,
+        SeekCur = 1,
+        SeekEnd = 2
+    };
+
+    struct FSInfo
+    {
+        size_t totalBytes;
+        size_t usedBytes;
+        size_t blockSize;
+        size_t pageSize;
+        size_t maxOpenFiles;
+        size_t maxPathLength;
+    };
+
+    struct FileHandle;
+    struct DirHandle;
+
+    class File : public Stream
+    {
+    public:
+        File() : handle(nullptr) {}
+        explicit File(FileHandle *h) : handle(h) {}
+        File(const File &other);
+        File &operator=(const File &other);
+        ~File() override { release(); }
+
+        size_t write(uint8_t c) override { return write(&c, 1); }
+        size_t write(const uint8_t *buf, size_t size) override;
+        int available() override;
+        int read() override;
+        int peek() override;
+        void flush() override;
+        size_t read(uint8_t *buf, size_t size);
+        // No timeout: a file has all it will have
+        size_t readBytes(char *buffer, size_t length) override { return read((uint8_t *)buffer, length); }
+
+        bool seek(uint32_t pos, SeekMode mode);
+        bool seek(uint32_t pos) { return seek(pos, SeekSet); }
+        size_t position() const;
+        size_t size() const;
+        void close();
+        operator bool() const;
+        const char *name() const;     // without the directory
+        const char *fullName() const; // without the leading '/'
+        bool isFile() const { return (bool)*this; }
+        bool isDirectory() const { return false; }
+
+    private:
+        FileHandle *handle;
+        void release();
+    };
+
+    class Dir
+    {
+    public:
+        Dir() : handle(nullptr) {}
+        explicit Dir(DirHandle *h) : handle(h) {}
+        Dir(const Dir &other);
+        Dir &operator=(const Dir &other);
+        ~Dir() { release(); }
+
+        // Steps to the next entry, files and subdirectories, in name order
+        bool next();
+        String fileName();
+        size_t fileSize();
+        bool isFile() const;
+        bool isDirectory() const;
+        File openFile(const char *mode);
+        bool rewind();
+
+    private:
+        DirHandle *handle;
+        void release();
+    };
+
+    class FS
+    {
+    public:
+        bool begin();
+        void end();
+        bool format();
+        bool info(FSInfo &info);
+
+        File open(const char *path, const char *mode);
+        File open(const String &path, const char *mode) { return open(path.c_str(), mode); }
+        bool exists(const char *path);
+        bool exists(const String &path) { return exists(path.c_str()); }
+        Dir openDir(const char *path);
+        Dir openDir(const String &path) { return openDir(path.c_str()); }
+        bool remove(const char *path);
+        bool remove(const String &path) { return remove(path.c_str()); }
+        bool rename(const char *pathFrom, const char *pathTo);
+        bool rename(const String &pathFrom, const String &pathTo) { return rename(pathFrom.c_str(), pathTo.c_str()); }
+        bool mkdir(const char *path);
+        bool mkdir(const String &path) { return mkdir(path.c_str()); }
+        bool rmdir(const char *path);
+        bool rmdir(const String &path) { return rmdir(path.c_str()); }
+    };
+}
+
+using fs::Dir;
+using fs::File;
+using fs::FS;
+using fs::FSInfo;
+using fs::SeekCur;
+using fs::SeekEnd;
+using fs::SeekMode;
+using fs::SeekSet;
+
+#endif
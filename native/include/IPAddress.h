@@ -0,0 +1,30 @@
+#ifndef IPAddress_h
+#define IPAddress_h
+
+#include <Arduino.h>
+
+// IPv4 only; the uint32_t form has the first octet in the low byte, as on
+// the chip (network byte order in memory)
+class IPAddress
+{
+public:
+    IPAddress() : address(0) {}
+    IPAddress(uint32_t raw) : address(raw) {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+        : address((uint32_t)a | (uint32_t)b << 8 | (uint32_t)c << 16 | (uint32_t)d << 24) {}
+
+    operator uint32_t() const { return address; }
+    uint8_t operator[](int index) const { return address >> (index * 8); }
+    bool operator==(const IPAddress &other) const { return address == other.address; }
+    bool operator!=(const IPAddress &other) const { return address != other.address; }
+    bool isSet() const { return address != 0; }
+
+    bool fromString(const char *text);
+    bool fromString(const String &text) { return fromString(text.c_str()); }
+    String toString() const;
+
+private:
+    uint32_t address;
+};
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef LittleFS_h
+#define LittleFS_h
+
+#include <FS.h>
+
+// LittleFS held in RAM, with the geometry of the nodemcuv2's 2 MB
+// filesystem (8 KB blocks, 256-byte pages). It starts empty, as if freshly
+// formatted, and is gone when the process exits; directories exist while a
+// file is under them, as LittleFS's SPIFFS-compatible mode keeps them.
+// Once it is full, write() stores nothing. What it would have programmed
+// is counted, see Native::flashStats().
+
+extern fs::FS LittleFS;
+
+#endif
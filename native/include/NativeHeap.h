@@ -0,0 +1,63 @@
+#ifndef NativeHeap_h
+#define NativeHeap_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+// The ESP8266's heap, emulated: one fixed arena managed best-fit with
+// coalescing, as umm_malloc does in the core. malloc(), free(), realloc() and
+// calloc() are replaced for the whole process; calls from a thread that
+// attached itself (the one running setup() and loop(), see main.cpp) are
+// served from the arena, all others from glibc. So ESP.getFreeHeap() and
+// ESP.getMaxFreeBlockSize() move with what the firmware, the emulated core
+// (String, WiFiClient, the web server's parsed request) and ArduinoJson
+// allocate, and an arena that runs out fails the allocation as the chip
+// would.
+//
+// Blocks carry a 16-byte header and are rounded up to 16 bytes, where
+// umm_malloc uses 8-byte blocks with a 4-byte header; fragmentation shows up
+// the same way, small sizes cost a bit more.
+
+#ifndef NATIVE_HEAP_SIZE
+#define NATIVE_HEAP_SIZE (48 * 1024) // NATIVE_HEAP overrides it at start
+#endif
+
+namespace NativeHeap
+{
+    struct Stats
+    {
+        uint32_t size;
+        uint32_t freeBytes; // usable bytes in free blocks
+        uint32_t maxFreeBlock;
+        uint32_t freeBlocks;
+        uint32_t usedBlocks;
+        uint8_t fragmentation; // as ESP.getHeapFragmentation()
+        uint64_t allocations;  // malloc(), calloc(), and realloc() that moved
+        uint64_t frees;
+        uint32_t failures; // requests the arena had no block for
+    };
+
+    // Sets the arena up; before any thread attaches
+    void begin(size_t size);
+
+    // Allocations of the calling thread come from the arena from now on
+    void attachThread();
+    void detachThread();
+    bool threadAttached();
+
+    Stats stats();
+
+    // Allocations in its lifetime go to glibc even on an attached thread:
+    // for what the chip keeps elsewhere (flash contents) and for test
+    // plumbing
+    class HostScope
+    {
+    public:
+        HostScope();
+        ~HostScope();
+        HostScope(const HostScope &) = delete;
+        HostScope &operator=(const HostScope &) = delete;
+    };
+}
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef NativeHost_h
+#define NativeHost_h
+
+#include <stdint.h>
+
+// What the [env:native] build adds around the emulated core: start-up, and
+// the hooks tests use in place of hardware. A unit is configured from its
+// environment, all optional:
+//
+//   NATIVE_HTTP_PORT     port the web server's port 80 listens on (8080)
+//   NATIVE_IP            station address once WiFi.begin() (127.0.0.1)
+//   NATIVE_CHIP_ID       ESP.getChipId(), what sync.h tells units apart by (pid)
+//   NATIVE_HEAP          emulated heap size in bytes (NATIVE_HEAP_SIZE)
+//   NATIVE_RTC           0: no DS3231 on the bus
+//   NATIVE_RTC_OFFSET    DS3231 time minus host time at start, in seconds (0)
+//   NATIVE_RTC_PPM       DS3231 rate error in ppm, + runs fast (0)
+//   NATIVE_SQW_PIN       GPIO the DS3231's INT/SQW drives (0, which is D3)
+//   NATIVE_GPIO_TRACE    file every pin change is appended to, one
+//                        "<CLOCK_REALTIME us> <gpio> <level>" line each
+//   NATIVE_RESET_REASON  ESP.getResetInfoPtr()->reason (REASON_DEFAULT_RST)
+//   NATIVE_SEED          seed of random() (from the clock)
+//   NATIVE_LOOP_NAP_US   sleep after every loop(), so many units fit on one
+//                        machine (100)
+
+namespace Native
+{
+    // Sets up the heap, the interrupt signals and the emulated chips, and
+    // makes the calling thread the one the firmware runs on: its allocations
+    // come from the emulated heap and interrupts preempt it. main() calls it
+    // before setup(); a test calls it first thing.
+    void begin();
+
+    // Drives an input pin from outside, e.g. a button (LOW is pressed)
+    void setInput(uint8_t pin, uint8_t level);
+
+    // What the firmware last wrote to a pin
+    uint8_t outputLevel(uint8_t pin);
+
+    // CLOCK_REALTIME, for timestamps compared across units
+    uint64_t realtimeUs();
+
+    // Moves millis() and micros() on as if that much time had passed, so a
+    // test gets past rate limits and timeouts without waiting them out. The
+    // DS3231 and delay() keep host time.
+    void advanceClock(uint32_t ms);
+
+    // What LittleFS would have done to flash since start. Files are
+    // copy-on-write: a commit (flush() or close() after changes) programs
+    // every block from the one holding the first changed byte to the end of
+    // the file, and updates the file's metadata; rename() and remove() are
+    // metadata updates too.
+    struct FlashStats
+    {
+        uint64_t bytesProgrammed; // data, in whole blocks
+        uint32_t commits;         // metadata updates
+        uint32_t opens;
+        uint64_t bytesRead;
+        uint64_t bytesWritten; // as handed to File::write()
+    };
+
+    FlashStats flashStats();
+
+    // Heap allocations the web server's last route handler made, from its
+    // call to its return: what the firmware asked for to answer a request,
+    // apart from the core reading the request in
+    uint64_t handlerAllocations();
+}
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef _RTCLIB_H_
+#define _RTCLIB_H_
+
+// The part of Adafruit RTClib the firmware uses: DateTime, TimeSpan, and
+// RTC_DS3231, which talks to the emulated DS3231 over Wire register by
+// register, as the library does on the chip.
+
+#include <Arduino.h>
+#include <Wire.h>
+
+#define SECONDS_PER_DAY 86400L
+#define SECONDS_FROM_1970_TO_2000 946684800
+
+class TimeSpan;
+
+class DateTime
+{
+public:
+    DateTime(uint32_t t = SECONDS_FROM_1970_TO_2000);
+    DateTime(uint16_t year, uint8_t month, uint8_t day, uint8_t hour = 0, uint8_t min = 0, uint8_t sec = 0);
+    DateTime(const DateTime &copy) = default;
+    DateTime(const char *date, const char *time);
+    DateTime(const __FlashStringHelper *date, const __FlashStringHelper *time)
+        : DateTime(reinterpret_cast<const char *>(date), reinterpret_cast<const char *>(time)) {}
+    DateTime &operator=(const DateTime &) = default;
+
+    bool isValid() const;
+    uint16_t year() const { return 2000U + yOff; }
+    uint8_t month() const { return m; }
+    uint8_t day() const { return d; }
+    uint8_t hour() const { return hh; }
+    uint8_t twelveHour() const;
+    uint8_t isPM() const { return hh >= 12; }
+    uint8_t minute() const { return mm; }
+    uint8_t second() const { return ss; }
+    uint8_t dayOfTheWeek() const; // 0 = Sunday
+    uint32_t secondstime() const;
+    uint32_t unixtime() const;
+
+    DateTime operator+(const TimeSpan &span) const;
+    DateTime operator-(const TimeSpan &span) const;
+    TimeSpan operator-(const DateTime &right) const;
+    bool operator<(const DateTime &right) const { return unixtime() < right.unixtime(); }
+    bool operator>(const DateTime &right) const { return right < *this; }
+    bool operator<=(const DateTime &right) const { return !(*this > right); }
+    bool operator>=(const DateTime &right) const { return !(*this < right); }
+    bool operator==(const DateTime &right) const { return unixtime() == right.unixtime(); }
+    bool operator!=(const DateTime &right) const { return !(*this == right); }
+
+protected:
+    uint8_t yOff; // years since 2000
+    uint8_t m;
+    uint8_t d;
+    uint8_t hh;
+    uint8_t mm;
+    uint8_t ss;
+};
+
+class TimeSpan
+{
+public:
+    TimeSpan(int32_t seconds = 0) : total(seconds) {}
+    TimeSpan(int16_t days, int8_t hours, int8_t minutes, int8_t seconds)
+        : total((int32_t)days * 86400L + (int32_t)hours * 3600 + (int32_t)minutes * 60 + seconds) {}
+    int16_t days() const { return total / 86400L; }
+    int8_t hours() const { return total / 3600 % 24; }
+    int8_t minutes() const { return total / 60 % 60; }
+    int8_t seconds() const { return total % 60; }
+    int32_t totalseconds() const { return total; }
+    TimeSpan operator+(const TimeSpan &right) const { return TimeSpan(total + right.total); }
+    TimeSpan operator-(const TimeSpan &right) const { return TimeSpan(total - right.total); }
+
+protected:
+    int32_t total;
+};
+
+enum Ds3231SqwPinMode
+{
+    DS3231_OFF = 0x1C,
+    DS3231_SquareWave1Hz = 0x00,
+    DS3231_SquareWave1kHz = 0x08,
+    DS3231_SquareWave4kHz = 0x10,
+    DS3231_SquareWave8kHz = 0x18
+};
+
+enum Ds3231Alarm1Mode
+{
+    DS3231_A1_PerSecond = 0x0F,
+    DS3231_A1_Second = 0x0E,
+    DS3231_A1_Minute = 0x0C,
+    DS3231_A1_Hour = 0x08,
+    DS3231_A1_Date = 0x00,
+    DS3231_A1_Day = 0x10
+};
+
+enum Ds3231Alarm2Mode
+{
+    DS3231_A2_PerMinute = 0x7,
+    DS3231_A2_Minute = 0x6,
+    DS3231_A2_Hour = 0x4,
+    DS3231_A2_Date = 0x0,
+    DS3231_A2_Day = 0x8
+};
+
+class RTC_DS3231
+{
+public:
+    bool begin(TwoWire *wireInstance = &Wire);
+    void adjust(const DateTime &dt);
+    bool lostPower();
+    DateTime now();
+    Ds3231SqwPinMode readSqwPinMode();
+    void writeSqwPinMode(Ds3231SqwPinMode mode);
+    bool setAlarm1(const DateTime &dt, Ds3231Alarm1Mode alarmMode);
+    bool setAlarm2(const DateTime &dt, Ds3231Alarm2Mode alarmMode);
+    void disableAlarm(uint8_t alarmNum);
+    void clearAlarm(uint8_t alarmNum);
+    bool alarmFired(uint8_t alarmNum);
+    void enable32K();
+    void disable32K();
+    bool isEnabled32K();
+    float getTemperature();
+
+    static uint8_t bcd2bin(uint8_t val) { return val - 6 * (val >> 4); }
+    static uint8_t bin2bcd(uint8_t val) { return val + 6 * (val / 10); }
+
+private:
+    TwoWire *wire = &Wire;
+
+    uint8_t readRegister(uint8_t reg);
+    void writeRegister(uint8_t reg, uint8_t value);
+};
+
+#endif
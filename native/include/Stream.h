@@ -0,0 +1,32 @@
+#ifndef Stream_h
+#define Stream_h
+
+#include "Print.h"
+
+// readBytes() waits up to the timeout for more data, like the core's, except
+// where a subclass overrides it (File does)
+class Stream : public Print
+{
+public:
+    Stream() : timeoutMs(1000) {}
+
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    void setTimeout(unsigned long timeout) { timeoutMs = timeout; }
+    unsigned long getTimeout() const { return timeoutMs; }
+
+    virtual size_t readBytes(char *buffer, size_t length);
+    virtual size_t readBytes(uint8_t *buffer, size_t length) { return readBytes((char *)buffer, length); }
+    size_t readBytesUntil(char terminator, char *buffer, size_t length);
+    String readString();
+    String readStringUntil(char terminator);
+
+protected:
+    unsigned long timeoutMs;
+
+    int timedRead();
+};
+
+#endif
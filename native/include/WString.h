@@ -0,0 +1,258 @@
+#ifndef WString_h
+#define WString_h
+
+// Arduino String as the ESP8266 core has it: up to SSO_CAPACITY characters
+// live inside the object, longer ones in one malloc() block rounded up to 16
+// bytes, so String use costs the emulated heap what it costs on the chip.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+class __FlashStringHelper;
+class StringSumHelper;
+
+class String
+{
+public:
+    static const unsigned SSO_CAPACITY = 11;
+
+    String() { init(); }
+    String(const char *cstr);
+    String(const char *cstr, unsigned length);
+    String(const String &str);
+    String(String &&str) noexcept;
+    String(const __FlashStringHelper *str) : String(reinterpret_cast<const char *>(str)) {}
+    explicit String(char c);
+    explicit String(unsigned char value, unsigned char base = 10);
+    explicit String(int value, unsigned char base = 10);
+    explicit String(unsigned int value, unsigned char base = 10);
+    explicit String(long value, unsigned char base = 10);
+    explicit String(unsigned long value, unsigned char base = 10);
+    explicit String(long long value, unsigned char base = 10);
+    explicit String(unsigned long long value, unsigned char base = 10);
+    explicit String(float value, unsigned char decimalPlaces = 2);
+    explicit String(double value, unsigned char decimalPlaces = 2);
+    ~String() { invalidate(); }
+
+    bool reserve(unsigned size);
+    unsigned length() const { return len; }
+    unsigned capacity() const { return onHeap ? heap.capacity : SSO_CAPACITY; }
+    bool isEmpty() const { return len == 0; }
+
+    String &operator=(const String &rhs);
+    String &operator=(String &&rhs) noexcept;
+    String &operator=(const char *cstr);
+    String &operator=(const __FlashStringHelper *str) { return *this = reinterpret_cast<const char *>(str); }
+    String &operator=(char c);
+
+    bool concat(const String &str) { return concat(str.c_str(), str.length()); }
+    bool concat(const char *cstr);
+    bool concat(const char *cstr, unsigned length);
+    bool concat(const __FlashStringHelper *str) { return concat(reinterpret_cast<const char *>(str)); }
+    bool concat(char c) { return concat(&c, 1); }
+    bool concat(unsigned char value) { return concat(String(value)); }
+    bool concat(int value) { return concat(String(value)); }
+    bool concat(unsigned int value) { return concat(String(value)); }
+    bool concat(long value) { return concat(String(value)); }
+    bool concat(unsigned long value) { return concat(String(value)); }
+    bool concat(long long value) { return concat(String(value)); }
+    bool concat(unsigned long long value) { return concat(String(value)); }
+    bool concat(float value) { return concat(String(value)); }
+    bool concat(double value) { return concat(String(value)); }
+
+    template <typename T>
+    String &operator+=(const T &rhs)
+    {
+        concat(rhs);
+        return *this;
+    }
+
+    int compareTo(const String &s) const;
+    bool equals(const String &s) const;
+    bool equals(const char *cstr) const;
+    bool equalsIgnoreCase(const String &s) const;
+    bool equalsConstantTime(const String &s) const;
+    bool operator==(const String &rhs) const { return equals(rhs); }
+    bool operator==(const char *cstr) const { return equals(cstr); }
+    bool operator!=(const String &rhs) const { return !equals(rhs); }
+    bool operator!=(const char *cstr) const { return !equals(cstr); }
+    bool operator<(const String &rhs) const { return compareTo(rhs) < 0; }
+    bool operator>(const String &rhs) const { return compareTo(rhs) > 0; }
+    bool operator<=(const String &rhs) const { return compareTo(rhs) <= 0; }
+    bool operator>=(const String &rhs) const { return compareTo(rhs) >= 0; }
+    bool startsWith(const String &prefix) const { return startsWith(prefix, 0); }
+    bool startsWith(const char *prefix) const { return startsWith(String(prefix)); }
+    bool startsWith(const String &prefix, unsigned offset) const;
+    bool endsWith(const String &suffix) const;
+    bool endsWith(const char *suffix) const { return endsWith(String(suffix)); }
+
+    char charAt(unsigned index) const { return operator[](index); }
+    void setCharAt(unsigned index, char c);
+    char operator[](unsigned index) const;
+    char &operator[](unsigned index);
+    void getBytes(unsigned char *buf, unsigned bufsize, unsigned index = 0) const;
+    void toCharArray(char *buf, unsigned bufsize, unsigned index = 0) const
+    {
+        getBytes((unsigned char *)buf, bufsize, index);
+    }
+    const char *c_str() const { return buffer(); }
+    char *begin() { return wbuffer(); }
+    char *end() { return wbuffer() + len; }
+    const char *begin() const { return c_str(); }
+    const char *end() const { return c_str() + len; }
+
+    int indexOf(char ch, unsigned fromIndex = 0) const;
+    int indexOf(const char *str, unsigned fromIndex = 0) const;
+    int indexOf(const String &str, unsigned fromIndex = 0) const { return indexOf(str.c_str(), fromIndex); }
+    int lastIndexOf(char ch) const;
+    int lastIndexOf(char ch, unsigned fromIndex) const;
+    int lastIndexOf(const String &str) const;
+    int lastIndexOf(const String &str, unsigned fromIndex) const;
+    String substring(unsigned beginIndex) const { return substring(beginIndex, len); }
+    String substring(unsigned beginIndex, unsigned endIndex) const;
+
+    void replace(char find, char replace);
+    void replace(const String &find, const String &replace);
+    void replace(const char *find, const char *replace) { this->replace(String(find), String(replace)); }
+    void remove(unsigned index);
+    void remove(unsigned index, unsigned count);
+    void toLowerCase();
+    void toUpperCase();
+    void trim();
+
+    long toInt() const;
+    float toFloat() const;
+    double toDouble() const;
+
+    explicit operator bool() const { return true; }
+
+protected:
+    // The first SSO_CAPACITY + 1 bytes hold the text while it fits
+    union
+    {
+        char ssoBuffer[SSO_CAPACITY + 1];
+        struct
+        {
+            char *ptr;
+            unsigned capacity;
+        } heap;
+    };
+    unsigned len;
+    bool onHeap;
+
+    const char *buffer() const { return onHeap ? heap.ptr : ssoBuffer; }
+    char *wbuffer() { return onHeap ? heap.ptr : ssoBuffer; }
+
+    void init()
+    {
+        onHeap = false;
+        len = 0;
+        ssoBuffer[0] = '\0';
+    }
+    void invalidate();
+    bool changeBuffer(unsigned maxStrLen);
+    String &copy(const char *cstr, unsigned length);
+    void move(String &rhs) noexcept;
+};
+
+class StringSumHelper : public String
+{
+public:
+    StringSumHelper(const String &s) : String(s) {}
+    StringSumHelper(String &&s) : String(static_cast<String &&>(s)) {}
+    StringSumHelper(const char *p) : String(p) {}
+    StringSumHelper(char c) : String(c) {}
+    StringSumHelper(unsigned char num) : String(num) {}
+    StringSumHelper(int num) : String(num) {}
+    StringSumHelper(unsigned int num) : String(num) {}
+    StringSumHelper(long num) : String(num) {}
+    StringSumHelper(unsigned long num) : String(num) {}
+    StringSumHelper(long long num) : String(num) {}
+    StringSumHelper(unsigned long long num) : String(num) {}
+    StringSumHelper(float num) : String(num) {}
+    StringSumHelper(double num) : String(num) {}
+};
+
+// a + b + c: every + after the first appends to the same temporary
+StringSumHelper &operator+(const StringSumHelper &lhs, const String &rhs);
+StringSumHelper &operator+(const StringSumHelper &lhs, const char *cstr);
+StringSumHelper &operator+(const StringSumHelper &lhs, const __FlashStringHelper *rhs);
+StringSumHelper &operator+(const StringSumHelper &lhs, char c);
+StringSumHelper &operator+(const StringSumHelper &lhs, unsigned char num);
+StringSumHelper &operator+(const StringSumHelper &lhs, int num);
+StringSumHelper &operator+(const StringSumHelper &lhs, unsigned int num);
+StringSumHelper &operator+(const StringSumHelper &lhs, long num);
+StringSumHelper &operator+(const StringSumHelper &lhs, unsigned long num);
+StringSumHelper &operator+(const StringSumHelper &lhs, long long num);
+StringSumHelper &operator+(const StringSumHelper &lhs, unsigned long long num);
+StringSumHelper &operator+(const StringSumHelper &lhs, float num);
+StringSumHelper &operator+(const StringSumHelper &lhs, double num);
+
+inline StringSumHelper operator+(const String &lhs, const String &rhs)
+{
+    StringSumHelper sum(lhs);
+    sum.concat(rhs);
+    return sum;
+}
+
+inline StringSumHelper operator+(const char *lhs, const String &rhs)
+{
+    StringSumHelper sum(lhs);
+    sum.concat(rhs);
+    return sum;
+}
+
+inline StringSumHelper operator+(const String &lhs, const char *rhs)
+{
+    StringSumHelper sum(lhs);
+    sum.concat(rhs);
+    return sum;
+}
+
+inline StringSumHelper operator+(const String &lhs, char rhs)
+{
+    StringSumHelper sum(lhs);
+    sum.concat(rhs);
+    return sum;
+}
+
+inline StringSumHelper operator+(const String &lhs, int rhs)
+{
+    StringSumHelper sum(lhs);
+    sum.concat(rhs);
+    return sum;
+}
+
+inline StringSumHelper operator+(const String &lhs, unsigned int rhs)
+{
+    StringSumHelper sum(lhs);
+    sum.concat(rhs);
+    return sum;
+}
+
+inline StringSumHelper operator+(const String &lhs, long rhs)
+{
+    StringSumHelper sum(lhs);
+    sum.concat(rhs);
+    return sum;
+}
+
+inline StringSumHelper operator+(const String &lhs, unsigned long rhs)
+{
+    StringSumHelper sum(lhs);
+    sum.concat(rhs);
+    return sum;
+}
+
+inline bool operator==(const char *lhs, const String &rhs)
+{
+    return rhs.equals(lhs);
+}
+
+inline bool operator!=(const char *lhs, const String &rhs)
+{
+    return !rhs.equals(lhs);
+}
+
+#endif
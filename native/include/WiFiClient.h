@@ -0,0 +1,54 @@
+#ifndef WiFiClient_h
+#define WiFiClient_h
+
+#include <Arduino.h>
+#include "IPAddress.h"
+
+// A TCP connection. Copies share it, as on the chip, and it closes when the
+// last copy goes or stop() is called. The shared state is allocated on the
+// emulated heap at about the size lwIP's control block and the core's
+// ClientContext take, so open connections cost heap as they do there.
+//
+// write() waits until the send buffer takes everything or the timeout
+// (5 s) passes. availableForWrite() is lwIP's TCP_SND_BUF (2 * 1460) less
+// what sits unacknowledged in the socket.
+class WiFiClient : public Stream
+{
+public:
+    WiFiClient();
+    explicit WiFiClient(int fd); // takes over a connected socket, for tests
+    WiFiClient(const WiFiClient &other);
+    WiFiClient &operator=(const WiFiClient &other);
+    ~WiFiClient() override;
+
+    uint8_t connected();
+    int available() override;
+    int read() override;
+    int read(uint8_t *buffer, size_t size);
+    int read(char *buffer, size_t size) { return read((uint8_t *)buffer, size); }
+    int peek() override;
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    size_t write_P(PGM_P buffer, size_t size) { return write((const uint8_t *)buffer, size); }
+    int availableForWrite() override;
+    void flush() override {}
+    void stop();
+    operator bool() { return available() || connected(); }
+
+    IPAddress remoteIP();
+    uint16_t remotePort();
+    IPAddress localIP();
+    uint16_t localPort();
+    void setNoDelay(bool noDelay);
+
+    using Print::write;
+
+    struct Context;
+
+private:
+    Context *context;
+
+    void release();
+};
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef WiFiServer_h
+#define WiFiServer_h
+
+#include "WiFiClient.h"
+
+// Port 80 is NATIVE_HTTP_PORT on the host. Clients wait in the kernel's
+// accept queue, sized by the backlog as lwIP's is; nothing is accepted while
+// the radio is off.
+class WiFiServer
+{
+public:
+    WiFiServer(uint16_t port) : port(port) {}
+    WiFiServer(IPAddress address, uint16_t port) : port(port) { (void)address; }
+    ~WiFiServer() { close(); }
+
+    void begin() { begin(port); }
+    void begin(uint16_t port) { begin(port, 5); }
+    void begin(uint16_t port, uint8_t backlog);
+    bool hasClient();
+    bool hasMaxPendingClients();
+    WiFiClient accept();
+    WiFiClient available() { return accept(); }
+    void setNoDelay(bool noDelay) { this->noDelay = noDelay; }
+    uint8_t status() { return fd >= 0 ? 1 : 0; }
+    void close();
+    void stop() { close(); }
+
+private:
+    uint16_t port;
+    int fd = -1;
+    uint8_t backlog = 5;
+    bool noDelay = true;
+};
+
+#endif
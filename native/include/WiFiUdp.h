@@ -0,0 +1,61 @@
+#ifndef WiFiUdp_h
+#define WiFiUdp_h
+
+#include "IPAddress.h"
+
+// UDP over the host's loopback: multicast groups are joined on the
+// interface address given (NATIVE_IP), so units on one machine hear each
+// other. A unit doesn't hear its own multicast, like lwIP without
+// IP_MULTICAST_LOOP. Outgoing and received packets are held in malloc()
+// blocks while in use, as the chip's pbufs are.
+class WiFiUDP : public Stream
+{
+public:
+    WiFiUDP() {}
+    ~WiFiUDP() override { stop(); }
+    WiFiUDP(const WiFiUDP &) = delete;
+    WiFiUDP &operator=(const WiFiUDP &) = delete;
+
+    uint8_t begin(uint16_t port);
+    uint8_t beginMulticast(IPAddress interfaceAddress, IPAddress multicast, uint16_t port);
+    void stop();
+
+    int beginPacket(IPAddress ip, uint16_t port);
+    int beginPacketMulticast(IPAddress multicastAddress, uint16_t port, IPAddress interfaceAddress, int ttl = 1);
+    int endPacket();
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t *buffer, size_t size) override;
+
+    int parsePacket();
+    int available() override { return rxLength - rxPosition; }
+    int read() override;
+    int read(unsigned char *buffer, size_t length);
+    int read(char *buffer, size_t length) { return read((unsigned char *)buffer, length); }
+    int peek() override;
+    void flush() override;
+    IPAddress remoteIP() { return rxFrom; }
+    uint16_t remotePort() { return rxFromPort; }
+
+    using Print::write;
+
+private:
+    int rxFd = -1;
+    int txFd = -1;
+    uint16_t txPort = 0; // ours, to drop our own multicast
+    uint32_t txInterface = 0;
+
+    uint32_t txTo = 0;
+    uint16_t txToPort = 0;
+    uint8_t *tx = nullptr;
+    size_t txLength = 0;
+
+    uint8_t *rx = nullptr;
+    size_t rxLength = 0;
+    size_t rxPosition = 0;
+    IPAddress rxFrom;
+    uint16_t rxFromPort = 0;
+
+    bool openTx(uint32_t interfaceAddress, int ttl);
+};
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef TwoWire_h
+#define TwoWire_h
+
+#include <Arduino.h>
+
+#define BUFFER_LENGTH 128
+
+// I2C to the chips on the emulated bus: a DS3231 at 0x68 (unless NATIVE_RTC=0).
+// Other addresses don't answer. A write transaction reaches the chip at
+// endTransmission(), as the bytes go out on the wire then.
+class TwoWire : public Stream
+{
+public:
+    void begin(int sda, int scl);
+    void begin();
+    void setClock(uint32_t frequency) { (void)frequency; }
+    void setClockStretchLimit(uint32_t limit) { (void)limit; }
+
+    void beginTransmission(uint8_t address);
+    void beginTransmission(int address) { beginTransmission((uint8_t)address); }
+    uint8_t endTransmission(uint8_t sendStop);
+    uint8_t endTransmission() { return endTransmission(true); }
+
+    uint8_t requestFrom(uint8_t address, size_t size, bool sendStop);
+    uint8_t requestFrom(uint8_t address, uint8_t size) { return requestFrom(address, (size_t)size, true); }
+    uint8_t requestFrom(int address, int size) { return requestFrom((uint8_t)address, (size_t)size, true); }
+
+    size_t write(uint8_t data) override;
+    size_t write(const uint8_t *data, size_t size) override;
+    int available() override;
+    int read() override;
+    int peek() override;
+    void flush() override {}
+
+    size_t write(unsigned long n) { return write((uint8_t)n); }
+    size_t write(long n) { return write((uint8_t)n); }
+    size_t write(unsigned int n) { return write((uint8_t)n); }
+    size_t write(int n) { return write((uint8_t)n); }
+    using Print::write;
+
+private:
+    uint8_t txAddress = 0;
+    uint8_t txBuffer[BUFFER_LENGTH];
+    size_t txLength = 0;
+    uint8_t rxBuffer[BUFFER_LENGTH];
+    size_t rxIndex = 0;
+    size_t rxLength = 0;
+};
+
+extern TwoWire Wire;
+
+#endif
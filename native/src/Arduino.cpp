@@ -0,0 +1,517 @@
+#include "NativeCore.h"
+#include <NativeHeap.h>
+#include <NativeHost.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace
+{
+    uint64_t startNs = 0;
+    pid_t firmwareTid = 0;
+    pthread_t firmwareThread;
+    int isrSignal = 0;
+
+    uint8_t pinModes[NATIVE_PINS];
+    uint8_t outputs[NATIVE_PINS];
+    int8_t inputs[NATIVE_PINS]; // set by Native::setInput, -1 if not driven
+    uint8_t seenLevels[NATIVE_PINS];
+    void (*pinIsrs[NATIVE_PINS])();
+    int pinIsrModes[NATIVE_PINS];
+    uint8_t sqwGpio = D3;
+    int traceFd = -1;
+
+    uint32_t wakePins = 0; // gpio_pin_wakeup_enable(), low level only
+
+    timer_t timer1Id;
+    timer_t sqwTimerId;
+    timercallback timer1Isr = nullptr;
+    volatile bool timer1On = false;
+    uint8_t timer1Divider = TIM_DIV1;
+    uint8_t timer1Reload = TIM_SINGLE;
+    uint32_t timer1Ticks = 0;
+
+    uint64_t randomState = 0x9E3779B97F4A7C15ULL;
+
+    uint64_t clockNs(clockid_t clock)
+    {
+        struct timespec ts;
+        clock_gettime(clock, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    }
+
+    unsigned long envNumber(const char *name, unsigned long fallback)
+    {
+        const char *v = getenv(name);
+        return v && *v ? strtoul(v, nullptr, 0) : fallback;
+    }
+
+    // Sleeps until an absolute CLOCK_MONOTONIC time; interrupts run meanwhile
+    void sleepUntil(uint64_t ns)
+    {
+        struct timespec ts = {(time_t)(ns / 1000000000ULL), (long)(ns % 1000000000ULL)};
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR)
+        {
+        }
+    }
+
+    // Formats without stdio, this runs in interrupt handlers too
+    void trace(uint8_t pin, uint8_t level)
+    {
+        if (traceFd < 0)
+            return;
+        char line[40];
+        char digits[24];
+        int n = 0;
+        uint64_t us = Native::realtimeUs();
+        int d = 0;
+        do
+        {
+            digits[d++] = '0' + us % 10;
+            us /= 10;
+        } while (us);
+        while (d)
+            line[n++] = digits[--d];
+        line[n++] = ' ';
+        if (pin >= 10)
+            line[n++] = '0' + pin / 10;
+        line[n++] = '0' + pin % 10;
+        line[n++] = ' ';
+        line[n++] = level ? '1' : '0';
+        line[n++] = '\n';
+        ssize_t ignored = ::write(traceFd, line, n); // O_APPEND: one line stays whole
+        (void)ignored;
+    }
+
+    uint8_t pinLevel(uint8_t pin)
+    {
+        if (pin == sqwGpio && Ds3231::present())
+            return Ds3231::sqwLevel();
+        if (pinModes[pin] == OUTPUT)
+            return outputs[pin];
+        if (inputs[pin] >= 0)
+            return inputs[pin];
+        return pinModes[pin] == INPUT_PULLUP ? HIGH : LOW;
+    }
+
+    // A pin may have changed: note the edge and run its ISR
+    void checkPin(uint8_t pin)
+    {
+        uint8_t level = pinLevel(pin);
+        if (level == seenLevels[pin])
+            return;
+        seenLevels[pin] = level;
+        if (pinModes[pin] != OUTPUT)
+            trace(pin, level);
+        void (*isr)() = pinIsrs[pin];
+        int mode = pinIsrModes[pin];
+        if (isr && (mode == CHANGE || (mode == FALLING && level == LOW) || (mode == RISING && level == HIGH)))
+            isr();
+    }
+
+    void armTimer(timer_t id, uint64_t ns, bool absolute, uint64_t intervalNs)
+    {
+        struct itimerspec spec = {};
+        spec.it_value.tv_sec = ns / 1000000000ULL;
+        spec.it_value.tv_nsec = ns % 1000000000ULL;
+        if (!absolute && spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0)
+            spec.it_value.tv_nsec = 1; // zero would disarm it
+        spec.it_interval.tv_sec = intervalNs / 1000000000ULL;
+        spec.it_interval.tv_nsec = intervalNs % 1000000000ULL;
+        timer_settime(id, absolute ? TIMER_ABSTIME : 0, &spec, nullptr);
+    }
+
+    void disarmTimer(timer_t id)
+    {
+        struct itimerspec spec = {};
+        timer_settime(id, 0, &spec, nullptr);
+    }
+
+    // 80 MHz is 12.5 ns a cycle
+    uint64_t timer1Ns(uint32_t ticks)
+    {
+        static const uint32_t cyclesPerTick[] = {1, 16, 256, 256};
+        return (uint64_t)ticks * cyclesPerTick[timer1Divider & 3] * 25 / 2;
+    }
+
+    void startTimer1()
+    {
+        uint64_t ns = timer1Ns(timer1Ticks);
+        armTimer(timer1Id, ns, false, timer1Reload == TIM_LOOP ? ns : 0);
+    }
+
+    void onInterrupt(int, siginfo_t *info, void *)
+    {
+        int savedErrno = errno;
+        int value = info->si_value.sival_int;
+        if (value == NativeCore::SOURCE_TIMER1)
+        {
+            // A single shot stays enabled, stopped at 0 until the next timer1_write()
+            if (timer1Isr && timer1On)
+                timer1Isr();
+        }
+        else if ((value & 0xFF) == NativeCore::SOURCE_PIN)
+        {
+            uint8_t pin = value >> 8;
+            if (pin < NATIVE_PINS)
+                checkPin(pin);
+            if (pin == sqwGpio && Ds3231::present())
+                NativeCore::scheduleSqw(Ds3231::nextChangeNs());
+        }
+        errno = savedErrno;
+    }
+
+    timer_t createTimer(int source)
+    {
+        struct sigevent ev = {};
+        ev.sigev_notify = SIGEV_THREAD_ID;
+        ev.sigev_signo = isrSignal;
+        ev.sigev_value.sival_int = source;
+        ev._sigev_un._tid = firmwareTid;
+        timer_t id;
+        timer_create(CLOCK_MONOTONIC, &ev, &id);
+        return id;
+    }
+}
+
+namespace NativeCore
+{
+    LightSleep lightSleep = {false, 0, nullptr};
+
+    int interruptSignal()
+    {
+        return isrSignal;
+    }
+
+    InterruptLock::InterruptLock()
+    {
+        sigset_t block;
+        sigemptyset(&block);
+        if (isrSignal)
+            sigaddset(&block, isrSignal);
+        pthread_sigmask(SIG_BLOCK, &block, &saved);
+    }
+
+    InterruptLock::~InterruptLock()
+    {
+        pthread_sigmask(SIG_SETMASK, &saved, nullptr);
+    }
+
+    uint64_t monotonicNs()
+    {
+        return clockNs(CLOCK_MONOTONIC);
+    }
+
+    void raisePin(uint8_t pin)
+    {
+        if (!isrSignal || pin >= NATIVE_PINS)
+            return;
+        union sigval value;
+        value.sival_int = SOURCE_PIN | pin << 8;
+        pthread_sigqueue(firmwareThread, isrSignal, value);
+    }
+
+    void scheduleSqw(uint64_t atNs)
+    {
+        if (isrSignal)
+            armTimer(sqwTimerId, atNs, true, 0);
+    }
+
+    uint8_t sqwPin()
+    {
+        return sqwGpio;
+    }
+}
+
+namespace Native
+{
+    void begin()
+    {
+        if (firmwareTid)
+            return;
+        startNs = clockNs(CLOCK_MONOTONIC);
+        NativeHeap::begin(envNumber("NATIVE_HEAP", NATIVE_HEAP_SIZE));
+        firmwareTid = syscall(SYS_gettid);
+        firmwareThread = pthread_self();
+
+        for (uint8_t pin = 0; pin < NATIVE_PINS; pin++)
+        {
+            inputs[pin] = -1;
+            seenLevels[pin] = LOW;
+        }
+        sqwGpio = envNumber("NATIVE_SQW_PIN", D3);
+        const char *tracePath = getenv("NATIVE_GPIO_TRACE");
+        if (tracePath && *tracePath)
+            traceFd = open(tracePath, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        const char *seed = getenv("NATIVE_SEED");
+        randomSeed(seed && *seed ? strtoul(seed, nullptr, 0) : clockNs(CLOCK_REALTIME) ^ getpid());
+
+        isrSignal = SIGRTMIN + 1;
+        struct sigaction action = {};
+        action.sa_sigaction = onInterrupt;
+        action.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(isrSignal, &action, nullptr);
+        timer1Id = createTimer(NativeCore::SOURCE_TIMER1);
+        sqwTimerId = createTimer(NativeCore::SOURCE_PIN | sqwGpio << 8);
+
+        Ds3231::begin();
+        if (Ds3231::present())
+        {
+            NativeCore::InterruptLock lock;
+            seenLevels[sqwGpio] = Ds3231::sqwLevel();
+            NativeCore::scheduleSqw(Ds3231::nextChangeNs());
+        }
+        NativeHeap::attachThread(); // last, the set-up above isn't the firmware's
+    }
+
+    void setInput(uint8_t pin, uint8_t level)
+    {
+        if (pin >= NATIVE_PINS)
+            return;
+        inputs[pin] = level ? HIGH : LOW;
+        NativeCore::raisePin(pin);
+    }
+
+    uint8_t outputLevel(uint8_t pin)
+    {
+        return pin < NATIVE_PINS ? outputs[pin] : LOW;
+    }
+
+    uint64_t realtimeUs()
+    {
+        return clockNs(CLOCK_REALTIME) / 1000;
+    }
+
+    void advanceClock(uint32_t ms)
+    {
+        startNs -= ms * 1000000ULL;
+    }
+}
+
+unsigned long millis()
+{
+    return (uint32_t)((clockNs(CLOCK_MONOTONIC) - startNs) / 1000000ULL);
+}
+
+unsigned long micros()
+{
+    return (uint32_t)((clockNs(CLOCK_MONOTONIC) - startNs) / 1000ULL);
+}
+
+void delay(unsigned long ms)
+{
+    uint64_t until = clockNs(CLOCK_MONOTONIC) + ms * 1000000ULL;
+    NativeCore::LightSleep &sleep = NativeCore::lightSleep;
+    if (!sleep.active)
+    {
+        sleepUntil(until);
+        return;
+    }
+
+    // Forced light sleep: over when the sleep time is up, or early when a
+    // wake pin reads low
+    if (sleep.untilNs && sleep.untilNs < until)
+        until = sleep.untilNs;
+    for (;;)
+    {
+        uint64_t now = clockNs(CLOCK_MONOTONIC);
+        if (now >= until)
+            break;
+        bool woken = false;
+        for (uint8_t pin = 0; pin < NATIVE_PINS && !woken; pin++)
+        {
+            if (wakePins & (1UL << pin))
+                woken = digitalRead(pin) == LOW;
+        }
+        if (woken)
+            break;
+        sleepUntil(until - now > 50000000ULL ? now + 50000000ULL : until);
+    }
+    sleep.active = false;
+    if (sleep.wakeupCb)
+        sleep.wakeupCb();
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    sleepUntil(clockNs(CLOCK_MONOTONIC) + us * 1000ULL);
+}
+
+void yield()
+{
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    if (pin >= NATIVE_PINS)
+        return;
+    NativeCore::InterruptLock lock;
+    pinModes[pin] = mode;
+    seenLevels[pin] = pinLevel(pin);
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+    if (pin >= NATIVE_PINS)
+        return;
+    value = value ? HIGH : LOW;
+    NativeCore::InterruptLock lock;
+    if (outputs[pin] == value && seenLevels[pin] == value)
+        return;
+    outputs[pin] = value;
+    if (pinModes[pin] == OUTPUT)
+    {
+        seenLevels[pin] = value;
+        trace(pin, value);
+    }
+}
+
+int digitalRead(uint8_t pin)
+{
+    if (pin >= NATIVE_PINS)
+        return LOW;
+    NativeCore::InterruptLock lock;
+    return pinLevel(pin);
+}
+
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode)
+{
+    if (pin >= NATIVE_PINS)
+        return;
+    NativeCore::InterruptLock lock;
+    pinIsrs[pin] = isr;
+    pinIsrModes[pin] = mode;
+    seenLevels[pin] = pinLevel(pin);
+}
+
+void detachInterrupt(uint8_t pin)
+{
+    if (pin >= NATIVE_PINS)
+        return;
+    NativeCore::InterruptLock lock;
+    pinIsrs[pin] = nullptr;
+}
+
+void noInterrupts()
+{
+    sigset_t block;
+    sigemptyset(&block);
+    sigaddset(&block, isrSignal);
+    pthread_sigmask(SIG_BLOCK, &block, nullptr);
+}
+
+void interrupts()
+{
+    sigset_t unblock;
+    sigemptyset(&unblock);
+    sigaddset(&unblock, isrSignal);
+    pthread_sigmask(SIG_UNBLOCK, &unblock, nullptr);
+}
+
+// xorshift64*, reproducible with NATIVE_SEED
+static uint32_t nextRandom()
+{
+    randomState ^= randomState >> 12;
+    randomState ^= randomState << 25;
+    randomState ^= randomState >> 27;
+    return (uint32_t)((randomState * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+long random(long max)
+{
+    if (max <= 0)
+        return 0;
+    return nextRandom() % max;
+}
+
+long random(long min, long max)
+{
+    if (min >= max)
+        return min;
+    return min + random(max - min);
+}
+
+void randomSeed(unsigned long seed)
+{
+    randomState = seed ? seed : 0x9E3779B97F4A7C15ULL;
+}
+
+void timer1_isr_init()
+{
+}
+
+void timer1_attachInterrupt(timercallback isr)
+{
+    NativeCore::InterruptLock lock;
+    timer1Isr = isr;
+}
+
+void timer1_detachInterrupt()
+{
+    NativeCore::InterruptLock lock;
+    timer1Isr = nullptr;
+    timer1_disable();
+}
+
+void timer1_enable(uint8_t divider, uint8_t intType, uint8_t reload)
+{
+    (void)intType;
+    NativeCore::InterruptLock lock;
+    timer1Divider = divider;
+    timer1Reload = reload;
+    timer1On = true;
+    if (timer1Ticks)
+        startTimer1();
+}
+
+void timer1_disable()
+{
+    NativeCore::InterruptLock lock;
+    timer1On = false;
+    timer1Ticks = 0;
+    disarmTimer(timer1Id);
+}
+
+// Loads the count; it runs down from here if the timer is enabled
+void timer1_write(uint32_t ticks)
+{
+    NativeCore::InterruptLock lock;
+    timer1Ticks = ticks & 0x7FFFFF;
+    if (timer1On)
+        startTimer1();
+}
+
+bool timer1_enabled()
+{
+    return timer1On;
+}
+
+void gpio_pin_wakeup_enable(uint32_t pin, GPIO_INT_TYPE type)
+{
+    if (pin < NATIVE_PINS && type == GPIO_PIN_INTR_LOLEVEL)
+        wakePins |= 1UL << pin;
+}
+
+void gpio_pin_wakeup_disable()
+{
+    wakePins = 0;
+}
+
+#if defined(__GLIBC__) && !__GLIBC_PREREQ(2, 38)
+size_t strlcpy(char *dst, const char *src, size_t size)
+{
+    size_t length = strlen(src);
+    if (size)
+    {
+        size_t n = length < size - 1 ? length : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return length;
+}
+#endif
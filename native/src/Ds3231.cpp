@@ -0,0 +1,326 @@
+#include "NativeCore.h"
+
+#include <math.h>
+#include <time.h>
+
+// The chip's time is a second count that runs from a phase origin at its own
+// rate (NATIVE_RTC_PPM), so units drift apart as real ones do. The time
+// registers are computed from it when read; writing the seconds register
+// resets the countdown chain, i.e. the second starts over right then.
+// Alarm flags are set for every second the count passed since the last look,
+// so nothing is missed between transactions.
+//
+// INT/SQW: with INTCN set it is low while an enabled alarm's flag is set;
+// without it the 1 Hz square wave falls as the seconds register increments
+// and rises half a second later. The faster square waves aren't emulated,
+// the pin stays high.
+
+#define REG_SECONDS 0x00
+#define REG_DAY 0x03
+#define REG_ALARM1 0x07
+#define REG_ALARM2 0x0B
+#define REG_CONTROL 0x0E
+#define REG_STATUS 0x0F
+#define REG_AGING 0x10
+#define REG_TEMP_MSB 0x11
+#define REG_TEMP_LSB 0x12
+#define REG_COUNT 0x13
+
+#define CONTROL_A1IE 0x01
+#define CONTROL_A2IE 0x02
+#define CONTROL_INTCN 0x04
+#define CONTROL_RS 0x18
+#define CONTROL_CONV 0x20
+#define STATUS_A1F 0x01
+#define STATUS_A2F 0x02
+#define STATUS_EN32KHZ 0x08
+#define STATUS_OSF 0x80
+
+#define NS_PER_S 1000000000ULL
+#define MAX_ALARM_SCAN (8 * 86400) // seconds checked for alarms after a long gap
+
+namespace
+{
+    bool chipPresent = false;
+    uint8_t regs[REG_COUNT];
+    uint8_t pointer = 0;
+
+    int64_t baseCount = 0;   // unix seconds at the phase origin
+    uint64_t originNs = 0;   // CLOCK_MONOTONIC
+    double rate = 1.0;       // chip seconds per host second
+    int64_t dowOffset = 3;   // day register = (days since 1970 + dowOffset) % 7 + 1
+    int64_t checkedCount = 0; // alarm flags are current up to this second
+
+    struct Fields
+    {
+        int year;
+        unsigned month;
+        unsigned date;
+        unsigned hour;
+        unsigned minute;
+        unsigned second;
+        unsigned dow; // 1..7
+    };
+
+    uint8_t bcd2bin(uint8_t v)
+    {
+        return v - 6 * (v >> 4);
+    }
+
+    uint8_t bin2bcd(uint8_t v)
+    {
+        return v + 6 * (v / 10);
+    }
+
+    int64_t floorDiv(int64_t a, int64_t b)
+    {
+        return a / b - (a % b != 0 && (a < 0) != (b < 0));
+    }
+
+    // Days since 1970-01-01 of a civil date and back (H. Hinnant's algorithms)
+    int64_t daysFromCivil(int y, unsigned m, unsigned d)
+    {
+        y -= m <= 2;
+        const int64_t era = (y >= 0 ? y : y - 399) / 400;
+        const unsigned yoe = (unsigned)(y - era * 400);
+        const unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+        const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        return era * 146097 + (int64_t)doe - 719468;
+    }
+
+    void civilFromDays(int64_t z, int &y, unsigned &m, unsigned &d)
+    {
+        z += 719468;
+        const int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+        const unsigned doe = (unsigned)(z - era * 146097);
+        const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        const unsigned mp = (5 * doy + 2) / 153;
+        d = doy - (153 * mp + 2) / 5 + 1;
+        m = mp < 10 ? mp + 3 : mp - 9;
+        y = (int)(yoe + era * 400) + (m <= 2);
+    }
+
+    Fields fieldsOf(int64_t count)
+    {
+        Fields f;
+        int64_t days = floorDiv(count, 86400);
+        int64_t secs = count - days * 86400;
+        civilFromDays(days, f.year, f.month, f.date);
+        f.hour = secs / 3600;
+        f.minute = secs / 60 % 60;
+        f.second = secs % 60;
+        f.dow = (unsigned)(((days + dowOffset) % 7 + 7) % 7) + 1;
+        return f;
+    }
+
+    // Chip seconds since the origin, as a real number
+    double chipElapsed(uint64_t nowNs)
+    {
+        return (double)(nowNs - originNs) * rate / NS_PER_S;
+    }
+
+    int64_t countAt(uint64_t nowNs)
+    {
+        return baseCount + (int64_t)floor(chipElapsed(nowNs));
+    }
+
+    unsigned hourOf(uint8_t reg)
+    {
+        if (reg & 0x40) // 12-hour mode, bit 5 is PM
+            return bcd2bin(reg & 0x1F) % 12 + ((reg & 0x20) ? 12 : 0);
+        return bcd2bin(reg & 0x3F);
+    }
+
+    // A mask bit (bit 7) set means the field doesn't take part
+    bool dayMatches(uint8_t reg, const Fields &f)
+    {
+        if (reg & 0x80)
+            return true;
+        if (reg & 0x40)
+            return bcd2bin(reg & 0x0F) == f.dow;
+        return bcd2bin(reg & 0x3F) == f.date;
+    }
+
+    bool alarm1Matches(const Fields &f)
+    {
+        const uint8_t *a = &regs[REG_ALARM1];
+        return ((a[0] & 0x80) || bcd2bin(a[0] & 0x7F) == f.second) &&
+               ((a[1] & 0x80) || bcd2bin(a[1] & 0x7F) == f.minute) &&
+               ((a[2] & 0x80) || hourOf(a[2]) == f.hour) && dayMatches(a[3], f);
+    }
+
+    // Alarm 2 has no seconds, it matches at second 0
+    bool alarm2Matches(const Fields &f)
+    {
+        const uint8_t *a = &regs[REG_ALARM2];
+        return f.second == 0 && ((a[0] & 0x80) || bcd2bin(a[0] & 0x7F) == f.minute) &&
+               ((a[1] & 0x80) || hourOf(a[1]) == f.hour) && dayMatches(a[2], f);
+    }
+
+    // Sets the alarm flags for every second reached since the last call
+    void checkAlarms(uint64_t nowNs)
+    {
+        int64_t count = countAt(nowNs);
+        if (count - checkedCount > MAX_ALARM_SCAN)
+            checkedCount = count - MAX_ALARM_SCAN;
+        for (int64_t t = checkedCount + 1; t <= count; t++)
+        {
+            Fields f = fieldsOf(t);
+            if (alarm1Matches(f))
+                regs[REG_STATUS] |= STATUS_A1F;
+            if (alarm2Matches(f))
+                regs[REG_STATUS] |= STATUS_A2F;
+        }
+        if (count > checkedCount)
+            checkedCount = count;
+    }
+
+    void timeRegisters(int64_t count, uint8_t *out)
+    {
+        Fields f = fieldsOf(count);
+        out[0] = bin2bcd(f.second);
+        out[1] = bin2bcd(f.minute);
+        out[2] = bin2bcd(f.hour);
+        out[3] = f.dow;
+        out[4] = bin2bcd(f.date);
+        out[5] = bin2bcd(f.month) | (f.year >= 2100 ? 0x80 : 0);
+        out[6] = bin2bcd(f.year % 100);
+    }
+
+    // New time register contents, written is which of the 7 were
+    void setTime(const uint8_t *time, uint8_t written, uint64_t nowNs)
+    {
+        int64_t oldCount = countAt(nowNs);
+        int year = 2000 + bcd2bin(time[6]) + ((time[5] & 0x80) ? 100 : 0);
+        int64_t days = daysFromCivil(year, bcd2bin(time[5] & 0x1F), bcd2bin(time[4] & 0x3F));
+        int64_t newCount = days * 86400 + hourOf(time[2]) * 3600 + bcd2bin(time[1] & 0x7F) * 60 +
+                           bcd2bin(time[0] & 0x7F);
+
+        if (written & (1 << REG_SECONDS))
+        {
+            baseCount = newCount; // countdown chain reset: the second starts now
+            originNs = nowNs;
+        }
+        else
+            baseCount += newCount - oldCount;
+
+        if (written & (1 << REG_DAY))
+            dowOffset = (time[3] & 0x07) - 1 - days;
+        else
+            dowOffset -= days - floorDiv(oldCount, 86400); // the day register counts on by itself
+        dowOffset = (dowOffset % 7 + 7) % 7;
+        checkedCount = newCount; // a jump doesn't fire alarms it skips
+    }
+
+    double envDouble(const char *name, double fallback)
+    {
+        const char *v = getenv(name);
+        return v && *v ? atof(v) : fallback;
+    }
+}
+
+namespace Ds3231
+{
+    void begin()
+    {
+        const char *rtc = getenv("NATIVE_RTC");
+        chipPresent = !(rtc && strcmp(rtc, "0") == 0);
+        memset(regs, 0, sizeof(regs));
+        regs[REG_CONTROL] = CONTROL_INTCN | CONTROL_RS; // power-on default
+        regs[REG_STATUS] = STATUS_EN32KHZ;              // kept its time on the battery
+        regs[REG_TEMP_MSB] = 25;
+
+        struct timespec real;
+        clock_gettime(CLOCK_REALTIME, &real);
+        originNs = NativeCore::monotonicNs();
+        rate = 1.0 + envDouble("NATIVE_RTC_PPM", 0) * 1e-6;
+        // The origin sits on the host's second edge plus the offset's fraction
+        double offset = envDouble("NATIVE_RTC_OFFSET", 0) + real.tv_nsec / 1e9;
+        double whole = floor(offset);
+        baseCount = real.tv_sec + (int64_t)whole;
+        originNs -= (uint64_t)((offset - whole) * NS_PER_S / rate);
+        dowOffset = 3; // 1970-01-01 was a Thursday
+        checkedCount = countAt(NativeCore::monotonicNs());
+    }
+
+    bool present()
+    {
+        return chipPresent;
+    }
+
+    void write(const uint8_t *data, size_t length)
+    {
+        if (length == 0)
+            return;
+        uint64_t nowNs = NativeCore::monotonicNs();
+        checkAlarms(nowNs);
+        pointer = data[0] % REG_COUNT;
+
+        uint8_t time[7];
+        timeRegisters(countAt(nowNs), time);
+        uint8_t timeWritten = 0;
+        for (size_t i = 1; i < length; i++)
+        {
+            uint8_t value = data[i];
+            if (pointer <= 6)
+            {
+                time[pointer] = value;
+                timeWritten |= 1 << pointer;
+            }
+            else if (pointer == REG_STATUS)
+                // Flags can only be cleared; BSY is read-only
+                regs[REG_STATUS] = (regs[REG_STATUS] & value & (STATUS_OSF | STATUS_A2F | STATUS_A1F)) |
+                                   (value & STATUS_EN32KHZ);
+            else if (pointer == REG_CONTROL)
+                regs[REG_CONTROL] = value & ~CONTROL_CONV;
+            else if (pointer < REG_TEMP_MSB)
+                regs[pointer] = value;
+            pointer = (pointer + 1) % REG_COUNT;
+        }
+        if (timeWritten)
+            setTime(time, timeWritten, nowNs);
+        NativeCore::raisePin(NativeCore::sqwPin()); // INT/SQW may have changed
+    }
+
+    size_t read(uint8_t *data, size_t length)
+    {
+        uint64_t nowNs = NativeCore::monotonicNs();
+        checkAlarms(nowNs);
+        uint8_t time[7];
+        timeRegisters(countAt(nowNs), time); // latched at the start of the read
+        for (size_t i = 0; i < length; i++)
+        {
+            data[i] = pointer <= 6 ? time[pointer] : regs[pointer];
+            pointer = (pointer + 1) % REG_COUNT;
+        }
+        return length;
+    }
+
+    uint8_t sqwLevel()
+    {
+        if (!chipPresent)
+            return HIGH;
+        uint64_t nowNs = NativeCore::monotonicNs();
+        checkAlarms(nowNs);
+        uint8_t control = regs[REG_CONTROL];
+        if (control & CONTROL_INTCN)
+        {
+            bool pending = ((regs[REG_STATUS] & STATUS_A1F) && (control & CONTROL_A1IE)) ||
+                           ((regs[REG_STATUS] & STATUS_A2F) && (control & CONTROL_A2IE));
+            return pending ? LOW : HIGH;
+        }
+        if (control & CONTROL_RS)
+            return HIGH;
+        double elapsed = chipElapsed(nowNs);
+        return elapsed - floor(elapsed) < 0.5 ? LOW : HIGH;
+    }
+
+    uint64_t nextChangeNs()
+    {
+        // Alarm flags and the square wave only change on half seconds
+        uint64_t nowNs = NativeCore::monotonicNs();
+        double halves = floor(chipElapsed(nowNs) * 2) + 1;
+        return originNs + (uint64_t)ceil(halves / 2 / rate * NS_PER_S);
+    }
+}
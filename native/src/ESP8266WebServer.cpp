@@ -0,0 +1,407 @@
+#include <ESP8266WebServer.h>
+#include <NativeHeap.h>
+#include <NativeHost.h>
+
+static const String emptyString;
+static uint64_t lastHandlerAllocations;
+
+static const char *statusText(int code)
+{
+    switch (code)
+    {
+    case 200:
+        return "OK";
+    case 204:
+        return "No Content";
+    case 304:
+        return "Not Modified";
+    case 400:
+        return "Bad Request";
+    case 404:
+        return "Not Found";
+    case 405:
+        return "Method Not Allowed";
+    case 500:
+        return "Internal Server Error";
+    case 503:
+        return "Service Unavailable";
+    default:
+        return "";
+    }
+}
+
+ESP8266WebServer::~ESP8266WebServer()
+{
+    close();
+    delete[] currentHeaders;
+    while (firstRoute)
+    {
+        Route *next = firstRoute->next;
+        delete firstRoute;
+        firstRoute = next;
+    }
+}
+
+void ESP8266WebServer::close()
+{
+    server.close();
+    dropClient();
+}
+
+void ESP8266WebServer::on(const String &uri, HTTPMethod method, THandlerFunction handler)
+{
+    Route *route = new Route{uri, method, handler, nullptr};
+    if (lastRoute)
+        lastRoute->next = route;
+    else
+        firstRoute = route;
+    lastRoute = route;
+}
+
+void ESP8266WebServer::dropClient()
+{
+    currentClient = WiFiClient();
+    currentStatus = HC_NONE;
+    delete[] currentArgs;
+    currentArgs = nullptr;
+    argCount = 0;
+}
+
+void ESP8266WebServer::handleClient()
+{
+    if (currentStatus == HC_NONE)
+    {
+        WiFiClient client = server.accept();
+        if (!client)
+            return;
+        currentClient = client;
+        currentStatus = HC_WAIT_READ;
+        statusChange = millis();
+    }
+
+    bool keepCurrentClient = false;
+    if (currentClient.connected() || currentClient.available())
+    {
+        switch (currentStatus)
+        {
+        case HC_NONE:
+            break;
+        case HC_WAIT_READ:
+            if (currentClient.available())
+            {
+                currentClient.setTimeout(HTTP_MAX_DATA_WAIT);
+                if (parseRequest())
+                {
+                    currentClient.setTimeout(HTTP_MAX_SEND_WAIT);
+                    handleRequest();
+                    if (currentClient.connected() || currentClient.available())
+                    {
+                        currentStatus = HC_WAIT_CLOSE;
+                        statusChange = millis();
+                        keepCurrentClient = true;
+                    }
+                }
+                else
+                    currentClient.stop();
+            }
+            else if (millis() - statusChange <= HTTP_MAX_DATA_WAIT)
+                keepCurrentClient = true;
+            break;
+        case HC_WAIT_CLOSE:
+            // Another request on this connection, unless someone else is waiting
+            if (!server.hasClient() && millis() - statusChange <= HTTP_MAX_CLOSE_WAIT)
+            {
+                keepCurrentClient = true;
+                if (currentClient.available())
+                    currentStatus = HC_WAIT_READ;
+            }
+            break;
+        }
+    }
+
+    if (!keepCurrentClient)
+        dropClient();
+}
+
+bool ESP8266WebServer::parseRequest()
+{
+    String request = currentClient.readStringUntil('\r');
+    currentClient.readStringUntil('\n');
+    for (int i = 0; i < headerCount; i++)
+        currentHeaders[i].value = String();
+
+    int addrStart = request.indexOf(' ');
+    int addrEnd = request.indexOf(' ', addrStart + 1);
+    if (addrStart == -1 || addrEnd == -1)
+        return false;
+
+    String methodText = request.substring(0, addrStart);
+    String url = request.substring(addrStart + 1, addrEnd);
+    String searchText;
+    int hasSearch = url.indexOf('?');
+    if (hasSearch != -1)
+    {
+        searchText = url.substring(hasSearch + 1);
+        url = url.substring(0, hasSearch);
+    }
+    currentUri = url;
+
+    HTTPMethod method = HTTP_GET;
+    if (methodText == "HEAD")
+        method = HTTP_HEAD;
+    else if (methodText == "POST")
+        method = HTTP_POST;
+    else if (methodText == "PUT")
+        method = HTTP_PUT;
+    else if (methodText == "PATCH")
+        method = HTTP_PATCH;
+    else if (methodText == "DELETE")
+        method = HTTP_DELETE;
+    else if (methodText == "OPTIONS")
+        method = HTTP_OPTIONS;
+    currentMethod = method;
+
+    bool isForm = false;
+    bool isEncoded = false;
+    size_t contentLength = 0;
+    for (;;)
+    {
+        request = currentClient.readStringUntil('\r');
+        currentClient.readStringUntil('\n');
+        if (request.isEmpty())
+            break;
+        int colon = request.indexOf(':');
+        if (colon == -1)
+            break;
+        String name = request.substring(0, colon);
+        String value = request.substring(colon + 1);
+        value.trim();
+        collectHeader(name, value);
+
+        if (name.equalsIgnoreCase("Content-Type"))
+        {
+            isForm = value.startsWith("multipart/") || value.startsWith("application/x-www-form-urlencoded");
+            isEncoded = value.startsWith("application/x-www-form-urlencoded");
+        }
+        else if (name.equalsIgnoreCase("Content-Length"))
+            contentLength = value.toInt();
+    }
+
+    char *plain = nullptr;
+    size_t plainLength = 0;
+    if (contentLength > 0)
+    {
+        plain = (char *)malloc(contentLength + 1);
+        if (plain == nullptr)
+            return false;
+        currentClient.setTimeout(HTTP_MAX_POST_WAIT);
+        plainLength = currentClient.readBytes(plain, contentLength);
+        plain[plainLength] = '\0';
+        if (plainLength < contentLength)
+        {
+            free(plain);
+            return false;
+        }
+    }
+
+    if (isEncoded && plain)
+    {
+        if (!searchText.isEmpty())
+            searchText += '&';
+        searchText += plain;
+    }
+    parseArguments(searchText);
+    if (plain && !isForm)
+    {
+        RequestArgument &arg = currentArgs[argCount++];
+        arg.key = "plain";
+        arg.value = String(plain, plainLength);
+    }
+    free(plain);
+    return true;
+}
+
+// Query and form arguments; room for one more, the "plain" body
+void ESP8266WebServer::parseArguments(const String &data)
+{
+    delete[] currentArgs;
+    currentArgs = nullptr;
+    argCount = 0;
+
+    int count = data.isEmpty() ? 0 : 1;
+    for (int i = 0; (i = data.indexOf('&', i)) != -1; i++)
+        count++;
+    currentArgs = new RequestArgument[count + 1];
+
+    int pos = 0;
+    while (count > 0 && pos <= (int)data.length())
+    {
+        int next = data.indexOf('&', pos);
+        if (next == -1)
+            next = data.length();
+        int equals = data.indexOf('=', pos);
+        if (next > pos)
+        {
+            RequestArgument &arg = currentArgs[argCount++];
+            if (equals == -1 || equals > next)
+            {
+                arg.key = urlDecode(data.substring(pos, next));
+            }
+            else
+            {
+                arg.key = urlDecode(data.substring(pos, equals));
+                arg.value = urlDecode(data.substring(equals + 1, next));
+            }
+        }
+        pos = next + 1;
+        if (argCount >= count)
+            break;
+    }
+}
+
+void ESP8266WebServer::collectHeaders(const char *headerKeys[], const size_t headerKeysCount)
+{
+    delete[] currentHeaders;
+    headerCount = headerKeysCount;
+    currentHeaders = new RequestArgument[headerCount];
+    for (int i = 0; i < headerCount; i++)
+        currentHeaders[i].key = headerKeys[i];
+}
+
+void ESP8266WebServer::collectHeader(const String &name, const String &value)
+{
+    for (int i = 0; i < headerCount; i++)
+    {
+        if (currentHeaders[i].key.equalsIgnoreCase(name))
+        {
+            currentHeaders[i].value = value;
+            return;
+        }
+    }
+}
+
+const String &ESP8266WebServer::arg(const String &name) const
+{
+    for (int i = 0; i < argCount; i++)
+    {
+        if (currentArgs[i].key == name)
+            return currentArgs[i].value;
+    }
+    return emptyString;
+}
+
+const String &ESP8266WebServer::arg(int i) const
+{
+    return i >= 0 && i < argCount ? currentArgs[i].value : emptyString;
+}
+
+const String &ESP8266WebServer::argName(int i) const
+{
+    return i >= 0 && i < argCount ? currentArgs[i].key : emptyString;
+}
+
+bool ESP8266WebServer::hasArg(const String &name) const
+{
+    for (int i = 0; i < argCount; i++)
+    {
+        if (currentArgs[i].key == name)
+            return true;
+    }
+    return false;
+}
+
+const String &ESP8266WebServer::header(const String &name) const
+{
+    for (int i = 0; i < headerCount; i++)
+    {
+        if (currentHeaders[i].key.equalsIgnoreCase(name))
+            return currentHeaders[i].value;
+    }
+    return emptyString;
+}
+
+const String &ESP8266WebServer::header(int i) const
+{
+    return i >= 0 && i < headerCount ? currentHeaders[i].value : emptyString;
+}
+
+const String &ESP8266WebServer::headerName(int i) const
+{
+    return i >= 0 && i < headerCount ? currentHeaders[i].key : emptyString;
+}
+
+bool ESP8266WebServer::hasHeader(const String &name) const
+{
+    return header(name).length() > 0;
+}
+
+void ESP8266WebServer::handleRequest()
+{
+    bool handled = false;
+    for (Route *route = firstRoute; route; route = route->next)
+    {
+        if ((route->method == HTTP_ANY || route->method == currentMethod) && route->uri == currentUri)
+        {
+            uint64_t before = NativeHeap::stats().allocations;
+            route->handler();
+            lastHandlerAllocations = NativeHeap::stats().allocations - before;
+            handled = true;
+            break;
+        }
+    }
+    if (!handled && notFoundHandler)
+    {
+        notFoundHandler();
+        handled = true;
+    }
+    if (!handled)
+        send(404, "text/plain", String("Not found: ") + currentUri);
+    currentUri = String();
+}
+
+uint64_t Native::handlerAllocations()
+{
+    return lastHandlerAllocations;
+}
+
+void ESP8266WebServer::send(int code, const char *contentType, const String &content)
+{
+    String response = "HTTP/1.1 ";
+    response += String(code);
+    response += ' ';
+    response += statusText(code);
+    response += "\r\nContent-Type: ";
+    response += contentType ? contentType : "text/html";
+    response += "\r\nContent-Length: ";
+    response += String(content.length());
+    response += keepAliveOn ? "\r\nConnection: keep-alive\r\n\r\n" : "\r\nConnection: close\r\n\r\n";
+    currentClient.write((const uint8_t *)response.c_str(), response.length());
+    if (currentMethod != HTTP_HEAD && content.length())
+        sendContent(content);
+}
+
+void ESP8266WebServer::sendContent(const char *content, size_t size)
+{
+    currentClient.write((const uint8_t *)content, size);
+}
+
+String ESP8266WebServer::urlDecode(const String &text)
+{
+    String decoded;
+    decoded.reserve(text.length());
+    for (unsigned i = 0; i < text.length(); i++)
+    {
+        char c = text[i];
+        if (c == '+')
+            decoded += ' ';
+        else if (c == '%' && i + 2 < text.length())
+        {
+            char hex[3] = {text[i + 1], text[i + 2], '\0'};
+            decoded += (char)strtol(hex, nullptr, 16);
+            i += 2;
+        }
+        else
+            decoded += c;
+    }
+    return decoded;
+}
@@ -0,0 +1,96 @@
+#include "NativeCore.h"
+
+#include <unistd.h>
+
+EspClass ESP;
+
+static uint32_t rtcUserMemory[128];
+
+bool EspClass::rtcUserMemoryRead(uint32_t offset, uint32_t *data, size_t size)
+{
+    if (data == nullptr || size == 0 || offset * 4 + size > sizeof(rtcUserMemory))
+        return false;
+    memcpy(data, (uint8_t *)rtcUserMemory + offset * 4, size);
+    return true;
+}
+
+bool EspClass::rtcUserMemoryWrite(uint32_t offset, uint32_t *data, size_t size)
+{
+    if (data == nullptr || size == 0 || offset * 4 + size > sizeof(rtcUserMemory))
+        return false;
+    memcpy((uint8_t *)rtcUserMemory + offset * 4, data, size);
+    return true;
+}
+
+rst_info *EspClass::getResetInfoPtr()
+{
+    static rst_info info = {};
+    static bool read = false;
+    if (!read)
+    {
+        const char *reason = getenv("NATIVE_RESET_REASON");
+        info.reason = reason && *reason ? strtoul(reason, nullptr, 0) : (uint32_t)REASON_DEFAULT_RST;
+        read = true;
+    }
+    return &info;
+}
+
+String EspClass::getResetReason()
+{
+    switch (getResetInfoPtr()->reason)
+    {
+    case REASON_DEFAULT_RST:
+        return F("Power On");
+    case REASON_WDT_RST:
+        return F("Hardware Watchdog");
+    case REASON_EXCEPTION_RST:
+        return F("Exception");
+    case REASON_SOFT_WDT_RST:
+        return F("Software Watchdog");
+    case REASON_SOFT_RESTART:
+        return F("Software/System restart");
+    case REASON_DEEP_SLEEP_AWAKE:
+        return F("Deep-Sleep Wake");
+    case REASON_EXT_SYS_RST:
+        return F("External System");
+    default:
+        return F("Unknown");
+    }
+}
+
+uint32_t EspClass::getChipId()
+{
+    static uint32_t id = 0;
+    if (id == 0)
+    {
+        const char *env = getenv("NATIVE_CHIP_ID");
+        id = env && *env ? strtoul(env, nullptr, 0) : (uint32_t)getpid();
+    }
+    return id;
+}
+
+uint32_t EspClass::getCycleCount()
+{
+    return (uint32_t)(NativeCore::monotonicNs() * 2 / 25); // 80 MHz
+}
+
+void EspClass::restart()
+{
+    fflush(stderr);
+    exit(0);
+}
+
+bool EspClass::forcedLightSleepBegin(uint32_t durationUs, void (*wakeupCb)())
+{
+    NativeCore::LightSleep &sleep = NativeCore::lightSleep;
+    sleep.active = true;
+    sleep.untilNs = durationUs ? NativeCore::monotonicNs() + durationUs * 1000ULL : 0;
+    sleep.wakeupCb = wakeupCb;
+    return true;
+}
+
+void EspClass::forcedLightSleepEnd(bool cancel)
+{
+    (void)cancel;
+    NativeCore::lightSleep.active = false;
+}
@@ -0,0 +1,551 @@
+#include <LittleFS.h>
+#include <NativeHeap.h>
+#include <NativeHost.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+// Flash contents live in host memory (a HostScope around every change);
+// what the core allocates per open file and directory listing, and the
+// Strings handed out, come from the emulated heap as on the chip.
+
+#define LFS_BLOCK_SIZE 8192
+#define LFS_PAGE_SIZE 256
+#define LFS_TOTAL_BYTES 2072576 // nodemcuv2, 4m2m: 2 MB less the 24 KB end
+#define LFS_PATH_MAX 64         // with the terminator; longer paths are refused
+#define LFS_NO_CHANGE SIZE_MAX
+
+fs::FS LittleFS;
+
+namespace
+{
+    struct Node
+    {
+        std::vector<uint8_t> data;
+        int refs; // the directory's, and one per open file
+    };
+
+    std::map<std::string, Node *> files; // path without the leading '/'
+    bool mounted = false;
+    Native::FlashStats flash = {};
+
+    void unref(Node *node)
+    {
+        if (--node->refs == 0)
+        {
+            NativeHeap::HostScope host;
+            delete node;
+        }
+    }
+
+    // Copies path without its leading '/' into out; false if too long
+    bool normalize(const char *path, char *out)
+    {
+        if (path == nullptr)
+            return false;
+        while (*path == '/')
+            path++;
+        size_t length = strlen(path);
+        if (length >= LFS_PATH_MAX)
+            return false;
+        memcpy(out, path, length + 1);
+        while (length > 0 && out[length - 1] == '/')
+            out[--length] = '\0';
+        return true;
+    }
+
+    // Whether a file is anywhere under dir ("" is the root)
+    bool isDirectory(const char *dir)
+    {
+        if (*dir == '\0')
+            return true;
+        NativeHeap::HostScope host;
+        std::string prefix = std::string(dir) + '/';
+        auto it = files.lower_bound(prefix);
+        return it != files.end() && it->first.compare(0, prefix.size(), prefix) == 0;
+    }
+
+    Node *find(const char *path)
+    {
+        NativeHeap::HostScope host;
+        auto it = files.find(path);
+        return it == files.end() ? nullptr : it->second;
+    }
+
+    size_t blocks(size_t bytes)
+    {
+        return (bytes + LFS_BLOCK_SIZE - 1) / LFS_BLOCK_SIZE;
+    }
+
+    size_t usedBlocks()
+    {
+        size_t used = 2; // the superblock pair
+        for (auto &entry : files)
+            used += blocks(entry.second->data.size());
+        return used;
+    }
+}
+
+namespace fs
+{
+    struct FileHandle
+    {
+        int refs;
+        Node *node; // nullptr once closed
+        size_t pos;
+        bool readable;
+        bool writable;
+        bool append;
+        size_t changedFrom; // first byte changed since the last commit
+        char path[LFS_PATH_MAX];
+        uint8_t cache[LFS_PAGE_SIZE]; // littlefs's per-file cache; here only its weight on the heap
+    };
+
+    struct DirHandle
+    {
+        int refs;
+        char path[LFS_PATH_MAX]; // "" for the root
+        char entry[LFS_PATH_MAX];
+        bool started;
+        bool entryIsDir;
+        size_t entrySize;
+    };
+}
+
+using fs::DirHandle;
+using fs::FileHandle;
+
+static void commit(FileHandle *h)
+{
+    if (h->changedFrom == LFS_NO_CHANGE)
+        return;
+    size_t size = h->node->data.size();
+    size_t last = blocks(size);
+    size_t first = h->changedFrom / LFS_BLOCK_SIZE;
+    if (last > first)
+        flash.bytesProgrammed += (uint64_t)(last - first) * LFS_BLOCK_SIZE;
+    flash.commits++;
+    h->changedFrom = LFS_NO_CHANGE;
+}
+
+// File
+
+fs::File::File(const File &other) : Stream(other), handle(other.handle)
+{
+    if (handle)
+        handle->refs++;
+}
+
+fs::File &fs::File::operator=(const File &other)
+{
+    if (this != &other)
+    {
+        if (other.handle)
+            other.handle->refs++;
+        release();
+        handle = other.handle;
+    }
+    return *this;
+}
+
+void fs::File::release()
+{
+    if (handle && --handle->refs == 0)
+    {
+        if (handle->node)
+        {
+            commit(handle);
+            unref(handle->node);
+        }
+        delete handle;
+    }
+    handle = nullptr;
+}
+
+fs::File::operator bool() const
+{
+    return handle && handle->node;
+}
+
+size_t fs::File::write(const uint8_t *buf, size_t size)
+{
+    if (!*this || !handle->writable || size == 0)
+        return 0;
+    std::vector<uint8_t> &data = handle->node->data;
+    if (handle->append)
+        handle->pos = data.size();
+    // The blocks the file grows by, and one more to copy a block it already
+    // has into (copy-on-write); without them littlefs fails with
+    // LFS_ERR_NOSPC and the core's write() stores nothing
+    size_t end = handle->pos + size;
+    size_t needed = end > data.size() ? blocks(end) - blocks(data.size()) : 0;
+    if (handle->pos < blocks(data.size()) * LFS_BLOCK_SIZE)
+        needed++;
+    if (usedBlocks() + needed > LFS_TOTAL_BYTES / LFS_BLOCK_SIZE)
+        return 0;
+    {
+        NativeHeap::HostScope host;
+        if (handle->pos + size > data.size())
+            data.resize(handle->pos + size);
+    }
+    memcpy(data.data() + handle->pos, buf, size);
+    if (handle->pos < handle->changedFrom)
+        handle->changedFrom = handle->pos;
+    handle->pos += size;
+    flash.bytesWritten += size;
+    return size;
+}
+
+int fs::File::available()
+{
+    if (!*this || !handle->readable)
+        return 0;
+    size_t size = handle->node->data.size();
+    return handle->pos < size ? (int)(size - handle->pos) : 0;
+}
+
+int fs::File::read()
+{
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+int fs::File::peek()
+{
+    if (available() <= 0)
+        return -1;
+    return handle->node->data[handle->pos];
+}
+
+size_t fs::File::read(uint8_t *buf, size_t size)
+{
+    int left = available();
+    if (left <= 0)
+        return 0;
+    if (size > (size_t)left)
+        size = left;
+    memcpy(buf, handle->node->data.data() + handle->pos, size);
+    handle->pos += size;
+    flash.bytesRead += size;
+    return size;
+}
+
+void fs::File::flush()
+{
+    if (*this)
+        commit(handle);
+}
+
+bool fs::File::seek(uint32_t pos, SeekMode mode)
+{
+    if (!*this)
+        return false;
+    size_t size = handle->node->data.size();
+    size_t base = mode == SeekCur ? handle->pos : mode == SeekEnd ? size : 0;
+    if (base + pos > size)
+        return false;
+    handle->pos = base + pos;
+    return true;
+}
+
+size_t fs::File::position() const
+{
+    return *this ? handle->pos : 0;
+}
+
+size_t fs::File::size() const
+{
+    return *this ? handle->node->data.size() : 0;
+}
+
+void fs::File::close()
+{
+    if (*this)
+    {
+        commit(handle);
+        unref(handle->node);
+        handle->node = nullptr;
+    }
+    release();
+}
+
+const char *fs::File::name() const
+{
+    if (!handle)
+        return "";
+    const char *slash = strrchr(handle->path, '/');
+    return slash ? slash + 1 : handle->path;
+}
+
+const char *fs::File::fullName() const
+{
+    return handle ? handle->path : "";
+}
+
+// Dir
+
+fs::Dir::Dir(const Dir &other) : handle(other.handle)
+{
+    if (handle)
+        handle->refs++;
+}
+
+fs::Dir &fs::Dir::operator=(const Dir &other)
+{
+    if (this != &other)
+    {
+        if (other.handle)
+            other.handle->refs++;
+        release();
+        handle = other.handle;
+    }
+    return *this;
+}
+
+void fs::Dir::release()
+{
+    if (handle && --handle->refs == 0)
+        delete handle;
+    handle = nullptr;
+}
+
+bool fs::Dir::next()
+{
+    if (!handle)
+        return false;
+    NativeHeap::HostScope host;
+    std::string prefix = handle->path;
+    if (!prefix.empty())
+        prefix += '/';
+    // The least name past the current entry; a subdirectory shows up
+    // through the files under it
+    std::string previous = handle->started ? handle->entry : "";
+    bool found = false;
+    for (auto it = files.lower_bound(prefix); it != files.end(); ++it)
+    {
+        if (it->first.compare(0, prefix.size(), prefix) != 0)
+            break;
+        size_t slash = it->first.find('/', prefix.size());
+        bool isDir = slash != std::string::npos;
+        std::string name = it->first.substr(prefix.size(), isDir ? slash - prefix.size() : std::string::npos);
+        if (handle->started && name <= previous)
+            continue;
+        if (found && name >= handle->entry)
+            continue;
+        strcpy(handle->entry, name.c_str());
+        handle->entryIsDir = isDir;
+        handle->entrySize = isDir ? 0 : it->second->data.size();
+        found = true;
+    }
+    handle->started = handle->started || found;
+    return found;
+}
+
+String fs::Dir::fileName()
+{
+    return handle && handle->started ? String(handle->entry) : String();
+}
+
+size_t fs::Dir::fileSize()
+{
+    return handle && handle->started ? handle->entrySize : 0;
+}
+
+bool fs::Dir::isFile() const
+{
+    return handle && handle->started && !handle->entryIsDir;
+}
+
+bool fs::Dir::isDirectory() const
+{
+    return handle && handle->started && handle->entryIsDir;
+}
+
+fs::File fs::Dir::openFile(const char *mode)
+{
+    if (!isFile())
+        return File();
+    char path[LFS_PATH_MAX * 2];
+    snprintf(path, sizeof(path), "%s/%s", handle->path, handle->entry);
+    return LittleFS.open(path, mode);
+}
+
+bool fs::Dir::rewind()
+{
+    if (!handle)
+        return false;
+    handle->started = false;
+    return true;
+}
+
+// FS
+
+bool fs::FS::begin()
+{
+    mounted = true;
+    return true;
+}
+
+void fs::FS::end()
+{
+    mounted = false;
+}
+
+bool fs::FS::format()
+{
+    if (mounted)
+        return false;
+    NativeHeap::HostScope host;
+    for (auto &entry : files)
+        unref(entry.second);
+    files.clear();
+    return true;
+}
+
+bool fs::FS::info(FSInfo &info)
+{
+    if (!mounted)
+        return false;
+    info.totalBytes = LFS_TOTAL_BYTES;
+    info.usedBytes = usedBlocks() * LFS_BLOCK_SIZE;
+    info.blockSize = LFS_BLOCK_SIZE;
+    info.pageSize = LFS_PAGE_SIZE;
+    info.maxOpenFiles = 5;
+    info.maxPathLength = LFS_PATH_MAX - 1;
+    return true;
+}
+
+fs::File fs::FS::open(const char *path, const char *mode)
+{
+    char name[LFS_PATH_MAX];
+    if (!mounted || mode == nullptr || !normalize(path, name) || *name == '\0')
+        return File();
+    bool plus = mode[1] == '+';
+    bool create = mode[0] == 'w' || mode[0] == 'a';
+    if (!create && mode[0] != 'r')
+        return File();
+    if (isDirectory(name))
+        return File();
+
+    Node *node = find(name);
+    bool created = false;
+    if (node == nullptr)
+    {
+        if (!create)
+            return File();
+        NativeHeap::HostScope host;
+        node = new Node{{}, 1};
+        files[name] = node;
+        created = true;
+    }
+    flash.opens++;
+
+    FileHandle *h = new (std::nothrow) FileHandle;
+    if (h == nullptr)
+    {
+        if (created)
+            remove(path);
+        return File();
+    }
+    h->refs = 1;
+    h->node = node;
+    node->refs++;
+    h->pos = 0;
+    h->readable = mode[0] == 'r' || plus;
+    h->writable = mode[0] != 'r' || plus;
+    h->append = mode[0] == 'a';
+    h->changedFrom = created ? 0 : LFS_NO_CHANGE;
+    strcpy(h->path, name);
+    if (mode[0] == 'w')
+    {
+        NativeHeap::HostScope host;
+        node->data.clear();
+        node->data.shrink_to_fit();
+        h->changedFrom = 0;
+    }
+    return File(h);
+}
+
+bool fs::FS::exists(const char *path)
+{
+    char name[LFS_PATH_MAX];
+    if (!mounted || !normalize(path, name))
+        return false;
+    return find(name) != nullptr || isDirectory(name);
+}
+
+fs::Dir fs::FS::openDir(const char *path)
+{
+    char name[LFS_PATH_MAX];
+    if (!mounted || !normalize(path, name))
+        return Dir();
+    // As the core: a directory that isn't there lists nothing
+    DirHandle *h = new (std::nothrow) DirHandle;
+    if (h == nullptr)
+        return Dir();
+    h->refs = 1;
+    strcpy(h->path, name);
+    h->entry[0] = '\0';
+    h->started = false;
+    h->entryIsDir = false;
+    h->entrySize = 0;
+    return Dir(h);
+}
+
+bool fs::FS::remove(const char *path)
+{
+    char name[LFS_PATH_MAX];
+    if (!mounted || !normalize(path, name))
+        return false;
+    NativeHeap::HostScope host;
+    auto it = files.find(name);
+    if (it == files.end())
+        return false;
+    unref(it->second);
+    files.erase(it);
+    flash.commits++;
+    return true;
+}
+
+bool fs::FS::rename(const char *pathFrom, const char *pathTo)
+{
+    char from[LFS_PATH_MAX];
+    char to[LFS_PATH_MAX];
+    if (!mounted || !normalize(pathFrom, from) || !normalize(pathTo, to) || *to == '\0')
+        return false;
+    NativeHeap::HostScope host;
+    auto it = files.find(from);
+    if (it == files.end() || isDirectory(to))
+        return false;
+    Node *node = it->second;
+    files.erase(it);
+    auto existing = files.find(to);
+    if (existing != files.end())
+    {
+        unref(existing->second);
+        existing->second = node;
+    }
+    else
+        files[to] = node;
+    flash.commits++;
+    return true;
+}
+
+bool fs::FS::mkdir(const char *path)
+{
+    // Directories come with the files under them
+    char name[LFS_PATH_MAX];
+    return mounted && normalize(path, name) && find(name) == nullptr;
+}
+
+bool fs::FS::rmdir(const char *path)
+{
+    char name[LFS_PATH_MAX];
+    return mounted && normalize(path, name) && !isDirectory(name);
+}
+
+Native::FlashStats Native::flashStats()
+{
+    return flash;
+}
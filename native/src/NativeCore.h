@@ -0,0 +1,72 @@
+#ifndef NativeCore_h
+#define NativeCore_h
+
+// Shared between the emulated core's sources, not for the firmware
+
+#include <Arduino.h>
+#include <signal.h>
+
+namespace NativeCore
+{
+    // What an interrupt signal is for, in its si_value
+    enum Source
+    {
+        SOURCE_TIMER1 = 1,
+        SOURCE_PIN = 2, // pin number in bits 8..15: look at the pin again
+    };
+
+    int interruptSignal();
+
+    // Keeps interrupts away while the firmware thread touches state an
+    // interrupt handler reads too; restores what was blocked before
+    class InterruptLock
+    {
+    public:
+        InterruptLock();
+        ~InterruptLock();
+        InterruptLock(const InterruptLock &) = delete;
+        InterruptLock &operator=(const InterruptLock &) = delete;
+
+    private:
+        sigset_t saved;
+    };
+
+    uint64_t monotonicNs();
+
+    // Has the firmware thread look at a pin's level again, as soon as
+    // interrupts are enabled; edges run the attached ISR
+    void raisePin(uint8_t pin);
+
+    // Arms the wakeup for the DS3231's next INT/SQW change
+    void scheduleSqw(uint64_t atNs);
+
+    // GPIO the DS3231's INT/SQW drives
+    uint8_t sqwPin();
+
+    // Forced light sleep state, see Esp.h
+    struct LightSleep
+    {
+        bool active;
+        uint64_t untilNs; // 0: until a wake pin
+        void (*wakeupCb)();
+    };
+    extern LightSleep lightSleep;
+}
+
+// The DS3231 on the bus: its registers over I2C and its INT/SQW pin
+namespace Ds3231
+{
+    void begin();
+    bool present();
+
+    // A write transaction: register pointer, then data
+    void write(const uint8_t *data, size_t length);
+    // A read transaction from the register pointer on
+    size_t read(uint8_t *data, size_t length);
+
+    uint8_t sqwLevel();
+    // When INT/SQW may change next, CLOCK_MONOTONIC ns
+    uint64_t nextChangeNs();
+}
+
+#endif
@@ -0,0 +1,397 @@
+#include <NativeHeap.h>
+#include <Esp.h>
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+#include <sys/mman.h>
+
+extern "C"
+{
+    void *__libc_malloc(size_t size);
+    void __libc_free(void *ptr);
+    void *__libc_realloc(void *ptr, size_t size);
+    void *__libc_calloc(size_t count, size_t size);
+    void *__libc_memalign(size_t alignment, size_t size);
+}
+
+namespace
+{
+    // Every block starts with one of these; free blocks also hold their free
+    // list links in the first bytes after it
+    struct Block
+    {
+        uint32_t size;     // whole block, header included
+        uint32_t prevSize; // of the block before, 0 for the first
+        uint32_t used;
+        uint32_t pad;
+    };
+
+    struct FreeLinks
+    {
+        Block *prev;
+        Block *next;
+    };
+
+    const size_t UNIT = sizeof(Block); // 16
+    const uint32_t USED = 0x55534544;  // "USED"
+
+    uint8_t *arena = nullptr;
+    size_t arenaSize = 0;
+    Block *freeList = nullptr;
+    NativeHeap::Stats counters = {};
+
+    __thread bool attached = false;
+    __thread int hostDepth = 0;
+
+    size_t (*libcUsableSize)(void *) = nullptr;
+
+    bool inArena(const void *p)
+    {
+        return arena != nullptr && (const uint8_t *)p >= arena && (const uint8_t *)p < arena + arenaSize;
+    }
+
+    bool fromArena()
+    {
+        return attached && hostDepth == 0 && arena != nullptr;
+    }
+
+    FreeLinks &links(Block *b)
+    {
+        return *(FreeLinks *)(b + 1);
+    }
+
+    Block *nextBlock(Block *b)
+    {
+        uint8_t *next = (uint8_t *)b + b->size;
+        return next < arena + arenaSize ? (Block *)next : nullptr;
+    }
+
+    Block *prevBlock(Block *b)
+    {
+        return b->prevSize ? (Block *)((uint8_t *)b - b->prevSize) : nullptr;
+    }
+
+    void unlinkFree(Block *b)
+    {
+        FreeLinks &l = links(b);
+        if (l.prev)
+            links(l.prev).next = l.next;
+        else
+            freeList = l.next;
+        if (l.next)
+            links(l.next).prev = l.prev;
+    }
+
+    void linkFree(Block *b)
+    {
+        b->used = 0;
+        links(b).prev = nullptr;
+        links(b).next = freeList;
+        if (freeList)
+            links(freeList).prev = b;
+        freeList = b;
+    }
+
+    void releaseBlock(Block *b);
+
+    void setSize(Block *b, uint32_t size)
+    {
+        b->size = size;
+        Block *next = nextBlock(b);
+        if (next)
+            next->prevSize = size;
+    }
+
+    // Cuts b down to size, the rest becomes a free block if it can hold one
+    void split(Block *b, uint32_t size)
+    {
+        if (b->size - size < 2 * UNIT)
+            return;
+        uint32_t rest = b->size - size;
+        setSize(b, size);
+        Block *tail = (Block *)((uint8_t *)b + size);
+        tail->prevSize = size;
+        setSize(tail, rest);
+        tail->used = USED; // freed right away, which merges it with a free next
+        releaseBlock(tail);
+    }
+
+    uint32_t blockSizeFor(size_t request)
+    {
+        if (request == 0)
+            request = 1;
+        if (request > arenaSize)
+            return 0;
+        return (uint32_t)((request + UNIT - 1) / UNIT * UNIT + UNIT);
+    }
+
+    // Marks b free and merges it with free neighbours
+    void releaseBlock(Block *b)
+    {
+        Block *next = nextBlock(b);
+        if (next && !next->used)
+        {
+            unlinkFree(next);
+            setSize(b, b->size + next->size);
+        }
+        Block *prev = prevBlock(b);
+        if (prev && !prev->used)
+        {
+            unlinkFree(prev);
+            setSize(prev, prev->size + b->size);
+            b = prev;
+        }
+        linkFree(b);
+    }
+
+    void *arenaMalloc(size_t request)
+    {
+        uint32_t need = blockSizeFor(request);
+        Block *best = nullptr;
+        for (Block *b = freeList; need && b; b = links(b).next)
+        {
+            if (b->size >= need && (best == nullptr || b->size < best->size))
+            {
+                best = b;
+                if (b->size == need)
+                    break;
+            }
+        }
+        if (best == nullptr)
+        {
+            counters.failures++;
+            errno = ENOMEM;
+            return nullptr;
+        }
+        unlinkFree(best);
+        best->used = USED;
+        split(best, need);
+        counters.allocations++;
+        return best + 1;
+    }
+
+    size_t arenaUsable(void *p)
+    {
+        return ((Block *)p - 1)->size - UNIT;
+    }
+
+    void *arenaRealloc(void *p, size_t request)
+    {
+        Block *b = (Block *)p - 1;
+        uint32_t need = blockSizeFor(request);
+        if (need == 0)
+        {
+            counters.failures++;
+            errno = ENOMEM;
+            return nullptr;
+        }
+        if (b->size >= need)
+        {
+            split(b, need);
+            return p;
+        }
+        Block *next = nextBlock(b);
+        if (next && !next->used && b->size + next->size >= need)
+        {
+            // Grow in place into the free block after it
+            unlinkFree(next);
+            setSize(b, b->size + next->size);
+            split(b, need);
+            return p;
+        }
+        void *moved = arenaMalloc(request);
+        if (moved == nullptr)
+            return nullptr;
+        memcpy(moved, p, b->size - UNIT);
+        releaseBlock(b);
+        counters.frees++;
+        return moved;
+    }
+}
+
+namespace NativeHeap
+{
+    void begin(size_t size)
+    {
+        if (arena != nullptr)
+            return;
+        size = size / UNIT * UNIT;
+        void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            return;
+        libcUsableSize = (size_t(*)(void *))dlsym(RTLD_NEXT, "malloc_usable_size");
+        arenaSize = size;
+        counters.size = size;
+        Block *all = (Block *)p;
+        all->size = size;
+        all->prevSize = 0;
+        arena = (uint8_t *)p; // last: from here on frees may land in it
+        linkFree(all);
+    }
+
+    void attachThread()
+    {
+        attached = true;
+    }
+
+    void detachThread()
+    {
+        attached = false;
+    }
+
+    bool threadAttached()
+    {
+        return attached;
+    }
+
+    Stats stats()
+    {
+        Stats s = counters;
+        double squares = 0;
+        for (Block *b = freeList; b; b = links(b).next)
+        {
+            uint32_t usable = b->size - UNIT;
+            s.freeBytes += usable;
+            s.freeBlocks++;
+            if (usable > s.maxFreeBlock)
+                s.maxFreeBlock = usable;
+            squares += (double)usable * usable;
+        }
+        for (Block *b = arena ? (Block *)arena : nullptr; b; b = nextBlock(b))
+        {
+            if (b->used)
+                s.usedBlocks++;
+        }
+        // umm_malloc's: 100 - sqrt(sum of squares) * 100 / sum
+        s.fragmentation = s.freeBytes ? (uint8_t)(100 - sqrt(squares) * 100 / s.freeBytes) : 0;
+        return s;
+    }
+
+    HostScope::HostScope()
+    {
+        hostDepth++;
+    }
+
+    HostScope::~HostScope()
+    {
+        hostDepth--;
+    }
+}
+
+extern "C"
+{
+    void *malloc(size_t size)
+    {
+        return fromArena() ? arenaMalloc(size) : __libc_malloc(size);
+    }
+
+    void free(void *p)
+    {
+        if (p == nullptr)
+            return;
+        if (inArena(p))
+        {
+            releaseBlock((Block *)p - 1);
+            counters.frees++;
+        }
+        else
+            __libc_free(p);
+    }
+
+    void *calloc(size_t count, size_t size)
+    {
+        if (!fromArena())
+            return __libc_calloc(count, size);
+        if (size && count > SIZE_MAX / size)
+        {
+            errno = ENOMEM;
+            return nullptr;
+        }
+        void *p = arenaMalloc(count * size);
+        if (p)
+            memset(p, 0, count * size);
+        return p;
+    }
+
+    void *realloc(void *p, size_t size)
+    {
+        if (p == nullptr)
+            return malloc(size);
+        if (size == 0)
+        {
+            free(p);
+            return nullptr;
+        }
+        return inArena(p) ? arenaRealloc(p, size) : __libc_realloc(p, size);
+    }
+
+    // Aligned requests are rare (the C library's own); they go to glibc
+    void *memalign(size_t alignment, size_t size)
+    {
+        return __libc_memalign(alignment, size);
+    }
+
+    void *aligned_alloc(size_t alignment, size_t size)
+    {
+        return __libc_memalign(alignment, size);
+    }
+
+    int posix_memalign(void **out, size_t alignment, size_t size)
+    {
+        void *p = __libc_memalign(alignment, size);
+        if (p == nullptr)
+            return ENOMEM;
+        *out = p;
+        return 0;
+    }
+
+    void *valloc(size_t size)
+    {
+        return __libc_memalign(4096, size);
+    }
+
+    size_t malloc_usable_size(void *p)
+    {
+        if (p == nullptr)
+            return 0;
+        if (inArena(p))
+            return arenaUsable(p);
+        return libcUsableSize ? libcUsableSize(p) : 0;
+    }
+}
+
+uint32_t EspClass::getFreeHeap()
+{
+    return NativeHeap::stats().freeBytes;
+}
+
+uint32_t EspClass::getMaxFreeBlockSize()
+{
+    return NativeHeap::stats().maxFreeBlock;
+}
+
+uint8_t EspClass::getHeapFragmentation()
+{
+    return NativeHeap::stats().fragmentation;
+}
+
+void EspClass::getHeapStats(uint32_t *free, uint32_t *max, uint8_t *frag)
+{
+    NativeHeap::Stats s = NativeHeap::stats();
+    if (free)
+        *free = s.freeBytes;
+    if (max)
+        *max = s.maxFreeBlock;
+    if (frag)
+        *frag = s.fragmentation;
+}
+
+void EspClass::getHeapStats(uint32_t *free, uint16_t *max, uint8_t *frag)
+{
+    uint32_t max32;
+    getHeapStats(free, &max32, frag);
+    if (max)
+        *max = max32 > 0xFFFF ? 0xFFFF : max32;
+}
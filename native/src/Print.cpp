@@ -0,0 +1,99 @@
+#include <Print.h>
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+    size_t n = 0;
+    while (size--)
+    {
+        size_t ret = write(*buffer++);
+        if (ret == 0)
+            break;
+        n += ret;
+    }
+    return n;
+}
+
+size_t Print::printf(const char *format, ...)
+{
+    va_list arg;
+    va_start(arg, format);
+    char temp[64];
+    char *buffer = temp;
+    size_t len = vsnprintf(temp, sizeof(temp), format, arg);
+    va_end(arg);
+    if (len > sizeof(temp) - 1)
+    {
+        buffer = (char *)malloc(len + 1);
+        if (buffer == nullptr)
+            return 0;
+        va_start(arg, format);
+        vsnprintf(buffer, len + 1, format, arg);
+        va_end(arg);
+    }
+    len = write((const uint8_t *)buffer, len);
+    if (buffer != temp)
+        free(buffer);
+    return len;
+}
+
+size_t Print::print(long n, int base)
+{
+    if (base == 10 && n < 0)
+    {
+        size_t t = print('-');
+        return t + printNumber(0ULL - (unsigned long long)n, 10);
+    }
+    return printNumber((unsigned long)n, base);
+}
+
+size_t Print::print(unsigned long n, int base)
+{
+    return printNumber(n, base);
+}
+
+size_t Print::print(long long n, int base)
+{
+    if (base == 10 && n < 0)
+    {
+        size_t t = print('-');
+        return t + printNumber(0ULL - (unsigned long long)n, 10);
+    }
+    return printNumber((unsigned long long)n, base);
+}
+
+size_t Print::print(unsigned long long n, int base)
+{
+    return printNumber(n, base);
+}
+
+size_t Print::print(double n, int digits)
+{
+    char buf[64];
+    if (isnan(n))
+        return print("nan");
+    if (isinf(n))
+        return print(n > 0 ? "inf" : "-inf");
+    snprintf(buf, sizeof(buf), "%.*f", digits, n);
+    return print(buf);
+}
+
+size_t Print::printNumber(unsigned long long n, uint8_t base)
+{
+    char buf[8 * sizeof(n) + 1];
+    char *str = &buf[sizeof(buf) - 1];
+    *str = '\0';
+    if (base < 2)
+        base = 10;
+    do
+    {
+        char c = n % base;
+        n /= base;
+        *--str = c < 10 ? c + '0' : c + 'A' - 10;
+    } while (n);
+    return write(str);
+}
@@ -0,0 +1,337 @@
+#include <RTClib.h>
+
+#define DS3231_I2C 0x68
+#define DS3231_TIME 0x00
+#define DS3231_ALARM1 0x07
+#define DS3231_ALARM2 0x0B
+#define DS3231_CONTROL 0x0E
+#define DS3231_STATUSREG 0x0F
+#define DS3231_TEMPERATUREREG 0x11
+
+static const uint8_t daysInMonth[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30};
+
+// Days since 2000-01-01, valid for 2000..2099
+static uint16_t date2days(uint16_t y, uint8_t m, uint8_t d)
+{
+    if (y >= 2000U)
+        y -= 2000U;
+    uint16_t days = d;
+    for (uint8_t i = 1; i < m; ++i)
+        days += daysInMonth[i - 1];
+    if (m > 2 && y % 4 == 0)
+        ++days;
+    return days + 365 * y + (y + 3) / 4 - 1;
+}
+
+static uint32_t time2ulong(uint16_t days, uint8_t h, uint8_t m, uint8_t s)
+{
+    return ((days * 24UL + h) * 60 + m) * 60 + s;
+}
+
+static uint8_t conv2d(const char *p)
+{
+    uint8_t v = 0;
+    if ('0' <= *p && *p <= '9')
+        v = *p - '0';
+    return 10 * v + *++p - '0';
+}
+
+static uint8_t dowToDS3231(uint8_t d)
+{
+    return d == 0 ? 7 : d;
+}
+
+DateTime::DateTime(uint32_t t)
+{
+    t -= SECONDS_FROM_1970_TO_2000;
+    ss = t % 60;
+    t /= 60;
+    mm = t % 60;
+    t /= 60;
+    hh = t % 24;
+    uint16_t days = t / 24;
+    uint8_t leap;
+    for (yOff = 0;; ++yOff)
+    {
+        leap = yOff % 4 == 0;
+        if (days < 365U + leap)
+            break;
+        days -= 365 + leap;
+    }
+    for (m = 1; m < 12; ++m)
+    {
+        uint8_t daysPerMonth = daysInMonth[m - 1];
+        if (leap && m == 2)
+            ++daysPerMonth;
+        if (days < daysPerMonth)
+            break;
+        days -= daysPerMonth;
+    }
+    d = days + 1;
+}
+
+DateTime::DateTime(uint16_t year, uint8_t month, uint8_t day, uint8_t hour, uint8_t min, uint8_t sec)
+{
+    if (year >= 2000U)
+        year -= 2000U;
+    yOff = year;
+    m = month;
+    d = day;
+    hh = hour;
+    mm = min;
+    ss = sec;
+}
+
+// __DATE__ ("Apr 16 2025") and __TIME__ ("18:34:56")
+DateTime::DateTime(const char *date, const char *time)
+{
+    yOff = conv2d(date + 9);
+    switch (date[0])
+    {
+    case 'J':
+        m = (date[1] == 'a') ? 1 : ((date[2] == 'n') ? 6 : 7);
+        break;
+    case 'F':
+        m = 2;
+        break;
+    case 'A':
+        m = date[2] == 'r' ? 4 : 8;
+        break;
+    case 'M':
+        m = date[2] == 'r' ? 3 : 5;
+        break;
+    case 'S':
+        m = 9;
+        break;
+    case 'O':
+        m = 10;
+        break;
+    case 'N':
+        m = 11;
+        break;
+    case 'D':
+        m = 12;
+        break;
+    }
+    d = conv2d(date + 4);
+    hh = conv2d(time);
+    mm = conv2d(time + 3);
+    ss = conv2d(time + 6);
+}
+
+bool DateTime::isValid() const
+{
+    if (yOff >= 100)
+        return false;
+    DateTime other(unixtime());
+    return yOff == other.yOff && m == other.m && d == other.d && hh == other.hh && mm == other.mm &&
+           ss == other.ss;
+}
+
+uint8_t DateTime::twelveHour() const
+{
+    if (hh == 0 || hh == 12)
+        return 12;
+    return hh > 12 ? hh - 12 : hh;
+}
+
+uint8_t DateTime::dayOfTheWeek() const
+{
+    uint16_t day = date2days(yOff, m, d);
+    return (day + 6) % 7; // Jan 1, 2000 is a Saturday, i.e. returns 6
+}
+
+uint32_t DateTime::unixtime() const
+{
+    return time2ulong(date2days(yOff, m, d), hh, mm, ss) + SECONDS_FROM_1970_TO_2000;
+}
+
+uint32_t DateTime::secondstime() const
+{
+    return time2ulong(date2days(yOff, m, d), hh, mm, ss);
+}
+
+DateTime DateTime::operator+(const TimeSpan &span) const
+{
+    return DateTime(unixtime() + span.totalseconds());
+}
+
+DateTime DateTime::operator-(const TimeSpan &span) const
+{
+    return DateTime(unixtime() - span.totalseconds());
+}
+
+TimeSpan DateTime::operator-(const DateTime &right) const
+{
+    return TimeSpan(unixtime() - right.unixtime());
+}
+
+uint8_t RTC_DS3231::readRegister(uint8_t reg)
+{
+    wire->beginTransmission(DS3231_I2C);
+    wire->write(reg);
+    wire->endTransmission();
+    wire->requestFrom(DS3231_I2C, 1);
+    return wire->read();
+}
+
+void RTC_DS3231::writeRegister(uint8_t reg, uint8_t value)
+{
+    wire->beginTransmission(DS3231_I2C);
+    wire->write(reg);
+    wire->write(value);
+    wire->endTransmission();
+}
+
+bool RTC_DS3231::begin(TwoWire *wireInstance)
+{
+    wire = wireInstance;
+    wire->beginTransmission(DS3231_I2C);
+    return wire->endTransmission() == 0;
+}
+
+void RTC_DS3231::adjust(const DateTime &dt)
+{
+    uint8_t buffer[8] = {DS3231_TIME,
+                         bin2bcd(dt.second()),
+                         bin2bcd(dt.minute()),
+                         bin2bcd(dt.hour()),
+                         bin2bcd(dowToDS3231(dt.dayOfTheWeek())),
+                         bin2bcd(dt.day()),
+                         bin2bcd(dt.month()),
+                         bin2bcd(dt.year() - 2000U)};
+    wire->beginTransmission(DS3231_I2C);
+    wire->write(buffer, 8);
+    wire->endTransmission();
+
+    uint8_t statreg = readRegister(DS3231_STATUSREG);
+    statreg &= ~0x80; // flip OSF bit
+    writeRegister(DS3231_STATUSREG, statreg);
+}
+
+bool RTC_DS3231::lostPower()
+{
+    return readRegister(DS3231_STATUSREG) >> 7;
+}
+
+DateTime RTC_DS3231::now()
+{
+    uint8_t buffer[7] = {0};
+    wire->beginTransmission(DS3231_I2C);
+    wire->write((uint8_t)DS3231_TIME);
+    wire->endTransmission();
+    if (wire->requestFrom(DS3231_I2C, 7) == 7)
+    {
+        for (uint8_t i = 0; i < 7; i++)
+            buffer[i] = wire->read();
+    }
+    return DateTime(bcd2bin(buffer[6]) + 2000U, bcd2bin(buffer[5] & 0x7F), bcd2bin(buffer[4]), bcd2bin(buffer[2]),
+                    bcd2bin(buffer[1]), bcd2bin(buffer[0] & 0x7F));
+}
+
+Ds3231SqwPinMode RTC_DS3231::readSqwPinMode()
+{
+    int mode = readRegister(DS3231_CONTROL) & 0x1C;
+    if (mode & 0x04)
+        mode = DS3231_OFF;
+    return static_cast<Ds3231SqwPinMode>(mode);
+}
+
+void RTC_DS3231::writeSqwPinMode(Ds3231SqwPinMode mode)
+{
+    uint8_t ctrl = readRegister(DS3231_CONTROL);
+    ctrl &= ~0x04; // turn off INTCON
+    ctrl &= ~0x18; // set freq bits to 0
+    writeRegister(DS3231_CONTROL, ctrl | mode);
+}
+
+bool RTC_DS3231::setAlarm1(const DateTime &dt, Ds3231Alarm1Mode alarmMode)
+{
+    uint8_t ctrl = readRegister(DS3231_CONTROL);
+    if (!(ctrl & 0x04))
+        return false;
+
+    uint8_t A1M1 = (alarmMode & 0x01) << 7;
+    uint8_t A1M2 = (alarmMode & 0x02) << 6;
+    uint8_t A1M3 = (alarmMode & 0x04) << 5;
+    uint8_t A1M4 = (alarmMode & 0x08) << 4;
+    uint8_t DY_DT = (alarmMode & 0x10) << 2;
+    uint8_t day = DY_DT ? dowToDS3231(dt.dayOfTheWeek()) : dt.day();
+
+    uint8_t buffer[5] = {DS3231_ALARM1, uint8_t(bin2bcd(dt.second()) | A1M1), uint8_t(bin2bcd(dt.minute()) | A1M2),
+                         uint8_t(bin2bcd(dt.hour()) | A1M3), uint8_t(bin2bcd(day) | A1M4 | DY_DT)};
+    wire->beginTransmission(DS3231_I2C);
+    wire->write(buffer, 5);
+    wire->endTransmission();
+    writeRegister(DS3231_CONTROL, ctrl | 0x01); // AI1E
+    return true;
+}
+
+bool RTC_DS3231::setAlarm2(const DateTime &dt, Ds3231Alarm2Mode alarmMode)
+{
+    uint8_t ctrl = readRegister(DS3231_CONTROL);
+    if (!(ctrl & 0x04))
+        return false;
+
+    uint8_t A2M2 = (alarmMode & 0x01) << 7;
+    uint8_t A2M3 = (alarmMode & 0x02) << 6;
+    uint8_t DY_DT = (alarmMode & 0x08) << 3;
+    uint8_t A2M4 = (alarmMode & 0x04) << 5;
+    uint8_t day = DY_DT ? dowToDS3231(dt.dayOfTheWeek()) : dt.day();
+
+    uint8_t buffer[4] = {DS3231_ALARM2, uint8_t(bin2bcd(dt.minute()) | A2M2), uint8_t(bin2bcd(dt.hour()) | A2M3),
+                         uint8_t(bin2bcd(day) | A2M4 | DY_DT)};
+    wire->beginTransmission(DS3231_I2C);
+    wire->write(buffer, 4);
+    wire->endTransmission();
+    writeRegister(DS3231_CONTROL, ctrl | 0x02); // AI2E
+    return true;
+}
+
+void RTC_DS3231::disableAlarm(uint8_t alarmNum)
+{
+    uint8_t ctrl = readRegister(DS3231_CONTROL);
+    ctrl &= ~(1 << (alarmNum - 1));
+    writeRegister(DS3231_CONTROL, ctrl);
+}
+
+void RTC_DS3231::clearAlarm(uint8_t alarmNum)
+{
+    uint8_t status = readRegister(DS3231_STATUSREG);
+    status &= ~(0x1 << (alarmNum - 1));
+    writeRegister(DS3231_STATUSREG, status);
+}
+
+bool RTC_DS3231::alarmFired(uint8_t alarmNum)
+{
+    return (readRegister(DS3231_STATUSREG) >> (alarmNum - 1)) & 0x1;
+}
+
+void RTC_DS3231::enable32K()
+{
+    writeRegister(DS3231_STATUSREG, readRegister(DS3231_STATUSREG) | 0x08);
+}
+
+void RTC_DS3231::disable32K()
+{
+    writeRegister(DS3231_STATUSREG, readRegister(DS3231_STATUSREG) & ~0x08);
+}
+
+bool RTC_DS3231::isEnabled32K()
+{
+    return (readRegister(DS3231_STATUSREG) >> 3) & 0x01;
+}
+
+float RTC_DS3231::getTemperature()
+{
+    uint8_t buffer[2] = {0, 0};
+    wire->beginTransmission(DS3231_I2C);
+    wire->write((uint8_t)DS3231_TEMPERATUREREG);
+    wire->endTransmission();
+    if (wire->requestFrom(DS3231_I2C, 2) == 2)
+    {
+        buffer[0] = wire->read();
+        buffer[1] = wire->read();
+    }
+    return (float)(int8_t)buffer[0] + (buffer[1] >> 6) * 0.25f;
+}
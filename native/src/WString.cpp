@@ -0,0 +1,575 @@
+#include <WString.h>
+
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <utility>
+
+static void numberToBuffer(char *buf, size_t size, unsigned long long value, bool negative, unsigned char base)
+{
+    char digits[66];
+    int i = 0;
+    if (base < 2 || base > 36)
+        base = 10;
+    do
+    {
+        unsigned d = value % base;
+        digits[i++] = d < 10 ? '0' + d : 'a' + d - 10;
+        value /= base;
+    } while (value);
+    size_t n = 0;
+    if (negative && n + 1 < size)
+        buf[n++] = '-';
+    while (i > 0 && n + 1 < size)
+        buf[n++] = digits[--i];
+    buf[n] = '\0';
+}
+
+static void signedToBuffer(char *buf, size_t size, long long value, unsigned char base)
+{
+    // The core prints negative numbers in other bases as their two's complement
+    if (base == 10 && value < 0)
+        numberToBuffer(buf, size, 0ULL - (unsigned long long)value, true, base);
+    else
+        numberToBuffer(buf, size, (unsigned long long)value, false, base);
+}
+
+String::String(const char *cstr)
+{
+    init();
+    if (cstr)
+        copy(cstr, strlen(cstr));
+}
+
+String::String(const char *cstr, unsigned length)
+{
+    init();
+    if (cstr)
+        copy(cstr, length);
+}
+
+String::String(const String &value)
+{
+    init();
+    *this = value;
+}
+
+String::String(String &&rval) noexcept
+{
+    init();
+    move(rval);
+}
+
+String::String(char c)
+{
+    init();
+    char buf[2] = {c, '\0'};
+    *this = buf;
+}
+
+String::String(unsigned char value, unsigned char base)
+{
+    init();
+    char buf[1 + 8 * sizeof(unsigned char)];
+    numberToBuffer(buf, sizeof(buf), value, false, base);
+    *this = buf;
+}
+
+String::String(int value, unsigned char base)
+{
+    init();
+    char buf[2 + 8 * sizeof(int)];
+    if (base == 10)
+        signedToBuffer(buf, sizeof(buf), value, base);
+    else
+        numberToBuffer(buf, sizeof(buf), (unsigned int)value, false, base);
+    *this = buf;
+}
+
+String::String(unsigned int value, unsigned char base)
+{
+    init();
+    char buf[1 + 8 * sizeof(unsigned int)];
+    numberToBuffer(buf, sizeof(buf), value, false, base);
+    *this = buf;
+}
+
+String::String(long value, unsigned char base)
+{
+    init();
+    char buf[2 + 8 * sizeof(long)];
+    if (base == 10)
+        signedToBuffer(buf, sizeof(buf), value, base);
+    else
+        numberToBuffer(buf, sizeof(buf), (unsigned long)value, false, base);
+    *this = buf;
+}
+
+String::String(unsigned long value, unsigned char base)
+{
+    init();
+    char buf[1 + 8 * sizeof(unsigned long)];
+    numberToBuffer(buf, sizeof(buf), value, false, base);
+    *this = buf;
+}
+
+String::String(long long value, unsigned char base)
+{
+    init();
+    char buf[2 + 8 * sizeof(long long)];
+    if (base == 10)
+        signedToBuffer(buf, sizeof(buf), value, base);
+    else
+        numberToBuffer(buf, sizeof(buf), (unsigned long long)value, false, base);
+    *this = buf;
+}
+
+String::String(unsigned long long value, unsigned char base)
+{
+    init();
+    char buf[1 + 8 * sizeof(unsigned long long)];
+    numberToBuffer(buf, sizeof(buf), value, false, base);
+    *this = buf;
+}
+
+String::String(float value, unsigned char decimalPlaces) : String((double)value, decimalPlaces)
+{
+}
+
+String::String(double value, unsigned char decimalPlaces)
+{
+    init();
+    char buf[64];
+    if (isnan(value))
+        strcpy(buf, "nan");
+    else if (isinf(value))
+        strcpy(buf, value > 0 ? "inf" : "-inf");
+    else
+        snprintf(buf, sizeof(buf), "%.*f", decimalPlaces, value);
+    *this = buf;
+}
+
+void String::invalidate()
+{
+    if (onHeap)
+        free(heap.ptr);
+    init();
+}
+
+bool String::reserve(unsigned size)
+{
+    if (capacity() >= size)
+        return true;
+    return changeBuffer(size);
+}
+
+bool String::changeBuffer(unsigned maxStrLen)
+{
+    if (maxStrLen <= SSO_CAPACITY && !onHeap)
+        return true;
+    // Like the core, heap buffers come in 16-byte steps
+    size_t newSize = (maxStrLen + 16) & ~(size_t)0xf;
+    if (onHeap)
+    {
+        char *grown = (char *)realloc(heap.ptr, newSize);
+        if (grown == nullptr)
+            return false;
+        heap.ptr = grown;
+        heap.capacity = newSize - 1;
+        return true;
+    }
+    char *fresh = (char *)malloc(newSize);
+    if (fresh == nullptr)
+        return false;
+    memcpy(fresh, ssoBuffer, len + 1);
+    heap.ptr = fresh;
+    heap.capacity = newSize - 1;
+    onHeap = true;
+    return true;
+}
+
+String &String::copy(const char *cstr, unsigned length)
+{
+    if (!reserve(length))
+    {
+        invalidate();
+        return *this;
+    }
+    char *buf = wbuffer();
+    memmove(buf, cstr, length);
+    buf[length] = '\0';
+    len = length;
+    return *this;
+}
+
+void String::move(String &rhs) noexcept
+{
+    invalidate();
+    onHeap = rhs.onHeap;
+    len = rhs.len;
+    if (rhs.onHeap)
+    {
+        heap.ptr = rhs.heap.ptr;
+        heap.capacity = rhs.heap.capacity;
+    }
+    else
+        memcpy(ssoBuffer, rhs.ssoBuffer, sizeof(ssoBuffer));
+    rhs.init();
+}
+
+String &String::operator=(const String &rhs)
+{
+    if (this == &rhs)
+        return *this;
+    return copy(rhs.buffer(), rhs.len);
+}
+
+String &String::operator=(String &&rval) noexcept
+{
+    if (this != &rval)
+        move(rval);
+    return *this;
+}
+
+String &String::operator=(const char *cstr)
+{
+    if (cstr)
+        copy(cstr, strlen(cstr));
+    else
+        invalidate();
+    return *this;
+}
+
+String &String::operator=(char c)
+{
+    char buf[2] = {c, '\0'};
+    return *this = buf;
+}
+
+bool String::concat(const char *cstr)
+{
+    if (cstr == nullptr)
+        return false;
+    return concat(cstr, strlen(cstr));
+}
+
+bool String::concat(const char *cstr, unsigned length)
+{
+    if (cstr == nullptr)
+        return false;
+    if (length == 0)
+        return true;
+    unsigned newlen = len + length;
+    // cstr may point into this string, which reserve() can move
+    if (cstr >= buffer() && cstr < buffer() + len)
+    {
+        size_t offset = cstr - buffer();
+        if (!reserve(newlen))
+            return false;
+        memmove(wbuffer() + len, buffer() + offset, length);
+    }
+    else
+    {
+        if (!reserve(newlen))
+            return false;
+        memmove(wbuffer() + len, cstr, length);
+    }
+    len = newlen;
+    wbuffer()[len] = '\0';
+    return true;
+}
+
+StringSumHelper &operator+(const StringSumHelper &lhs, const String &rhs)
+{
+    StringSumHelper &a = const_cast<StringSumHelper &>(lhs);
+    if (!a.concat(rhs))
+        static_cast<String &>(a) = (const char *)nullptr;
+    return a;
+}
+
+StringSumHelper &operator+(const StringSumHelper &lhs, const char *cstr)
+{
+    StringSumHelper &a = const_cast<StringSumHelper &>(lhs);
+    if (!cstr || !a.concat(cstr))
+        static_cast<String &>(a) = (const char *)nullptr;
+    return a;
+}
+
+StringSumHelper &operator+(const StringSumHelper &lhs, const __FlashStringHelper *rhs)
+{
+    return lhs + reinterpret_cast<const char *>(rhs);
+}
+
+StringSumHelper &operator+(const StringSumHelper &lhs, char c)
+{
+    StringSumHelper &a = const_cast<StringSumHelper &>(lhs);
+    a.concat(c);
+    return a;
+}
+
+#define STRING_SUM_NUMBER(T)                                        \
+    StringSumHelper &operator+(const StringSumHelper &lhs, T num) \
+    {                                                               \
+        StringSumHelper &a = const_cast<StringSumHelper &>(lhs);    \
+        a.concat(num);                                              \
+        return a;                                                   \
+    }
+
+STRING_SUM_NUMBER(unsigned char)
+STRING_SUM_NUMBER(int)
+STRING_SUM_NUMBER(unsigned int)
+STRING_SUM_NUMBER(long)
+STRING_SUM_NUMBER(unsigned long)
+STRING_SUM_NUMBER(long long)
+STRING_SUM_NUMBER(unsigned long long)
+STRING_SUM_NUMBER(float)
+STRING_SUM_NUMBER(double)
+
+int String::compareTo(const String &s) const
+{
+    return strcmp(buffer(), s.buffer());
+}
+
+bool String::equals(const String &s) const
+{
+    return len == s.len && compareTo(s) == 0;
+}
+
+bool String::equals(const char *cstr) const
+{
+    if (len == 0)
+        return cstr == nullptr || *cstr == '\0';
+    if (cstr == nullptr)
+        return false;
+    return strcmp(buffer(), cstr) == 0;
+}
+
+bool String::equalsIgnoreCase(const String &s) const
+{
+    if (this == &s)
+        return true;
+    if (len != s.len)
+        return false;
+    return strcasecmp(buffer(), s.buffer()) == 0;
+}
+
+bool String::equalsConstantTime(const String &s) const
+{
+    if (len != s.len)
+        return false;
+    unsigned char diff = 0;
+    for (unsigned i = 0; i < len; i++)
+        diff |= (unsigned char)(buffer()[i] ^ s.buffer()[i]);
+    return diff == 0;
+}
+
+bool String::startsWith(const String &prefix, unsigned offset) const
+{
+    if (offset > len || prefix.len > len - offset)
+        return false;
+    return strncmp(buffer() + offset, prefix.buffer(), prefix.len) == 0;
+}
+
+bool String::endsWith(const String &suffix) const
+{
+    if (len < suffix.len)
+        return false;
+    return strcmp(buffer() + len - suffix.len, suffix.buffer()) == 0;
+}
+
+void String::setCharAt(unsigned index, char c)
+{
+    if (index < len)
+        wbuffer()[index] = c;
+}
+
+char String::operator[](unsigned index) const
+{
+    if (index >= len)
+        return 0;
+    return buffer()[index];
+}
+
+char &String::operator[](unsigned index)
+{
+    static char dummy;
+    if (index >= len)
+    {
+        dummy = 0;
+        return dummy;
+    }
+    return wbuffer()[index];
+}
+
+void String::getBytes(unsigned char *buf, unsigned bufsize, unsigned index) const
+{
+    if (!bufsize || !buf)
+        return;
+    if (index >= len)
+    {
+        buf[0] = 0;
+        return;
+    }
+    unsigned n = bufsize - 1;
+    if (n > len - index)
+        n = len - index;
+    memcpy(buf, buffer() + index, n);
+    buf[n] = 0;
+}
+
+int String::indexOf(char ch, unsigned fromIndex) const
+{
+    if (fromIndex >= len)
+        return -1;
+    const char *found = strchr(buffer() + fromIndex, ch);
+    return found ? found - buffer() : -1;
+}
+
+int String::indexOf(const char *str, unsigned fromIndex) const
+{
+    if (fromIndex >= len)
+        return -1;
+    const char *found = strstr(buffer() + fromIndex, str);
+    return found ? found - buffer() : -1;
+}
+
+int String::lastIndexOf(char ch) const
+{
+    return len ? lastIndexOf(ch, len - 1) : -1;
+}
+
+int String::lastIndexOf(char ch, unsigned fromIndex) const
+{
+    if (fromIndex >= len)
+        return -1;
+    for (int i = fromIndex; i >= 0; i--)
+    {
+        if (buffer()[i] == ch)
+            return i;
+    }
+    return -1;
+}
+
+int String::lastIndexOf(const String &str) const
+{
+    return len >= str.len ? lastIndexOf(str, len - str.len) : -1;
+}
+
+int String::lastIndexOf(const String &str, unsigned fromIndex) const
+{
+    if (str.len == 0 || len == 0 || str.len > len)
+        return -1;
+    if (fromIndex >= len)
+        fromIndex = len - 1;
+    int found = -1;
+    for (const char *p = buffer(); p <= buffer() + fromIndex; p++)
+    {
+        p = strstr(p, str.buffer());
+        if (!p || p > buffer() + fromIndex)
+            break;
+        found = p - buffer();
+    }
+    return found;
+}
+
+String String::substring(unsigned left, unsigned right) const
+{
+    if (left > right)
+        std::swap(left, right);
+    if (left >= len)
+        return String();
+    if (right > len)
+        right = len;
+    return String(buffer() + left, right - left);
+}
+
+void String::replace(char find, char replace)
+{
+    for (char *p = wbuffer(); *p; p++)
+    {
+        if (*p == find)
+            *p = replace;
+    }
+}
+
+void String::replace(const String &find, const String &replace)
+{
+    if (len == 0 || find.len == 0)
+        return;
+    String result;
+    const char *readFrom = buffer();
+    const char *foundAt;
+    while ((foundAt = strstr(readFrom, find.buffer())) != nullptr)
+    {
+        result.concat(readFrom, foundAt - readFrom);
+        result.concat(replace);
+        readFrom = foundAt + find.len;
+    }
+    if (readFrom == buffer())
+        return;
+    result.concat(readFrom);
+    *this = static_cast<String &&>(result);
+}
+
+void String::remove(unsigned index)
+{
+    remove(index, (unsigned)-1);
+}
+
+void String::remove(unsigned index, unsigned count)
+{
+    if (index >= len || count == 0)
+        return;
+    if (count > len - index)
+        count = len - index;
+    char *buf = wbuffer();
+    len -= count;
+    memmove(buf + index, buf + index + count, len - index);
+    buf[len] = 0;
+}
+
+void String::toLowerCase()
+{
+    for (char *p = wbuffer(); *p; p++)
+        *p = tolower((unsigned char)*p);
+}
+
+void String::toUpperCase()
+{
+    for (char *p = wbuffer(); *p; p++)
+        *p = toupper((unsigned char)*p);
+}
+
+void String::trim()
+{
+    if (len == 0)
+        return;
+    char *buf = wbuffer();
+    char *begin = buf;
+    while (isspace((unsigned char)*begin))
+        begin++;
+    char *end = buf + len - 1;
+    while (end >= begin && isspace((unsigned char)*end))
+        end--;
+    len = end + 1 - begin;
+    if (begin > buf)
+        memmove(buf, begin, len);
+    buf[len] = 0;
+}
+
+long String::toInt() const
+{
+    return atol(buffer());
+}
+
+float String::toFloat() const
+{
+    return atof(buffer());
+}
+
+double String::toDouble() const
+{
+    return atof(buffer());
+}
@@ -0,0 +1,655 @@
+#include "NativeCore.h"
+#include <ESP8266WiFi.h>
+#include <NativeHeap.h>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/sockios.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define TCP_SND_BUF (2 * 1460)
+#define WIFI_CLIENT_TIMEOUT_MS 5000
+#define STATION_WINDOW_MS 60000
+#define MAX_STATIONS 8
+
+ESP8266WiFiClass WiFi;
+
+// Sized like lwIP's tcp_pcb plus the core's ClientContext
+struct WiFiClient::Context
+{
+    int fd;
+    int refs;
+    uint32_t remote;
+    uint16_t remotePort;
+    uint8_t pcb[224];
+};
+
+namespace
+{
+    struct Station
+    {
+        uint32_t address;
+        uint32_t lastMs;
+    };
+
+    Station stations[MAX_STATIONS];
+
+    uint32_t envAddress(const char *name, const char *fallback)
+    {
+        const char *v = getenv(name);
+        struct in_addr address;
+        if (inet_pton(AF_INET, v && *v ? v : fallback, &address) != 1)
+            inet_pton(AF_INET, fallback, &address);
+        return address.s_addr;
+    }
+
+    // Waits for the socket, with interrupts running meanwhile
+    bool waitFor(int fd, short events, int timeoutMs)
+    {
+        uint32_t start = millis();
+        for (;;)
+        {
+            int left = timeoutMs - (int)(millis() - start);
+            if (left < 0)
+                return false;
+            struct pollfd p = {fd, events, 0};
+            int n = poll(&p, 1, left);
+            if (n > 0)
+                return true;
+            if (n == 0 || errno != EINTR)
+                return false;
+        }
+    }
+}
+
+IPAddress ESP8266WiFiClass::softAPIP()
+{
+    return IPAddress(192, 168, 4, 1);
+}
+
+bool IPAddress::fromString(const char *text)
+{
+    struct in_addr parsed;
+    if (text == nullptr || inet_pton(AF_INET, text, &parsed) != 1)
+        return false;
+    address = parsed.s_addr;
+    return true;
+}
+
+String IPAddress::toString() const
+{
+    char text[16];
+    snprintf(text, sizeof(text), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+    return String(text);
+}
+
+bool ESP8266WiFiClass::mode(WiFiMode_t mode)
+{
+    currentMode = mode;
+    if (mode == WIFI_OFF)
+        stationJoined = false;
+    return true;
+}
+
+bool ESP8266WiFiClass::softAP(const char *ssid, const char *passphrase, int channel, int hidden, int maxConnection)
+{
+    (void)ssid;
+    (void)passphrase;
+    (void)channel;
+    (void)hidden;
+    (void)maxConnection;
+    if (!(currentMode & WIFI_AP))
+        currentMode = (WiFiMode_t)(currentMode | WIFI_AP);
+    sleeping = false;
+    return true;
+}
+
+bool ESP8266WiFiClass::softAPdisconnect(bool wifiOff)
+{
+    currentMode = (WiFiMode_t)(currentMode & ~WIFI_AP);
+    if (wifiOff)
+        currentMode = WIFI_OFF;
+    return true;
+}
+
+void ESP8266WiFiClass::noteStation(IPAddress address)
+{
+    uint32_t now = millis();
+    Station *slot = &stations[0];
+    for (Station &s : stations)
+    {
+        if (s.lastMs != 0 && s.address == (uint32_t)address)
+        {
+            slot = &s;
+            break;
+        }
+        if (s.lastMs == 0 || now - s.lastMs > now - slot->lastMs)
+            slot = &s;
+    }
+    *slot = {address, now ? now : 1};
+}
+
+uint8_t ESP8266WiFiClass::softAPgetStationNum()
+{
+    uint32_t now = millis();
+    uint8_t count = 0;
+    for (const Station &s : stations)
+    {
+        if (s.lastMs != 0 && now - s.lastMs < STATION_WINDOW_MS)
+            count++;
+    }
+    return count;
+}
+
+wl_status_t ESP8266WiFiClass::begin(const char *ssid, const char *passphrase)
+{
+    (void)passphrase;
+    if (ssid == nullptr || *ssid == '\0')
+        return WL_NO_SSID_AVAIL;
+    currentMode = (WiFiMode_t)(currentMode | WIFI_STA);
+    stationJoined = true;
+    return WL_CONNECTED;
+}
+
+bool ESP8266WiFiClass::disconnect(bool wifiOff)
+{
+    stationJoined = false;
+    if (wifiOff)
+        currentMode = WIFI_OFF;
+    return true;
+}
+
+wl_status_t ESP8266WiFiClass::status()
+{
+    return stationJoined && (currentMode & WIFI_STA) && !sleeping ? WL_CONNECTED : WL_DISCONNECTED;
+}
+
+IPAddress ESP8266WiFiClass::localIP()
+{
+    return status() == WL_CONNECTED ? IPAddress(envAddress("NATIVE_IP", "127.0.0.1")) : IPAddress();
+}
+
+bool ESP8266WiFiClass::forceSleepBegin(uint32_t sleepUs)
+{
+    (void)sleepUs;
+    sleeping = true;
+    return true;
+}
+
+bool ESP8266WiFiClass::forceSleepWake()
+{
+    sleeping = false;
+    return true;
+}
+
+WiFiClient::WiFiClient() : context(nullptr)
+{
+    timeoutMs = WIFI_CLIENT_TIMEOUT_MS;
+}
+
+WiFiClient::WiFiClient(int fd) : WiFiClient()
+{
+    if (fd < 0)
+        return;
+    context = new Context();
+    context->fd = fd;
+    context->refs = 1;
+    struct sockaddr_in peer = {};
+    socklen_t length = sizeof(peer);
+    if (getpeername(fd, (struct sockaddr *)&peer, &length) == 0 && peer.sin_family == AF_INET)
+    {
+        context->remote = peer.sin_addr.s_addr;
+        context->remotePort = ntohs(peer.sin_port);
+    }
+}
+
+WiFiClient::WiFiClient(const WiFiClient &other) : Stream(other), context(other.context)
+{
+    if (context)
+        context->refs++;
+}
+
+WiFiClient &WiFiClient::operator=(const WiFiClient &other)
+{
+    if (other.context)
+        other.context->refs++;
+    release();
+    context = other.context;
+    timeoutMs = other.timeoutMs;
+    return *this;
+}
+
+WiFiClient::~WiFiClient()
+{
+    release();
+}
+
+void WiFiClient::release()
+{
+    if (context && --context->refs == 0)
+    {
+        if (context->fd >= 0)
+            ::close(context->fd);
+        delete context;
+    }
+    context = nullptr;
+}
+
+void WiFiClient::stop()
+{
+    if (context && context->fd >= 0)
+    {
+        ::close(context->fd);
+        context->fd = -1;
+    }
+}
+
+uint8_t WiFiClient::connected()
+{
+    if (!context || context->fd < 0)
+        return 0;
+    char c;
+    ssize_t n = recv(context->fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (n > 0)
+        return 1;
+    if (n == 0)
+        return 0; // the peer closed
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+}
+
+int WiFiClient::available()
+{
+    if (!context || context->fd < 0)
+        return 0;
+    int n = 0;
+    if (ioctl(context->fd, FIONREAD, &n) < 0)
+        return 0;
+    return n;
+}
+
+int WiFiClient::read()
+{
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+int WiFiClient::read(uint8_t *buffer, size_t size)
+{
+    if (!context || context->fd < 0 || size == 0)
+        return 0;
+    ssize_t n = recv(context->fd, buffer, size, MSG_DONTWAIT);
+    return n > 0 ? (int)n : 0;
+}
+
+int WiFiClient::peek()
+{
+    if (!context || context->fd < 0)
+        return -1;
+    uint8_t c;
+    return recv(context->fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) == 1 ? c : -1;
+}
+
+size_t WiFiClient::write(uint8_t c)
+{
+    return write(&c, 1);
+}
+
+size_t WiFiClient::write(const uint8_t *buffer, size_t size)
+{
+    if (!context || context->fd < 0)
+        return 0;
+    size_t sent = 0;
+    uint32_t start = millis();
+    while (sent < size)
+    {
+        ssize_t n = send(context->fd, buffer + sent, size - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n > 0)
+        {
+            sent += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+            break; // reset by the peer
+        int left = (int)timeoutMs - (int)(millis() - start);
+        if (left <= 0 || !waitFor(context->fd, POLLOUT, left))
+            break;
+    }
+    return sent;
+}
+
+int WiFiClient::availableForWrite()
+{
+    if (!context || context->fd < 0)
+        return 0;
+    int queued = 0;
+    if (ioctl(context->fd, SIOCOUTQ, &queued) < 0)
+        return 0;
+    return queued < TCP_SND_BUF ? TCP_SND_BUF - queued : 0;
+}
+
+IPAddress WiFiClient::remoteIP()
+{
+    return context ? IPAddress(context->remote) : IPAddress();
+}
+
+uint16_t WiFiClient::remotePort()
+{
+    return context ? context->remotePort : 0;
+}
+
+IPAddress WiFiClient::localIP()
+{
+    struct sockaddr_in local = {};
+    socklen_t length = sizeof(local);
+    if (!context || context->fd < 0 || getsockname(context->fd, (struct sockaddr *)&local, &length) != 0)
+        return IPAddress();
+    return IPAddress(local.sin_addr.s_addr);
+}
+
+uint16_t WiFiClient::localPort()
+{
+    struct sockaddr_in local = {};
+    socklen_t length = sizeof(local);
+    if (!context || context->fd < 0 || getsockname(context->fd, (struct sockaddr *)&local, &length) != 0)
+        return 0;
+    return ntohs(local.sin_port);
+}
+
+void WiFiClient::setNoDelay(bool noDelay)
+{
+    if (!context || context->fd < 0)
+        return;
+    int on = noDelay;
+    setsockopt(context->fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+}
+
+void WiFiServer::begin(uint16_t port, uint8_t backlog)
+{
+    this->backlog = backlog;
+    if (fd >= 0)
+    {
+        listen(fd, backlog); // already listening: only the backlog changes
+        return;
+    }
+    uint16_t hostPort = port;
+    if (port == 80)
+    {
+        const char *env = getenv("NATIVE_HTTP_PORT");
+        hostPort = env && *env ? atoi(env) : 8080;
+    }
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return;
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(hostPort);
+    address.sin_addr.s_addr = envAddress("NATIVE_IP", "127.0.0.1");
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(fd, backlog) != 0)
+    {
+        fprintf(stderr, "native: can't listen on port %u: %s\n", hostPort, strerror(errno));
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+// The accept queue: TCP_INFO of a listening socket has its length in
+// tcpi_unacked and the backlog in tcpi_sacked
+bool WiFiServer::hasMaxPendingClients()
+{
+    if (fd < 0)
+        return false;
+    struct tcp_info info = {};
+    socklen_t length = sizeof(info);
+    if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &length) != 0)
+        return false;
+    return info.tcpi_unacked >= backlog;
+}
+
+bool WiFiServer::hasClient()
+{
+    if (fd < 0 || !WiFi.radioUp())
+        return false;
+    struct pollfd p = {fd, POLLIN, 0};
+    return poll(&p, 1, 0) > 0 && (p.revents & POLLIN);
+}
+
+WiFiClient WiFiServer::accept()
+{
+    if (fd < 0 || !WiFi.radioUp())
+        return WiFiClient();
+    int client = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (client < 0)
+        return WiFiClient();
+    // lwIP acks at once; with the host's delayed ACKs Nagle would hold every
+    // second write of a response back for 40 ms
+    int on = noDelay;
+    setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    int sendBuffer = TCP_SND_BUF;
+    setsockopt(client, SOL_SOCKET, SO_SNDBUF, &sendBuffer, sizeof(sendBuffer));
+    WiFiClient accepted(client);
+    WiFi.noteStation(accepted.remoteIP());
+    return accepted;
+}
+
+void WiFiServer::close()
+{
+    if (fd >= 0)
+        ::close(fd);
+    fd = -1;
+}
+
+bool WiFiUDP::openTx(uint32_t interfaceAddress, int ttl)
+{
+    if (txFd >= 0 && txInterface == interfaceAddress)
+        return true;
+    if (txFd >= 0)
+        ::close(txFd);
+    txFd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (txFd < 0)
+        return false;
+    struct in_addr interface = {interfaceAddress};
+    setsockopt(txFd, IPPROTO_IP, IP_MULTICAST_IF, &interface, sizeof(interface));
+    unsigned char loop = 1, hops = ttl; // loop: the other units on this host hear it
+    setsockopt(txFd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+    setsockopt(txFd, IPPROTO_IP, IP_MULTICAST_TTL, &hops, sizeof(hops));
+    struct sockaddr_in local = {};
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = interfaceAddress;
+    socklen_t length = sizeof(local);
+    if (bind(txFd, (struct sockaddr *)&local, sizeof(local)) != 0 ||
+        getsockname(txFd, (struct sockaddr *)&local, &length) != 0)
+    {
+        ::close(txFd);
+        txFd = -1;
+        return false;
+    }
+    txPort = ntohs(local.sin_port);
+    txInterface = interfaceAddress;
+    return true;
+}
+
+uint8_t WiFiUDP::begin(uint16_t port)
+{
+    return beginMulticast(IPAddress(), IPAddress(), port);
+}
+
+uint8_t WiFiUDP::beginMulticast(IPAddress interfaceAddress, IPAddress multicast, uint16_t port)
+{
+    stop();
+    rxFd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (rxFd < 0)
+        return 0;
+    int on = 1;
+    setsockopt(rxFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    setsockopt(rxFd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = multicast.isSet() ? (uint32_t)multicast : htonl(INADDR_ANY);
+    if (bind(rxFd, (struct sockaddr *)&address, sizeof(address)) != 0)
+    {
+        stop();
+        return 0;
+    }
+    if (multicast.isSet())
+    {
+        struct ip_mreq group = {};
+        group.imr_multiaddr.s_addr = multicast;
+        group.imr_interface.s_addr = interfaceAddress.isSet() ? (uint32_t)interfaceAddress : htonl(INADDR_LOOPBACK);
+        if (setsockopt(rxFd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &group, sizeof(group)) != 0)
+        {
+            stop();
+            return 0;
+        }
+        openTx(group.imr_interface.s_addr, 1);
+    }
+    return 1;
+}
+
+void WiFiUDP::stop()
+{
+    flush();
+    free(tx);
+    tx = nullptr;
+    txLength = 0;
+    if (rxFd >= 0)
+        ::close(rxFd);
+    if (txFd >= 0)
+        ::close(txFd);
+    rxFd = txFd = -1;
+    txPort = 0;
+    txInterface = 0;
+}
+
+int WiFiUDP::beginPacket(IPAddress ip, uint16_t port)
+{
+    if (!openTx(txInterface ? txInterface : htonl(INADDR_LOOPBACK), 1))
+        return 0;
+    txTo = ip;
+    txToPort = port;
+    free(tx);
+    tx = nullptr;
+    txLength = 0;
+    return 1;
+}
+
+int WiFiUDP::beginPacketMulticast(IPAddress multicastAddress, uint16_t port, IPAddress interfaceAddress, int ttl)
+{
+    uint32_t interface = interfaceAddress.isSet() ? (uint32_t)interfaceAddress : htonl(INADDR_LOOPBACK);
+    if (!openTx(interface, ttl))
+        return 0;
+    txTo = multicastAddress;
+    txToPort = port;
+    free(tx);
+    tx = nullptr;
+    txLength = 0;
+    return 1;
+}
+
+size_t WiFiUDP::write(const uint8_t *buffer, size_t size)
+{
+    if (txFd < 0 || size == 0)
+        return 0;
+    uint8_t *grown = (uint8_t *)realloc(tx, txLength + size);
+    if (grown == nullptr)
+        return 0;
+    tx = grown;
+    memcpy(tx + txLength, buffer, size);
+    txLength += size;
+    return size;
+}
+
+int WiFiUDP::endPacket()
+{
+    if (txFd < 0)
+        return 0;
+    struct sockaddr_in to = {};
+    to.sin_family = AF_INET;
+    to.sin_port = htons(txToPort);
+    to.sin_addr.s_addr = txTo;
+    ssize_t n = sendto(txFd, tx, txLength, 0, (struct sockaddr *)&to, sizeof(to));
+    bool sent = n >= 0 && (size_t)n == txLength;
+    free(tx);
+    tx = nullptr;
+    txLength = 0;
+    return sent;
+}
+
+int WiFiUDP::parsePacket()
+{
+    flush();
+    if (rxFd < 0)
+        return 0;
+    for (;;)
+    {
+        int size = 0;
+        if (ioctl(rxFd, FIONREAD, &size) < 0)
+            return 0;
+        struct sockaddr_in from = {};
+        socklen_t length = sizeof(from);
+        uint8_t *packet = (uint8_t *)malloc(size ? size : 1);
+        if (packet == nullptr)
+        {
+            // No heap for the pbuf: the packet is lost, as on the chip
+            char drop;
+            recv(rxFd, &drop, 1, MSG_DONTWAIT);
+            return 0;
+        }
+        ssize_t n = recvfrom(rxFd, packet, size ? size : 1, MSG_DONTWAIT, (struct sockaddr *)&from, &length);
+        if (n < 0)
+        {
+            free(packet);
+            return 0;
+        }
+        if (txPort != 0 && ntohs(from.sin_port) == txPort && from.sin_addr.s_addr == txInterface)
+        {
+            free(packet); // our own multicast
+            continue;
+        }
+        rx = packet;
+        rxLength = n;
+        rxPosition = 0;
+        rxFrom = IPAddress(from.sin_addr.s_addr);
+        rxFromPort = ntohs(from.sin_port);
+        return n;
+    }
+}
+
+int WiFiUDP::read()
+{
+    return rxPosition < rxLength ? rx[rxPosition++] : -1;
+}
+
+int WiFiUDP::read(unsigned char *buffer, size_t length)
+{
+    size_t n = rxLength - rxPosition;
+    if (n > length)
+        n = length;
+    memcpy(buffer, rx + rxPosition, n);
+    rxPosition += n;
+    return n;
+}
+
+int WiFiUDP::peek()
+{
+    return rxPosition < rxLength ? rx[rxPosition] : -1;
+}
+
+// Drops what is left of the received packet
+void WiFiUDP::flush()
+{
+    free(rx);
+    rx = nullptr;
+    rxLength = 0;
+    rxPosition = 0;
+}
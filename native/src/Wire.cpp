@@ -0,0 +1,79 @@
+#include "NativeCore.h"
+#include <Wire.h>
+
+#define DS3231_I2C 0x68
+
+TwoWire Wire;
+
+void TwoWire::begin(int sda, int scl)
+{
+    (void)sda;
+    (void)scl;
+}
+
+void TwoWire::begin()
+{
+}
+
+void TwoWire::beginTransmission(uint8_t address)
+{
+    txAddress = address;
+    txLength = 0;
+}
+
+// 0: acknowledged, 2: no chip at the address
+uint8_t TwoWire::endTransmission(uint8_t sendStop)
+{
+    (void)sendStop;
+    if (txAddress != DS3231_I2C || !Ds3231::present())
+        return 2;
+    NativeCore::InterruptLock lock;
+    Ds3231::write(txBuffer, txLength);
+    txLength = 0;
+    return 0;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, size_t size, bool sendStop)
+{
+    (void)sendStop;
+    rxIndex = 0;
+    rxLength = 0;
+    if (address != DS3231_I2C || !Ds3231::present())
+        return 0;
+    if (size > BUFFER_LENGTH)
+        size = BUFFER_LENGTH;
+    NativeCore::InterruptLock lock;
+    rxLength = Ds3231::read(rxBuffer, size);
+    return rxLength;
+}
+
+size_t TwoWire::write(uint8_t data)
+{
+    if (txLength >= BUFFER_LENGTH)
+        return 0;
+    txBuffer[txLength++] = data;
+    return 1;
+}
+
+size_t TwoWire::write(const uint8_t *data, size_t size)
+{
+    size_t n = 0;
+    while (n < size && write(data[n]))
+        n++;
+    return n;
+}
+
+int TwoWire::available()
+{
+    return rxLength - rxIndex;
+}
+
+int TwoWire::read()
+{
+    return rxIndex < rxLength ? rxBuffer[rxIndex++] : -1;
+}
+
+int TwoWire::peek()
+{
+    return rxIndex < rxLength ? rxBuffer[rxIndex] : -1;
+}
@@ -0,0 +1,23 @@
+#include <Arduino.h>
+#include <NativeHost.h>
+
+#include <unistd.h>
+
+// The core's main loop on Linux. Unit tests bring their own main().
+#ifndef PIO_UNIT_TESTING
+
+int main()
+{
+    Native::begin();
+    const char *nap = getenv("NATIVE_LOOP_NAP_US");
+    useconds_t napUs = nap && *nap ? strtoul(nap, nullptr, 10) : 100;
+    setup();
+    for (;;)
+    {
+        loop();
+        if (napUs)
+            usleep(napUs);
+    }
+}
+
+#endif
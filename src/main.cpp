@@ -4,18 +4,25 @@
 void setup()
 {
   // Serial.begin(9600);
-  initLittleFS();
-  led.init();
-  bell.init();
-  applySavedConfig();
-  WifiSetup();
-  RtcSetup();
-  initSchedulesCache(); // Load schedules once at startup
+  initWatchdog();
+
+  // Only what the first bell needs; the web routes and schedules.json follow
+  // from the task loop. Each step's time is in /metrics.
+  timeBootPhase("initLittleFS", initLittleFS);
+  timeBootPhase("devices", []
+                { led.init(); bell.init(); });
+  timeBootPhase("applySavedConfig", applySavedConfig);
+  timeBootPhase("WifiSetup", WifiSetup);
+  timeBootPhase("RtcSetup", RtcSetup);
+  timeBootPhase("initSchedulesCache", initSchedulesCache); // Build-time defaults, schedules.json follows from a task
+  timeBootPhase("loadCalendar", loadCalendar);
+  timeBootPhase("initTasks", initTasks);
+  bootTimes.setupDoneMs = millis();
 }
 
 void loop()
 {
-  server.handleClient(); // handle incoming client requests
   // showTime();
-  controlDevices();
+  taskLoop.run();
+  lightSleepIfDozing(); // power.h
 }
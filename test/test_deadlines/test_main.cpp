@@ -0,0 +1,213 @@
+#include <Arduino.h>
+#include <NativeHost.h>
+#include <TaskLoop.h>
+#include <unity.h>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Bell deadlines while eight browsers load the dashboard: the firmware (src/,
+// built in with test_build_src) runs its task loop on this thread, and eight
+// clients, each from its own loopback address as phones on the access point
+// are, load the page and everything script.js asks for as it starts, then
+// reload it. Requests go out one per client at a time, each on its own
+// connection, and loop() runs between reads of the sockets; connecting
+// doesn't block, the server only accepts from inside loop().
+//
+// Afterwards each real-time task's maxLateUs (TaskLoop.h) must be within
+// what the loop promises it: one HTTP task's turn, its budget, besides the
+// real-time tasks' own longest runs. Those are measured rather than assumed
+// because on the host they also hold whatever time the OS took from the
+// process. The host is much faster than the chip, so this checks the loop's
+// structure, not the chip's timing.
+
+void setup(); // src/main.cpp
+void loop();
+extern TaskLoop taskLoop; // include/header.h
+
+#define PORT 18193
+#define CLIENTS 8
+#define PAGE_LOADS 2 // a load and a reload
+#define HTTP_TURN_US 20000 // the http task's budget (tasks.h)
+#define RELOAD_AFTER_US 1000000
+#define SETTLE_US 1000000
+#define LOAD_TIMEOUT_US 30000000
+
+// The page, its assets, and script.js's calls as it starts (as
+// tools/pageload.py --api reads them from the script)
+static const char *const PAGE[] = {"/", "/style.css", "/script.js", "/time", "/status", "/schedules",
+                                   "/profiles", "/schedules/upcoming?n=5", "/config",
+                                   "/schedules/upcoming?n=5", "/calendar"};
+#define PAGE_REQUESTS (sizeof(PAGE) / sizeof(PAGE[0]))
+
+struct Client
+{
+    int fd;
+    uint8_t step; // requests done, over all page loads
+    bool open;         // connecting or waiting for the response
+    bool sent;         // the request went out
+    bool counted;      // the response's status line is in
+    uint32_t notBefore; // micros() the next request waits for
+};
+
+static Client clients[CLIENTS];
+static uint32_t responses[6]; // by the status's first digit
+
+static int connectFrom(uint8_t client)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    TEST_ASSERT_TRUE(fd >= 0);
+    sockaddr_in from = {};
+    from.sin_family = AF_INET;
+    from.sin_addr.s_addr = htonl(INADDR_LOOPBACK + 1 + client); // 127.0.0.2 on
+    TEST_ASSERT_EQUAL(0, bind(fd, (sockaddr *)&from, sizeof(from)));
+    sockaddr_in to = {};
+    to.sin_family = AF_INET;
+    to.sin_port = htons(PORT);
+    to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    if (connect(fd, (sockaddr *)&to, sizeof(to)) != 0 && errno != EINPROGRESS)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Sends the request once the connection is up; false while it isn't
+static bool trySend(Client &c)
+{
+    char text[256];
+    int len = snprintf(text, sizeof(text),
+                       "GET %s HTTP/1.1\r\nHost: unit\r\nAccept: application/json\r\n"
+                       "Accept-Encoding: gzip, deflate\r\nConnection: close\r\n\r\n",
+                       PAGE[c.step % PAGE_REQUESTS]);
+    ssize_t n = send(c.fd, text, len, MSG_NOSIGNAL);
+    if (n < 0 && (errno == EAGAIN || errno == ENOTCONN))
+        return false;
+    TEST_ASSERT_EQUAL_MESSAGE(len, n, PAGE[c.step % PAGE_REQUESTS]);
+    return true;
+}
+
+// Reads what there is; true once the server has closed the connection
+static bool received(uint8_t i)
+{
+    static char buffer[4096];
+    Client &c = clients[i];
+    for (;;)
+    {
+        ssize_t n = recv(c.fd, buffer, sizeof(buffer), 0);
+        if (n > 0)
+        {
+            if (!c.counted && n > 9)
+                responses[(buffer[9] - '0') % 6]++; // "HTTP/1.1 200"
+            c.counted = true;
+            continue;
+        }
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            return true;
+        return false;
+    }
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_page_loads_keep_deadlines()
+{
+    // The web server starts on the task loop's first pass; the rest of the
+    // boot's work (schedules.json, the first flash writes) is left out of
+    // the maxima
+    uint64_t settled = Native::realtimeUs() + SETTLE_US;
+    while (Native::realtimeUs() < settled)
+        loop();
+    taskLoop.resetMaxima();
+
+    for (uint8_t i = 0; i < CLIENTS; i++)
+        clients[i] = {-1, 0, false, false, false, (uint32_t)micros()};
+    uint8_t done = 0;
+    uint64_t deadline = Native::realtimeUs() + LOAD_TIMEOUT_US;
+    while (done < CLIENTS)
+    {
+        TEST_ASSERT_TRUE_MESSAGE(Native::realtimeUs() < deadline, "page loads did not finish");
+        loop();
+        for (uint8_t i = 0; i < CLIENTS; i++)
+        {
+            Client &c = clients[i];
+            if (c.step >= PAGE_LOADS * PAGE_REQUESTS)
+                continue;
+            if (!c.open)
+            {
+                if ((int32_t)(micros() - c.notBefore) < 0)
+                    continue;
+                c.fd = connectFrom(i);
+                TEST_ASSERT_TRUE(c.fd >= 0);
+                c.open = true;
+                c.sent = false;
+                c.counted = false;
+            }
+            if (!c.sent)
+                c.sent = trySend(c);
+            if (!c.sent || !received(i))
+                continue;
+            close(c.fd);
+            c.open = false;
+            c.step++;
+            if (c.step % PAGE_REQUESTS == 0)
+                c.notBefore = micros() + RELOAD_AFTER_US;
+            if (c.step == PAGE_LOADS * PAGE_REQUESTS)
+                done++;
+        }
+    }
+
+    char message[160];
+    snprintf(message, sizeof(message), "%u responses: %u 2xx/3xx, %u 503; longest pass %u us",
+             (unsigned)(CLIENTS * PAGE_LOADS * PAGE_REQUESTS), (unsigned)(responses[2] + responses[3]),
+             (unsigned)responses[5], (unsigned)taskLoop.maxPassUs);
+    TEST_MESSAGE(message);
+    uint8_t realtime = 0;
+    uint32_t deadlineUs = HTTP_TURN_US;
+    for (uint8_t i = 0; i < taskLoop.taskCount(); i++)
+    {
+        if (taskLoop.task(i).priority == TASK_REALTIME)
+        {
+            deadlineUs += taskLoop.task(i).maxUs;
+            realtime++;
+        }
+    }
+    TEST_ASSERT_EQUAL(2, realtime); // triggers and devices
+    for (uint8_t i = 0; i < taskLoop.taskCount(); i++)
+    {
+        const Task &task = taskLoop.task(i);
+        if (task.priority != TASK_REALTIME)
+            continue;
+        snprintf(message, sizeof(message), "%s: %u runs, late by at most %u us (deadline %u us)", task.name,
+                 (unsigned)task.runs, (unsigned)task.maxLateUs, (unsigned)deadlineUs);
+        TEST_MESSAGE(message);
+        TEST_ASSERT_TRUE_MESSAGE(task.maxLateUs <= deadlineUs, message);
+    }
+    TEST_ASSERT_EQUAL(CLIENTS * PAGE_LOADS * PAGE_REQUESTS, responses[2] + responses[3] + responses[5]);
+}
+
+int main()
+{
+    // Unity's output would otherwise get its buffer from the emulated heap
+    static char out[BUFSIZ];
+    setvbuf(stdout, out, _IOLBF, sizeof(out));
+
+    setenv("NATIVE_HTTP_PORT", "18193", 1);
+    Native::begin();
+    setup();
+    UNITY_BEGIN();
+    RUN_TEST(test_page_loads_keep_deadlines);
+    return UNITY_END();
+}
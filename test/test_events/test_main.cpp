@@ -0,0 +1,158 @@
+#include <Arduino.h>
+#include <NativeHost.h>
+#include <LittleFS.h>
+#include <unity.h>
+
+// The event log (lib/functions/events.h) while flash fails: records stay
+// buffered, the segments on flash stay as they were, and nothing rotates
+// until a write has gone through. The firmware (src/, test_build_src) runs
+// on this thread; its event log is driven directly, the segment files are
+// read back from the RAM LittleFS.
+
+void setup(); // src/main.cpp
+void loop();
+bool secondClockValid(); // clock.h
+void logEvent(uint8_t zone, uint8_t source, uint8_t schedule, uint32_t lateUs); // events.h
+void flushEventsIfDue();
+extern uint8_t eventBuffered;
+extern uint8_t eventSegmentCount;
+
+#define SEGMENTS 4                 // EVENT_SEGMENTS
+#define SEGMENT_BYTES (512 * 8)    // EVENT_SEGMENT_RECORDS records of 8 bytes
+#define BATCH 16                   // EVENT_FLUSH_AT
+#define FLUSH_INTERVAL_MS 61000    // past EVENT_FLUSH_MS
+#define RETRIES 5
+#define CLOCK_TIMEOUT_US 5000000
+
+static long fileSize(uint32_t seq)
+{
+    char path[20];
+    snprintf(path, sizeof(path), "/events/%u", (unsigned)seq);
+    File f = LittleFS.open(path, "r");
+    return f ? (long)f.size() : -1;
+}
+
+static void logBatch()
+{
+    for (int i = 0; i < BATCH; i++)
+        logEvent(1, 3, 0xFF, 0); // the LED, from the web
+}
+
+static void flushPass()
+{
+    Native::advanceClock(FLUSH_INTERVAL_MS);
+    flushEventsIfDue();
+}
+
+// Full segments /events/1 to /events/4, old records in time order, and an
+// empty /events/5 as a failed flush leaves one
+static void writeSegments()
+{
+    static uint8_t records[SEGMENT_BYTES];
+    for (uint32_t seq = 1; seq <= SEGMENTS; seq++)
+    {
+        for (uint32_t i = 0; i < SEGMENT_BYTES / 8; i++)
+        {
+            uint32_t time = 1000000 + seq * 1000 + i;
+            memcpy(records + i * 8, &time, 4);
+            memset(records + i * 8 + 4, 0, 4);
+        }
+        char path[20];
+        snprintf(path, sizeof(path), "/events/%u", (unsigned)seq);
+        LittleFS.open(path, "w").write(records, sizeof(records));
+    }
+    LittleFS.open("/events/5", "w").close();
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_boot_drops_empty_segment()
+{
+    flushEventsIfDue(); // finds the segments
+    TEST_ASSERT_EQUAL(SEGMENTS, eventSegmentCount);
+    TEST_ASSERT_EQUAL(-1, fileSize(5));
+}
+
+// Flash not mounted: every open fails, and four of them used to leave four
+// empty segments where the history was
+void test_open_failure_keeps_history()
+{
+    LittleFS.end();
+    logBatch();
+    for (int i = 0; i < RETRIES; i++)
+    {
+        flushPass();
+        TEST_ASSERT_EQUAL(BATCH, eventBuffered);
+        TEST_ASSERT_EQUAL(SEGMENTS, eventSegmentCount);
+    }
+    TEST_ASSERT_TRUE(LittleFS.begin());
+    for (uint32_t seq = 1; seq <= SEGMENTS; seq++)
+        TEST_ASSERT_EQUAL(SEGMENT_BYTES, fileSize(seq));
+    TEST_ASSERT_EQUAL(-1, fileSize(5));
+
+    // Back: one new segment, the oldest removed for it
+    flushPass();
+    TEST_ASSERT_EQUAL(0, eventBuffered);
+    TEST_ASSERT_EQUAL(SEGMENTS, eventSegmentCount);
+    TEST_ASSERT_EQUAL(-1, fileSize(1));
+    TEST_ASSERT_EQUAL(SEGMENT_BYTES, fileSize(2));
+    TEST_ASSERT_EQUAL(BATCH * 8, fileSize(5));
+}
+
+// Flash full: writes store nothing, the segment isn't sealed, and the
+// records go to the same segment once there is room again
+void test_full_flash_keeps_segment()
+{
+    static uint8_t block[8192];
+    File fill = LittleFS.open("/fill", "w");
+    while (fill.write(block, sizeof(block)) == sizeof(block))
+        ;
+    fill.close();
+
+    logBatch();
+    for (int i = 0; i < RETRIES; i++)
+    {
+        flushPass();
+        TEST_ASSERT_EQUAL(BATCH, eventBuffered);
+    }
+    TEST_ASSERT_EQUAL(BATCH * 8, fileSize(5));
+    TEST_ASSERT_EQUAL(-1, fileSize(6));
+
+    TEST_ASSERT_TRUE(LittleFS.remove("/fill"));
+    flushPass();
+    TEST_ASSERT_EQUAL(0, eventBuffered);
+    TEST_ASSERT_EQUAL(2 * BATCH * 8, fileSize(5));
+    TEST_ASSERT_EQUAL(-1, fileSize(6));
+    TEST_ASSERT_EQUAL(SEGMENT_BYTES, fileSize(2));
+    TEST_ASSERT_EQUAL(SEGMENTS, eventSegmentCount);
+}
+
+int main()
+{
+    // Unity's output would otherwise get its buffer from the emulated heap
+    static char out[BUFSIZ];
+    setvbuf(stdout, out, _IOLBF, sizeof(out));
+
+    setenv("NATIVE_HTTP_PORT", "18191", 1);
+    Native::begin();
+    LittleFS.begin();
+    writeSegments();
+    setup();
+
+    // Events are only logged once the second clock runs
+    uint64_t deadline = Native::realtimeUs() + CLOCK_TIMEOUT_US;
+    while (!secondClockValid() && Native::realtimeUs() < deadline)
+        loop();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_boot_drops_empty_segment);
+    RUN_TEST(test_open_failure_keeps_history);
+    RUN_TEST(test_full_flash_keeps_segment);
+    return UNITY_END();
+}
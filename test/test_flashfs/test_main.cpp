@@ -0,0 +1,216 @@
+#include <Arduino.h>
+#include <NativeHeap.h>
+#include <NativeHost.h>
+#include <FlashFS.h>
+#include <Persist.h>
+#include <ArduinoJson.h>
+#include <unity.h>
+
+// FlashFS's counters against the RAM LittleFS of the native build, which
+// counts what a copy-on-write flash would have programmed (NativeHost.h).
+// The two are worked out independently and must agree: wear to the byte,
+// metadata commits, opens and bytes moved.
+
+static Native::FlashStats before;
+static uint32_t wearBefore;
+static uint32_t commitsBefore;
+
+static uint64_t programmed()
+{
+    return Native::flashStats().bytesProgrammed - before.bytesProgrammed;
+}
+
+static uint32_t commits()
+{
+    return Native::flashStats().commits - before.commits;
+}
+
+static void assertWearMatches()
+{
+    TEST_ASSERT_EQUAL_UINT64(programmed(), FlashFS::wearBytes - wearBefore);
+    TEST_ASSERT_EQUAL_UINT32(commits(), FlashFS::metadataCommits - commitsBefore);
+}
+
+static void writeFile(const char *path, const char *mode, size_t size)
+{
+    static uint8_t data[512];
+    FlashFile f = FlashFS::open(path, mode);
+    TEST_ASSERT_TRUE(f);
+    while (size > 0)
+    {
+        size_t n = size < sizeof(data) ? size : sizeof(data);
+        memset(data, 'a' + size % 26, n);
+        TEST_ASSERT_EQUAL(n, f.write(data, n));
+        size -= n;
+    }
+    f.close();
+}
+
+void setUp()
+{
+    LittleFS.end();
+    TEST_ASSERT_TRUE(LittleFS.format());
+    TEST_ASSERT_TRUE(FlashFS::begin());
+    before = Native::flashStats();
+    wearBefore = FlashFS::wearBytes;
+    commitsBefore = FlashFS::metadataCommits;
+}
+
+void tearDown()
+{
+}
+
+void test_geometry()
+{
+    FSInfo info;
+    TEST_ASSERT_TRUE(LittleFS.info(info));
+    TEST_ASSERT_EQUAL(info.blockSize, FlashFS::fsInfo.blockSize);
+    TEST_ASSERT_EQUAL(info.totalBytes / info.blockSize, FlashFS::blockCount());
+}
+
+// Whole files written from the start, sizes on and around block edges
+void test_truncating_writes()
+{
+    uint32_t block = FlashFS::fsInfo.blockSize;
+    const size_t sizes[] = {0, 1, 100, block - 1, block, block + 1, 3 * block - 17, 3 * block};
+    for (size_t size : sizes)
+    {
+        writeFile("/data.bin", "w", size);
+        assertWearMatches();
+        TEST_ASSERT_EQUAL(size, LittleFS.open("/data.bin", "r").size());
+    }
+    TEST_ASSERT_EQUAL_UINT64(12 * (uint64_t)block, programmed()); // 0+1+1+1+1+2+3+3 blocks
+}
+
+// Persist::save: header, body, header rewritten in place, flush, close,
+// then renames; every generation and both file sizes
+void test_persist_save()
+{
+    NativeHeap::HostScope host; // documents bigger than the emulated heap
+    size_t count = 0;
+    {
+        DynamicJsonDocument doc(64 * 1024);
+        JsonArray list = doc.createNestedArray("schedules");
+        for (int i = 0; i < 20; i++)
+        {
+            JsonObject s = list.createNestedObject();
+            s["time"] = "08:00";
+            s["enabled"] = true;
+            TEST_ASSERT_TRUE(Persist::save("/schedules.json", doc));
+            assertWearMatches();
+        }
+        for (int i = 0; i < 250; i++)
+            list.add("seventy-odd characters of text, so that the file spans a few blocks");
+        TEST_ASSERT_FALSE(doc.overflowed());
+        TEST_ASSERT_TRUE(measureJson(doc) > 2 * FlashFS::fsInfo.blockSize);
+        for (int i = 0; i < 3; i++)
+        {
+            TEST_ASSERT_TRUE(Persist::save("/schedules.json", doc));
+            assertWearMatches();
+        }
+        count = list.size();
+    }
+
+    DynamicJsonDocument loaded(64 * 1024);
+    TEST_ASSERT_TRUE(Persist::load("/schedules.json", loaded));
+    TEST_ASSERT_EQUAL(count, loaded["schedules"].size());
+    assertWearMatches();
+}
+
+// Records appended as events.h does, across block edges: each commit
+// reprograms only the tail block(s)
+void test_appends()
+{
+    uint32_t block = FlashFS::fsInfo.blockSize;
+    size_t size = 0;
+    while (size < 4 * block)
+    {
+        writeFile("/events/1", "a", 96);
+        size += 96;
+        assertWearMatches();
+    }
+    TEST_ASSERT_EQUAL(size, LittleFS.open("/events/1", "r").size());
+    // One block per append, two where one crosses into the next
+    uint32_t appends = size / 96;
+    TEST_ASSERT_UINT_WITHIN(4 * block, (uint64_t)appends * block, programmed());
+}
+
+// Writing inside a file: from the block written to the end
+void test_rewrite_in_place()
+{
+    uint32_t block = FlashFS::fsInfo.blockSize;
+    writeFile("/data.bin", "w", 3 * block);
+    FlashFile f = FlashFS::open("/data.bin", "r+");
+    TEST_ASSERT_TRUE(f.seek(2 * block + 5));
+    TEST_ASSERT_EQUAL(4, f.write((const uint8_t *)"abcd", 4));
+    f.flush();
+    f.flush(); // nothing new: no commit
+    f.close();
+    assertWearMatches();
+    TEST_ASSERT_EQUAL_UINT64(4 * block, programmed());
+}
+
+void test_rename_and_remove()
+{
+    writeFile("/a.json", "w", 10);
+    TEST_ASSERT_TRUE(FlashFS::rename("/a.json", "/b.json"));
+    TEST_ASSERT_TRUE(FlashFS::remove("/b.json"));
+    TEST_ASSERT_FALSE(FlashFS::remove("/b.json"));
+    TEST_ASSERT_FALSE(FlashFS::rename("/b.json", "/c.json"));
+    assertWearMatches();
+    TEST_ASSERT_EQUAL(3, commits());
+}
+
+// Opens and bytes, per path with ".tmp" and ".bak" folded in, and per caller
+void test_io_accounting()
+{
+    FlashFS::setCaller("test_io_accounting");
+    writeFile("/config.json.tmp", "w", 1000);
+    FlashFS::rename("/config.json.tmp", "/config.json");
+
+    FlashFile f = FlashFS::open("/config.json", "r");
+    uint8_t buffer[300];
+    uint32_t bytes = 0;
+    int n;
+    while ((n = f.read(buffer, sizeof(buffer))) > 0)
+        bytes += n;
+    f.close();
+    f = FlashFS::open("/config.json", "r");
+    while (f.read() >= 0)
+        bytes++;
+    f.close();
+    TEST_ASSERT_EQUAL(2000, bytes);
+
+    Native::FlashStats after = Native::flashStats();
+    FlashIoStats *path = nullptr;
+    for (uint8_t i = 0; i < FlashFS::pathCount; i++)
+    {
+        if (strcmp(FlashFS::paths[i].path, "/config.json") == 0)
+            path = &FlashFS::paths[i].io;
+    }
+    TEST_ASSERT_NOT_NULL(path);
+    TEST_ASSERT_EQUAL(after.opens - before.opens, path->opens);
+    TEST_ASSERT_EQUAL(after.bytesRead - before.bytesRead, path->bytesRead);
+    TEST_ASSERT_EQUAL(after.bytesWritten - before.bytesWritten, path->bytesWritten);
+    TEST_ASSERT_EQUAL(1, path->metaOps);
+
+    FlashIoStats &caller = FlashFS::callers[FlashFS::callerCount - 1].io;
+    TEST_ASSERT_EQUAL_STRING("test_io_accounting", FlashFS::callers[FlashFS::callerCount - 1].name);
+    TEST_ASSERT_EQUAL(path->opens, caller.opens);
+    TEST_ASSERT_EQUAL(path->bytesRead, caller.bytesRead);
+    assertWearMatches();
+}
+
+int main()
+{
+    Native::begin();
+    UNITY_BEGIN();
+    RUN_TEST(test_geometry);
+    RUN_TEST(test_truncating_writes);
+    RUN_TEST(test_persist_save);
+    RUN_TEST(test_appends);
+    RUN_TEST(test_rewrite_in_place);
+    RUN_TEST(test_rename_and_remove);
+    RUN_TEST(test_io_accounting);
+    return UNITY_END();
+}
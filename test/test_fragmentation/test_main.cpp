@@ -0,0 +1,220 @@
+#include <Arduino.h>
+#include <NativeHeap.h>
+#include <NativeHost.h>
+#include <unity.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Thousands of schedule edits through the web server must not cut the heap
+// up: the firmware (src/, built in with test_build_src) runs on the emulated
+// heap, requests go to its port over loopback, and after every cycle of
+// add, edit and delete the largest free block is compared with where it
+// stood before. Every request is answered by loop() on this thread, so the
+// heap is read only between requests, as a quiet device would be.
+
+void setup(); // src/main.cpp
+void loop();
+
+#define PORT 18190
+#define CYCLES 2000
+#define WARM_UP_CYCLES 50
+#define MAX_SCHEDULES 40
+#define BLOCK_SLACK 64 // bytes the largest block may wander by, four heap blocks
+#define REQUEST_TIMEOUT_US 5000000
+
+static char reply[4096];
+static size_t replyLength;
+static int schedules;
+static uint32_t baselineBlock;
+static uint32_t baselineFree;
+
+static int connectToUnit()
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    TEST_ASSERT_TRUE(fd >= 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (sockaddr *)&addr, sizeof(addr)) == 0)
+        return fd;
+    close(fd);
+    return -1;
+}
+
+// Sends one request and runs loop() until its response is in; the status
+static int request(const char *path, const char *body)
+{
+    Native::advanceClock(250); // refills the admission buckets (admission.h)
+
+    int fd = connectToUnit();
+    TEST_ASSERT_TRUE_MESSAGE(fd >= 0, path);
+
+    char text[1024];
+    int len = snprintf(text, sizeof(text),
+                       "POST %s HTTP/1.1\r\nHost: unit\r\nContent-Type: application/json\r\n"
+                       "Content-Length: %u\r\nConnection: close\r\n\r\n%s",
+                       path, (unsigned)strlen(body), body);
+    TEST_ASSERT_EQUAL(len, send(fd, text, len, MSG_NOSIGNAL));
+
+    // Complete once the headers and Content-Length bytes of body are in
+    replyLength = 0;
+    const char *bodyStart = nullptr;
+    size_t contentLength = 0;
+    uint64_t deadline = Native::realtimeUs() + REQUEST_TIMEOUT_US;
+    while (bodyStart == nullptr || replyLength < (size_t)(bodyStart - reply) + contentLength)
+    {
+        TEST_ASSERT_TRUE_MESSAGE(Native::realtimeUs() < deadline, path);
+        loop();
+        ssize_t n = recv(fd, reply + replyLength, sizeof(reply) - 1 - replyLength, MSG_DONTWAIT);
+        if (n > 0)
+            replyLength += n;
+        reply[replyLength] = '\0';
+        const char *end = strstr(reply, "\r\n\r\n");
+        if (bodyStart == nullptr && end != nullptr)
+        {
+            const char *field = strstr(reply, "Content-Length: ");
+            TEST_ASSERT_NOT_NULL(field);
+            contentLength = strtoul(field + 16, nullptr, 10);
+            bodyStart = end + 4;
+        }
+    }
+    close(fd);
+
+    // Lets the server see the close and drop the request's arguments
+    for (int i = 0; i < 3; i++)
+        loop();
+    return atoi(reply + 9);
+}
+
+static void randomSchedule(char *json, size_t size, int index)
+{
+    char days[32] = "";
+    int mask = 1 + random(127);
+    for (int d = 0; d < 7; d++)
+    {
+        if (mask & (1 << d))
+            snprintf(days + strlen(days), sizeof(days) - strlen(days), "%s%d", days[0] ? "," : "", d);
+    }
+    if (index < 0)
+        snprintf(json, size, "{\"time\":\"%02ld:%02ld\",\"type\":\"bell\",\"profile\":\"%s\",\"days\":[%s],\"enabled\":true}",
+                 random(24), random(60), random(2) ? "normal" : "short", days);
+    else
+        snprintf(json, size, "{\"index\":%d,\"time\":\"%02ld:%02ld\",\"days\":[%s],\"enabled\":%s}",
+                 index, random(24), random(60), days, random(2) ? "true" : "false");
+}
+
+static void add()
+{
+    char json[256];
+    randomSchedule(json, sizeof(json), -1);
+    TEST_ASSERT_EQUAL_MESSAGE(200, request("/schedules/add", json), reply);
+    schedules++;
+}
+
+static void edit()
+{
+    char json[256];
+    randomSchedule(json, sizeof(json), random(schedules));
+    TEST_ASSERT_EQUAL_MESSAGE(200, request("/schedules/edit", json), reply);
+}
+
+static void remove()
+{
+    char json[32];
+    snprintf(json, sizeof(json), "{\"index\":%ld}", random(schedules));
+    TEST_ASSERT_EQUAL_MESSAGE(200, request("/schedules/delete", json), reply);
+    schedules--;
+}
+
+// One add, edit and delete; every fourth cycle leaves out the add or the
+// delete, so the list wanders between one and MAX_SCHEDULES entries
+static void cycle()
+{
+    long skip = random(8);
+    if (schedules < MAX_SCHEDULES && skip != 0)
+        add();
+    edit();
+    if (schedules > 1 && skip != 1)
+        remove();
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_warm_up()
+{
+    // The web server starts from the task loop, once WiFi is up
+    uint64_t deadline = Native::realtimeUs() + REQUEST_TIMEOUT_US;
+    int fd;
+    while ((fd = connectToUnit()) < 0)
+    {
+        TEST_ASSERT_TRUE_MESSAGE(Native::realtimeUs() < deadline, "web server not listening");
+        loop();
+    }
+    close(fd);
+
+    for (int i = 0; i < 12; i++)
+        add();
+    for (int i = 0; i < WARM_UP_CYCLES; i++)
+        cycle();
+    NativeHeap::Stats stats = NativeHeap::stats();
+    baselineBlock = stats.maxFreeBlock;
+    baselineFree = stats.freeBytes;
+    TEST_ASSERT_EQUAL(0, stats.failures);
+}
+
+void test_largest_block_holds()
+{
+    char message[96];
+    uint32_t smallest = baselineBlock;
+    for (int i = 0; i < CYCLES; i++)
+    {
+        cycle();
+        uint32_t block = NativeHeap::stats().maxFreeBlock;
+        if (block < smallest)
+            smallest = block;
+        snprintf(message, sizeof(message), "cycle %d: largest free block %u, was %u", i, (unsigned)block, (unsigned)baselineBlock);
+        TEST_ASSERT_TRUE_MESSAGE(block + BLOCK_SLACK >= baselineBlock, message);
+    }
+    NativeHeap::Stats stats = NativeHeap::stats();
+    snprintf(message, sizeof(message), "largest free block %u to %u, smallest %u, free %u to %u",
+             (unsigned)baselineBlock, (unsigned)stats.maxFreeBlock, (unsigned)smallest,
+             (unsigned)baselineFree, (unsigned)stats.freeBytes);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_EQUAL(0, stats.failures);
+}
+
+// Nothing held on to: the heap is back where it was
+void test_no_leak()
+{
+    TEST_ASSERT_UINT_WITHIN(BLOCK_SLACK, baselineFree, NativeHeap::stats().freeBytes);
+}
+
+int main()
+{
+    // Unity's output would otherwise get its buffer from the emulated heap
+    static char out[BUFSIZ];
+    setvbuf(stdout, out, _IOLBF, sizeof(out));
+
+    char port[8];
+    snprintf(port, sizeof(port), "%d", PORT);
+    setenv("NATIVE_HTTP_PORT", port, 1);
+    setenv("NATIVE_SEED", "1", 0);
+    Native::begin();
+    setup();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_warm_up);
+    RUN_TEST(test_largest_block_holds);
+    RUN_TEST(test_no_leak);
+    return UNITY_END();
+}
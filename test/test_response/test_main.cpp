@@ -0,0 +1,486 @@
+#include <Arduino.h>
+#include <NativeHeap.h>
+#include <NativeHost.h>
+#include <Response.h>
+#include <ArduinoJson.h>
+#include <unity.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Every way a handler builds a response through ResponseWriter must leave
+// the heap alone: the emulated heap counts each malloc(), calloc(),
+// realloc() and operator new of this thread, and each path is run many
+// times between two readings of that count. The client is one end of a
+// socket pair; what came out of the other end is checked too.
+//
+// Then the firmware's own routes (src/, built in with test_build_src),
+// requested over loopback as test_fragmentation does: route bookkeeping,
+// admission and the handler together must not allocate either.
+
+void setup(); // src/main.cpp
+void loop();
+
+#define REQUESTS 200
+#define ROUTE_REQUESTS 50
+#define WIRE_SIZE 16384
+#define PORT 18192
+#define REQUEST_TIMEOUT_US 5000000
+
+static ResponseWriter response;
+static WiFiClient client;
+static int peer = -1;
+
+static char wire[WIRE_SIZE]; // what the last request put on the socket
+static size_t wireLength;
+static char body[WIRE_SIZE]; // its body, chunked encoding undone
+static size_t bodyLength;
+
+// A body source for sendStream(), as a file would be
+class PatternStream : public Stream
+{
+public:
+    size_t left = 0;
+    int available() override { return left; }
+    int read() override { return left ? (int)('a' + left-- % 26) : -1; }
+    int peek() override { return left ? (int)('a' + left % 26) : -1; }
+    size_t write(uint8_t) override { return 0; }
+};
+
+static uint64_t allocations()
+{
+    return NativeHeap::stats().allocations;
+}
+
+// Reads what is on the socket and undoes the framing: body gets the
+// content, the return value is the header block's length
+static size_t receive()
+{
+    wireLength = 0;
+    ssize_t n;
+    while ((n = recv(peer, wire + wireLength, sizeof(wire) - 1 - wireLength, MSG_DONTWAIT)) > 0)
+        wireLength += n;
+    wire[wireLength] = '\0';
+
+    const char *end = strstr(wire, "\r\n\r\n");
+    TEST_ASSERT_NOT_NULL(end);
+    size_t headerLength = end + 4 - wire;
+    const char *p = wire + headerLength;
+    bodyLength = 0;
+    if (strstr(wire, "Transfer-Encoding: chunked\r\n") == nullptr)
+    {
+        bodyLength = wireLength - headerLength;
+        memcpy(body, p, bodyLength);
+    }
+    else
+    {
+        for (;;)
+        {
+            char *next;
+            size_t size = strtoul(p, &next, 16);
+            TEST_ASSERT_EQUAL_STRING_LEN("\r\n", next, 2);
+            p = next + 2;
+            if (size == 0)
+                break;
+            memcpy(body + bodyLength, p, size);
+            bodyLength += size;
+            p += size;
+            TEST_ASSERT_EQUAL_STRING_LEN("\r\n", p, 2);
+            p += 2;
+        }
+        TEST_ASSERT_EQUAL_STRING_LEN("\r\n", p, 2);
+        TEST_ASSERT_EQUAL(wireLength, p + 2 - wire);
+    }
+    body[bodyLength] = '\0';
+    return headerLength;
+}
+
+static bool hasHeader(const char *line)
+{
+    const char *end = strstr(wire, "\r\n\r\n");
+    const char *found = strstr(wire, line);
+    return found && found < end;
+}
+
+void setUp()
+{
+    int fds[2];
+    TEST_ASSERT_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    int size = 4 * WIRE_SIZE;
+    setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    setsockopt(fds[1], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    client = WiFiClient(fds[0]);
+    peer = fds[1];
+    ResponseWriter::keepAliveS = 0;
+}
+
+void tearDown()
+{
+    client.stop();
+    client = WiFiClient();
+    close(peer);
+    peer = -1;
+}
+
+// /time and /status sized: fits the buffer, goes out with Content-Length
+void test_buffered()
+{
+    uint64_t before = allocations();
+    for (int i = 0; i < REQUESTS; i++)
+    {
+        response.begin(client, 200, "application/json");
+        response.printf("{\"time\":\"%04u/%02u/%02u %02u:%02u:%02u\",\"uptime\":%lu,", 2024, 5, 17, 8, 0, i % 60, (unsigned long)i);
+        response.print("\"led\":");
+        response.print(i % 2 ? "true" : "false");
+        response.print(",\"name\":");
+        response.printJsonString("Hall \"B\"\\\n");
+        response.print('}');
+        response.end();
+        if (i < REQUESTS - 1)
+            receive();
+    }
+    TEST_ASSERT_EQUAL_UINT64(before, allocations());
+
+    receive();
+    TEST_ASSERT_EQUAL_STRING_LEN("HTTP/1.1 200 OK\r\n", wire, 17);
+    TEST_ASSERT_TRUE(hasHeader("Content-Type: application/json\r\n"));
+    TEST_ASSERT_TRUE(hasHeader("Connection: close\r\n"));
+    char length[40];
+    snprintf(length, sizeof(length), "Content-Length: %u\r\n", (unsigned)bodyLength);
+    TEST_ASSERT_TRUE(hasHeader(length));
+    TEST_ASSERT_EQUAL_STRING("{\"time\":\"2024/05/17 08:00:19\",\"uptime\":199,\"led\":true,"
+                             "\"name\":\"Hall \\\"B\\\"\\\\\\u000a\"}",
+                             body);
+}
+
+void test_keep_alive_header()
+{
+    ResponseWriter::keepAliveS = 5;
+    uint64_t before = allocations();
+    response.begin(client, 404, "text/plain");
+    response.print("Not found");
+    response.end();
+    TEST_ASSERT_EQUAL_UINT64(before, allocations());
+
+    receive();
+    TEST_ASSERT_EQUAL_STRING_LEN("HTTP/1.1 404 Not Found\r\n", wire, 24);
+    TEST_ASSERT_TRUE(hasHeader("Connection: keep-alive\r\nKeep-Alive: timeout=5\r\n"));
+    TEST_ASSERT_EQUAL_STRING("Not found", body);
+
+    ResponseWriter::keepAliveS = 65535;
+    response.begin(client, 200, "text/plain");
+    response.print("ok");
+    response.end();
+    receive();
+    TEST_ASSERT_TRUE(hasHeader("Connection: keep-alive\r\nKeep-Alive: timeout=65535\r\n"));
+    TEST_ASSERT_EQUAL_STRING("ok", body);
+}
+
+// Longer than the buffer, written in pieces as the schedule list is:
+// falls back to chunked transfer encoding, a chunk per full buffer
+void test_chunked_fallback()
+{
+    uint64_t before = allocations();
+    for (int i = 0; i < REQUESTS; i++)
+    {
+        response.begin(client, 200, "application/json");
+        response.print('[');
+        for (int item = 0; item < 400; item++)
+            response.printf("%s{\"i\":%03d}", item ? "," : "", item);
+        response.print(']');
+        response.end();
+        if (i < REQUESTS - 1)
+            receive();
+    }
+    TEST_ASSERT_EQUAL_UINT64(before, allocations());
+
+    receive();
+    TEST_ASSERT_TRUE(hasHeader("Transfer-Encoding: chunked\r\n"));
+    TEST_ASSERT_FALSE(hasHeader("Content-Length"));
+    TEST_ASSERT_EQUAL(2 + 400 * 9 + 399, bodyLength);
+    TEST_ASSERT_EQUAL_STRING_LEN("[{\"i\":000},{\"i\":001},", body, 21);
+    TEST_ASSERT_EQUAL_STRING(",{\"i\":399}]", body + bodyLength - 11);
+}
+
+// One printf that doesn't fit what is left of the buffer: the buffer goes
+// out as a chunk and the item is formatted again, not through a heap buffer
+// as Print::printf would
+void test_printf_past_buffer()
+{
+    static char filler[RESPONSE_BUFFER_SIZE - 100 + 1];
+    memset(filler, 'x', sizeof(filler) - 1);
+    static char item[301];
+    memset(item, 'y', sizeof(item) - 1);
+
+    uint64_t before = allocations();
+    for (int i = 0; i < REQUESTS; i++)
+    {
+        response.begin(client, 200, "text/plain");
+        response.print(filler);
+        response.printf("<%s>", item);
+        response.end();
+        if (i < REQUESTS - 1)
+            receive();
+    }
+    TEST_ASSERT_EQUAL_UINT64(before, allocations());
+
+    receive();
+    TEST_ASSERT_TRUE(hasHeader("Transfer-Encoding: chunked\r\n"));
+    TEST_ASSERT_EQUAL(sizeof(filler) - 1 + sizeof(item) + 1, bodyLength);
+    TEST_ASSERT_EQUAL_STRING_LEN(filler, body, sizeof(filler) - 1);
+    TEST_ASSERT_EQUAL('<', body[sizeof(filler) - 1]);
+    TEST_ASSERT_EQUAL('>', body[bodyLength - 1]);
+}
+
+// Documents serialized straight into the writer (wire.h), both sizes
+void test_serialized_document()
+{
+    static StaticJsonDocument<8192> doc;
+    doc.clear();
+    JsonArray days = doc.createNestedArray("days");
+    for (int d = 0; d < 7; d++)
+        days.add(d);
+    doc["time"] = "08:00:00";
+    doc["enabled"] = true;
+
+    uint64_t before = allocations();
+    for (int i = 0; i < REQUESTS; i++)
+    {
+        response.begin(client, 200, "application/json");
+        serializeJson(doc, response);
+        response.end();
+        if (i < REQUESTS - 1)
+            receive();
+    }
+    TEST_ASSERT_EQUAL_UINT64(before, allocations());
+    receive();
+    TEST_ASSERT_EQUAL_STRING("{\"days\":[0,1,2,3,4,5,6],\"time\":\"08:00:00\",\"enabled\":true}", body);
+
+    JsonArray list = doc.createNestedArray("list");
+    for (int n = 0; n < 200; n++)
+        list.add(n * 1000);
+    TEST_ASSERT_FALSE(doc.overflowed());
+    before = allocations();
+    for (int i = 0; i < REQUESTS; i++)
+    {
+        response.begin(client, 200, "application/json");
+        serializeJson(doc, response);
+        response.end();
+        if (i < REQUESTS - 1)
+            receive();
+    }
+    TEST_ASSERT_EQUAL_UINT64(before, allocations());
+    receive();
+    TEST_ASSERT_TRUE(hasHeader("Transfer-Encoding: chunked\r\n"));
+    TEST_ASSERT_EQUAL(measureJson(doc), bodyLength);
+}
+
+// Static files: headers, then the body copied through a stack buffer
+void test_stream()
+{
+    PatternStream source;
+    uint64_t before = allocations();
+    for (int i = 0; i < REQUESTS; i++)
+    {
+        source.left = 3000;
+        response.sendStream(client, 200, "text/css", source, 3000, "Cache-Control: max-age=86400\r\n");
+        if (i < REQUESTS - 1)
+            receive();
+    }
+    TEST_ASSERT_EQUAL_UINT64(before, allocations());
+
+    receive();
+    TEST_ASSERT_TRUE(hasHeader("Content-Length: 3000\r\nCache-Control: max-age=86400\r\n"));
+    TEST_ASSERT_EQUAL(3000, bodyLength);
+    TEST_ASSERT_EQUAL('a' + 3000 % 26, body[0]);
+    TEST_ASSERT_EQUAL('a' + 1 % 26, body[2999]);
+}
+
+// A file shorter than the Content-Length sent for it: what there is, then
+// the connection closed, even with keep-alive on
+void test_stream_short()
+{
+    ResponseWriter::keepAliveS = 5;
+    PatternStream source;
+    source.left = 1000;
+    response.sendStream(client, 200, "text/css", source, 3000);
+    receive();
+    TEST_ASSERT_TRUE(hasHeader("Content-Length: 3000\r\n"));
+    TEST_ASSERT_EQUAL(1000, bodyLength);
+    TEST_ASSERT_EQUAL(0, recv(peer, wire, sizeof(wire), MSG_DONTWAIT)); // closed
+}
+
+// Header lines longer than the header buffer, as a long ETag or content
+// type could make them: a 500 and a closed connection, never a cut header
+// block followed by a body
+void test_headers_overflow()
+{
+    static char extra[400];
+    memset(extra, 'x', sizeof(extra));
+    memcpy(extra, "X-Long: ", 8);
+    memcpy(extra + sizeof(extra) - 3, "\r\n", 3);
+
+    PatternStream source;
+    source.left = 3000;
+    uint64_t before = allocations();
+    response.sendStream(client, 200, "text/css", source, 3000, extra);
+    TEST_ASSERT_EQUAL_UINT64(before, allocations());
+    TEST_ASSERT_EQUAL(3000, source.left); // the body wasn't read
+    receive();
+    TEST_ASSERT_EQUAL_STRING_LEN("HTTP/1.1 500 Internal Server Error\r\n", wire, 36);
+    TEST_ASSERT_TRUE(hasHeader("Connection: close\r\n"));
+    TEST_ASSERT_EQUAL(0, bodyLength);
+    TEST_ASSERT_EQUAL(0, recv(peer, wire, sizeof(wire), MSG_DONTWAIT)); // closed
+}
+
+// The same where the headers only go out with the first chunk
+void test_headers_overflow_chunked()
+{
+    static char type[300];
+    memset(type, 't', sizeof(type) - 1);
+    response.begin(client, 200, type);
+    for (int i = 0; i < 3 * RESPONSE_BUFFER_SIZE; i++)
+        response.print('b');
+    response.end();
+    receive();
+    TEST_ASSERT_EQUAL_STRING_LEN("HTTP/1.1 500 ", wire, 13);
+    TEST_ASSERT_EQUAL(0, bodyLength);
+    TEST_ASSERT_EQUAL(0, recv(peer, wire, sizeof(wire), MSG_DONTWAIT));
+}
+
+static int connectToUnit()
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    TEST_ASSERT_TRUE(fd >= 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (sockaddr *)&addr, sizeof(addr)) == 0)
+        return fd;
+    close(fd);
+    return -1;
+}
+
+// Sends one request with a browser's headers and runs loop() until the
+// response is in; the status
+static int request(const char *method, const char *path)
+{
+    Native::advanceClock(250); // refills the admission buckets (admission.h)
+
+    int fd = connectToUnit();
+    TEST_ASSERT_TRUE_MESSAGE(fd >= 0, path);
+    char text[512];
+    int len = snprintf(text, sizeof(text),
+                       "%s %s HTTP/1.1\r\nHost: unit\r\nAccept: application/json\r\n"
+                       "Accept-Encoding: gzip, deflate\r\nContent-Type: application/json\r\n"
+                       "Content-Length: %u\r\nConnection: close\r\n\r\n%s",
+                       method, path, strcmp(method, "POST") == 0 ? 2u : 0u, strcmp(method, "POST") == 0 ? "{}" : "");
+    TEST_ASSERT_EQUAL(len, send(fd, text, len, MSG_NOSIGNAL));
+
+    // Complete once the headers and Content-Length bytes of body are in
+    wireLength = 0;
+    const char *bodyStart = nullptr;
+    size_t contentLength = 0;
+    uint64_t deadline = Native::realtimeUs() + REQUEST_TIMEOUT_US;
+    while (bodyStart == nullptr || wireLength < (size_t)(bodyStart - wire) + contentLength)
+    {
+        TEST_ASSERT_TRUE_MESSAGE(Native::realtimeUs() < deadline, path);
+        loop();
+        ssize_t n = recv(fd, wire + wireLength, sizeof(wire) - 1 - wireLength, MSG_DONTWAIT);
+        if (n > 0)
+            wireLength += n;
+        wire[wireLength] = '\0';
+        const char *end = strstr(wire, "\r\n\r\n");
+        if (bodyStart == nullptr && end != nullptr)
+        {
+            const char *field = strstr(wire, "Content-Length: ");
+            TEST_ASSERT_NOT_NULL(field);
+            contentLength = strtoul(field + 16, nullptr, 10);
+            bodyStart = end + 4;
+        }
+    }
+    close(fd);
+
+    // Lets the server see the close and drop the request's arguments
+    for (int i = 0; i < 3; i++)
+        loop();
+    return atoi(wire + 9);
+}
+
+// Each route many times; the first request is left out, it may fill a
+// response cache (cache.h). What the core allocates to read a request in
+// (its argument and header arrays, and the Strings of values longer than
+// the 11 characters String keeps inline) is outside the handler and not
+// counted, and neither are the tasks loop() runs in between.
+static void assertRouteAllocationFree(const char *method, const char *path)
+{
+    char message[96];
+    TEST_ASSERT_EQUAL_MESSAGE(200, request(method, path), wire);
+    for (int i = 0; i < ROUTE_REQUESTS; i++)
+    {
+        TEST_ASSERT_EQUAL_MESSAGE(200, request(method, path), wire);
+        snprintf(message, sizeof(message), "%s %s, request %d", method, path, i);
+        TEST_ASSERT_EQUAL_UINT64_MESSAGE(0, Native::handlerAllocations(), message);
+    }
+}
+
+void test_route_time()
+{
+    // The web server starts from the task loop, once WiFi is up
+    uint64_t deadline = Native::realtimeUs() + REQUEST_TIMEOUT_US;
+    int fd;
+    while ((fd = connectToUnit()) < 0)
+    {
+        TEST_ASSERT_TRUE_MESSAGE(Native::realtimeUs() < deadline, "web server not listening");
+        loop();
+    }
+    close(fd);
+
+    assertRouteAllocationFree("GET", "/time");
+}
+
+void test_route_status()
+{
+    assertRouteAllocationFree("GET", "/status");
+}
+
+void test_route_toggle()
+{
+    assertRouteAllocationFree("POST", "/led/toggle");
+}
+
+// The page, from flash: header lookups past 11 characters (webPage.h)
+void test_route_page()
+{
+    assertRouteAllocationFree("GET", "/");
+}
+
+int main()
+{
+    // Unity's output would otherwise get its buffer from the emulated heap
+    static char out[BUFSIZ];
+    setvbuf(stdout, out, _IOLBF, sizeof(out));
+
+    setenv("NATIVE_HTTP_PORT", "18192", 1);
+    Native::begin();
+    UNITY_BEGIN();
+    RUN_TEST(test_buffered);
+    RUN_TEST(test_keep_alive_header);
+    RUN_TEST(test_chunked_fallback);
+    RUN_TEST(test_printf_past_buffer);
+    RUN_TEST(test_serialized_document);
+    RUN_TEST(test_stream);
+    RUN_TEST(test_stream_short);
+    RUN_TEST(test_headers_overflow);
+    RUN_TEST(test_headers_overflow_chunked);
+
+    setup();
+    RUN_TEST(test_route_time);
+    RUN_TEST(test_route_status);
+    RUN_TEST(test_route_toggle);
+    RUN_TEST(test_route_page);
+    return UNITY_END();
+}
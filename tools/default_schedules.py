@@ -0,0 +1,125 @@
+"""Compiles data/schedules.json into include/default_schedules.h.
+
+Runs before every PlatformIO build (extra_scripts = pre:...). The header holds
+the same minute-sorted trigger tables profiles.h builds at runtime, as
+constexpr PROGMEM arrays, so the firmware rings the shipped schedule from the
+first loop without touching LittleFS. Mirrors compileScheduleSet(): keep the
+two in step.
+
+Can also be run by hand: python3 tools/default_schedules.py
+"""
+
+import json
+import os
+
+MAX_SCHEDULES = 50
+MAX_PROFILES = 8
+PROFILE_NAME_LEN = 16
+DEFAULT_PROFILE = "normal"
+
+
+def parse_time(time):
+    """"HH:MM" or "HH:MM:SS" -> (minute of day, second), None if malformed"""
+    if not isinstance(time, str) or len(time) < 5 or time[2] != ":":
+        return None
+    if len(time) != 5 and (len(time) < 8 or time[5] != ":"):
+        return None
+    try:
+        hour, minute = int(time[:2]), int(time[3:5])
+        second = int(time[6:8]) if len(time) > 5 else 0
+    except ValueError:
+        return None
+    if not (0 <= hour <= 23 and 0 <= minute <= 59 and 0 <= second <= 59):
+        return None
+    return hour * 60 + minute, second
+
+
+def profile_name(schedule):
+    name = schedule.get("profile") or DEFAULT_PROFILE
+    return name[:PROFILE_NAME_LEN - 1]
+
+
+def compile_schedules(schedules):
+    profiles = [DEFAULT_PROFILE]
+    for schedule in schedules:
+        name = profile_name(schedule)
+        if name not in profiles and len(profiles) < MAX_PROFILES:
+            profiles.append(name)
+
+    triggers = []
+    tables = []
+    for name in profiles:
+        start = len(triggers)
+        run = []
+        for index, schedule in enumerate(schedules):
+            if not schedule.get("enabled") or profile_name(schedule) != name:
+                continue
+            if start + len(run) >= MAX_SCHEDULES:
+                break
+            parsed = parse_time(schedule.get("time"))
+            if parsed is None:
+                continue
+            minute, second = parsed
+            days = 0
+            for day in schedule.get("days", []):
+                if isinstance(day, int) and 0 <= day <= 6:
+                    days |= 1 << day
+            kind = "TRIGGER_LED" if schedule.get("type") == "led" else "TRIGGER_BELL"
+            run.append((minute, second, days, kind, index))
+        run.sort(key=lambda t: (t[0], t[1]))  # stable, like the insertion sort
+        triggers.extend(run)
+        tables.append((name, start, len(run)))
+    return triggers, tables
+
+
+def render(triggers, tables, source):
+    lines = [
+        "// Generated by tools/default_schedules.py from %s, do not edit" % source,
+        "#pragma once",
+        "",
+        "#define DEFAULT_TRIGGER_COUNT %d" % len(triggers),
+        "#define DEFAULT_PROFILE_COUNT %d" % len(tables),
+        "",
+        "constexpr Trigger DEFAULT_TRIGGERS[] PROGMEM = {",
+    ]
+    for minute, second, days, kind, index in triggers or [(0, 0, 0, "TRIGGER_BELL", 0)]:
+        lines.append("    {%d, %d, 0x%02X, %s, %d}, // %02d:%02d:%02d" % (
+            minute, second, days, kind, index, minute // 60, minute % 60, second))
+    lines += ["};", "", "constexpr DefaultProfile DEFAULT_PROFILES[] PROGMEM = {"]
+    for name, start, count in tables:
+        lines.append("    {%s, %d, %d}," % (json.dumps(name), start, count))
+    lines += ["};", ""]
+    return "\n".join(lines)
+
+
+def generate(project_dir):
+    source = os.path.join(project_dir, "data", "schedules.json")
+    target = os.path.join(project_dir, "include", "default_schedules.h")
+    try:
+        with open(source) as f:
+            schedules = json.load(f).get("schedules", [])
+    except (OSError, ValueError) as e:
+        print("default_schedules: %s, building without defaults" % e)
+        schedules = []
+
+    text = render(*compile_schedules(schedules), source="data/schedules.json")
+    try:
+        with open(target) as f:
+            if f.read() == text:
+                return  # unchanged, don't force a rebuild
+    except OSError:
+        pass
+    with open(target, "w") as f:
+        f.write(text)
+    print("default_schedules: wrote %s" % os.path.relpath(target, project_dir))
+
+
+try:
+    Import("env")  # noqa: F821 - provided by PlatformIO
+except NameError:
+    env = None
+
+if env is not None:
+    generate(env["PROJECT_DIR"])
+elif __name__ == "__main__":
+    generate(os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
@@ -0,0 +1,80 @@
+"""Compiles the dashboard in data/ into include/web_assets.h.
+
+Runs before every PlatformIO build (extra_scripts = pre:...). index.html,
+style.css and script.js are gzipped and written out as PROGMEM byte arrays,
+with an ETag taken from the content, so assets.h can serve the page straight
+from the firmware image without opening LittleFS.
+
+Can also be run by hand: python3 tools/embed_assets.py
+"""
+
+import gzip
+import hashlib
+import os
+
+ASSETS = ["index.html", "style.css", "script.js"]
+BYTES_PER_LINE = 16
+
+
+def identifier(name):
+    return "ASSET_" + "".join(c if c.isalnum() else "_" for c in name).upper()
+
+
+def render(assets):
+    lines = [
+        "// Generated by tools/embed_assets.py from data/, do not edit",
+        "#pragma once",
+        "",
+        "#define WEB_ASSET_COUNT %d" % len(assets),
+        "",
+    ]
+    for name, raw, packed in assets:
+        lines.append("// %s: %d bytes, %d gzipped" % (name, len(raw), len(packed)))
+        lines.append("const uint8_t %s[] PROGMEM = {" % identifier(name))
+        for i in range(0, len(packed), BYTES_PER_LINE):
+            lines.append("    " + ", ".join("0x%02X" % b for b in packed[i:i + BYTES_PER_LINE]) + ",")
+        lines += ["};", ""]
+    lines.append("const WebAsset WEB_ASSETS[] = {")
+    for name, raw, packed in assets:
+        etag = '"\\"%s\\""' % hashlib.sha1(raw).hexdigest()[:8]
+        lines.append('    {"/%s", %s, %d, %s},' % (name, identifier(name), len(packed), etag))
+    lines += ["};", ""]
+    return "\n".join(lines)
+
+
+def generate(project_dir):
+    assets = []
+    for name in ASSETS:
+        source = os.path.join(project_dir, "data", name)
+        try:
+            with open(source, "rb") as f:
+                raw = f.read()
+        except OSError as e:
+            print("embed_assets: %s, not embedded" % e)
+            continue
+        # mtime=0 keeps the output identical for identical input
+        assets.append((name, raw, gzip.compress(raw, compresslevel=9, mtime=0)))
+
+    target = os.path.join(project_dir, "include", "web_assets.h")
+    text = render(assets)
+    try:
+        with open(target) as f:
+            if f.read() == text:
+                return  # unchanged, don't force a rebuild
+    except OSError:
+        pass
+    with open(target, "w") as f:
+        f.write(text)
+    total = sum(len(packed) for _, _, packed in assets)
+    print("embed_assets: wrote %s (%d bytes of flash)" % (os.path.relpath(target, project_dir), total))
+
+
+try:
+    Import("env")  # noqa: F821 - provided by PlatformIO
+except NameError:
+    env = None
+
+if env is not None:
+    generate(env["PROJECT_DIR"])
+elif __name__ == "__main__":
+    generate(os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
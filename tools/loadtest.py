@@ -0,0 +1,358 @@
+#!/usr/bin/env python3
+"""Finds how many dashboards a bell controller takes before bells lag.
+
+Runs N simulated browsers against a unit, for each N in --clients, and
+reports throughput, p50/p99 latency per route and how late the unit's bells
+fired meanwhile. Each browser follows data/script.js as shipped: the polling
+intervals and the calls made on page load are read from the file, so the
+harness stays in step with the dashboard. Browsers load the page, poll
+over one keep-alive connection like a browser does, and now and then add,
+edit and delete a schedule. Requests shed by admission control (503)
+count as shed, like a failed fetch() that script.js simply ignores.
+
+Bell lateness comes from the unit itself. Before each step the harness
+adds probe bell schedules every --probe-every seconds for the length of the
+step, and reads the "triggers" lateness histogram from /metrics before and
+after. The bells are switched on and their duration set to 0 for the run,
+so the probes fire (and count) without ringing, unless --ring is given.
+Probes, the switch and the duration are put back afterwards.
+
+With --bell-off, the probes ring and each step is run once per way of timing
+the bell's off edge (ringing.h): by the loop, or by hardware timer 1. Each run
+reports how long the bells rang past their duration, from the "bellOff"
+histogram, so the two distributions under the same load sit side by side.
+The unit's setting is put back afterwards.
+
+    python3 tools/loadtest.py --host 192.168.4.1 --clients 1 2 4 8 --seconds 60
+    python3 tools/loadtest.py --clients 4 8 --bell-off loop timer
+
+With --native it runs against the firmware built for Linux instead
+(tools/native.py): the same routes, loop and bell timing, on an emulated
+ESP8266 heap, so the load at which bells start to lag can be found without
+a unit on the bench.
+
+    python3 tools/loadtest.py --native --clients 1 4 16 64
+"""
+
+import argparse
+import http.client
+import json
+import math
+import os
+import random
+import re
+import threading
+import time
+
+import native
+
+TIMEOUT = 5
+SETUP_S = 10
+SCRIPT = os.path.join(os.path.dirname(os.path.dirname(os.path.abspath(__file__))), "data", "script.js")
+PAGE = ["/", "/style.css", "/script.js"]
+EDIT_TIME = "03:33"  # schedule edits land far from any probe
+
+
+def dashboard_pattern(path=SCRIPT):
+    """(calls on load, {function: interval s}, {function: first fetch URL})"""
+    with open(path) as f:
+        source = f.read()
+    on_load = re.findall(r"^(\w+)\(\);", source, re.M)
+    intervals = {name: int(ms) / 1000 for name, ms in re.findall(r"^setInterval\((\w+), (\d+)\);", source, re.M)}
+    urls = {}
+    for name, body in re.findall(r"^function (\w+)\([^)]*\) \{\n(.*?)^\}", source, re.M | re.S):
+        body = re.sub(r"^\s*//.*$", "", body, flags=re.M)
+        match = re.search(r"fetch\(\s*([\"'`])([^\"'`]*)\1", body)
+        if match:
+            urls[name] = match.group(2)
+    return on_load, intervals, urls
+
+
+class Browser:
+    """One dashboard on one keep-alive connection"""
+
+    def __init__(self, host, results, lock):
+        self.host = host
+        self.results = results
+        self.lock = lock
+        self.conn = None
+        self.revision = -1
+
+    def request(self, path, body=None):
+        method = "GET" if body is None else "POST"
+        headers = {"Accept-Encoding": "gzip"}
+        data = None
+        if body is not None:
+            data = json.dumps(body)
+            headers["Content-Type"] = "application/json"
+        route = path.split("?")[0]
+        start = time.monotonic()
+        for attempt in range(2):
+            try:
+                if self.conn is None:
+                    self.conn = http.client.HTTPConnection(self.host, timeout=TIMEOUT)
+                self.conn.request(method, path, body=data, headers=headers)
+                resp = self.conn.getresponse()
+                payload = resp.read()
+                if resp.will_close:
+                    self.close()
+                break
+            except (OSError, http.client.HTTPException):
+                self.close()
+                if attempt:
+                    self.record(route, None, "errors")
+                    return None
+        elapsed = (time.monotonic() - start) * 1000
+        if resp.status == 503 and resp.getheader("Retry-After"):
+            self.record(route, None, "shed")
+            return None
+        if resp.status >= 400:
+            self.record(route, None, "errors")
+            return None
+        self.record(route, elapsed, None)
+        return payload
+
+    def record(self, route, ms, failure):
+        with self.lock:
+            entry = self.results.setdefault(route, {"ms": [], "shed": 0, "errors": 0})
+            if failure:
+                entry[failure] += 1
+            else:
+                entry["ms"].append(ms)
+
+    def close(self):
+        if self.conn is not None:
+            self.conn.close()
+            self.conn = None
+
+    def call(self, name, urls):
+        """What script.js's function name fetches"""
+        if name == "loadSchedules":
+            # full list first, then deltas since the revision it returned
+            path = "/schedules" if self.revision < 0 else "/schedules/changes?since=%d" % self.revision
+            payload = self.request(path)
+            if payload:
+                try:
+                    self.revision = json.loads(payload).get("revision", self.revision)
+                except ValueError:
+                    pass
+        elif name in urls:
+            self.request(urls[name])
+
+    def edit_cycle(self):
+        alarm = {"time": EDIT_TIME, "type": "bell", "days": [6], "enabled": False}
+        if self.request("/schedules/add", alarm) is None:
+            return
+        schedules = self.request("/schedules")
+        if not schedules:
+            return
+        index = len(json.loads(schedules).get("schedules", [])) - 1
+        alarm.update(index=index, days=[5, 6])
+        self.request("/schedules/edit", alarm)
+        self.request("/schedules/delete", {"index": index})
+
+
+def browse(host, deadline, pattern, edit_every, results, lock):
+    on_load, intervals, urls = pattern
+    browser = Browser(host, results, lock)
+    for path in PAGE:
+        browser.request(path)
+    for name in on_load:
+        browser.call(name, urls)
+
+    now = time.monotonic()
+    due = {name: now + period for name, period in intervals.items()}
+    next_edit = now + random.expovariate(1 / edit_every) if edit_every else math.inf
+    while True:
+        name = min(due, key=due.get) if due else None
+        wake = min(due[name] if name else math.inf, next_edit)
+        if wake >= deadline:
+            break
+        time.sleep(max(0, wake - time.monotonic()))
+        if name and due[name] <= next_edit:
+            browser.call(name, urls)
+            due[name] += intervals[name]
+        else:
+            browser.edit_cycle()
+            next_edit += random.expovariate(1 / edit_every)
+    browser.close()
+
+
+# ---- the unit's side: probes, bell duration, /metrics ----
+
+def call(host, path, body=None):
+    for _ in range(10):
+        conn = http.client.HTTPConnection(host, timeout=TIMEOUT)
+        try:
+            if body is None:
+                conn.request("GET", path, headers={"Connection": "close"})
+            else:
+                conn.request("POST", path, body=json.dumps(body),
+                             headers={"Content-Type": "application/json", "Connection": "close"})
+            resp = conn.getresponse()
+            payload = resp.read()
+        finally:
+            conn.close()
+        if resp.status != 503:
+            return json.loads(payload) if payload[:1] in (b"{", b"[") else payload
+        time.sleep(int(resp.getheader("Retry-After") or 1))
+    raise IOError("%s: still shed after 10 tries" % path)
+
+
+def unit_seconds(host):
+    """The unit's clock as seconds of the day"""
+    text = call(host, "/time").decode()
+    hh, mm, ss = (int(x) for x in text.split(" ")[1].split(":"))
+    return hh * 3600 + mm * 60 + ss
+
+
+def add_probes(host, start, seconds, every):
+    times = []
+    t = start
+    while t < start + seconds:
+        times.append("%02d:%02d:%02d" % (t // 3600 % 24, t // 60 % 60, t % 60))
+        t += every
+    profile = call(host, "/profiles").get("active", "normal")
+    for probe in times:
+        call(host, "/schedules/add", {"time": probe, "type": "bell", "days": list(range(7)),
+                                      "enabled": True, "profile": profile})
+    return set(times)
+
+
+def remove_probes(host, probes):
+    schedules = call(host, "/schedules").get("schedules", [])
+    for index in reversed(range(len(schedules))):
+        s = schedules[index]
+        if s.get("time") in probes and s.get("type") == "bell" and len(s.get("days", [])) == 7:
+            call(host, "/schedules/delete", {"index": index})
+
+
+def histogram(before, after, max_ms):
+    """Count and percentiles (ms, bucket bounds) of what was added in between;
+    past the last bound a percentile is max_ms"""
+    counts = [(b["le"], a["count"] - b["count"]) for b, a in zip(before, after)]
+    total = sum(n for _, n in counts)
+    result = {"count": total, "max": max_ms}
+    for p in (50, 99):
+        rank, seen = math.ceil(total * p / 100), 0
+        result["p%d" % p] = None
+        for le, n in counts:
+            seen += n
+            if total and seen >= rank:
+                result["p%d" % p] = le if le is not None else max_ms
+                break
+    return result
+
+
+def lateness(before, after):
+    """Percentiles of the triggers fired in between"""
+    return histogram(before["lateMs"], after["lateMs"], after["maxLateUs"] / 1000)
+
+
+def overrun(before, after, mode):
+    """Percentiles of how long past their duration the bells rang in between"""
+    old = next(m for m in before["bellOff"]["modes"] if m["mode"] == mode)
+    new = next(m for m in after["bellOff"]["modes"] if m["mode"] == mode)
+    return histogram(old["overrunMs"], new["overrunMs"], new["maxOverrunUs"] / 1000)
+
+
+def percentile(values, p):
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(math.ceil(p / 100 * len(ordered))) - 1)]
+
+
+def step(args, clients, pattern, bell_off=None):
+    # Probes from SETUP_S out, past adding them; the browsers start a second
+    # before the first and stop as the last has fired
+    now = time.monotonic()
+    start = unit_seconds(args.host) + SETUP_S
+    probes = add_probes(args.host, start, args.seconds, args.probe_every)
+    before = call(args.host, "/metrics")
+    time.sleep(max(0, now + SETUP_S - 1 - time.monotonic()))
+
+    results, lock = {}, threading.Lock()
+    deadline = now + SETUP_S + args.seconds
+    threads = [threading.Thread(target=browse, args=(args.host, deadline, pattern, args.edit_every, results, lock))
+               for _ in range(clients)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+
+    after = call(args.host, "/metrics")
+    remove_probes(args.host, probes)
+
+    total = sum(len(r["ms"]) for r in results.values())
+    late = lateness(before["triggers"], after["triggers"])
+    print("%d clients: %.1f req/s, loop max pass %.1f ms, bells: %d of %d probes fired, late p50 %s ms, "
+          "p99 %s ms" % (clients, total / (args.seconds + 1), after["loop"]["maxPassUs"] / 1000, late["count"],
+                        len(probes), late["p50"], late["p99"]))
+    if bell_off:
+        over = overrun(before, after, bell_off)
+        print("  bell off by %s: %d rang past their duration by p50 %s ms, p99 %s ms, max %.1f ms (all-time)" % (
+            bell_off, over["count"], over["p50"], over["p99"], over["max"]))
+    for route in sorted(results):
+        r = results[route]
+        if r["ms"]:
+            print("  %-24s %6d ok  %5.1f/s  p50 %6.1f ms  p99 %6.1f ms  %4d shed  %4d errors" % (
+                route, len(r["ms"]), len(r["ms"]) / args.seconds, percentile(r["ms"], 50),
+                percentile(r["ms"], 99), r["shed"], r["errors"]))
+        else:
+            print("  %-24s      0 ok  %4d shed  %4d errors" % (route, r["shed"], r["errors"]))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--host", default="192.168.4.1")
+    parser.add_argument("--clients", type=int, nargs="+", default=[1, 2, 4, 8])
+    parser.add_argument("--seconds", type=int, default=60, help="per step")
+    parser.add_argument("--probe-every", type=int, default=15, help="seconds between probe bells")
+    parser.add_argument("--edit-every", type=float, default=120, help="mean seconds between edits per browser, 0 = none")
+    parser.add_argument("--ring", action="store_true", help="let the probes actually ring")
+    parser.add_argument("--bell-off", nargs="+", choices=["loop", "timer"],
+                        help="run each step per way of timing the off edge, ringing the probes")
+    parser.add_argument("--script", default=SCRIPT, help="dashboard script to take the request pattern from")
+    native.add_arguments(parser)
+    args = parser.parse_args()
+
+    pattern = dashboard_pattern(args.script)
+    print("script.js: on load %s; every %s" % (", ".join(pattern[0]), ", ".join(
+        "%s %gs" % (name, period) for name, period in pattern[1].items())))
+
+    unit = None
+    if args.native:
+        unit = native.Unit(native.program(args), args.port).start()
+        args.host = unit.host
+    try:
+        run(args, pattern)
+    finally:
+        if unit:
+            unit.stop()
+
+
+def run(args, pattern):
+    config = call(args.host, "/config")
+    duration = config.get("bellDurationMs", 3000)
+    timed = config.get("bellTimer", True)
+    # Triggers only fire while the bells are switched on (the LED)
+    switched_on = call(args.host, "/status").get("led", False)
+    if not switched_on:
+        call(args.host, "/led/toggle", {})
+    if not args.ring and not args.bell_off:
+        call(args.host, "/config/bell-duration", {"bellDurationMs": 0})
+    try:
+        for clients in args.clients:
+            for mode in args.bell_off or [None]:
+                if mode:
+                    call(args.host, "/config/bell-timer", {"bellTimer": mode == "timer"})
+                step(args, clients, pattern, mode)
+    finally:
+        call(args.host, "/config/bell-duration", {"bellDurationMs": duration})
+        if args.bell_off:
+            call(args.host, "/config/bell-timer", {"bellTimer": timed})
+        if not switched_on:
+            call(args.host, "/led/toggle", {})
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,130 @@
+#!/usr/bin/env python3
+"""Runs the firmware on Linux, one process per unit.
+
+Builds [env:native] (platformio.ini) and starts .pio/build/<env>/program
+with the NATIVE_* settings listed in native/include/NativeHost.h: the real
+setup(), loop() and routes, over the emulated core in native/. loadtest.py
+and soak.py start their units through here when given --native, sync_sim.py
+and skew_sim.py always. On its own it runs one unit in the foreground:
+
+    python3 tools/native.py --port 8080 --set RTC_PPM=20
+"""
+
+import argparse
+import http.client
+import os
+import shutil
+import subprocess
+import time
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+
+def build(env="native"):
+    """Path of the env's program, built (or brought up to date) first"""
+    pio = shutil.which("pio") or shutil.which("platformio")
+    if pio is None:
+        raise SystemExit("PlatformIO (pio) is needed to build [env:%s]" % env)
+    subprocess.run([pio, "run", "-s", "-e", env], cwd=ROOT, check=True)
+    return os.path.join(ROOT, ".pio", "build", env, "program")
+
+
+class Unit:
+    """One firmware process; settings are NATIVE_* without the prefix,
+    any case: Unit(program, 8081, chip_id=2, rtc_ppm=-15)"""
+
+    def __init__(self, program, port, **settings):
+        self.program = program
+        self.port = port
+        self.settings = settings
+        self.proc = None
+
+    @property
+    def host(self):
+        return "127.0.0.1:%d" % self.port
+
+    def start(self, timeout=15):
+        env = dict(os.environ)
+        env["NATIVE_HTTP_PORT"] = str(self.port)
+        for name, value in self.settings.items():
+            env["NATIVE_" + name.upper()] = str(value)
+        self.proc = subprocess.Popen([self.program], env=env, cwd=ROOT, stdin=subprocess.DEVNULL)
+        deadline = time.monotonic() + timeout
+        while time.monotonic() < deadline:
+            if self.proc.poll() is not None:
+                raise RuntimeError("unit on port %d exited with %d" % (self.port, self.proc.returncode))
+            if self.serving():
+                return self
+            time.sleep(0.1)
+        self.stop()
+        raise RuntimeError("unit on port %d not serving after %d s" % (self.port, timeout))
+
+    def serving(self):
+        conn = http.client.HTTPConnection("127.0.0.1", self.port, timeout=2)
+        try:
+            conn.request("GET", "/time", headers={"Connection": "close"})
+            return conn.getresponse().status == 200
+        except (OSError, http.client.HTTPException):
+            return False
+        finally:
+            conn.close()
+
+    def stop(self):
+        if self.proc is not None and self.proc.poll() is None:
+            self.proc.terminate()
+            try:
+                self.proc.wait(5)
+            except subprocess.TimeoutExpired:
+                self.proc.kill()
+                self.proc.wait()
+        self.proc = None
+
+    def __enter__(self):
+        return self.start()
+
+    def __exit__(self, *exc):
+        self.stop()
+
+
+def add_arguments(parser):
+    """--native and what goes with it, for the harnesses"""
+    group = parser.add_argument_group("native build")
+    group.add_argument("--native", action="store_true", help="run against units of the native build, not --host")
+    group.add_argument("--native-env", default="native", help="platformio.ini env to build")
+    group.add_argument("--program", help="an already built native program; skips building")
+    group.add_argument("--port", type=int, default=18080, help="HTTP port of the (first) native unit")
+
+
+def program(args):
+    return args.program or build(args.native_env)
+
+
+def settings(pairs):
+    result = {}
+    for pair in pairs or []:
+        name, _, value = pair.partition("=")
+        result[name] = value
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--env", default="native")
+    parser.add_argument("--program", help="an already built native program; skips building")
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--set", nargs="+", metavar="NAME=VALUE", help="NATIVE_* settings, without the prefix")
+    args = parser.parse_args()
+
+    unit = Unit(args.program or build(args.env), args.port, **settings(args.set))
+    unit.start()
+    print("serving on http://%s/, Ctrl-C stops it" % unit.host)
+    try:
+        unit.proc.wait()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        unit.stop()
+
+
+if __name__ == "__main__":
+    main()
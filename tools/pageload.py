@@ -0,0 +1,217 @@
+#!/usr/bin/env python3
+"""Measures dashboard page-load latency with several browsers at once.
+
+Each simulated client loads the page the way a browser does: / first, then
+style.css and script.js over two parallel connections, and counts the page
+as loaded when the last of the three has arrived. Clients start together and
+reload in a loop for --seconds, so every run has them competing for the
+device's few TCP slots and the file stream task.
+
+    python3 tools/pageload.py --host 192.168.4.1 --clients 1 4 8 --save before.json
+    (flash the new firmware)
+    python3 tools/pageload.py --host 192.168.4.1 --clients 1 4 8 --compare before.json
+
+Loads are cold (no cache) unless --revalidate is given, which sends the
+If-None-Match a browser would send from its cache after the first load.
+
+With --api a page also takes the API calls script.js makes as it starts
+(loadtest.py reads them from the file), which is what admission control
+(admission.h) has to leave room for. --pause waits between a page arriving
+and the reload, and --reloads stops each client after that many reloads
+instead of after --seconds.
+
+All clients come from this host's address, so the device's admission control
+sees them as one client; requests it sheds with 503 are counted per path,
+waited out per Retry-After and retried, and the page time includes the wait.
+With --native the clients run against the firmware built for Linux
+(tools/native.py) instead, each from its own loopback address, so they are
+as many clients to the unit as phones on its access point:
+
+    python3 tools/pageload.py --native --clients 8 --api --pause 1 --reloads 1
+"""
+
+import argparse
+import http.client
+import json
+import math
+import sys
+import threading
+import time
+from concurrent.futures import ThreadPoolExecutor
+
+import loadtest
+import native
+
+TIMEOUT = 10
+ASSETS = ["/style.css", "/script.js"]
+shed = {}
+
+
+def page_calls():
+    """What script.js fetches as it starts: its calls on load, and the two
+    loadSchedules() makes once the list is in"""
+    on_load, _, urls = loadtest.dashboard_pattern()
+    calls = []
+    for name in on_load:
+        if name == "loadSchedules":
+            calls += ["/schedules", urls["loadProfiles"], urls["loadUpcoming"]]
+        elif name in urls:
+            calls.append(urls[name])
+    return calls
+
+
+def fetch(host, path, etags, revalidate, source=None):
+    """One request on its own connection; returns (seconds, body bytes)"""
+    headers = {"Accept-Encoding": "gzip"}
+    if revalidate and path in etags:
+        headers["If-None-Match"] = etags[path]
+    start = time.monotonic()
+    while True:
+        conn = http.client.HTTPConnection(host, timeout=TIMEOUT, source_address=source)
+        try:
+            conn.request("GET", path, headers=headers)
+            resp = conn.getresponse()
+            body = resp.read()
+        finally:
+            conn.close()
+        if resp.status == 503 and resp.getheader("Retry-After"):
+            route = path.split("?")[0]
+            shed[route] = shed.get(route, 0) + 1
+            time.sleep(int(resp.getheader("Retry-After")))
+            continue
+        if resp.status not in (200, 304):
+            raise IOError("%s: HTTP %d" % (path, resp.status))
+        if resp.getheader("ETag"):
+            etags[path] = resp.getheader("ETag")
+        return time.monotonic() - start, len(body)
+
+
+def load_page(host, etags, revalidate, pool, calls, source):
+    """/ then both assets in parallel, then calls; returns per-path seconds
+    and bytes"""
+    start = time.monotonic()
+    times = {}
+    times["/"], size = fetch(host, "/", etags, revalidate, source)
+    for paths in (ASSETS, calls):
+        futures = {path: pool.submit(fetch, host, path, etags, revalidate, source) for path in paths}
+        for path, future in futures.items():
+            times[path.split("?")[0]], n = future.result()
+            size += n
+    times["page"] = time.monotonic() - start
+    return times, size
+
+
+def client(host, deadline, args, calls, source, results, lock):
+    etags = {}
+    loads = 0
+    with ThreadPoolExecutor(max_workers=len(ASSETS)) as pool:
+        while time.monotonic() < deadline and (args.reloads is None or loads <= args.reloads):
+            try:
+                times, size = load_page(host, etags, args.revalidate, pool, calls, source)
+            except (OSError, http.client.HTTPException) as e:
+                with lock:
+                    results["errors"] += 1
+                    results["lastError"] = str(e)
+                time.sleep(0.2)
+                continue
+            with lock:
+                for path, seconds in times.items():
+                    results["times"].setdefault(path, []).append(seconds * 1000)
+                results["bytes"] += size
+            loads += 1
+            time.sleep(args.pause)
+
+
+def percentile(values, p):
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(math.ceil(p / 100 * len(ordered))) - 1)]
+
+
+def run(host, clients, args, calls):
+    results = {"times": {}, "bytes": 0, "errors": 0, "lastError": None}
+    shed.clear()
+    lock = threading.Lock()
+    start = time.monotonic()
+    deadline = start + args.seconds
+    # Loopback has every 127/8 address; one each makes them separate clients
+    sources = [("127.0.0.%d" % (2 + i), 0) if args.native else None for i in range(clients)]
+    threads = [threading.Thread(target=client, args=(host, deadline, args, calls, source, results, lock))
+               for source in sources]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+
+    seconds = time.monotonic() - start
+    summary = {"clients": clients, "errors": results["errors"], "lastError": results["lastError"],
+               "shed": sum(shed.values()), "shedPaths": dict(shed)}
+    pages = results["times"].get("page", [])
+    summary["pages"] = len(pages)
+    summary["pagesPerSec"] = len(pages) / seconds
+    summary["kbPerPage"] = results["bytes"] / len(pages) / 1024 if pages else 0
+    for path, values in results["times"].items():
+        summary[path] = {"p%d" % p: percentile(values, p) for p in (50, 90, 99)}
+        summary[path]["max"] = max(values)
+    return summary
+
+
+def print_summary(summary, baseline=None):
+    def cell(value, old):
+        if old is None:
+            return "%8.0fms" % value
+        return "%8.0fms (%+4.0f%%)" % (value, (value - old) / old * 100 if old else 0)
+
+    print("%d clients: %d pages, %.1f pages/s, %.1f KB/page, %d shed, %d errors%s" % (
+        summary["clients"], summary["pages"], summary["pagesPerSec"], summary["kbPerPage"], summary.get("shed", 0),
+        summary["errors"],
+        " (%s)" % summary["lastError"] if summary["lastError"] else ""))
+    if summary.get("shedPaths"):
+        print("  shed: %s" % ", ".join("%s %d" % item for item in sorted(summary["shedPaths"].items())))
+    for path in ["page", "/"] + ASSETS + [p for p in summary if p.startswith("/") and p != "/" and p not in ASSETS]:
+        if path not in summary:
+            continue
+        old = baseline.get(path) if baseline else None
+        print("  %-11s p50 %s  p90 %s  p99 %s  max %s" % (path, *(
+            cell(summary[path][p], old[p] if old else None) for p in ("p50", "p90", "p99", "max"))))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--host", default="192.168.4.1")
+    parser.add_argument("--clients", type=int, nargs="+", default=[1, 4, 8])
+    parser.add_argument("--seconds", type=float, default=30)
+    parser.add_argument("--revalidate", action="store_true", help="send If-None-Match after the first load")
+    parser.add_argument("--api", action="store_true", help="a page includes script.js's first API calls")
+    parser.add_argument("--pause", type=float, default=0, help="seconds between a page and its reload")
+    parser.add_argument("--reloads", type=int, help="reloads per client, then stop (default: until --seconds)")
+    parser.add_argument("--save", help="write the results to this JSON file")
+    parser.add_argument("--compare", help="JSON file from an earlier --save to compare against")
+    native.add_arguments(parser)
+    args = parser.parse_args()
+    calls = page_calls() if args.api else []
+
+    baseline = {}
+    if args.compare:
+        with open(args.compare) as f:
+            baseline = {str(s["clients"]): s for s in json.load(f)}
+
+    summaries = []
+    for clients in args.clients:
+        # A fresh unit per step on native, its buckets full
+        unit = native.Unit(native.program(args), args.port).start() if args.native else None
+        try:
+            summary = run(unit.host if unit else args.host, clients, args, calls)
+        finally:
+            if unit:
+                unit.stop()
+        print_summary(summary, baseline.get(str(clients)))
+        summaries.append(summary)
+
+    if args.save:
+        with open(args.save, "w") as f:
+            json.dump(summaries, f, indent=2)
+    return 1 if any(s["pages"] == 0 for s in summaries) else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
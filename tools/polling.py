@@ -0,0 +1,164 @@
+#!/usr/bin/env python3
+"""Measures dashboard polling with and without HTTP keep-alive.
+
+Every simulated dashboard polls /time and /status the way script.js does,
+either over one persistent connection (keep) or with a new connection per
+request (close). For each mode it reports requests/s, latency, how many TCP
+connections the clients had to open, and the device's own view from the
+/metrics "connections" section: accepted vs reused connections and the heap
+held per connection. It also reports the device's handler time per request
+for the two routes and how many of them the response cache (cache.h) served,
+which is what keeps that time flat as dashboards are added.
+
+    python3 tools/polling.py --host 192.168.4.1 --clients 1 3 --rate 0
+
+--rate is polls per second per dashboard; 0 polls as fast as the device
+answers, which is how to measure requests/s. All dashboards share this
+host's address, so admission control (admission.h) limits them together;
+its 503s are counted as shed and waited out per Retry-After.
+"""
+
+import argparse
+import http.client
+import json
+import math
+import threading
+import time
+
+TIMEOUT = 5
+PATHS = ["/time", "/status"]
+
+
+class Dashboard:
+    def __init__(self, host, keep):
+        self.host = host
+        self.keep = keep
+        self.conn = None
+        self.connects = 0
+        self.shed = 0
+
+    def get(self, path):
+        headers = {} if self.keep else {"Connection": "close"}
+        for attempt in range(2):
+            if self.conn is None:
+                self.conn = http.client.HTTPConnection(self.host, timeout=TIMEOUT)
+                self.connects += 1
+            try:
+                self.conn.request("GET", path, headers=headers)
+                resp = self.conn.getresponse()
+                resp.read()
+                if resp.will_close:
+                    self.close()
+                if resp.status == 503 and resp.getheader("Retry-After"):
+                    self.shed += 1
+                    time.sleep(int(resp.getheader("Retry-After")))
+                return resp.status
+            except (OSError, http.client.HTTPException):
+                # the device let an idle connection go; retry once on a new one
+                self.close()
+                if attempt:
+                    raise
+        return None
+
+    def close(self):
+        if self.conn is not None:
+            self.conn.close()
+            self.conn = None
+
+
+def metrics(host):
+    while True:
+        conn = http.client.HTTPConnection(host, timeout=TIMEOUT)
+        try:
+            conn.request("GET", "/metrics", headers={"Connection": "close"})
+            resp = conn.getresponse()
+            body = resp.read()
+        finally:
+            conn.close()
+        if resp.status != 503:
+            return json.loads(body)
+        time.sleep(int(resp.getheader("Retry-After") or 1))
+
+
+def percentile(values, p):
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(math.ceil(p / 100 * len(ordered))) - 1)]
+
+
+def run(host, clients, seconds, rate, keep):
+    latencies, errors, connects, shed = [], [0], [0], [0]
+    lock = threading.Lock()
+    deadline = time.monotonic() + seconds
+
+    def dashboard():
+        d = Dashboard(host, keep)
+        period = 1.0 / rate if rate else 0
+        next_poll = time.monotonic()
+        while time.monotonic() < deadline:
+            for path in PATHS:
+                start = time.monotonic()
+                try:
+                    if d.get(path) == 503:
+                        continue
+                except (OSError, http.client.HTTPException):
+                    with lock:
+                        errors[0] += 1
+                    continue
+                with lock:
+                    latencies.append((time.monotonic() - start) * 1000)
+            if period:
+                next_poll += period
+                time.sleep(max(0, next_poll - time.monotonic()))
+        d.close()
+        with lock:
+            connects[0] += d.connects
+            shed[0] += d.shed
+
+    before = metrics(host)
+    threads = [threading.Thread(target=dashboard) for _ in range(clients)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    after = metrics(host)
+
+    def delta(key):
+        return after.get("connections", {}).get(key, 0) - before.get("connections", {}).get(key, 0)
+
+    def route_delta(section, name_key, name, key):
+        old = next((r for r in before.get(section, []) if r[name_key] == name), {})
+        new = next((r for r in after.get(section, []) if r[name_key] == name), {})
+        return (new.get(key, 0) - old.get(key, 0)) % 2 ** 32
+
+    calls = sum(route_delta("routes", "path", p, "calls") for p in PATHS)
+    handler_us = sum(route_delta("routes", "path", p, "us") for p in PATHS)
+    slots = [c["route"] for c in after.get("responseCache", [])]
+    hits = sum(route_delta("responseCache", "route", s, "hits") for s in slots)
+    lookups = hits + sum(route_delta("responseCache", "route", s, k) for s in slots for k in ("misses", "stateMisses"))
+
+    print("%-5s %2d clients: %6.1f req/s  p50 %5.0fms  p99 %5.0fms  %5d shed  %5d errors  %5d connects  "
+          "device: %d accepted, %d reused, %s B/connection, %.0fus/request, %.0f%% cached" % (
+              "keep" if keep else "close", clients, len(latencies) / seconds,
+              percentile(latencies, 50) if latencies else 0, percentile(latencies, 99) if latencies else 0,
+              shed[0], errors[0], connects[0], delta("accepted"), delta("reused"),
+              after.get("connections", {}).get("heapPerConnection", "?"), handler_us / calls if calls else 0,
+              100 * hits / lookups if lookups else 0))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--host", default="192.168.4.1")
+    parser.add_argument("--clients", type=int, nargs="+", default=[1, 3])
+    parser.add_argument("--seconds", type=float, default=30)
+    parser.add_argument("--rate", type=float, default=1.0, help="polls per second per dashboard, 0 = flat out")
+    parser.add_argument("--modes", nargs="+", choices=["close", "keep"], default=["close", "keep"])
+    args = parser.parse_args()
+
+    for clients in args.clients:
+        for mode in args.modes:
+            run(args.host, clients, args.seconds, args.rate, mode == "keep")
+            time.sleep(3)  # let the last connections time out between runs
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,172 @@
+#!/usr/bin/env python3
+"""Estimates what power saving (power.h) saves over a week of a schedule.
+
+Plays a week second by second for each power mode: the triggers from a
+schedules.json (compiled the way default_schedules.py does), phones joining
+the AP now and then during the day, and the firmware's doze rules with the
+POWER_* constants read from lib/functions/power.h. For each mode it reports
+the radio and CPU duty cycle, the average current and the energy per day
+against the always-on loop, and how long a phone arriving while the unit
+dozes waits before it can join the AP (unless they press the button, which
+ends the doze at once).
+
+The currents are typical figures for a bare ESP-12 module at 3.3 V, not
+measurements; pass your own (a NodeMCU board adds its USB-serial chip and
+regulator as --board-ma). The calendar is not modelled: every week is a
+normal one on the given profile.
+
+    python3 tools/power_sim.py --visits 6 --board-ma 8
+"""
+
+import argparse
+import bisect
+import json
+import math
+import os
+import random
+import re
+
+from default_schedules import compile_schedules
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+WEEK = 7 * 86400
+MODES = ("off", "modem", "light")
+
+
+def power_constants(path=os.path.join(ROOT, "lib", "functions", "power.h")):
+    with open(path) as f:
+        return {name: int(value) for name, value in re.findall(r"^#define (POWER_\w+) (\d+)", f.read(), re.M)}
+
+
+def week_events(schedules_path, profile):
+    """Seconds into the week (day 0 = Saturday, as in Trigger.days) of every
+    trigger, and of the bell ones"""
+    with open(schedules_path) as f:
+        schedules = json.load(f).get("schedules", [])
+    triggers, tables = compile_schedules(schedules)
+    events, bells = [], []
+    for name, start, count in tables:
+        if name != profile:
+            continue
+        for minute, second, days, kind, _ in triggers[start:start + count]:
+            for day in range(7):
+                if days & (1 << day):
+                    at = day * 86400 + minute * 60 + second
+                    events.append(at)
+                    if kind == "TRIGGER_BELL":
+                        bells.append(at)
+    return sorted(events), sorted(bells)
+
+
+def visit_list(per_day, minutes, hours, seed):
+    """(arrival, seconds on the AP) for phones joining during the day"""
+    rng = random.Random(seed)
+    visits = []
+    first, last = hours
+    for day in range(7):
+        t = day * 86400 + first * 3600
+        end = day * 86400 + last * 3600
+        rate = per_day / ((last - first) * 3600) if per_day else 0
+        while rate:
+            t += rng.expovariate(rate)
+            if t >= end:
+                break
+            visits.append((int(t), max(1, int(rng.expovariate(1 / (minutes * 60))))))
+    return visits
+
+
+def simulate(mode, events, bells, visits, c, args):
+    """Seconds spent per state, and the phones' waits"""
+    awake = modem = light = slices = 0
+    waits = []
+    next_visit = 0
+    station_until = -1
+    last_request = -math.inf
+    ap_up_since = 0
+    doze_end = None
+    ringing = set()
+    for at in bells:
+        ringing.update(range(at, at + args.bell_s))
+
+    for t in range(WEEK):
+        if doze_end is not None and t >= doze_end:
+            doze_end = None
+            ap_up_since = t
+
+        # phones join once the AP is there; while it is down they wait
+        while next_visit < len(visits) and visits[next_visit][0] <= t and doze_end is None:
+            arrival, stay = visits[next_visit]
+            waits.append(t - arrival)
+            station_until = max(station_until, t + stay)
+            next_visit += 1
+        if t < station_until:
+            last_request = t
+
+        if doze_end is None and mode != "off":
+            i = bisect.bisect_left(events, t)
+            next_event = events[i] if i < len(events) else events[0] + WEEK if events else math.inf
+            window = c["POWER_MAX_DOZE_S"]
+            if next_event - t < c["POWER_MAX_DOZE_S"] + c["POWER_GUARD_S"]:
+                window = max(0, next_event - t - c["POWER_GUARD_S"])
+            if (t >= station_until and t - last_request >= c["POWER_IDLE_S"] and
+                    t - ap_up_since >= c["POWER_AP_WINDOW_S"] and t not in ringing and
+                    window >= c["POWER_MIN_DOZE_S"]):
+                doze_end = t + window
+                slices += math.ceil(window / c["POWER_SLICE_S"])
+
+        if doze_end is None:
+            awake += 1
+        elif mode == "modem":
+            modem += 1
+        else:
+            light += 1
+    return {"awake": awake, "modem": modem, "light": light, "slices": slices, "waits": waits,
+            "ringing": len(ringing)}
+
+
+def average_ma(r, args):
+    slice_s = r["slices"] * args.slice_ms / 1000  # RTC read and sleep entry, CPU on
+    charge = (r["awake"] * args.ap_ma + r["modem"] * args.modem_ma +
+              (r["light"] - slice_s) * args.light_ma + slice_s * args.modem_ma +
+              r["ringing"] * args.bell_ma)
+    return charge / WEEK + args.board_ma
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--schedules", default=os.path.join(ROOT, "data", "schedules.json"))
+    parser.add_argument("--profile", default="normal")
+    parser.add_argument("--visits", type=float, default=4, help="phones joining the AP per day")
+    parser.add_argument("--visit-min", type=float, default=5, help="mean minutes a phone stays")
+    parser.add_argument("--hours", type=int, nargs=2, default=[7, 17], help="when phones come by")
+    parser.add_argument("--bell-s", type=int, default=3, help="bell duration")
+    parser.add_argument("--ap-ma", type=float, default=75, help="AP up, loop running")
+    parser.add_argument("--modem-ma", type=float, default=16, help="radio off, loop running")
+    parser.add_argument("--light-ma", type=float, default=0.9, help="forced light sleep")
+    parser.add_argument("--slice-ms", type=float, default=10, help="awake per light sleep slice")
+    parser.add_argument("--bell-ma", type=float, default=70, help="bell relay while ringing")
+    parser.add_argument("--board-ma", type=float, default=0, help="always drawn by the board")
+    parser.add_argument("--volts", type=float, default=3.3)
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+
+    c = power_constants()
+    events, bells = week_events(args.schedules, args.profile)
+    visits = visit_list(args.visits, args.visit_min, args.hours, args.seed)
+    print("%d triggers a week (%d bells), %d phone visits" % (len(events), len(bells), len(visits)))
+
+    print("%-6s %9s %9s %9s %10s %10s %8s %10s %10s" % ("mode", "radio on", "cpu on", "avg mA", "mAh/day",
+                                                       "Wh/day", "saved", "wait p50", "wait max"))
+    baseline = None
+    for mode in MODES:
+        r = simulate(mode, events, bells, visits, c, args)
+        ma = average_ma(r, args)
+        baseline = baseline or ma
+        waits = sorted(r["waits"]) or [0]
+        print("%-6s %8.1f%% %8.1f%% %9.1f %10.0f %10.2f %7.0f%% %9ds %9ds" % (
+            mode, 100 * r["awake"] / WEEK, 100 * (r["awake"] + r["modem"]) / WEEK, ma, ma * 24,
+            ma * 24 * args.volts / 1000, 100 * (1 - ma / baseline), waits[len(waits) // 2], waits[-1]))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,178 @@
+#!/usr/bin/env python3
+"""Measures how far apart several bell units ring for the same trigger.
+
+Runs --units units of the native build (tools/native.py) side by side, once
+per way a unit can tell where its RTC's second starts (clock.h):
+
+  micros  the edge predicted from micros(), [env:native]
+  sqw     the DS3231's 1 Hz square wave on SQW_PIN, [env:native_sqw]
+
+Every unit gets its own DS3231, started up to --clock-spread seconds off and
+running up to --ppm fast or slow, and replication on (sync.h) with the
+clock set by hand on the first unit, so the others phase-align to it as
+they would on a site. Probe bells are added on the first unit and reach the
+rest by sync. Each unit traces its pins (NATIVE_GPIO_TRACE); a probe rings
+where the bell pin (D5) falls, and skew is the spread between the first and
+the last unit to ring it, all timestamps from the one host clock. Lateness,
+each unit against its own RTC edge, is the "triggers" histogram from
+/metrics, summed over the units.
+
+Each build runs idle and busy, busy being --browsers dashboards open on
+every unit (loadtest.py's browsers, without edits).
+
+    python3 tools/skew_sim.py --units 4 --seconds 120
+"""
+
+import argparse
+import os
+import random
+import tempfile
+import threading
+import time
+
+import loadtest
+import native
+
+BELL_GPIO = 14  # D5, include/header.h
+BELL_MS = 200  # probes ring this long, well apart from the next
+SETUP_S = 20  # to add the probes and let them replicate
+CLUSTER_S = 1.0  # falling edges this close belong to one probe
+BUILDS = (("micros", "native"), ("sqw", "native_sqw"))
+
+
+def falling_edges(path, offset):
+    """Host times (s) the bell pin went low at, from the trace past offset"""
+    edges = []
+    with open(path) as f:
+        f.seek(offset)
+        for line in f:
+            us, gpio, level = line.split()
+            if int(gpio) == BELL_GPIO and level == "0":
+                edges.append(int(us) / 1e6)
+    return edges
+
+
+def ring_groups(edges_per_unit):
+    """Edges of all units grouped per probe: [(unit, time), ...] each"""
+    edges = sorted((t, unit) for unit, times in enumerate(edges_per_unit) for t in times)
+    groups = []
+    for t, unit in edges:
+        if groups and t - groups[-1][0][1] < CLUSTER_S:
+            groups[-1].append((unit, t))
+        else:
+            groups.append([(unit, t)])
+    return groups
+
+
+def summed_triggers(metrics):
+    """The units' "triggers" lateness histograms added up"""
+    total = [dict(bucket) for bucket in metrics[0]["triggers"]["lateMs"]]
+    for m in metrics[1:]:
+        for bucket, other in zip(total, m["triggers"]["lateMs"]):
+            bucket["count"] += other["count"]
+    return {"lateMs": total, "maxLateUs": max(m["triggers"]["maxLateUs"] for m in metrics)}
+
+
+def converged(units):
+    states = [loadtest.call(u.host, "/metrics")["sync"] for u in units]
+    return len(set((s["revision"], s["digest"]) for s in states)) == 1
+
+
+def start_units(program, args, traces):
+    key = os.urandom(16).hex()
+    units = []
+    for i in range(args.units):
+        unit = native.Unit(program, args.port + i, chip_id=2000 + i, seed=i + 1,
+                           rtc_offset=random.randint(-args.clock_spread, args.clock_spread),
+                           rtc_ppm="%.1f" % random.uniform(-args.ppm, args.ppm),
+                           gpio_trace=traces[i])
+        units.append(unit)
+        unit.start()
+    for unit in units:
+        loadtest.call(unit.host, "/config/sync", {"ssid": "skew-sim", "password": "", "key": key})
+        loadtest.call(unit.host, "/config/bell-duration", {"bellDurationMs": BELL_MS})
+        if not loadtest.call(unit.host, "/status").get("led", False):
+            loadtest.call(unit.host, "/led/toggle", {})  # triggers only fire with the bells on
+    now = time.localtime()
+    loadtest.call(units[0].host, "/send-time", {"time": time.strftime("%Y-%m-%dT%H:%M:%S", now)})
+    return units
+
+
+def measure(units, args, traces, browsers, pattern):
+    leader = units[0].host
+    start = loadtest.unit_seconds(leader) + SETUP_S
+    probes = loadtest.add_probes(leader, start, args.seconds, args.probe_every)
+    setup_end = time.monotonic() + SETUP_S - 1
+    while not converged(units) and time.monotonic() < setup_end:
+        time.sleep(0.5)
+    offsets = [os.path.getsize(path) for path in traces]
+    before = [loadtest.call(u.host, "/metrics") for u in units]
+    time.sleep(max(0, setup_end - time.monotonic()))
+
+    deadline = time.monotonic() + args.seconds + 2
+    results, lock = {}, threading.Lock()
+    threads = [threading.Thread(target=loadtest.browse, args=(u.host, deadline, pattern, 0, results, lock))
+               for u in units for _ in range(browsers)]
+    for t in threads:
+        t.start()
+    time.sleep(max(0, deadline - time.monotonic()))
+    for t in threads:
+        t.join()
+
+    after = [loadtest.call(u.host, "/metrics") for u in units]
+    loadtest.remove_probes(leader, probes)
+
+    groups = ring_groups([falling_edges(path, offset) for path, offset in zip(traces, offsets)])
+    complete = [g for g in groups if len(set(unit for unit, _ in g)) == len(units)]
+    skews = [(max(t for _, t in g) - min(t for _, t in g)) * 1000 for g in complete]
+    late = loadtest.lateness(summed_triggers(before), summed_triggers(after))
+    return {"probes": len(probes), "rung": len(complete), "skews": skews, "late": late}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--units", type=int, default=4)
+    parser.add_argument("--seconds", type=int, default=120, help="probes rung per build and load")
+    parser.add_argument("--probe-every", type=int, default=5, help="seconds between probe bells")
+    parser.add_argument("--browsers", type=int, default=4, help="dashboards open per unit when busy")
+    parser.add_argument("--settle", type=int, default=60, help="seconds for the clocks to align first")
+    parser.add_argument("--clock-spread", type=int, default=10, help="RTCs start up to this many seconds off")
+    parser.add_argument("--ppm", type=float, default=20, help="RTCs run up to this fast or slow")
+    parser.add_argument("--program", help="an already built [env:native] program")
+    parser.add_argument("--program-sqw", help="an already built [env:native_sqw] program")
+    parser.add_argument("--port", type=int, default=18200, help="HTTP port of the first unit")
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+    random.seed(args.seed)
+    pattern = loadtest.dashboard_pattern()
+    programs = {"native": args.program, "native_sqw": args.program_sqw}
+
+    print("%-7s %-5s %7s %10s %10s %10s %10s %10s" % ("clock", "load", "rung", "skew p50", "skew p90",
+                                                      "skew p99", "skew max", "late p99"))
+    failed = False
+    for mode, env in BUILDS:
+        program = programs[env] or native.build(env)
+        with tempfile.TemporaryDirectory() as tmp:
+            traces = [os.path.join(tmp, "unit%d.trace" % i) for i in range(args.units)]
+            units = start_units(program, args, traces)
+            try:
+                time.sleep(args.settle)
+                for load, browsers in (("idle", 0), ("busy", args.browsers)):
+                    r = measure(units, args, traces, browsers, pattern)
+                    skews = r["skews"]
+                    if not skews:
+                        failed = True
+                        print("%-7s %-5s %3d/%-3d  no probe rang on every unit" % (mode, load, 0, r["probes"]))
+                        continue
+                    print("%-7s %-5s %3d/%-3d %8.1fms %8.1fms %8.1fms %8.1fms %8sms" % (
+                        mode, load, r["rung"], r["probes"], loadtest.percentile(skews, 50),
+                        loadtest.percentile(skews, 90), loadtest.percentile(skews, 99), max(skews),
+                        r["late"]["p99"]))
+            finally:
+                for unit in units:
+                    unit.stop()
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
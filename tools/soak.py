@@ -0,0 +1,167 @@
+#!/usr/bin/env python3
+"""Heap soak test against a running bell controller.
+
+Replays a compressed month of dashboard traffic (time/status polling,
+schedule edits, bell presses) as fast as the device answers, sampling
+/metrics as it goes. Exits non-zero if heap fragmentation or the largest free
+block crosses the given limits, so a leak or a fragmenting handler fails the
+run instead of showing up weeks later on a school wall.
+
+    python3 tools/soak.py --host 192.168.4.1 --days 30
+
+Every simulated school day the dashboard is open for --hours hours and polls
+/time every --poll seconds; edits and bell presses are spread over the day.
+Schedules added by the soak are deleted again, so the schedule file ends where
+it started. Use --no-bell when the bell is actually wired up.
+
+With --native the soak runs against the firmware built for Linux
+(tools/native.py) instead of a unit: the same handlers on an emulated
+ESP8266 heap of the same size, so /metrics reports the heap as the chip
+would. Admission control paces the requests as it does on the device, so
+keep --days small there.
+
+    python3 tools/soak.py --native --days 2 --hours 1
+"""
+
+import argparse
+import json
+import random
+import sys
+import time
+import urllib.error
+import urllib.request
+
+import native
+
+TIMEOUT = 5
+
+
+shed = 0
+
+
+def request(host, path, body=None):
+    """Waits out 503s from admission control, the soak runs flat out"""
+    global shed
+    url = "http://%s%s" % (host, path)
+    data = None if body is None else json.dumps(body).encode()
+    while True:
+        req = urllib.request.Request(url, data=data, method="POST" if data else "GET")
+        if data:
+            req.add_header("Content-Type", "application/json")
+        try:
+            with urllib.request.urlopen(req, timeout=TIMEOUT) as resp:
+                return resp.read()
+        except urllib.error.HTTPError as e:
+            if e.code != 503 or not e.headers.get("Retry-After"):
+                raise
+            shed += 1
+            time.sleep(int(e.headers["Retry-After"]))
+
+
+def metrics(host):
+    return json.loads(request(host, "/metrics"))
+
+
+def schedule_count(host):
+    return len(json.loads(request(host, "/schedules")).get("schedules", []))
+
+
+def edit_cycle(host):
+    """Adds one schedule, edits it and deletes it again."""
+    minute = random.randrange(24 * 60)
+    alarm = {
+        "time": "%02d:%02d" % (minute // 60, minute % 60),
+        "type": "bell",
+        "days": [random.randrange(7)],
+        "enabled": True,
+    }
+    request(host, "/schedules/add", alarm)
+    index = schedule_count(host) - 1
+    alarm.update(index=index, days=[0, 1, 2, 3, 4])
+    request(host, "/schedules/edit", alarm)
+    request(host, "/schedules/delete", {"index": index})
+
+
+def check(m, args):
+    heap = m["heap"]
+    problems = []
+    if heap["fragmentation"] > args.max_fragmentation:
+        problems.append("fragmentation %d%% > %d%%" % (heap["fragmentation"], args.max_fragmentation))
+    if heap["maxFreeBlock"] < args.min_free_block:
+        problems.append("largest free block %d < %d" % (heap["maxFreeBlock"], args.min_free_block))
+    return problems
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--host", default="192.168.4.1")
+    parser.add_argument("--days", type=int, default=30, help="simulated days")
+    parser.add_argument("--hours", type=float, default=8, help="dashboard hours per day")
+    parser.add_argument("--poll", type=float, default=10, help="simulated seconds between /time polls")
+    parser.add_argument("--edits", type=int, default=4, help="schedule edit cycles per day")
+    parser.add_argument("--presses", type=int, default=6, help="bell presses per day")
+    parser.add_argument("--no-bell", action="store_true", help="skip bell presses")
+    parser.add_argument("--max-fragmentation", type=int, default=30, help="percent")
+    parser.add_argument("--min-free-block", type=int, default=8192, help="bytes")
+    native.add_arguments(parser)
+    args = parser.parse_args()
+
+    unit = None
+    if args.native:
+        unit = native.Unit(native.program(args), args.port).start()
+        args.host = unit.host
+    try:
+        return soak(args)
+    finally:
+        if unit:
+            unit.stop()
+
+
+def soak(args):
+    polls_per_day = int(args.hours * 3600 / args.poll)
+    start = time.time()
+    requests = errors = 0
+    first = metrics(args.host)
+    print("start: free %d, largest block %d, fragmentation %d%%" % (
+        first["heap"]["free"], first["heap"]["maxFreeBlock"], first["heap"]["fragmentation"]))
+
+    for day in range(args.days):
+        edits = set(random.sample(range(polls_per_day), min(args.edits, polls_per_day)))
+        presses = set() if args.no_bell else set(random.sample(range(polls_per_day), min(args.presses, polls_per_day)))
+        for poll in range(polls_per_day):
+            try:
+                request(args.host, "/time")
+                if poll % 2 == 0:
+                    request(args.host, "/status")
+                if poll % 3 == 0:
+                    request(args.host, "/schedules/upcoming?n=5")
+                if poll in edits:
+                    edit_cycle(args.host)
+                if poll in presses:
+                    request(args.host, "/bell/toggle", {})
+                requests += 1
+            except OSError as e:
+                errors += 1
+                print("day %d poll %d: %s" % (day + 1, poll, e), file=sys.stderr)
+                time.sleep(1)
+
+        m = metrics(args.host)
+        heap = m["heap"]
+        print("day %2d: free %d (min %d), largest block %d (min %d), fragmentation %d%% (max %d%%), %d errors" % (
+            day + 1, heap["free"], heap["minFree"], heap["maxFreeBlock"], heap["minMaxFreeBlock"],
+            heap["fragmentation"], heap["maxFragmentation"], errors))
+        problems = check(m, args)
+        if problems:
+            worst = sorted(m["routes"], key=lambda r: r["maxHeapDrop"], reverse=True)[:3]
+            for r in worst:
+                print("  %s: %d calls, keeps up to %d bytes" % (r["path"], r["calls"], r["maxHeapDrop"]))
+            print("FAIL: " + ", ".join(problems))
+            return 1
+
+    print("PASS: %d days, %d poll rounds, %d errors, %d shed in %.0f s" % (
+        args.days, requests, errors, shed, time.time() - start))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,245 @@
+#!/usr/bin/env python3
+"""Runs several units of the native build on one machine and measures sync.
+
+Each node is the firmware built for Linux (tools/native.py) with its own
+chip id, HTTP port and a DS3231 that starts up to --clock-spread seconds off,
+running the real lib/functions/sync.h: beacons and snapshots multicast on
+loopback, Trickle timing, last writer wins by revision, clock following.
+Replication is switched on and the edits made through the web API, as from
+the dashboard, and everything measured is read back from /metrics.
+
+    python3 tools/sync_sim.py --nodes 2 4 8 --seconds 180
+
+For each node count it reports how long an edit and a conflicting pair of
+edits took to reach every node, and the packets and bytes sent per node per
+minute once the network settles, which should stay flat as the node count
+grows. Then it multicasts forged packets at the nodes: a snapshot under the
+wrong key, and, under the right one, a revision far ahead and a clock set
+later than it reads. Every one must be dropped. It exits non-zero if any run
+fails to converge or a forgery gets through.
+"""
+
+import argparse
+import datetime
+import http.client
+import json
+import os
+import random
+import socket
+import struct
+import sys
+import threading
+import time
+
+import native
+
+TIMEOUT = 5
+CONVERGE_S = 60
+SYNC_SSID = "sync-sim"
+SYNC_GROUP = ("239.255.66.66", 4210)  # lib/functions/sync.h
+SYNC_MAGIC = 0x32534253
+SYNC_SNAPSHOT = 2
+FORGED_NODE = 0xF0F0F0F0
+
+
+def call(host, path, body=None):
+    """One request; waits out 503s from admission control"""
+    while True:
+        conn = http.client.HTTPConnection(host, timeout=TIMEOUT)
+        try:
+            if body is None:
+                conn.request("GET", path)
+            else:
+                conn.request("POST", path, json.dumps(body), {"Content-Type": "application/json"})
+            resp = conn.getresponse()
+            data = resp.read()
+            if resp.status == 503 and resp.getheader("Retry-After"):
+                time.sleep(int(resp.getheader("Retry-After")))
+                continue
+            if resp.status != 200:
+                raise RuntimeError("%s %s: %d %s" % (host, path, resp.status, data[:80]))
+            return json.loads(data) if data[:1] in (b"{", b"[") else data.decode()
+        finally:
+            conn.close()
+
+
+def siphash24(key, data):
+    """SipHash-2-4 of data under a 16-byte key, as lib/SipHash/SipHash.h"""
+    mask = (1 << 64) - 1
+    rotl = lambda x, b: ((x << b) | (x >> (64 - b))) & mask
+    k0, k1 = struct.unpack("<QQ", key)
+    v = [0x736f6d6570736575 ^ k0, 0x646f72616e646f6d ^ k1, 0x6c7967656e657261 ^ k0, 0x7465646279746573 ^ k1]
+
+    def sipround():
+        v[0] = (v[0] + v[1]) & mask
+        v[1] = rotl(v[1], 13) ^ v[0]
+        v[0] = rotl(v[0], 32)
+        v[2] = (v[2] + v[3]) & mask
+        v[3] = rotl(v[3], 16) ^ v[2]
+        v[0] = (v[0] + v[3]) & mask
+        v[3] = rotl(v[3], 21) ^ v[0]
+        v[2] = (v[2] + v[1]) & mask
+        v[1] = rotl(v[1], 17) ^ v[2]
+        v[2] = rotl(v[2], 32)
+
+    tail = len(data) & 7
+    words = [struct.unpack_from("<Q", data, i)[0] for i in range(0, len(data) - tail, 8)]
+    words.append((len(data) & 0xFF) << 56 | int.from_bytes(data[len(data) - tail:], "little"))
+    for m in words:
+        v[3] ^= m
+        sipround()
+        sipround()
+        v[0] ^= m
+    v[2] ^= 0xFF
+    for _ in range(4):
+        sipround()
+    return struct.pack("<Q", v[0] ^ v[1] ^ v[2] ^ v[3])
+
+
+def forged_snapshot(key, revision, unix_time, time_set_at):
+    """An empty snapshot packet, signed with key"""
+    header = struct.pack("<IBBHIIIII", SYNC_MAGIC, SYNC_SNAPSHOT, 0, 0xFFFF, FORGED_NODE, revision, 0,
+                         unix_time, time_set_at)
+    return header + siphash24(key, header)
+
+
+def send_forgeries(units, key):
+    """Multicasts packets no node may act on; True if every node dropped them"""
+    before = [sync_state(u) for u in units]
+    now = int(time.time())
+    forgeries = [forged_snapshot(os.urandom(16), 0xFFFFFFFF, now, now),  # not our key
+                 forged_snapshot(key, max(s["revision"] for s in before) + 100000, now, now),
+                 forged_snapshot(key, 0, now, 0xFFFFFFF0)]  # clock set in the future
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_IF, socket.inet_aton("127.0.0.1"))
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_LOOP, 1)
+    for packet in forgeries:
+        sock.sendto(packet, SYNC_GROUP)
+    sock.close()
+    time.sleep(2)
+    after = [sync_state(u) for u in units]
+    for b, a in zip(before, after):
+        dropped = a["unauthenticated"] - b["unauthenticated"] + a["rejected"] - b["rejected"]
+        if dropped < len(forgeries) or a["revision"] != b["revision"] or a["adopted"] != b["adopted"]:
+            return False
+        if any(peer["node"] == FORGED_NODE for peer in a["peers"]):
+            return False
+    return True
+
+
+def sync_state(unit):
+    return call(unit.host, "/metrics")["sync"]
+
+
+def lists(units):
+    """(revision, digest) of every node"""
+    states = [sync_state(u) for u in units]
+    return [(s["revision"], s["digest"]) for s in states]
+
+
+def wait_converged(units, timeout=CONVERGE_S):
+    """Seconds until every node has the same list, None if it never does"""
+    start = time.monotonic()
+    while time.monotonic() - start < timeout:
+        if len(set(lists(units))) == 1:
+            return time.monotonic() - start
+        time.sleep(0.2)
+    return None
+
+
+def schedule(minute, days=(0, 1, 2, 3, 4)):
+    return {"time": "%02d:%02d" % (minute // 60, minute % 60), "type": "bell", "days": list(days), "enabled": True}
+
+
+def clock(unit):
+    return datetime.datetime.strptime(call(unit.host, "/time").strip(), "%Y/%m/%d %H:%M:%S")
+
+
+def traffic(units):
+    states = [sync_state(u) for u in units]
+    return (sum(s["beaconsSent"] + s["snapshotsSent"] for s in states), sum(s["bytesSent"] for s in states))
+
+
+def simulate(program, count, seconds, base_port, spread):
+    key = os.urandom(16)
+    units = [native.Unit(program, base_port + i, chip_id=1000 + i, seed=i + 1,
+                         rtc_offset=random.randint(-spread, spread)) for i in range(count)]
+    result = {"nodes": count}
+    try:
+        for unit in units:
+            unit.start()
+        for unit in units:
+            call(unit.host, "/config/sync", {"ssid": SYNC_SSID, "password": "", "key": key.hex()})
+        deadline = time.monotonic() + CONVERGE_S
+        while not all(s["connected"] for s in map(sync_state, units)):
+            if time.monotonic() > deadline:
+                raise RuntimeError("replication did not start on every node")
+            time.sleep(0.2)
+        wait_converged(units)
+
+        # One edit on one node, and the clock set by hand on another
+        now = datetime.datetime.now().replace(microsecond=0)
+        call(units[-1].host, "/send-time", {"time": now.isoformat()})
+        start = time.monotonic()
+        call(units[0].host, "/schedules/add", schedule(8 * 60))
+        converged = wait_converged(units)
+        result["edit_s"] = None if converged is None else time.monotonic() - start
+
+        # Two nodes edit at the same revision
+        edits = [threading.Thread(target=call, args=(u.host, "/schedules/add", schedule(minute)))
+                 for u, minute in ((units[0], 10 * 60), (units[-1], 11 * 60))]
+        start = time.monotonic()
+        for t in edits:
+            t.start()
+        for t in edits:
+            t.join()
+        converged = wait_converged(units)
+        result["conflict_s"] = None if converged is None else time.monotonic() - start
+        result["conflicts"] = sum(sync_state(u)["conflicts"] for u in units)
+
+        # Steady state traffic
+        packets, sent = traffic(units)
+        time.sleep(seconds)
+        packets_after, sent_after = traffic(units)
+        minutes = seconds / 60
+        result["packets_per_node_min"] = (packets_after - packets) / count / minutes
+        result["bytes_per_node_min"] = (sent_after - sent) / count / minutes
+        result["total_packets_min"] = (packets_after - packets) / minutes
+        clocks = [clock(u) for u in units]
+        result["clock_spread_s"] = (max(clocks) - min(clocks)).total_seconds()
+        result["converged"] = len(set(lists(units))) == 1
+        result["forgeries_dropped"] = send_forgeries(units, key)
+    finally:
+        for unit in units:
+            unit.stop()
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--nodes", type=int, nargs="+", default=[2, 4, 8])
+    parser.add_argument("--seconds", type=float, default=180, help="steady-state seconds measured per run")
+    parser.add_argument("--clock-spread", type=int, default=30, help="RTCs start up to this many seconds off")
+    parser.add_argument("--env", default="native", help="platformio.ini env to build")
+    parser.add_argument("--program", help="an already built native program; skips building")
+    parser.add_argument("--port", type=int, default=18100, help="HTTP port of the first node")
+    args = parser.parse_args()
+
+    program = args.program or native.build(args.env)
+    failed = False
+    print("%5s %8s %10s %9s %12s %12s %12s %7s %9s" % ("nodes", "edit s", "conflict s", "conflicts", "pkt/node/min",
+                                                       "B/node/min", "pkt/min all", "clock", "forgeries"))
+    for count in args.nodes:
+        r = simulate(program, count, args.seconds, args.port, args.clock_spread)
+        if r["edit_s"] is None or r["conflict_s"] is None or not r["converged"] or not r["forgeries_dropped"]:
+            failed = True
+        fmt = lambda v: "FAIL" if v is None else "%.1f" % v
+        print("%5d %8s %10s %9d %12.2f %12.0f %12.2f %6ds %9s" % (
+            count, fmt(r["edit_s"]), fmt(r["conflict_s"]), r["conflicts"], r["packets_per_node_min"],
+            r["bytes_per_node_min"], r["total_packets_min"], r["clock_spread_s"],
+            "dropped" if r["forgeries_dropped"] else "ACCEPTED"))
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,228 @@
+#!/usr/bin/env python3
+"""Compares JSON and MessagePack on the routes that speak both (wire.h).
+
+For each route it fetches the same document N times per format and reports
+the payload size, round-trip latency and how long this host takes to decode
+it. It also reads the device's own cost from the /metrics "wire" section
+around every run: serialize time per response, and parse time per request
+body for a POST sent N times in each format. It checks that both formats
+decode to the same document.
+
+    python3 tools/wire_bench.py --host 192.168.4.1 -n 30
+
+Requests are paced under the per-client admission rate (admission.h); a 503
+is waited out per Retry-After and not timed.
+"""
+
+import argparse
+import http.client
+import json
+import math
+import struct
+import time
+
+TIMEOUT = 5
+MSGPACK = "application/msgpack"
+ROUTES = ["/status", "/config", "/schedules"]
+PACE_S = 0.25
+
+
+def unpack(data):
+    """MessagePack -> Python, the subset ArduinoJson writes"""
+    value, end = _unpack(data, 0)
+    if end != len(data):
+        raise ValueError("%d trailing bytes" % (len(data) - end))
+    return value
+
+
+def _unpack(data, i):
+    b = data[i]
+    i += 1
+    if b <= 0x7F:
+        return b, i
+    if b >= 0xE0:
+        return b - 0x100, i
+    if 0xA0 <= b <= 0xBF:
+        return data[i:i + (b & 0x1F)].decode(), i + (b & 0x1F)
+    if 0x90 <= b <= 0x9F:
+        return _unpack_array(data, i, b & 0x0F)
+    if 0x80 <= b <= 0x8F:
+        return _unpack_map(data, i, b & 0x0F)
+    simple = {0xC0: None, 0xC2: False, 0xC3: True}
+    if b in simple:
+        return simple[b], i
+    fixed = {0xCC: ">B", 0xCD: ">H", 0xCE: ">I", 0xCF: ">Q", 0xD0: ">b", 0xD1: ">h", 0xD2: ">i", 0xD3: ">q",
+             0xCA: ">f", 0xCB: ">d"}
+    if b in fixed:
+        size = struct.calcsize(fixed[b])
+        return struct.unpack_from(fixed[b], data, i)[0], i + size
+    lengths = {0xD9: ">B", 0xDA: ">H", 0xDB: ">I", 0xC4: ">B", 0xC5: ">H", 0xC6: ">I",
+               0xDC: ">H", 0xDD: ">I", 0xDE: ">H", 0xDF: ">I"}
+    if b in lengths:
+        n = struct.unpack_from(lengths[b], data, i)[0]
+        i += struct.calcsize(lengths[b])
+        if b in (0xDC, 0xDD):
+            return _unpack_array(data, i, n)
+        if b in (0xDE, 0xDF):
+            return _unpack_map(data, i, n)
+        raw = data[i:i + n]
+        return (raw.decode() if b >= 0xD9 else bytes(raw)), i + n
+    raise ValueError("unsupported MessagePack type 0x%02X" % b)
+
+
+def _unpack_array(data, i, n):
+    items = []
+    for _ in range(n):
+        item, i = _unpack(data, i)
+        items.append(item)
+    return items, i
+
+
+def _unpack_map(data, i, n):
+    items = {}
+    for _ in range(n):
+        key, i = _unpack(data, i)
+        items[key], i = _unpack(data, i)
+    return items, i
+
+
+def pack(value):
+    """Python -> MessagePack, enough for request bodies"""
+    if value is None:
+        return b"\xc0"
+    if value is True or value is False:
+        return b"\xc3" if value else b"\xc2"
+    if isinstance(value, int):
+        if 0 <= value <= 0x7F:
+            return bytes([value])
+        if -32 <= value < 0:
+            return struct.pack(">b", value)
+        return struct.pack(">Bq", 0xD3, value)
+    if isinstance(value, float):
+        return struct.pack(">Bd", 0xCB, value)
+    if isinstance(value, str):
+        raw = value.encode()
+        head = bytes([0xA0 | len(raw)]) if len(raw) < 32 else struct.pack(">BI", 0xDB, len(raw))
+        return head + raw
+    if isinstance(value, (list, tuple)):
+        head = bytes([0x90 | len(value)]) if len(value) < 16 else struct.pack(">BI", 0xDD, len(value))
+        return head + b"".join(pack(v) for v in value)
+    if isinstance(value, dict):
+        head = bytes([0x80 | len(value)]) if len(value) < 16 else struct.pack(">BI", 0xDF, len(value))
+        return head + b"".join(pack(k) + pack(v) for k, v in value.items())
+    raise TypeError(type(value))
+
+
+class Client:
+    def __init__(self, host):
+        self.host = host
+        self.conn = None
+
+    def request(self, method, path, headers, body=None):
+        """(status, content type, body, ms) with 503s waited out"""
+        while True:
+            for attempt in range(2):
+                try:
+                    if self.conn is None:
+                        self.conn = http.client.HTTPConnection(self.host, timeout=TIMEOUT)
+                    start = time.perf_counter()
+                    self.conn.request(method, path, body=body, headers=headers)
+                    resp = self.conn.getresponse()
+                    payload = resp.read()
+                    ms = (time.perf_counter() - start) * 1000
+                    if resp.will_close:
+                        self.close()
+                    break
+                except (OSError, http.client.HTTPException):
+                    self.close()
+                    if attempt:
+                        raise
+            if resp.status != 503 or not resp.getheader("Retry-After"):
+                return resp.status, resp.getheader("Content-Type"), payload, ms
+            time.sleep(int(resp.getheader("Retry-After")))
+
+    def close(self):
+        if self.conn is not None:
+            self.conn.close()
+            self.conn = None
+
+    def wire(self):
+        status, _, payload, _ = self.request("GET", "/metrics", {})
+        return json.loads(payload)["wire"]
+
+
+def delta(before, after, count, total):
+    """Events between two /metrics reads, and the total's growth per event"""
+    n = after[count] - before[count]
+    if n <= 0:
+        return 0, 0
+    return n, ((after[total] - before[total]) % 2 ** 32) / n
+
+
+def percentile(values, p):
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(math.ceil(p / 100 * len(ordered))) - 1)]
+
+
+def fetch_run(client, path, fmt, n):
+    headers = {"Accept": MSGPACK} if fmt == "msgpack" else {"Accept": "application/json"}
+    sizes, latencies, decode_us, doc = [], [], [], None
+    for _ in range(n):
+        status, ctype, payload, ms = client.request("GET", path, headers)
+        if status != 200:
+            raise IOError("%s: HTTP %d" % (path, status))
+        start = time.perf_counter()
+        doc = unpack(payload) if (ctype or "").startswith(MSGPACK) else json.loads(payload)
+        decode_us.append((time.perf_counter() - start) * 1e6)
+        sizes.append(len(payload))
+        latencies.append(ms)
+        time.sleep(PACE_S)
+    return doc, sizes, latencies, decode_us
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--host", default="192.168.4.1")
+    parser.add_argument("-n", type=int, default=20, help="requests per route and format")
+    parser.add_argument("--routes", nargs="+", default=ROUTES)
+    args = parser.parse_args()
+    client = Client(args.host)
+
+    print("%-12s %-8s %8s %10s %12s %14s %12s" % ("route", "format", "bytes", "p50 ms", "decode us",
+                                                  "device ser us", "device B"))
+    for path in args.routes:
+        docs = {}
+        for fmt in ("json", "msgpack"):
+            before = client.wire()[fmt]
+            doc, sizes, latencies, decode_us = fetch_run(client, path, fmt, args.n)
+            after = client.wire()[fmt]
+            docs[fmt] = doc
+            served, serialize_us = delta(before, after, "responses", "serializeUs")
+            device_bytes = (after["bytesOut"] - before["bytesOut"]) / served if served else 0
+            print("%-12s %-8s %8d %10.1f %12.1f %14.0f %12.0f" % (
+                path, fmt, percentile(sizes, 50), percentile(latencies, 50), percentile(decode_us, 50),
+                serialize_us, device_bytes))
+        if docs["json"] != docs["msgpack"]:
+            print("  !! %s decodes differently: %r vs %r" % (path, docs["json"], docs["msgpack"]))
+
+    # Request bodies: set keep-alive to what it already is, in each format
+    _, _, payload, _ = client.request("GET", "/config", {"Accept": "application/json"})
+    body = {"keepAlive": json.loads(payload).get("httpKeepAlive", True)}
+    print("\n%-24s %-8s %8s %14s" % ("body", "format", "bytes", "device parse us"))
+    for fmt in ("json", "msgpack"):
+        data = pack(body) if fmt == "msgpack" else json.dumps(body).encode()
+        headers = {"Content-Type": MSGPACK if fmt == "msgpack" else "application/json"}
+        before = client.wire()[fmt]
+        for _ in range(args.n):
+            status, _, _, _ = client.request("POST", "/config/keep-alive", headers, data)
+            if status != 200:
+                raise IOError("/config/keep-alive: HTTP %d" % status)
+            time.sleep(PACE_S)
+        after = client.wire()[fmt]
+        _, parse_us = delta(before, after, "requests", "parseUs")
+        print("%-24s %-8s %8d %14.0f" % ("/config/keep-alive", fmt, len(data), parse_us))
+    client.close()
+
+
+if __name__ == "__main__":
+    main()